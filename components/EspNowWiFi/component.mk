@@ -0,0 +1,6 @@
+#
+# "main" pseudo-component makefile.
+#
+# (Uses default behaviour of compiling all source files in directory, adding 'include' to include path.)
+
+$(call compile_only_if,$(CONFIG_MESH_TRANSPORT_ESPNOW),wifi.o)
@@ -0,0 +1,1045 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  wifi.cpp
+//! \brief This source contains the implementation of the WiFi functions which allow the
+//!        app_main function to connect the esp32 to a designated access point. The root joins
+//!        the access point as a station, the other nodes of the suit stay on its channel and
+//!        talk to it over ESP-NOW, with no association and no routing in between.
+//!
+//!
+#include "wifi.h"
+#include "esp_now.h"
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Globals and constants
+//!
+egHandle  nowEventGroup     = {};
+const int nowStartBit       = BIT0;
+const int nowConnectedBit   = BIT1;                         /*!< The root got an ip, a node hears the root */
+const int nowHuntBit        = BIT2;                         /*!< A node may look for the root */
+const int TX_SIZE           = 1460;
+const int MIN_RX_DEPTH      = 32;                           /*!< Receive queue of a small suit */
+const int NOW_RETRIES       = 3;                            /*!< Resends of the fragments not acked */
+const int NOW_PEERS         = ESP_NOW_MAX_TOTAL_PEER_NUM - 1;   /*!< The broadcast address takes one */
+
+const TickType_t TICKSTOWAIT = 500 / portTICK_PERIOD_MS;
+const TickType_t SENT_TICKS  = max<TickType_t>(20 / portTICK_PERIOD_MS, 1);  /*!< Send callback of a frame */
+const TickType_t ACK_TICKS   = max<TickType_t>(30 / portTICK_PERIOD_MS, 1);  /*!< Ack of a message */
+const int64_t    BEACON_TIME = 500000;                      /*!< us between beacons of the root */
+const int64_t    HUB_DWELL   = 3 * BEACON_TIME;             /*!< us a node listens on a channel */
+const int64_t    HUB_TIMEOUT = 3000000;                     /*!< us without a frame of the root until it's lost */
+const int64_t    PEER_TIMEOUT = 2 * BATCH_AGE_MAX * 1000LL; /*!< us the root sends to a node it last heard */
+const byte       BROADCAST[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+//! \enum Frame types. A node sends data to the root, which acks it, the root sends its data
+//!       to every node it has heard from in turn, and each acks it. Before the root has
+//!       heard from any node it broadcasts, unacked.
+//!
+typedef enum {
+    NOW_DATA,
+    NOW_GROUP,
+    NOW_ACK,
+    NOW_BEACON
+}nowType;
+
+//! \brief nowHeader starts every ESP-NOW frame. A message is split in fragments of up to
+//!        NOW_PAYLOAD bytes, the ack of a message carries the fragments received as a
+//!        bitmap in index. All bytes, so there is no padding.
+//!
+typedef struct
+{
+    byte meshId[6];                                         /*!< Frames of other suits are dropped */
+    byte type;
+    byte seq;                                               /*!< Message number of the sender */
+    byte index;                                             /*!< Fragment, or the bitmap of an ack */
+    byte count;                                             /*!< Fragments in the message */
+}nowHeader;
+
+const int NOW_PAYLOAD   = ESP_NOW_MAX_DATA_LEN - sizeof(nowHeader);
+const int NOW_FRAGMENTS = (TX_SIZE + NOW_PAYLOAD - 1) / NOW_PAYLOAD;     /*!< 7, the bitmap holds 8 */
+
+//! \brief nowFrame is a frame as it was received, copied out of the wifi task.
+//!
+typedef struct
+{
+    byte mac[6];
+    byte data[ESP_NOW_MAX_DATA_LEN];
+    int  size;
+}nowFrame;
+
+//! \brief nowPartial is the message being received from another node.
+//!
+typedef struct
+{
+    byte    seq;
+    byte    count;
+    byte    received;                                       /*!< Bitmap of the fragments */
+    bool    done;                                           /*!< Delivered, resends are only acked */
+    int     length;
+    int64_t startedAt;
+    string  data;
+}nowPartial;
+
+//! \brief nowPeer is a node the root acks. ESP-NOW only sends to known peers, and holds
+//!        fewer than a suit may have, so the least recently heard one makes room.
+//!
+typedef struct
+{
+    byte    mac[6];
+    int64_t heardAt;
+}nowPeer;
+
+//! \brief meshFrame is a frame waiting in a lane, its data is in one of the lane's slots.
+//!
+typedef struct
+{
+    char         *data;                                     /*!< The slot, TX_SIZE bytes */
+    int           size;
+    int64_t       queuedAt;
+}meshFrame;
+
+//! \brief meshLaneState is a transmit lane: its queue, the slots its frames are copied
+//!        into, the average time its frames wait before they are sent, and the average
+//!        time until they are acked.
+//!
+typedef struct
+{
+    QueueHandle_t queue;
+    QueueHandle_t free;                                     /*!< Slots not holding a frame, one per frame queued */
+    int           depth;                                    /*!< Frames the queue holds */
+    int64_t       latency;                                  /*!< Moving average in us */
+    int64_t       acked;                                    /*!< Moving average in us */
+    int           sent;
+}meshLaneState;
+
+const int  LANE_REPORT = 200;                               /*!< Frames sent between lane reports */
+
+meshLaneState lanes[LANE_COUNT] = {
+    { NULL, NULL,  8, 0, 0, 0 },                            /*!< Acks, responses, commands */
+    { NULL, NULL,  8, 0, 0, 0 },                            /*!< Live samples */
+    { NULL, NULL, 16, 0, 0, 0 }                             /*!< Backlog and retransmissions */
+};
+TaskHandle_t  laneTask  = NULL;
+TaskHandle_t  rxTask    = NULL;
+QueueHandle_t rawQueue  = NULL;                             /*!< nowFrame, from the receive callback */
+QueueHandle_t ackQueue  = NULL;                             /*!< nowHeader, acks for the lane task */
+QueueHandle_t rxQueue   = NULL;                             /*!< string*, whole messages */
+SemaphoreHandle_t sentSemaphore = NULL;                     /*!< Given by the send callback */
+
+string routerSSID;
+byte   meshId[6] = { 0x7A, 0x69, 0xDE, 0xAD, 0xBE, 0xEF };  /*!< Unless the suit has its own */
+byte   hubAddr[6] = {};                                     /*!< Station address of the root */
+mutex  hubLock;                                             /*!< Guards hubAddr */
+byte   txSeq      = 0;
+
+map<uint64_t, nowPartial> partials;                         /*!< By sender, the receive task's own */
+vector<nowPeer>           peers;                            /*!< Changed by the receive task only */
+mutex                     peerLock;                         /*!< Guards changes to peers, and other tasks' reads */
+vector<byte>              channels;                         /*!< Left to listen on for the root */
+int                       nowErrors = 0;                    /*!< Failed sends and receives since boot */
+
+esp_timer_handle_t reconnectTimer = NULL;
+wifiProfile linkProfile = WIFI_PROFILE_REALTIME;
+bool        stopping    = false;                            /*!< Disconnected on purpose, no reconnect */
+int         attempts    = 0;                                /*!< Reconnects since the link went down */
+int64_t     downAt      = 0;                                /*!< Tick the link went down, 0 while up */
+int         reconnects  = 0;
+int         outage      = 0;                                /*!< Last outage in ms */
+
+extern BnoModule bno;
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Functions section
+//!
+
+//! \fn     LinkDown
+//! \brief  This function starts timing an outage, if the link was up.
+//!
+void LinkDown()
+{
+    if ((xEventGroupGetBits(nowEventGroup) & nowConnectedBit) && downAt == 0)
+        downAt = esp_timer_get_time();
+}
+
+//! \fn     LinkUp
+//! \brief  This function ends the outage being timed, if any.
+//!
+void LinkUp()
+{
+    if (downAt != 0)
+    {
+        outage = (esp_timer_get_time() - downAt) / 1000;
+        reconnects++;
+        cout << "WiFi: link back, down for " << outage << " ms";
+        if (bno.IsRoot())
+            cout << " and " << attempts << " attempts";
+        cout << endl;
+        downAt = 0;
+    }
+    attempts = 0;
+}
+
+//! \fn     Reconnect
+//! \brief  This function is the reconnect timer callback of the root, it tries to associate
+//!         again once the backoff of the attempt is over.
+//! \param  <void*> unused.
+//!
+void Reconnect(void *arg)
+{
+    attempts++;
+    esp_wifi_connect();
+}
+
+//! \fn     ScheduleReconnect
+//! \brief  This function starts the reconnect timer. The backoff of the profile doubles
+//!         with every attempt, up to its longest delay.
+//!
+void ScheduleReconnect()
+{
+    const wifiProfileConfig &config = profileToConfig.at(linkProfile);
+    int64_t                  delay  = (int64_t)config.backoffMin << min(attempts, 16);
+
+    esp_timer_start_once(reconnectTimer, min<int64_t>(delay, config.backoffMax) * 1000);
+}
+
+//! \fn     MacKey
+//! \brief  Packs a mac address into a map key.
+//! \param  <byte[6]> the mac address.
+//! \return <uint64_t> the key.
+//!
+uint64_t MacKey(const byte mac[6])
+{
+    uint64_t key = 0;
+
+    for (int i = 0; i < 6; i++)
+        key = (key << 8) | mac[i];
+
+    return key;
+}
+
+//! \fn     ScanAccessPoints
+//! \brief  This function performs a wifi scan of every channel.
+//! \return <vector<wifi_ap_record_t>> the access points found.
+//!
+vector<wifi_ap_record_t> ScanAccessPoints()
+{
+    uint16_t           numAccessPoints = {};
+    wifi_scan_config_t scanConfig      = {};
+
+    scanConfig.show_hidden = true;
+    scanConfig.ssid        = NULL;
+    scanConfig.bssid       = NULL;
+    scanConfig.channel     = 0;
+
+    if (esp_wifi_scan_start(&scanConfig, true) != ESP_OK || esp_wifi_scan_get_ap_num(&numAccessPoints) != ESP_OK)
+        return vector<wifi_ap_record_t>();
+
+    vector<wifi_ap_record_t> apRecords(numAccessPoints);
+    esp_wifi_scan_get_ap_records(&numAccessPoints, apRecords.data());
+    apRecords.resize(numAccessPoints);
+
+    return apRecords;
+}
+
+//! \fn    TuneChannel
+//! \brief This function moves a node that doesn't hear the root to the next channel to
+//!        listen on. The channels of the access points with the router ssid go first,
+//!        strongest first, as the root joins one of them. Once they were all tried, it
+//!        scans again, and falls back on every channel if none was found.
+//!
+void TuneChannel()
+{
+    if (channels.empty())
+    {
+        for (auto &record : ScanAccessPoints())
+        {
+            if (routerSSID.compare((char*)record.ssid) == 0 &&
+                find(channels.begin(), channels.end(), record.primary) == channels.end())
+                channels.insert(channels.begin(), record.primary);          /*!< Taken from the back */
+        }
+
+        for (byte ch = 1; channels.empty() && ch <= 13; ch++)
+            channels.insert(channels.begin(), ch);
+    }
+
+    esp_wifi_set_channel(channels.back(), WIFI_SECOND_CHAN_NONE);
+    cout << "Listening for the root on channel " << (int)channels.back() << endl;
+    channels.pop_back();
+}
+
+//! \fn     AddPeer
+//! \brief  This function makes sure a node can be sent to. If ESP-NOW holds as many
+//!         peers as it can, the least recently heard one is removed first.
+//! \param  <byte[6]> the station address of the node.
+//!
+void AddPeer(const byte mac[6])
+{
+    esp_now_peer_info_t info = {};
+    nowPeer             peer = {};
+    int64_t             now  = esp_timer_get_time();
+
+    for (auto &p : peers)
+    {
+        if (memcmp(p.mac, mac, 6) == 0)
+        {
+            peerLock.lock();
+            p.heardAt = now;
+            peerLock.unlock();
+            return;
+        }
+    }
+
+    if (peers.size() >= NOW_PEERS)
+    {
+        auto oldest = min_element(peers.begin(), peers.end(),
+                                  [](const nowPeer &a, const nowPeer &b) { return a.heardAt < b.heardAt; });
+        esp_now_del_peer(oldest->mac);
+        peerLock.lock();
+        peers.erase(oldest);
+        peerLock.unlock();
+    }
+
+    CopyMemory(info.peer_addr, const_cast<byte*>(mac), 6);
+    info.channel = 0;                                       /*!< Whichever the station is on */
+    info.ifidx   = ESP_IF_WIFI_STA;
+    info.encrypt = false;
+
+    if (esp_now_add_peer(&info) != ESP_OK)
+    {
+        nowErrors++;
+        return;
+    }
+
+    CopyMemory(peer.mac, const_cast<byte*>(mac), 6);
+    peer.heardAt = now;
+    peerLock.lock();
+    peers.push_back(peer);
+    peerLock.unlock();
+}
+
+//! \fn     SendFragment
+//! \brief  This function sends one ESP-NOW frame, the header followed by its payload.
+//! \param  <byte[6]> the address, <nowHeader> the header, <char*> the payload, <int> its size.
+//! \return <error> the result of esp_now_send.
+//!
+error SendFragment(const byte to[6], const nowHeader &header, const char *payload, int size)
+{
+    byte frame[ESP_NOW_MAX_DATA_LEN];
+
+    CopyMemory(frame, const_cast<nowHeader*>(&header), sizeof(header));
+    CopyMemory(frame + sizeof(header), const_cast<char*>(payload), size);
+
+    return esp_now_send(to, frame, sizeof(header) + size);
+}
+
+//! \fn     SendControl
+//! \brief  This function sends a frame with no payload, a beacon or an ack.
+//! \param  <byte[6]> the address, <nowType> the type, <byte> seq, <byte> index, <byte> count.
+//!
+void SendControl(const byte to[6], nowType type, byte seq, byte index, byte count)
+{
+    nowHeader header = {};
+
+    CopyMemory(header.meshId, meshId, 6);
+    header.type  = type;
+    header.seq   = seq;
+    header.index = index;
+    header.count = count;
+
+    if (esp_now_send(to, reinterpret_cast<byte*>(&header), sizeof(header)) != ESP_OK)
+        nowErrors++;
+}
+
+//! \fn     WaitForAck
+//! \brief  This function waits for the ack of a message, acks of older messages are
+//!         dropped.
+//! \param  <byte> the message number, <byte> the bitmap of the fragments not acked yet.
+//! \return <byte> the bitmap of the fragments still missing, unchanged without an ack.
+//!
+byte WaitForAck(byte seq, byte missing)
+{
+    nowHeader ack = {};
+
+    while (xQueueReceive(ackQueue, &ack, ACK_TICKS) == pdTRUE)
+    {
+        if (ack.seq == seq)
+            return missing & ~ack.index;
+    }
+
+    return missing;
+}
+
+//! \fn     SendTo
+//! \brief  This function sends a message to one address in fragments of up to NOW_PAYLOAD
+//!         bytes, each after the send callback of the one before. If it is acked, it
+//!         waits for the ack, which tells the fragments received, so only the missing
+//!         ones are sent again, up to NOW_RETRIES times.
+//! \param  <byte[6]> the address, <nowType> the frame type, <char*> the data to send and
+//!         its size, <bool> wait for acks or not.
+//! \return <error> ESP_ERR_TIMEOUT if the message wasn't acked after every retry.
+//!
+error SendTo(const byte to[6], nowType type, const char *data, int size, bool acked)
+{
+    nowHeader header  = {};
+    byte      missing = {};
+
+    CopyMemory(header.meshId, meshId, 6);
+    header.type  = type;
+    header.seq   = ++txSeq;
+    header.count = max<int>((size + NOW_PAYLOAD - 1) / NOW_PAYLOAD, 1);
+    missing      = (1 << header.count) - 1;
+
+    xQueueReset(ackQueue);
+    for (int round = 0; round <= NOW_RETRIES && missing != 0; round++)
+    {
+        for (int i = 0; i < header.count; i++)
+        {
+            int offset = i * NOW_PAYLOAD;
+
+            if ((missing & (1 << i)) == 0)
+                continue;
+
+            header.index = i;
+            if (SendFragment(to, header, data + offset, min<int>(NOW_PAYLOAD, size - offset)) == ESP_OK)
+                xSemaphoreTake(sentSemaphore, SENT_TICKS);
+        }
+
+        if (!acked)
+            return ESP_OK;
+        missing = WaitForAck(header.seq, missing);
+    }
+
+    if (missing != 0)
+    {
+        nowErrors++;
+        return ESP_ERR_TIMEOUT;
+    }
+
+    return ESP_OK;
+}
+
+//! \fn     SendMessage
+//! \brief  This function sends a message, see SendTo. A node sends to the root. The root
+//!         sends to every node it heard from within PEER_TIMEOUT in turn, each acks it,
+//!         so the acks, responses, and commands it carries aren't lost to a busy channel.
+//!         Before the root has heard from any node it broadcasts, unacked.
+//! \param  <char*> the data to send and its size.
+//! \return <error> ESP_ERR_ESPNOW_NOT_FOUND if the root isn't known, ESP_ERR_TIMEOUT if the
+//!         message wasn't acked by the root, or by some node, after every retry.
+//!
+error SendMessage(const char *data, int size)
+{
+    vector<nowPeer> to     = {};
+    byte            hub[6] = {};
+    error           result = ESP_OK;
+    int64_t         now    = esp_timer_get_time();
+
+    if (!bno.IsRoot())
+    {
+        if (!(xEventGroupGetBits(nowEventGroup) & nowConnectedBit))
+        {
+            nowErrors++;
+            return ESP_ERR_ESPNOW_NOT_FOUND;
+        }
+        hubLock.lock();
+        CopyMemory(hub, hubAddr, 6);
+        hubLock.unlock();
+
+        return SendTo(hub, NOW_DATA, data, size, true);
+    }
+
+    peerLock.lock();
+    for (auto &p : peers)
+    {
+        if (now - p.heardAt <= PEER_TIMEOUT)
+            to.push_back(p);
+    }
+    peerLock.unlock();
+
+    if (to.empty())
+        return SendTo(BROADCAST, NOW_GROUP, data, size, false);
+
+    for (auto &p : to)
+    {
+        if (SendTo(p.mac, NOW_GROUP, data, size, true) != ESP_OK)
+            result = ESP_ERR_TIMEOUT;
+    }
+
+    return result;
+}
+
+//! \fn     Reassemble
+//! \brief  This function takes a fragment into the message of its sender, and queues the
+//!         message once it's whole. A new message number starts a new message. It acks
+//!         the last fragment, and the fragment completing the message, with what it has
+//!         received, and acks again resends of a message it has delivered.
+//! \param  <nowFrame> the frame, <int64_t> current tick.
+//!
+void Reassemble(const nowFrame &frame, int64_t now)
+{
+    const nowHeader *header   = reinterpret_cast<const nowHeader*>(frame.data);
+    const char      *payload  = reinterpret_cast<const char*>(frame.data) + sizeof(nowHeader);
+    int              size     = frame.size - sizeof(nowHeader);
+    bool             complete = false;
+    string          *message  = NULL;
+
+    if (header->count == 0 || header->count > NOW_FRAGMENTS || header->index >= header->count || size > NOW_PAYLOAD)
+    {
+        nowErrors++;
+        return;
+    }
+
+    nowPartial &partial = partials[MacKey(frame.mac)];
+    if (partial.seq != header->seq || partial.count != header->count ||
+        (!partial.done && now - partial.startedAt > HUB_TIMEOUT))
+    {
+        partial.seq       = header->seq;
+        partial.count     = header->count;
+        partial.received  = 0;
+        partial.done      = false;
+        partial.length    = 0;
+        partial.startedAt = now;
+        partial.data.assign(header->count * NOW_PAYLOAD, '\0');
+    }
+
+    if (!partial.done && (partial.received & (1 << header->index)) == 0)
+    {
+        partial.data.replace(header->index * NOW_PAYLOAD, size, payload, size);
+        partial.received |= (1 << header->index);
+        if (header->index == header->count - 1)
+            partial.length = header->index * NOW_PAYLOAD + size;
+
+        if (partial.received == (1 << header->count) - 1)
+        {
+            partial.done = complete = true;
+            message      = new string(partial.data, 0, partial.length);
+            if (xQueueSend(rxQueue, &message, 0) != pdTRUE)
+            {
+                delete message;
+                nowErrors++;                                /*!< Dropped, the sender resends */
+            }
+        }
+    }
+
+    if (complete || partial.done || header->index == header->count - 1)
+        SendControl(frame.mac, NOW_ACK, partial.seq, partial.received, partial.count);
+}
+
+//! \fn     Receive
+//! \brief  This function handles a frame. The root takes data from the nodes, and makes
+//!         them peers so it can ack them and send to them, and their acks. A node takes
+//!         the first root it hears as its hub, and its data, beacons, and acks.
+//! \param  <nowFrame> the frame, <int64_t> current tick, <int64_t&> when the root was last heard.
+//!
+void Receive(const nowFrame &frame, int64_t now, int64_t &heardAt)
+{
+    const nowHeader *header = reinterpret_cast<const nowHeader*>(frame.data);
+    bool             hub    = false;
+
+    if (bno.IsRoot())
+    {
+        if (header->type == NOW_DATA)
+        {
+            AddPeer(frame.mac);
+            Reassemble(frame, now);
+        }else if (header->type == NOW_ACK && xQueueSend(ackQueue, header, 0) != pdTRUE) {
+            nowErrors++;
+        }
+        return;
+    }
+
+    hubLock.lock();
+    if (header->type == NOW_BEACON && !(xEventGroupGetBits(nowEventGroup) & nowConnectedBit))
+    {
+        peerLock.lock();
+        peers.clear();
+        peerLock.unlock();
+        esp_now_del_peer(hubAddr);
+        CopyMemory(hubAddr, const_cast<byte*>(frame.mac), 6);
+        AddPeer(hubAddr);
+        LinkUp();
+        xEventGroupSetBits(nowEventGroup, nowConnectedBit);
+        channels.clear();
+    }
+    hub = (memcmp(hubAddr, frame.mac, 6) == 0);
+    hubLock.unlock();
+
+    if (!hub)
+        return;
+
+    heardAt = now;
+    if (header->type == NOW_GROUP)
+        Reassemble(frame, now);
+    else if (header->type == NOW_ACK && xQueueSend(ackQueue, header, 0) != pdTRUE)
+        nowErrors++;
+}
+
+//! \fn     ReceiveThread
+//! \brief  This function is the receive task, it handles the frames the receive callback
+//!         queued. The root sends a beacon every BEACON_TIME, for the nodes to find it. A
+//!         node that hasn't heard the root for HUB_TIMEOUT looks for it again, listening
+//!         on every channel in turn for HUB_DWELL.
+//! \param  <void*> unused.
+//!
+void ReceiveThread(void *arg)
+{
+    nowFrame   frame    = {};
+    int64_t    now      = {};
+    int64_t    beaconAt = {};
+    int64_t    heardAt  = {};
+    int64_t    tunedAt  = {};
+    EventBits_t bits    = {};
+    TickType_t ticks    = max<TickType_t>(BEACON_TIME / 1000 / portTICK_PERIOD_MS, 1);
+
+    while (1)
+    {
+        bool got = (xQueueReceive(rawQueue, &frame, ticks) == pdTRUE);
+
+        now  = esp_timer_get_time();
+        bits = xEventGroupGetBits(nowEventGroup);
+
+        if (bno.IsRoot() && now - beaconAt >= BEACON_TIME)
+        {
+            SendControl(BROADCAST, NOW_BEACON, 0, 0, 0);
+            beaconAt = now;
+        }else if (!bno.IsRoot() && (bits & nowConnectedBit) && now - heardAt > HUB_TIMEOUT) {
+            cout << "Lost the root" << endl;
+            LinkDown();
+            xEventGroupClearBits(nowEventGroup, nowConnectedBit);
+            bits &= ~nowConnectedBit;
+        }
+
+        if (!bno.IsRoot() && (bits & nowHuntBit) && !(bits & nowConnectedBit) && now - tunedAt >= HUB_DWELL)
+        {
+            TuneChannel();
+            tunedAt = esp_timer_get_time();
+        }
+
+        if (got)
+            Receive(frame, now, heardAt);
+    }
+}
+
+//! \fn     LaneThread
+//! \brief  This function is the transmit task. Before every message it checks the lanes
+//!         in order, so a real-time message never waits behind more than the one bulk
+//!         message being sent.
+//! \param  <void*> unused.
+//!
+void LaneThread(void *arg)
+{
+    meshFrame frame  = {};
+    int64_t   now    = {};
+    int64_t   acked  = {};
+    int       l      = {};
+
+    while (1)
+    {
+        for (l = 0; l < LANE_COUNT; l++)
+        {
+            if (xQueueReceive(lanes[l].queue, &frame, 0) == pdTRUE)
+                break;
+        }
+
+        if (l == LANE_COUNT)
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            continue;
+        }
+
+        meshLaneState &lane = lanes[l];
+
+        now = esp_timer_get_time();
+        SendMessage(frame.data, frame.size);
+        acked = esp_timer_get_time() - now;
+        xQueueSend(lane.free, &frame.data, portMAX_DELAY);  /*!< Never blocks, the slot was taken from it */
+
+        lane.latency = (lane.latency == 0 ? now - frame.queuedAt : (7 * lane.latency + now - frame.queuedAt) / 8);
+        lane.acked   = (lane.acked == 0 ? acked : (7 * lane.acked + acked) / 8);
+        if (++lane.sent % LANE_REPORT == 0)
+            cout << "ESP-NOW lane " << l << ": " << lane.sent << " frames, " << lane.latency / 1000 << " ms queued, "
+                 << lane.acked / 1000 << " ms to ack" << endl;
+    }
+}
+
+//! \fn     ReceiveCallback
+//! \brief  This function is called by the wifi task for every ESP-NOW frame, it only
+//!         copies the frames of the suit to the receive task.
+//! \param  <uint8_t*> the sender, <uint8_t*> the frame, <int> its size.
+//!
+void ReceiveCallback(const uint8_t *mac, const uint8_t *data, int size)
+{
+    nowFrame frame;
+
+    if (size < (int)sizeof(nowHeader) || size > ESP_NOW_MAX_DATA_LEN || memcmp(data, meshId, 6) != 0)
+        return;
+
+    CopyMemory(frame.mac, const_cast<uint8_t*>(mac), 6);
+    CopyMemory(frame.data, const_cast<uint8_t*>(data), size);
+    frame.size = size;
+
+    if (xQueueSend(rawQueue, &frame, 0) != pdTRUE)
+        nowErrors++;
+}
+
+//! \fn     SendCallback
+//! \brief  This function is called by the wifi task once a frame was sent, acked by the
+//!         radio of the receiver or not, the acks of SendMessage tell what arrived.
+//! \param  <uint8_t*> the receiver, <esp_now_send_status_t> the status.
+//!
+void SendCallback(const uint8_t *mac, esp_now_send_status_t status)
+{
+    xSemaphoreGive(sentSemaphore);
+}
+
+//! \fn     EventHandler
+//! \brief  This static function intercepts system events regarding the wifi
+//!         adapter.
+//! \params void* and system_event_t.
+//! \return esp_error_t code.
+//!
+static error EventHandler(void *ctx, system_event_t *event)
+{
+    switch (event->event_id)
+    {
+    case SYSTEM_EVENT_STA_START:
+        xEventGroupSetBits(nowEventGroup, nowStartBit);
+        break;
+    case SYSTEM_EVENT_STA_GOT_IP:
+        LinkUp();
+        xEventGroupSetBits(nowEventGroup, nowConnectedBit);
+        break;
+    case SYSTEM_EVENT_STA_DISCONNECTED:
+        if (bno.IsRoot())
+        {
+            LinkDown();
+            xEventGroupClearBits(nowEventGroup, nowConnectedBit);
+            if (!stopping)
+                ScheduleReconnect();
+        }
+        break;
+    default:
+        break;
+    }
+    return ESP_OK;
+}
+
+//! \fn    WifiInit
+//! \brief This function initializes the wifi adapter in station mode with the buffers,
+//!        AMPDU, and tx power of the link profile, and ESP-NOW on top. The radio stays
+//!        awake whatever the profile, ESP-NOW frames aren't buffered for sleeping stations.
+//! \param <wifiProfile> the profile.
+//!
+void WIFI::WifiInit(wifiProfile profile)
+{
+    const wifiProfileConfig &config    = profileToConfig.at(profile);
+    wifi_init_config_t       wifiCfg   = WIFI_INIT_CONFIG_DEFAULT();
+    esp_now_peer_info_t      broadcast = {};
+    esp_timer_create_args_t  timer     = {};
+    error                    err       = {};
+
+    linkProfile   = profile;
+    nowEventGroup = xEventGroupCreate();
+
+    timer.callback = &Reconnect;
+    timer.name     = "reconnect";
+    esp_timer_create(&timer, &reconnectTimer);
+
+    wifiCfg.static_rx_buf_num  = config.staticRxBuf;
+    wifiCfg.dynamic_rx_buf_num = config.dynamicRxBuf;
+    wifiCfg.dynamic_tx_buf_num = config.dynamicTxBuf;
+    wifiCfg.ampdu_rx_enable    = config.ampdu;
+    wifiCfg.ampdu_tx_enable    = config.ampdu;
+
+    if ((err = nvs_flash_init()) == ESP_ERR_NVS_NO_FREE_PAGES)
+    {
+        nvs_flash_erase();
+        nvs_flash_init();
+    }
+
+    tcpip_adapter_init();
+    esp_event_loop_init(EventHandler, NULL);
+    esp_wifi_init(&wifiCfg);
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    esp_wifi_set_mode(WIFI_MODE_STA);
+    esp_wifi_start();
+    xEventGroupWaitBits(nowEventGroup, nowStartBit, pdFALSE, pdTRUE, portMAX_DELAY);
+    esp_wifi_set_ps(WIFI_PS_NONE);
+    esp_wifi_set_max_tx_power(config.txPower);
+    cout << "WiFi: " << config.name << " profile" << endl;
+
+    rawQueue      = xQueueCreate(MIN_RX_DEPTH, sizeof(nowFrame));
+    ackQueue      = xQueueCreate(4, sizeof(nowHeader));
+    rxQueue       = xQueueCreate(max(MIN_RX_DEPTH, 2 * CONFIG_MESH_MAX_NODES), sizeof(string*));  /*!< Room for a burst from every node */
+    sentSemaphore = xSemaphoreCreateBinary();
+    for (auto &lane : lanes)
+    {
+        char *slots = new char[lane.depth * TX_SIZE];      /*!< Kept for good, like the lane */
+
+        lane.queue = xQueueCreate(lane.depth, sizeof(meshFrame));
+        lane.free  = xQueueCreate(lane.depth, sizeof(char*));
+        for (int i = 0; i < lane.depth; i++)
+        {
+            char *slot = slots + i * TX_SIZE;
+            xQueueSend(lane.free, &slot, 0);
+        }
+    }
+
+    ESP_ERROR_CHECK(esp_now_init());
+    esp_now_register_recv_cb(&ReceiveCallback);
+    esp_now_register_send_cb(&SendCallback);
+
+    CopyMemory(broadcast.peer_addr, const_cast<byte*>(BROADCAST), 6);
+    broadcast.ifidx = ESP_IF_WIFI_STA;
+    esp_now_add_peer(&broadcast);
+
+    xTaskCreate(&ReceiveThread, "NowRx", 4096, NULL, tskIDLE_PRIORITY + 6, &rxTask);
+    xTaskCreate(&LaneThread, "NowTx", 4096, NULL, tskIDLE_PRIORITY + 5, &laneTask);
+}
+
+//! \fn    WifiConnect
+//! \brief This function connects the root to the configured wifi ssid. The other nodes
+//!        don't associate, they look for the root on the channels of the ssid.
+//! \param string ssid, string password.
+//!
+void WIFI::WifiConnect(string sid, string pwd)
+{
+    wifi_config_t wifiConfig = {};
+    EventBits_t   eventBits  = {};
+
+    routerSSID = sid;
+
+    if (bno.IsRoot())
+    {
+        sid.copy((char *)wifiConfig.sta.ssid, sid.length());
+        pwd.copy((char *)wifiConfig.sta.password, pwd.length());
+        stopping = false;
+        esp_wifi_set_config(ESP_IF_WIFI_STA, &wifiConfig);
+        esp_wifi_connect();
+        cout << "Waiting for IP address";
+    }else {
+        xEventGroupSetBits(nowEventGroup, nowHuntBit);
+    }
+
+    while ((eventBits & nowConnectedBit) == 0)
+    {
+        cout << "." << flush;
+        eventBits = xEventGroupWaitBits(nowEventGroup, nowConnectedBit, pdFALSE, pdTRUE, TICKSTOWAIT);
+    }
+
+    if (bno.IsRoot())
+        cout << endl << "Connected to access point!" << endl;
+    else
+        cout << endl << "ESP32 connected to mesh network!" << endl;
+}
+
+//! \fn    WifiDisconnect
+//! \brief Disconnects the root from the configured wifi ssid, and stops the other nodes
+//!        from looking for the root.
+//!
+void WIFI::WifiDisconnect()
+{
+    xEventGroupClearBits(nowEventGroup, nowHuntBit);
+    if (bno.IsRoot())
+    {
+        stopping = true;
+        esp_timer_stop(reconnectTimer);
+        esp_wifi_disconnect();
+    }
+    xEventGroupClearBits(nowEventGroup, nowConnectedBit);
+}
+
+//! \fn     WifiGetStatus
+//! \brief  Gets the current status of the wifi connection.
+//! \return wifiStatus enum value.
+//!
+wifiStatus WIFI::WifiGetStatus()
+{
+    if (xEventGroupGetBits(nowEventGroup) & nowConnectedBit)
+        return WIFI_STATUS_CONNECTED;
+    else
+        return WIFI_STATUS_DISCONNECTED;
+}
+
+//! \fn     WifiSetPowerSave
+//! \brief  The root keeps its radio awake to hear the nodes, and the nodes to hear its
+//!         acks, ESP-NOW frames aren't held for stations in modem sleep, so the radio
+//!         stays awake. Asking for modem sleep is reported once, and turned down.
+//! \param  bool enable.
+//! \return <bool> false, the radio never sleeps.
+//!
+bool WIFI::WifiSetPowerSave(bool enable)
+{
+    static bool reported = false;
+
+    if (enable && !reported)
+    {
+        cout << "WiFi: ESP-NOW doesn't allow modem sleep, the radio stays awake" << endl;
+        reported = true;
+    }
+
+    return false;
+}
+
+//! \fn     WifiGetRssi
+//! \brief  Gets the signal strength of the access point.
+//! \return <int> rssi in dBm, 0 if not connected, and on every node but the root.
+//!
+int WIFI::WifiGetRssi()
+{
+    wifi_ap_record_t ap = {};
+
+    if (!bno.IsRoot() || esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return 0;
+
+    return ap.rssi;
+}
+
+//! \fn     WifiGetProfile
+//! \brief  Gets the link profile the adapter was initialized with.
+//! \return <wifiProfile> the profile.
+//!
+wifiProfile WIFI::WifiGetProfile()
+{
+    return linkProfile;
+}
+
+//! \fn     WifiGetReconnects
+//! \brief  Gets the number of times the link came back after an outage since boot, the
+//!         access point of the root, the root of the other nodes.
+//! \return <int> the outages.
+//!
+int WIFI::WifiGetReconnects()
+{
+    return reconnects;
+}
+
+//! \fn     WifiGetOutage
+//! \brief  Gets how long the link was down in the last outage.
+//! \return <int> the outage in ms, 0 if there was none.
+//!
+int WIFI::WifiGetOutage()
+{
+    return outage;
+}
+
+//! \fn     WifiIsMeshEnabled
+//! \brief  Indicates whether mesh networking is enabled on the calling
+//!         node.
+//! \return <bool> true of false.
+//!
+bool WIFI::MESH::WifiIsMeshEnabled()
+{
+    return true;
+}
+
+//! \fn     WiFiMeshIsRoot
+//! \brief  Indicates whether the calling node is root node, or not,
+//!         when mesh networking is enabled.
+//! \return <bool> true or false.
+//!
+bool WIFI::MESH::WifiIsRootNode()
+{
+    return bno.IsRoot();
+}
+
+//! \fn     WifiMeshSetId
+//! \brief  Sets the id of the suit, before connecting. Every frame carries it, frames of
+//!         other suits on the channel are dropped.
+//! \param  <string> the id, 12 hex digits.
+//! \return <bool> false if the id is malformed, and the default is kept.
+//!
+bool WIFI::MESH::WifiMeshSetId(const string &id)
+{
+    byte parsed[6] = {};
+
+    if (id.length() != 12 || id.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+        return false;
+
+    for (int i = 0; i < 6; i++)
+        parsed[i] = strtoul(id.substr(2 * i, 2).c_str(), NULL, 16);
+
+    CopyMemory(meshId, parsed, 6);
+    cout << "Mesh id " << id << endl;
+
+    return true;
+}
+
+//! \fn     WifiMeshTxMain
+//! \brief  This function copies data into a free slot of a transmit lane and returns, the
+//!         transmit task sends it, see LaneThread and SendMessage. The slots are allocated
+//!         once, so queueing a message doesn't touch the heap.
+//! \param  <string> the data to send, <meshLane> the lane to send it in.
+//! \return <error> ESP_ERR_NO_MEM if the lane is full and the data was dropped.
+//!
+error WIFI::MESH::WifiMeshTxMain(const string &data, meshLane lane)
+{
+    meshFrame frame = {};
+
+    if (data.length() > TX_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+
+    if (xQueueReceive(lanes[lane].free, &frame.data, 0) != pdTRUE)
+        return ESP_ERR_NO_MEM;
+
+    CopyMemory(frame.data, const_cast<char*>(data.data()), data.length());
+    frame.size     = data.length();
+    frame.queuedAt = esp_timer_get_time();
+
+    xQueueSend(lanes[lane].queue, &frame, portMAX_DELAY);   /*!< Never blocks, the queue holds every slot */
+    xTaskNotifyGive(laneTask);
+
+    return ESP_OK;
+}
+
+//! \fn     WifiMeshGetLatency
+//! \brief  Gets the average time frames of a lane wait before they are sent.
+//! \param  <meshLane> the lane.
+//! \return <int64_t> the latency in us.
+//!
+int64_t WIFI::MESH::WifiMeshGetLatency(meshLane lane)
+{
+    return lanes[lane].latency;
+}
+
+//! \fn     WifiMeshGetLayer
+//! \brief  Gets the layer of the calling node in the star, the root is layer 1.
+//! \return <int> the layer, 0 if the node doesn't hear the root.
+//!
+int WIFI::MESH::WifiMeshGetLayer()
+{
+    if (bno.IsRoot())
+        return 1;
+
+    return (xEventGroupGetBits(nowEventGroup) & nowConnectedBit ? 2 : 0);
+}
+
+//! \fn     WifiMeshGetErrors
+//! \brief  Gets the number of failed ESP-NOW sends and receives since boot.
+//! \return <int> the errors.
+//!
+int WIFI::MESH::WifiMeshGetErrors()
+{
+    return nowErrors;
+}
+
+//! \fn     WifiMeshRxMain
+//! \brief  This function hands over the messages the receive task has put together. It
+//!         waits up to 'timeout' ms for one message, then takes every message waiting
+//!         without waiting any longer.
+//! \return <vector<string>> the json array items
+//!
+strings WIFI::MESH::WifiMeshRxMain(int timeout)
+{
+    strings  response = {};
+    string  *message  = NULL;
+
+    while (xQueueReceive(rxQueue, &message, (response.empty() ? timeout / portTICK_PERIOD_MS : 0)) == pdTRUE)
+    {
+        response.push_back(*message);
+        delete message;
+    }
+
+    return response;
+}
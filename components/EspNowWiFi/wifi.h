@@ -0,0 +1,125 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  wifi.h
+//! \brief This header contains the definition of the WiFi functions which allow the app_main
+//!        function to connect the esp32 to a designated access point. The root joins the access
+//!        point, the other nodes of the suit talk to it over ESP-NOW, in a star with the root as
+//!        its hub. The MESH functions are the same as those of the MeshWiFi component.
+//!
+//!
+#pragma once
+#include "../../main/bno.h"
+
+
+namespace WIFI {
+    //! \fn     WifiInit
+    //! \brief  Initializes the wifi adapter with the radio settings of a link profile.
+    //! \param  <wifiProfile> the profile.
+    //!
+    void        WifiInit(wifiProfile profile);
+
+    //! \fn     WifiConnect
+    //! \brief  Connects the esp32 to the configured wifi ssid.
+    //! \param  string ssid, string password.
+    //!
+    void        WifiConnect(string sid, string pwd);
+
+    //! \fn     WifiDisconnect
+    //! \brief  Disconnects the esp32 from the configured wifi ssid.
+    //!
+    void        WifiDisconnect();
+
+    //! \fn     WifiGetStatus
+    //! \brief  Gets the current status of the wifi connection.
+    //! \return wifiStatus enum value.
+    //!
+    wifiStatus  WifiGetStatus();
+
+    //! \fn     WifiSetPowerSave
+    //! \brief  Puts the radio in modem sleep between DTIM beacons, or keeps it awake.
+    //! \param  bool enable.
+    //! \return <bool> true if the radio sleeps between beacons now.
+    //!
+    bool        WifiSetPowerSave(bool enable);
+
+    //! \fn     WifiGetRssi
+    //! \brief  Gets the signal strength of the access point.
+    //! \return <int> rssi in dBm, 0 if not connected, and on every node but the root.
+    //!
+    int         WifiGetRssi();
+
+    //! \fn     WifiGetProfile
+    //! \brief  Gets the link profile the adapter was initialized with.
+    //! \return <wifiProfile> the profile.
+    //!
+    wifiProfile WifiGetProfile();
+
+    //! \fn     WifiGetReconnects
+    //! \brief  Gets the number of link outages since boot.
+    //! \return <int> the outages.
+    //!
+    int         WifiGetReconnects();
+
+    //! \fn     WifiGetOutage
+    //! \brief  Gets how long the link was down in the last outage.
+    //! \return <int> the outage in ms, 0 if there was none.
+    //!
+    int         WifiGetOutage();
+
+    namespace MESH {
+        //! \fn     WifiIsMeshEnabled
+        //! \brief  Indicates whether mesh networking is enabled on the calling
+        //!         node.
+        //! \return <bool> true of false.
+        //!
+        bool    WifiIsMeshEnabled();
+
+        //! \fn     WiFiMeshIsRoot
+        //! \brief  Indicates whether the calling node is root node, or not,
+        //!         when mesh networking is enabled.
+        //! \return <bool> true or false.
+        //!
+        bool    WifiIsRootNode();
+
+        //! \fn     WifiMeshSetId
+        //! \brief  Sets the id of the mesh to join, before connecting. Suits in the same
+        //!         room must use different ids.
+        //! \param  <string> the id, 12 hex digits.
+        //! \return <bool> false if the id is malformed, and the default is kept.
+        //!
+        bool    WifiMeshSetId(const string &id);
+
+        //! \fn     WifiMeshTxMain
+        //! \brief  This function handles sending data to other nodes of the suit using the
+        //!         esp-idf ESP-NOW API function calls.
+        //! \param  <string> the data to send, <meshLane> the lane to send it in.
+        //!
+        error   WifiMeshTxMain(const string &data, meshLane lane = LANE_REALTIME);
+
+        //! \fn     WifiMeshGetLatency
+        //! \brief  Gets the average time frames of a lane wait before they are sent.
+        //! \param  <meshLane> the lane.
+        //! \return <int64_t> the latency in us.
+        //!
+        int64_t WifiMeshGetLatency(meshLane lane);
+
+        //! \fn     WifiMeshGetLayer
+        //! \brief  Gets the layer of the calling node in the star, the root is layer 1.
+        //! \return <int> the layer, 0 if the node doesn't hear the root.
+        //!
+        int     WifiMeshGetLayer();
+
+        //! \fn     WifiMeshGetErrors
+        //! \brief  Gets the number of failed ESP-NOW sends and receives since boot.
+        //! \return <int> the errors.
+        //!
+        int     WifiMeshGetErrors();
+
+        //! \fn     WifiMeshRxMain
+        //! \brief  This function handles receiving data from other nodes of the suit using the
+        //!         esp-idf ESP-NOW API function calls.
+        //! \return <vector<string>> the json array items
+        //!
+        strings WifiMeshRxMain(int timeout);
+    }
+}
+
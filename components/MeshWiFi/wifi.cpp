@@ -17,14 +17,64 @@ const int meshConnectedBit  = BIT1;
 const int meshRootGotIpBit  = BIT2;
 const int RX_SIZE           = 1500;
 const int TX_SIZE           = 1460;
-const int MAX_NODES         = 8;
 const int ADD_ROOT          = 1;
+const int MIN_XON_QSIZE     = 32;                           /*!< Receive queue of a small mesh */
 
-const TickType_t TICKSTOWAIT = 500 / portTICK_PERIOD_MS;
-const uint8_t    MESH_ID[6]  = { 0x7A, 0x69, 0xDE, 0xAD, 0xBE, 0xEF };
+const TickType_t  TICKSTOWAIT = 500 / portTICK_PERIOD_MS;
+const int         NOISE_FLOOR = -95;                        /*!< Weakest rssi counted as occupancy */
+const int         CHANNEL_SPREAD = 5;                       /*!< 2.4 GHz channels closer than this overlap */
+const mesh_addr_t GROUP_ID    = {{ 0x01, 0x00, 0x5E, 0x42, 0x4E, 0x4F }};  /*!< Joined by every node */
 
 string routerSSID;
 string routerPSWD;
+byte   meshId[6] = { 0x7A, 0x69, 0xDE, 0xAD, 0xBE, 0xEF };  /*!< Unless the suit has its own */
+
+vector<mesh_addr_t> routes;                                 /*!< Routing table cache, root first */
+mutex       routeLock;                                      /*!< Guards the routing table cache */
+mesh_addr_t parentAddr = {};                                /*!< Station address of the parent */
+vector<byte> rxBuf(RX_SIZE);                                /*!< Receive buffer, kept off the stack */
+
+//! \brief meshFrame is a frame waiting in a lane, its data is in one of the lane's slots.
+//!
+typedef struct
+{
+    char         *data;                                     /*!< The slot, TX_SIZE bytes */
+    int           size;
+    int64_t       queuedAt;
+}meshFrame;
+
+//! \brief meshLaneState is a transmit lane: its queue, the slots its frames are copied
+//!        into, its token bucket, and the average time its frames wait before they are sent.
+//!
+typedef struct
+{
+    QueueHandle_t queue;
+    QueueHandle_t free;                                     /*!< Slots not holding a frame, one per frame queued */
+    mesh_tos_t    tos;
+    int           depth;                                    /*!< Frames the queue holds */
+    int           rate;                                     /*!< Bytes per second */
+    int64_t       tokens;                                   /*!< Bytes that may be sent now */
+    int64_t       filledAt;                                 /*!< Tick the bucket was last filled */
+    int64_t       latency;                                  /*!< Moving average in us */
+    int           sent;
+}meshLaneState;
+
+const int  LANE_BURST  = 4 * TX_SIZE;                       /*!< Token bucket size of every lane */
+const int  LANE_REPORT = 200;                               /*!< Frames sent between lane reports */
+const int  BULK_RATE   = LEAF_WINDOW * TX_SIZE * 1000 / RETX_TIME;   /*!< A whole window resent every RETX_TIME */
+const int  BULK_DEPTH  = 2 * LEAF_WINDOW;                   /*!< Two resend rounds */
+
+meshLaneState lanes[LANE_COUNT] = {
+    { NULL, NULL, MESH_TOS_P2P,  8, 32000, LANE_BURST, 0, 0, 0 },   /*!< Acks, responses, commands, never resent by the relay */
+    { NULL, NULL, MESH_TOS_DEF,  8, 64000, LANE_BURST, 0, 0, 0 },   /*!< Live samples, the relay resends them */
+    { NULL, NULL, MESH_TOS_P2P, BULK_DEPTH, BULK_RATE, LANE_BURST, 0, 0, 0 }    /*!< Backlog and retransmissions */
+};
+TaskHandle_t  laneTask = NULL;
+int           meshErrors = 0;                               /*!< Failed sends and receives since boot */
+wifiProfile   linkProfile = WIFI_PROFILE_REALTIME;
+int64_t       parentLostAt = 0;                             /*!< Tick the parent was lost, 0 while connected */
+int           reconnects = 0;
+int           outage     = 0;                               /*!< Last outage in ms */
 
 extern BnoModule bno;
 
@@ -49,14 +99,11 @@ void WaitForIp(EventBits_t eventBits)
     cout << endl << "Connected to access point!" << endl;
 }
 
-//! \fn     GetWifiChannel
-//! \brief  This function performs a wifi scan, and then cycles through all the scanned access
-//!         points, looking for the one with mesh associated data. This will be the softAp of the
-//!         root node. When the softAp is found, its channel is returned to caller. If no softAp
-//!         is found, channel 1 is returned.
-//! \return <byte> the wifi channel.
+//! \fn     ScanAccessPoints
+//! \brief  This function performs a wifi scan of every channel.
+//! \return <vector<wifi_ap_record_t>> the access points found.
 //!
-byte GetWifiChannel()
+vector<wifi_ap_record_t> ScanAccessPoints()
 {
     uint16_t           numAccessPoints = {};
     wifi_scan_config_t scanConfig      = {};
@@ -69,22 +116,121 @@ byte GetWifiChannel()
     ESP_ERROR_CHECK(esp_wifi_scan_start(&scanConfig, true));
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&numAccessPoints));
 
-    wifi_ap_record_t *apRecords = new wifi_ap_record_t[numAccessPoints];
-    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&numAccessPoints, apRecords));
+    vector<wifi_ap_record_t> apRecords(numAccessPoints);
+    ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&numAccessPoints, apRecords.data()));
+    apRecords.resize(numAccessPoints);
+
+    return apRecords;
+}
 
-    for (int i = 0; i < numAccessPoints; i++)
+//! \fn     GetWifiChannel
+//! \brief  This function performs a wifi scan, and then cycles through all the scanned access
+//!         points, looking for the one with mesh associated data. This will be the softAp of the
+//!         root node. When the softAp is found, its channel is returned to caller. If no softAp
+//!         is found, channel 1 is returned.
+//! \return <byte> the wifi channel.
+//!
+byte GetWifiChannel()
+{
+    for (auto &record : ScanAccessPoints())
     {
-        string temp((char*)apRecords[i].ssid);
+        string temp((char*)record.ssid);
         if (temp.compare(routerSSID) == 0)
         {
             cout << "Found channel!" << endl;
-            return apRecords[i].primary;
+            return record.primary;
         }
     }
 
     return static_cast<byte>(1);
 }
 
+//! \fn     PlanWifiChannel
+//! \brief  This function measures how busy each channel is, and picks the least congested
+//!         access point with the router ssid. Every other access point in range, other
+//!         suits' softAps included, adds its rssi above NOISE_FLOOR to the occupancy of its
+//!         channel, and less of it to the channels it overlaps. Ties go to the stronger
+//!         access point. If none has the router ssid, channel 1 is returned.
+//! \param  <byte[6]> the bssid of the access point picked, left as is if none.
+//! \return <byte> the wifi channel.
+//!
+byte PlanWifiChannel(byte bssid[6])
+{
+    vector<wifi_ap_record_t> records = ScanAccessPoints();
+    const wifi_ap_record_t  *best    = NULL;
+    int                      bestLoad = {};
+
+    for (auto &candidate : records)
+    {
+        int load = 0;
+
+        if (routerSSID.compare((char*)candidate.ssid) != 0)
+            continue;
+
+        for (auto &other : records)
+        {
+            int distance = abs(other.primary - candidate.primary);
+
+            if (&other == &candidate || distance >= CHANNEL_SPREAD)
+                continue;
+            load += max(0, other.rssi - NOISE_FLOOR) * (CHANNEL_SPREAD - distance) / CHANNEL_SPREAD;
+        }
+        cout << "Channel " << (int)candidate.primary << ": rssi " << (int)candidate.rssi << ", occupancy " << load << endl;
+
+        if (best == NULL || load < bestLoad || (load == bestLoad && candidate.rssi > best->rssi))
+        {
+            best     = &candidate;
+            bestLoad = load;
+        }
+    }
+
+    if (best == NULL)
+        return static_cast<byte>(1);
+
+    CopyMemory(bssid, const_cast<byte*>(best->bssid), 6);
+    cout << "Planned channel " << (int)best->primary << endl;
+
+    return best->primary;
+}
+
+//! \fn    RefreshRoutes
+//! \brief This function refreshes the routing table cache. It's called on routing table
+//!        events only, so sending never has to fetch the table. The cache is sized to
+//!        the table, however many nodes are below this one.
+//!
+void RefreshRoutes()
+{
+    int                 size  = esp_mesh_get_routing_table_size();
+    vector<mesh_addr_t> table(max(size, 1));
+
+    if (esp_mesh_get_routing_table(table.data(), table.size() * sizeof(mesh_addr_t), &size) != ESP_OK)
+        return;
+    table.resize(size);
+
+    routeLock.lock();
+    routes.swap(table);
+    routeLock.unlock();
+
+    cout << "Routing table: " << size << " nodes" << endl;
+}
+
+//! \fn    RefreshParent
+//! \brief This function caches the station address of the parent, which a node sends
+//!        its messages to. The parent bssid is its softAP address, which is the station
+//!        address plus one on the esp32.
+//!
+void RefreshParent()
+{
+    if (esp_mesh_get_parent_bssid(&parentAddr) != ESP_OK)
+        return;
+
+    for (int i = 5; i >= 0; i--)
+    {
+        if (parentAddr.addr[i]-- != 0)                      /*!< Stop unless it borrowed */
+            break;
+    }
+}
+
 //! \fn    ScanHandler
 //! \brief This function handles checking each access point found during the
 //!        ap scan, and locates the parent node for either root or a leaf node.
@@ -176,18 +322,36 @@ void MeshEventHandler(mesh_event_t event)
         break;
     case MESH_EVENT_ROUTING_TABLE_ADD:
         cout << "<MESH_EVENT_ROUTING_TABLE_ADD>" << endl;
+        RefreshRoutes();
+        break;
+    case MESH_EVENT_ROUTING_TABLE_REMOVE:
+        cout << "<MESH_EVENT_ROUTING_TABLE_REMOVE>" << endl;
+        RefreshRoutes();
+        break;
     case MESH_EVENT_NO_PARENT_FOUND:
         cout << "<MESH_EVENT_NO_PARENT_FOUND>" << endl;
         // TODO : stuff
         break;
     case MESH_EVENT_PARENT_CONNECTED:
         cout << "<MESH_EVENT_PARENT_CONNECTED>" << endl;
+        if (parentLostAt != 0)
+        {
+            outage = (esp_timer_get_time() - parentLostAt) / 1000;
+            reconnects++;
+            cout << "Mesh: parent back after " << outage << " ms" << endl;
+            parentLostAt = 0;
+        }
         if (esp_mesh_is_root())
             tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+        esp_mesh_set_group_id(&GROUP_ID, 1);
+        RefreshParent();
+        RefreshRoutes();
         xEventGroupSetBits(meshEventGroup, meshConnectedBit);
         break;
     case MESH_EVENT_PARENT_DISCONNECTED:
         cout << "<MESH_EVENT_PARENT_DISCONNECTED>" << endl;
+        if ((xEventGroupGetBits(meshEventGroup) & meshConnectedBit) && parentLostAt == 0)
+            parentLostAt = esp_timer_get_time();
         xEventGroupClearBits(meshEventGroup, meshConnectedBit);
         break;
     case MESH_EVENT_ROOT_GOT_IP:
@@ -202,17 +366,157 @@ void MeshEventHandler(mesh_event_t event)
     }
 }
 
+//! \fn     SendFrame
+//! \brief  This function sends a frame to other mesh nodes using the esp-idf mesh API
+//!         function calls. A leaf sends to its parent, which merges the frame with its own
+//!         when it isn't the root, or straight to the root if the parent can't be reached.
+//!         The root sends once to GROUP_ID,
+//!         which every node joins, so fanning out takes the same time for any number of
+//!         leaves. Only if that fails, it sends to each leaf in the routing table cache
+//!         without blocking, so one unreachable leaf can't hold up the others, and the
+//!         first error is returned once every leaf was tried.
+//! \param  <char*> the data to send and its size, <mesh_tos_t> the lane's type of service.
+//!
+error SendFrame(const char *data, int size, mesh_tos_t tos)
+{
+    vector<mesh_addr_t> table;
+    int         tableSize = {};
+    int         failed    = 0;
+    mesh_data_t txData;
+    error       result;
+    error       first     = ESP_OK;
+
+    txData.data  = reinterpret_cast<byte*>(const_cast<char*>(data));           /*!< esp_mesh_send copies it */
+    txData.size  = size;
+    txData.tos   = tos;
+    txData.proto = (esp_mesh_is_root() ? MESH_PROTO_HTTP : MESH_PROTO_JSON);
+
+    if (!esp_mesh_is_root())
+    {
+        if (esp_mesh_get_layer() > MESH_ROOT_LAYER + 1 &&
+            esp_mesh_send(&parentAddr, &txData, MESH_DATA_P2P, NULL, 0) == ESP_OK)
+            return ESP_OK;
+
+        if ((result = esp_mesh_send(NULL, &txData, 0, NULL, 0)) != ESP_OK)
+            meshErrors++;
+        return result;
+    }
+
+    routeLock.lock();
+    table     = routes;
+    tableSize = table.size();
+    routeLock.unlock();
+
+    if (tableSize <= ADD_ROOT)                                              /*!< No leaves */
+        return ESP_OK;
+
+    if ((result = esp_mesh_send(&GROUP_ID, &txData, MESH_DATA_GROUP, NULL, 0)) == ESP_OK)
+        return ESP_OK;
+
+    for (int i = ADD_ROOT; i < tableSize; i++)
+    {
+        result = esp_mesh_send(&table[i], &txData, MESH_DATA_P2P | MESH_DATA_NONBLOCK, NULL, 0);
+        if (result != ESP_OK)
+        {
+            failed++;
+            meshErrors++;
+            first = (first == ESP_OK ? result : first);
+        }
+    }
+
+    if (failed > 0)
+        cout << "\"esp_mesh_send\" failed for " << failed << " of " << tableSize - ADD_ROOT << " nodes" << endl;
+
+    return first;
+}
+
+//! \fn     TakeTokens
+//! \brief  This function fills a lane's token bucket for the time passed, and takes the
+//!         tokens for a frame if there are enough.
+//! \param  <meshLaneState> the lane, <int> frame size, <int64_t> current tick.
+//! \return <int64_t> 0 if the tokens were taken, otherwise the us until there are enough.
+//!
+int64_t TakeTokens(meshLaneState &lane, int size, int64_t now)
+{
+    lane.tokens   = min<int64_t>(lane.tokens + (now - lane.filledAt) * lane.rate / 1000000, LANE_BURST);
+    lane.filledAt = now;
+
+    if (lane.tokens < size)
+        return (size - lane.tokens) * 1000000 / lane.rate + 1;
+
+    lane.tokens -= size;
+    return 0;
+}
+
+//! \fn     LaneThread
+//! \brief  This function is the transmit task. Before every frame it checks the lanes in
+//!         order, so a control or real-time frame never waits behind more than the one
+//!         bulk frame being sent. A lane out of tokens holds its frames until the bucket
+//!         refills, and holds the lanes after it too.
+//! \param  <void*> unused.
+//!
+void LaneThread(void *arg)
+{
+    meshFrame  frame = {};
+    int64_t    now   = {};
+    int64_t    wait  = {};
+    TickType_t sleep = {};
+
+    while (1)
+    {
+        sleep = portMAX_DELAY;
+
+        for (int l = 0; l < LANE_COUNT; l++)
+        {
+            meshLaneState &lane = lanes[l];
+
+            if (xQueuePeek(lane.queue, &frame, 0) != pdTRUE)
+                continue;
+
+            now = esp_timer_get_time();
+            if ((wait = TakeTokens(lane, frame.size, now)) > 0)
+            {
+                sleep = max<TickType_t>(wait / 1000 / portTICK_PERIOD_MS, 1);
+                break;                                      /*!< Lower lanes wait too */
+            }
+
+            xQueueReceive(lane.queue, &frame, 0);
+            SendFrame(frame.data, frame.size, lane.tos);
+            xQueueSend(lane.free, &frame.data, portMAX_DELAY);  /*!< Never blocks, the slot was taken from it */
+
+            lane.latency = (lane.latency == 0 ? now - frame.queuedAt : (7 * lane.latency + now - frame.queuedAt) / 8);
+            if (++lane.sent % LANE_REPORT == 0)
+                cout << "Mesh lane " << l << ": " << lane.sent << " frames, " << lane.latency / 1000 << " ms queued" << endl;
+
+            sleep = 0;
+            break;                                          /*!< Start over from the control lane */
+        }
+
+        if (sleep != 0)
+            ulTaskNotifyTake(pdTRUE, sleep);
+    }
+}
+
 //! \fn    WifiInit
-//! \brief This function initializes the wifi adapter using mostly 
-//!        default values.
+//! \brief This function initializes the wifi adapter with the buffers, AMPDU, and tx power
+//!        of the link profile. esp-mesh keeps the radio awake whatever the profile.
+//! \param <wifiProfile> the profile.
 //!
-void WIFI::WifiInit()
+void WIFI::WifiInit(wifiProfile profile)
 {
-    wifi_init_config_t wifiCfg = WIFI_INIT_CONFIG_DEFAULT();
-    error              err     = {};
+    const wifiProfileConfig &config  = profileToConfig.at(profile);
+    wifi_init_config_t       wifiCfg = WIFI_INIT_CONFIG_DEFAULT();
+    error                    err     = {};
 
+    linkProfile    = profile;
     meshEventGroup = xEventGroupCreate();
 
+    wifiCfg.static_rx_buf_num  = config.staticRxBuf;
+    wifiCfg.dynamic_rx_buf_num = config.dynamicRxBuf;
+    wifiCfg.dynamic_tx_buf_num = config.dynamicTxBuf;
+    wifiCfg.ampdu_rx_enable    = config.ampdu;
+    wifiCfg.ampdu_tx_enable    = config.ampdu;
+
     if ((err = nvs_flash_init()) == ESP_ERR_NVS_NO_FREE_PAGES)
     {
         nvs_flash_erase();
@@ -227,9 +531,27 @@ void WIFI::WifiInit()
     esp_wifi_init(&wifiCfg);
     esp_wifi_set_storage(WIFI_STORAGE_FLASH);
     esp_wifi_start();
+    esp_wifi_set_max_tx_power(config.txPower);
+    cout << "WiFi: " << config.name << " profile" << endl;
+
+    for (auto &lane : lanes)
+    {
+        char *slots = new char[lane.depth * TX_SIZE];      /*!< Kept for good, like the lane */
+
+        lane.queue = xQueueCreate(lane.depth, sizeof(meshFrame));
+        lane.free  = xQueueCreate(lane.depth, sizeof(char*));
+        for (int i = 0; i < lane.depth; i++)
+        {
+            char *slot = slots + i * TX_SIZE;
+            xQueueSend(lane.free, &slot, 0);
+        }
+    }
+    xTaskCreate(&LaneThread, "MeshTx", 4096, NULL, tskIDLE_PRIORITY + 5, &laneTask);
 
     esp_mesh_init();
-    esp_mesh_set_max_layer(2);
+    esp_mesh_set_max_layer(CONFIG_MESH_MAX_LAYER);
+    esp_mesh_set_capacity_num(CONFIG_MESH_MAX_NODES);
+    esp_mesh_set_xon_qsize(max(MIN_XON_QSIZE, 2 * CONFIG_MESH_MAX_NODES));  /*!< Room for a burst from every node */
     esp_mesh_fix_root(true);
     if (bno.IsRoot())
         esp_mesh_set_type(MESH_ROOT);
@@ -250,12 +572,17 @@ void WIFI::WifiConnect(string sid, string pwd)
 
     /*!< Configure mesh properties */
     meshCfg.event_cb = &MeshEventHandler;
+#ifdef CONFIG_MESH_CHANNEL_PLAN
+    meshCfg.channel  = (bno.IsRoot() ? PlanWifiChannel(meshCfg.router.bssid) : 0);  /*!< 0 scans for the mesh id */
+    meshCfg.allow_channel_switch = true;
+#else
     meshCfg.channel  = (esp_mesh_is_root() ? 1 : GetWifiChannel());
+#endif
     meshCfg.router.ssid_len = sid.length();
     meshCfg.crypto_funcs    = &g_wifi_default_mesh_crypto_funcs;
     meshCfg.mesh_ap.max_connection = CONFIG_MESH_AP_CONNECTIONS;
 
-    CopyMemory((uint8_t *)&meshCfg.mesh_id, const_cast<byte*>(MESH_ID), 6);
+    CopyMemory((uint8_t *)&meshCfg.mesh_id, meshId, 6);
     CopyMemory(meshCfg.router.ssid, const_cast<char*>(routerSSID.c_str()), routerSSID.length());
     CopyMemory(meshCfg.router.password, const_cast<char*>(routerPSWD.c_str()), routerPSWD.length());
     CopyMemory(meshCfg.mesh_ap.password, const_cast<char*>(meshPwd.c_str()), meshPwd.length());
@@ -298,6 +625,69 @@ wifiStatus WIFI::WifiGetStatus()
         return WIFI_STATUS_DISCONNECTED;
 }
 
+//! \fn     WifiSetPowerSave
+//! \brief  esp-mesh keeps the radio of every node awake to forward for its children,
+//!         and doesn't support modem sleep, so the radio stays awake whatever the link
+//!         profile. Asking for modem sleep is reported once, and turned down.
+//! \param  bool enable.
+//! \return <bool> false, the radio never sleeps.
+//!
+bool WIFI::WifiSetPowerSave(bool enable)
+{
+    static bool reported = false;
+
+    if (enable && !reported)
+    {
+        cout << "WiFi: esp-mesh doesn't support modem sleep, the radio stays awake" << endl;
+        reported = true;
+    }
+
+    return false;
+}
+
+//! \fn     WifiGetRssi
+//! \brief  Gets the signal strength of the mesh parent.
+//! \return <int> rssi in dBm, 0 if not connected.
+//!
+int WIFI::WifiGetRssi()
+{
+    wifi_ap_record_t ap = {};
+
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return 0;
+
+    return ap.rssi;
+}
+
+//! \fn     WifiGetProfile
+//! \brief  Gets the link profile the adapter was initialized with.
+//! \return <wifiProfile> the profile.
+//!
+wifiProfile WIFI::WifiGetProfile()
+{
+    return linkProfile;
+}
+
+//! \fn     WifiGetReconnects
+//! \brief  Gets the number of times the node got a parent back after losing it, since
+//!         boot. esp-mesh looks for a new parent on its own, there is no backoff to tune.
+//! \return <int> the outages.
+//!
+int WIFI::WifiGetReconnects()
+{
+    return reconnects;
+}
+
+//! \fn     WifiGetOutage
+//! \brief  Gets the time from losing the parent to connecting to one again, in the last
+//!         outage.
+//! \return <int> the outage in ms, 0 if there was none.
+//!
+int WIFI::WifiGetOutage()
+{
+    return outage;
+}
+
 //! \fn     WifiIsMeshEnabled
 //! \brief  Indicates whether mesh networking is enabled on the calling
 //!         node.
@@ -318,61 +708,94 @@ bool WIFI::MESH::WifiIsRootNode()
     return MESH_ROOT == esp_mesh_get_type();
 }
 
+//! \fn     WifiMeshSetId
+//! \brief  Sets the id of the mesh to join, before connecting. Suits in the same room
+//!         must use different ids.
+//! \param  <string> the id, 12 hex digits.
+//! \return <bool> false if the id is malformed, and the default is kept.
+//!
+bool WIFI::MESH::WifiMeshSetId(const string &id)
+{
+    byte parsed[6] = {};
+
+    if (id.length() != 12 || id.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+        return false;
+
+    for (int i = 0; i < 6; i++)
+        parsed[i] = strtoul(id.substr(2 * i, 2).c_str(), NULL, 16);
+
+    CopyMemory(meshId, parsed, 6);
+    cout << "Mesh id " << id << endl;
+
+    return true;
+}
+
 //! \fn     WifiMeshTxMain
-//! \brief  This function handles sending data to other mesh nodes using the esp-idf
-//!         mesh API function calls.
-//! \param  <string> the data to send.
+//! \brief  This function copies data into a free slot of a transmit lane and returns, the
+//!         transmit task sends it, see LaneThread and SendFrame. The slots are allocated
+//!         once, so queueing a frame doesn't touch the heap.
+//! \param  <string> the data to send, <meshLane> the lane to send it in.
+//! \return <error> ESP_ERR_MESH_QUEUE_FULL if the lane is full and the data was dropped.
 //!
-error WIFI::MESH::WifiMeshTxMain(string data)
+error WIFI::MESH::WifiMeshTxMain(const string &data, meshLane lane)
 {
-    byte        txBuf[TX_SIZE]   = {};
-    int         flag             = {};
-    int         tableSize        = 0;
-    mesh_addr_t table[MAX_NODES + ADD_ROOT];
-    mesh_data_t txData;
-    error       result;
-    
-    txData.data  = txBuf;
-    txData.size  = data.length();
-    txData.tos   = MESH_TOS_P2P;
-    txData.proto = (esp_mesh_is_root() ? MESH_PROTO_HTTP : MESH_PROTO_JSON);
-    CopyMemory(txData.data, const_cast<char*>(data.c_str()), data.length());
+    meshFrame frame = {};
 
-    if (esp_mesh_is_root())
-    {
-        result = esp_mesh_get_routing_table((mesh_addr_t*)&table, sizeof(table) * 6, &tableSize);
-        flag   = MESH_DATA_P2P;
-    }
+    if (data.length() > TX_SIZE)
+        return ESP_ERR_INVALID_SIZE;
+
+    if (xQueueReceive(lanes[lane].free, &frame.data, 0) != pdTRUE)
+        return ESP_ERR_MESH_QUEUE_FULL;
+
+    CopyMemory(frame.data, const_cast<char*>(data.data()), data.length());
+    frame.size     = data.length();
+    frame.queuedAt = esp_timer_get_time();
+
+    xQueueSend(lanes[lane].queue, &frame, portMAX_DELAY);   /*!< Never blocks, the queue holds every slot */
+    xTaskNotifyGive(laneTask);
 
-    if (!esp_mesh_is_root())
-        tableSize++;
-    
-    for (int i = 0; i < tableSize; i++)
-    {
-        if (esp_mesh_is_root() && (i == 0))
-            continue;
-        if (esp_mesh_is_root())
-            result = esp_mesh_send(&table[i], &txData, flag, NULL, 0);
-        else
-            result = esp_mesh_send(NULL, &txData, flag, NULL, 0);
-        
-        if (result != ESP_OK)
-            return result;
-        cout << "\"esp_mesh_send\" sent message " << i + 1 << endl;
-    }
-    
     return ESP_OK;
 }
 
+//! \fn     WifiMeshGetLatency
+//! \brief  Gets the average time frames of a lane wait before they are sent.
+//! \param  <meshLane> the lane.
+//! \return <int64_t> the latency in us.
+//!
+int64_t WIFI::MESH::WifiMeshGetLatency(meshLane lane)
+{
+    return lanes[lane].latency;
+}
+
+//! \fn     WifiMeshGetLayer
+//! \brief  Gets the layer of the calling node in the mesh, the root is layer 1.
+//! \return <int> the layer.
+//!
+int WIFI::MESH::WifiMeshGetLayer()
+{
+    return esp_mesh_get_layer();
+}
+
+//! \fn     WifiMeshGetErrors
+//! \brief  Gets the number of failed mesh sends and receives since boot.
+//! \return <int> the errors.
+//!
+int WIFI::MESH::WifiMeshGetErrors()
+{
+    return meshErrors;
+}
+
 //! \fn     WifiMeshRxMain
 //! \brief  This function handles receiving data from other mesh nodes using the esp-idf
-//!         mesh API function calls.
+//!         mesh API function calls. It waits up to 'timeout' ms for one message, then
+//!         takes every message waiting for this node without waiting any longer, the
+//!         root and the nodes with children get one from each of them.
 //! \return <vector<string>> the json array items
 //!
 strings WIFI::MESH::WifiMeshRxMain(int timeout)
 {
-    byte        rxBuf[RX_SIZE] = {};
     int         flag           = {};
+    int         bound          = 1;
     strings     response       = {};
     error       result;
 
@@ -380,41 +803,26 @@ strings WIFI::MESH::WifiMeshRxMain(int timeout)
     mesh_addr_t       from;
     mesh_data_t       rxData;
 
-    rxData.data = rxBuf;
-    rxData.size = RX_SIZE;
-
-    if (esp_mesh_is_root())
-    {
-        int32_t routingTableSize = esp_mesh_get_routing_table_size() - 1;
-        int64_t start {}, ticks {};
-        while (pending.toSelf < routingTableSize)
-        {
-            start = esp_timer_get_time();
-            esp_mesh_get_rx_pending(&pending);
-            Pause(10);
-            ticks += esp_timer_get_time() - start;
-            if (ticks > 500000)
-                break;
-        }
-    }
-    
-    int bound = (esp_mesh_is_root() ? pending.toSelf : 1);
     for (int i = 0; i < bound; i++)
     {
-        ZeroMemory(rxData.data, RX_SIZE);
-        rxData.size = RX_SIZE;
-        result      = esp_mesh_recv(&from, &rxData, timeout, &flag, NULL, 0);
-        if (rxData.size == 0)
-        {
-            string res = "No data!";
-            response.push_back(res);
+        rxData.data = rxBuf.data();
+        rxData.size = rxBuf.size();
+        result      = esp_mesh_recv(&from, &rxData, (i == 0 ? timeout : 0), &flag, NULL, 0);
+
+        if (i == 0 && esp_mesh_get_rx_pending(&pending) == ESP_OK)
+            bound += pending.toSelf;
+
+        if (result == ESP_ERR_MESH_TIMEOUT) {
             continue;
         }else if (result != ESP_OK) {
-            cout << std::hex << result << std::dec << endl;
+            meshErrors++;
+            continue;
+        }else if (rxData.size == 0) {
+            string res = "No data!";
+            response.push_back(res);
             continue;
         }
-        string temp(reinterpret_cast<char*>(rxData.data));
-        response.push_back(temp);
+        response.push_back(string(reinterpret_cast<char*>(rxData.data), rxData.size));
         cout << "\"esp_mesh_recv\" received message " << i + 1 << endl;
     }
 
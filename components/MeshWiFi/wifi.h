@@ -11,9 +11,10 @@
 
 namespace WIFI {
     //! \fn     WifiInit
-    //! \brief  Initializes the wifi adapter.
+    //! \brief  Initializes the wifi adapter with the radio settings of a link profile.
+    //! \param  <wifiProfile> the profile.
     //!
-    void        WifiInit();
+    void        WifiInit(wifiProfile profile);
 
     //! \fn     WifiConnect
     //! \brief  Connects the esp32 to the configured wifi ssid.
@@ -32,6 +33,37 @@ namespace WIFI {
     //!
     wifiStatus  WifiGetStatus();
 
+    //! \fn     WifiSetPowerSave
+    //! \brief  Puts the radio in modem sleep between DTIM beacons, or keeps it awake.
+    //! \param  bool enable.
+    //! \return <bool> true if the radio sleeps between beacons now.
+    //!
+    bool        WifiSetPowerSave(bool enable);
+
+    //! \fn     WifiGetRssi
+    //! \brief  Gets the signal strength of the mesh parent.
+    //! \return <int> rssi in dBm, 0 if not connected.
+    //!
+    int         WifiGetRssi();
+
+    //! \fn     WifiGetProfile
+    //! \brief  Gets the link profile the adapter was initialized with.
+    //! \return <wifiProfile> the profile.
+    //!
+    wifiProfile WifiGetProfile();
+
+    //! \fn     WifiGetReconnects
+    //! \brief  Gets the number of link outages since boot.
+    //! \return <int> the outages.
+    //!
+    int         WifiGetReconnects();
+
+    //! \fn     WifiGetOutage
+    //! \brief  Gets how long the link was down in the last outage.
+    //! \return <int> the outage in ms, 0 if there was none.
+    //!
+    int         WifiGetOutage();
+
     namespace MESH {
         //! \fn     WifiIsMeshEnabled
         //! \brief  Indicates whether mesh networking is enabled on the calling
@@ -47,12 +79,39 @@ namespace WIFI {
         //!
         bool    WifiIsRootNode();
 
+        //! \fn     WifiMeshSetId
+        //! \brief  Sets the id of the mesh to join, before connecting. Suits in the same
+        //!         room must use different ids.
+        //! \param  <string> the id, 12 hex digits.
+        //! \return <bool> false if the id is malformed, and the default is kept.
+        //!
+        bool    WifiMeshSetId(const string &id);
+
         //! \fn     WifiMeshTxMain
         //! \brief  This function handles sending data to other mesh nodes using the esp-idf
         //!         mesh API function calls.
-        //! \param  <string> the data to send.
+        //! \param  <string> the data to send, <meshLane> the lane to send it in.
+        //!
+        error   WifiMeshTxMain(const string &data, meshLane lane = LANE_REALTIME);
+
+        //! \fn     WifiMeshGetLatency
+        //! \brief  Gets the average time frames of a lane wait before they are sent.
+        //! \param  <meshLane> the lane.
+        //! \return <int64_t> the latency in us.
+        //!
+        int64_t WifiMeshGetLatency(meshLane lane);
+
+        //! \fn     WifiMeshGetLayer
+        //! \brief  Gets the layer of the calling node in the mesh, the root is layer 1.
+        //! \return <int> the layer, 0 if mesh networking is disabled.
+        //!
+        int     WifiMeshGetLayer();
+
+        //! \fn     WifiMeshGetErrors
+        //! \brief  Gets the number of failed mesh sends and receives since boot.
+        //! \return <int> the errors.
         //!
-        error   WifiMeshTxMain(string data);
+        int     WifiMeshGetErrors();
 
         //! \fn     WifiMeshRxMain
         //! \brief  This function handles receiving data from other mesh nodes using the esp-idf
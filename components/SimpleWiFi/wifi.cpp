@@ -14,6 +14,37 @@ static EventGroupHandle_t wifiEventGroup;
 const  int                wifiStartBit     = BIT0;
 const  int                wifiConnectedBit = BIT1;
 const  TickType_t         ticksToWait      = 500 / portTICK_PERIOD_MS;
+static esp_timer_handle_t reconnectTimer;
+static wifiProfile        linkProfile      = WIFI_PROFILE_REALTIME;
+static bool               stopping         = false;         /*!< Disconnected on purpose, no reconnect */
+static int                attempts         = 0;             /*!< Reconnects since the link went down */
+static int64_t            downAt           = 0;             /*!< Tick the link went down, 0 while up */
+static int                reconnects       = 0;
+static int                outage           = 0;             /*!< Last outage in ms */
+
+
+//! \fn    Reconnect
+//! \brief This static function is the reconnect timer callback, it tries to associate
+//!        again once the backoff of the attempt is over.
+//! \param void* unused.
+//!
+static void Reconnect(void *arg)
+{
+    attempts++;
+    esp_wifi_connect();
+}
+
+//! \fn    ScheduleReconnect
+//! \brief This static function starts the reconnect timer. The backoff of the profile
+//!        doubles with every attempt, up to its longest delay.
+//!
+static void ScheduleReconnect()
+{
+    const wifiProfileConfig &config = profileToConfig.at(linkProfile);
+    int64_t                  delay  = (int64_t)config.backoffMin << min(attempts, 16);
+
+    esp_timer_start_once(reconnectTimer, min<int64_t>(delay, config.backoffMax) * 1000);
+}
 
 
 //! \fn     EventHandler
@@ -32,11 +63,22 @@ static error EventHandler(void *ctx, system_event_t *event)
     case SYSTEM_EVENT_STA_CONNECTED:
         break;
     case SYSTEM_EVENT_STA_GOT_IP:
+        if (downAt != 0)
+        {
+            outage = (esp_timer_get_time() - downAt) / 1000;
+            reconnects++;
+            cout << "WiFi: reconnected after " << attempts << " attempts, down for " << outage << " ms" << endl;
+            downAt = 0;
+        }
+        attempts = 0;
         xEventGroupSetBits(wifiEventGroup, wifiConnectedBit);
         break;
     case SYSTEM_EVENT_STA_DISCONNECTED:
-        esp_wifi_connect();
+        if ((xEventGroupGetBits(wifiEventGroup) & wifiConnectedBit) && downAt == 0)
+            downAt = esp_timer_get_time();
         xEventGroupClearBits(wifiEventGroup, wifiConnectedBit);
+        if (!stopping)
+            ScheduleReconnect();
         break;
     default:
         break;
@@ -45,15 +87,29 @@ static error EventHandler(void *ctx, system_event_t *event)
 }
 
 //! \fn    WifiInit
-//! \brief This function initializes the wifi adapter using mostly 
-//!        default values.
+//! \brief This function initializes the wifi adapter with the buffers, AMPDU, modem sleep,
+//!        and tx power of the link profile.
+//! \param <wifiProfile> the profile.
 //!
-void WIFI::WifiInit()
+void WIFI::WifiInit(wifiProfile profile)
 {
-    wifi_init_config_t wifiCfg = WIFI_INIT_CONFIG_DEFAULT();
-    error              err     = {};
+    const wifiProfileConfig &config  = profileToConfig.at(profile);
+    wifi_init_config_t       wifiCfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_timer_create_args_t  timer   = {};
+    error                    err     = {};
 
+    linkProfile    = profile;
     wifiEventGroup = xEventGroupCreate();
+
+    timer.callback = &Reconnect;
+    timer.name     = "reconnect";
+    esp_timer_create(&timer, &reconnectTimer);
+
+    wifiCfg.static_rx_buf_num  = config.staticRxBuf;
+    wifiCfg.dynamic_rx_buf_num = config.dynamicRxBuf;
+    wifiCfg.dynamic_tx_buf_num = config.dynamicTxBuf;
+    wifiCfg.ampdu_rx_enable    = config.ampdu;
+    wifiCfg.ampdu_tx_enable    = config.ampdu;
     
     if ((err = nvs_flash_init()) == ESP_ERR_NVS_NO_FREE_PAGES)
     {
@@ -69,6 +125,10 @@ void WIFI::WifiInit()
     esp_wifi_start();
 
     xEventGroupWaitBits(wifiEventGroup, wifiStartBit, pdFALSE, pdTRUE, portMAX_DELAY);
+    esp_wifi_set_ps(config.sleep);
+    esp_wifi_set_max_tx_power(config.txPower);
+
+    cout << "WiFi: " << config.name << " profile" << endl;
 }
 
 //! \fn    WifiConnect
@@ -78,6 +138,7 @@ void WIFI::WifiInit()
 void WIFI::WifiConnect(string sid, string pwd)
 {
     EventBits_t eventBits = {};
+    int64_t     startedAt = esp_timer_get_time();
 
     wifi_config_t wifiConfig = {};
     sid.copy((char *)wifiConfig.sta.ssid, sid.length());
@@ -85,6 +146,7 @@ void WIFI::WifiConnect(string sid, string pwd)
 
     cout << endl << "ESP32 connecting to SSID!" << endl;
 
+    stopping = false;
     esp_wifi_set_config(ESP_IF_WIFI_STA, &wifiConfig);
     esp_wifi_connect();
 
@@ -95,7 +157,7 @@ void WIFI::WifiConnect(string sid, string pwd)
         eventBits = xEventGroupWaitBits(wifiEventGroup, wifiConnectedBit, pdFALSE, pdTRUE, ticksToWait);
     }
 
-    cout << "ESP32 connected to SSID!" << endl;
+    cout << "ESP32 connected to SSID in " << (esp_timer_get_time() - startedAt) / 1000 << " ms!" << endl;
 }
 
 //! \fn    WifiDisconnect
@@ -103,6 +165,8 @@ void WIFI::WifiConnect(string sid, string pwd)
 //!
 void WIFI::WifiDisconnect()
 {
+    stopping = true;
+    esp_timer_stop(reconnectTimer);
     esp_wifi_disconnect();
     xEventGroupClearBits(wifiEventGroup, wifiConnectedBit);
 }
@@ -119,6 +183,63 @@ wifiStatus WIFI::WifiGetStatus()
         return WIFI_STATUS_DISCONNECTED;
 }
 
+//! \fn    WifiSetPowerSave
+//! \brief Puts the radio in the modem sleep of the link profile between DTIM beacons, or
+//!        keeps it awake. The radio must be awake while a batch is sent, or every packet
+//!        waits for a beacon. The realtime profile never sleeps.
+//! \param bool enable.
+//! \return <bool> true if the radio sleeps between beacons now.
+//!
+bool WIFI::WifiSetPowerSave(bool enable)
+{
+    wifi_ps_type_t sleep = (enable ? profileToConfig.at(linkProfile).sleep : WIFI_PS_NONE);
+
+    return (esp_wifi_set_ps(sleep) == ESP_OK && sleep != WIFI_PS_NONE);
+}
+
+//! \fn     WifiGetRssi
+//! \brief  Gets the signal strength of the access point.
+//! \return <int> rssi in dBm, 0 if not connected.
+//!
+int WIFI::WifiGetRssi()
+{
+    wifi_ap_record_t ap = {};
+
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK)
+        return 0;
+
+    return ap.rssi;
+}
+
+//! \fn     WifiGetProfile
+//! \brief  Gets the link profile the adapter was initialized with.
+//! \return <wifiProfile> the profile.
+//!
+wifiProfile WIFI::WifiGetProfile()
+{
+    return linkProfile;
+}
+
+//! \fn     WifiGetReconnects
+//! \brief  Gets the number of times the station got its ip back after losing the access
+//!         point, since boot.
+//! \return <int> the outages.
+//!
+int WIFI::WifiGetReconnects()
+{
+    return reconnects;
+}
+
+//! \fn     WifiGetOutage
+//! \brief  Gets the time from losing the access point to getting the ip back, in the last
+//!         outage.
+//! \return <int> the outage in ms, 0 if there was none.
+//!
+int WIFI::WifiGetOutage()
+{
+    return outage;
+}
+
 //! \fn     WifiIsMeshEnabled
 //! \brief  Indicates whether mesh networking is enabled on the calling
 //!         node.
@@ -139,16 +260,54 @@ bool WIFI::MESH::WifiIsRootNode()
     return true;
 }
 
+//! \fn     WifiMeshSetId
+//! \brief  Sets the id of the mesh to join, there is no mesh without mesh networking.
+//! \param  <string> the id, 12 hex digits.
+//! \return <bool> true.
+//!
+bool WIFI::MESH::WifiMeshSetId(const string &id)
+{
+    return true;
+}
+
 //! \fn     WifiMeshTxMain
 //! \brief  This function handles sending data to other mesh nodes using the esp-idf
 //!         mesh API function calls.
-//! \param  <string> the data to send.
+//! \param  <string> the data to send, <meshLane> the lane to send it in.
 //!
-error WIFI::MESH::WifiMeshTxMain(string data)
+error WIFI::MESH::WifiMeshTxMain(const string &data, meshLane lane)
 {
     return ESP_OK;
 }
 
+//! \fn     WifiMeshGetLatency
+//! \brief  Gets the average time frames of a lane wait before they are sent.
+//! \param  <meshLane> the lane.
+//! \return <int64_t> the latency in us.
+//!
+int64_t WIFI::MESH::WifiMeshGetLatency(meshLane lane)
+{
+    return 0;
+}
+
+//! \fn     WifiMeshGetLayer
+//! \brief  Gets the layer of the calling node in the mesh.
+//! \return <int> 0, mesh networking is disabled.
+//!
+int WIFI::MESH::WifiMeshGetLayer()
+{
+    return 0;
+}
+
+//! \fn     WifiMeshGetErrors
+//! \brief  Gets the number of failed mesh sends and receives since boot.
+//! \return <int> 0, mesh networking is disabled.
+//!
+int WIFI::MESH::WifiMeshGetErrors()
+{
+    return 0;
+}
+
 //! \fn     WifiMeshRxMain
 //! \brief  This function handles receiving data from other mesh nodes using the esp-idf
 //!         mesh API function calls.
@@ -0,0 +1,43 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  batch.cpp
+//! \brief This source contains the implementation of the EventBatch class, a fixed capacity
+//!        batch of events handed from the sampler to the network.
+//!
+//!
+#include "batch.h"
+
+
+//! \fn       Push
+//! \memberof EventBatch
+//! \brief    Push stores an event in the next free slot. A full batch refuses the event
+//!           rather than growing, or moving the events it already holds.
+//! \param    <SensorEvent> the event.
+//! \return   <bool> false if the batch is full and the event was dropped.
+//!
+bool EventBatch::Push(const SensorEvent &e)
+{
+    if (count == capacity)
+        return false;
+
+    if (count == 0)
+        openedAt = esp_timer_get_time();
+    events[count++] = e;
+
+    return true;
+}
+
+//! \fn       SetCapacity
+//! \memberof EventBatch
+//! \brief    SetCapacity changes the number of events the batch holds. Storage is only
+//!           allocated when the capacity grows past what the batch had before, and a
+//!           smaller capacity keeps it. The batch must not be filled meanwhile.
+//! \param    <int> events.
+//!
+void EventBatch::SetCapacity(int n)
+{
+    if (n > static_cast<int>(events.size()))
+        events.resize(n);
+
+    capacity = n;
+    count    = min(count, n);
+}
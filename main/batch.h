@@ -0,0 +1,79 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  batch.h
+//! \brief This header contains the definition of the EventBatch class, a fixed capacity batch of
+//!        events handed from the sampler to the network, and EventView, the non-owning view the
+//!        serialization and send functions take.
+//!
+//!
+#pragma once
+#include "event.h"
+
+
+//! \class EventView batch.h
+//! \brief The EventView class refers to events stored elsewhere, a whole batch or a single
+//!        event, without copying or owning them. The events must outlive the view.
+//!
+class EventView
+{
+public:
+    EventView(const SensorEvent *d, int n) : data(d), count(n) {}
+    EventView(const SensorEvent &e)        : data(&e), count(1) {}
+
+    const SensorEvent *begin() const { return data; }
+    const SensorEvent *end  () const { return data + count; }
+    int                size () const { return count; }
+    bool               empty() const { return count == 0; }
+
+private:
+    const SensorEvent *data;
+    int                count;
+};
+
+//! \class EventBatch batch.h
+//! \brief The EventBatch class holds up to its capacity of events, in storage allocated
+//!        when the capacity grows, never while filling. Clearing a batch only resets its
+//!        count, so filling, posting, and clearing it again never touches the heap. Batches
+//!        are handed between the sampler and the network by swapping pointers, the events
+//!        themselves never move. The batch also keeps what its watermarks are checked
+//!        against: its estimated json size and the tick of its first event.
+//!
+class EventBatch
+{
+public:
+    EventBatch() : count(0), capacity(0), openedAt(0), trigger(TRIGGER_AGE) {}
+
+    bool         Push       (const SensorEvent &e);
+    void         SetCapacity(int n);            /*!< Only while no one is filling the batch */
+
+    /*!< inline public methods */
+    void         Clear()       { count = 0; }
+    int          Size () const { return count; }
+    bool         Empty() const { return count == 0; }
+    bool         Full () const { return count == capacity; }
+    int64_t      Age  (int64_t now) const { return (count == 0 ? 0 : now - openedAt); }
+    EventView    View () const { return EventView(events.data(), count); }
+
+    void         SetTrigger(batchTrigger t) { trigger = t; }
+    batchTrigger GetTrigger() const         { return trigger; }
+    /*!< inline public methods */
+
+private:
+    vector<SensorEvent> events;
+    int                 count;
+    int                 capacity;
+    int64_t             openedAt;               /*!< Tick of the first event */
+    batchTrigger        trigger;                /*!< Watermark that closed the batch */
+};
+
+//! \brief batchStats are the counters of the batches posted and the events dropped.
+//!
+typedef struct
+{
+    int           batches;                      /*!< Batches posted */
+    int           events;                       /*!< Events posted */
+    int           smallest;
+    int           largest;
+    int           triggers[TRIGGER_COUNT];      /*!< Batches closed by each watermark */
+    int           dropped;                      /*!< Events dropped, no batch free */
+    int           shed;                         /*!< Optional samples not taken under pressure */
+}batchStats;
@@ -12,138 +12,636 @@
 //! \fn       Constructor
 //! \memberof BnoModule
 //! \brief    This is the constructor for the BnoModule class. It accepts three 
-//!           input parameters: the clock line, data line, and slave address.
-//! \param    <line> clock and data lines, <byte> slave address.
+//!           input parameters: the uart port, and its tx and rx lines. It sets up
+//!           the port on those lines, and the module talks to the IMU using a
+//!           UartTransport on that port.
+//! \param    <uport> uart port, <line> tx and rx lines.
 //!
 BnoModule::BnoModule(uport p, line tx, line rx)
 {
-    uaPort = p;
-    txPin  = tx;
-    rxPin  = rx;
-    test   = "LinearAccel";
+    UART::InitUART(p, tx, rx);
+    bus      = make_shared<UartTransport>(p);
+    test     = "LinearAccel";
+    streams  = "";
+    owner    = NULL;
+    hasCalib = false;
+    healthy  = false;
+    failures = 0;
+    errors   = 0;
+    failedAt = 0;
+    downtime = 0;
+    initTime = 0;
+    setupMode  = OPMODE_CONFIG;
+    setupPower = POWER_MODE_NORMAL;
+    configured = false;
+}
+
+//! \fn       Constructor
+//! \memberof BnoModule
+//! \brief    This constructor accepts any BnoTransport, which allows each sensor
+//!           to be placed on either the UART or an I2C bus.
+//! \param    <shared_ptr<BnoTransport>> the transport to the IMU.
+//!
+BnoModule::BnoModule(shared_ptr<BnoTransport> t)
+{
+    bus      = t;
+    test     = "LinearAccel";
+    streams  = "";
+    owner    = NULL;
+    hasCalib = false;
+    healthy  = false;
+    failures = 0;
+    errors   = 0;
+    failedAt = 0;
+    downtime = 0;
+    initTime = 0;
+    setupMode  = OPMODE_CONFIG;
+    setupPower = POWER_MODE_NORMAL;
+    configured = false;
 }
 
 //! \fn       Setup
 //! \memberof BnoModule
-//! \brief    The setup function writes values to the necessary bno registers to 
-//!           initialize the imu.
-//! \param    <bnoOpmode> the requested mode of operation.
+//! \brief    The setup function reads the device config from NVS, then writes values
+//!           to the necessary bno registers to initialize the imu. If the imu doesn't
+//!           answer the module is left unhealthy, and the owner task will keep trying
+//!           to bring it up, so only an NVS failure is fatal. Setup must be called
+//!           before Start.
+//! \param    <bnoOpmode> the requested mode of operation, <bnoPowermode> the power mode,
+//!           in low power mode the imu sleeps while it detects no motion.
 //! \return   <bool> for success or failure.
 //!
-bool BnoModule::Setup(bnoOpmode mode)
+bool BnoModule::Setup(bnoOpmode mode, bnoPowermode power)
 {
-    byte id = {};
-
     /*!< First read the device config partition */
     if (NVS::OpenNVSPartition(NVS_PARTITION_NAME, NVS_NSNAME_CONFIG) == ESP_OK)
     {
         NVS::ReadDeviceConfig(location, deviceId, test);
+        NVS::ReadStreamConfig(streams);
     }else {
         cout << "Oops... unable to read device config from NVS!" << endl;
         return false;
     }
 
-    /*!< Check for the correct chip id of the BNO055 */
-    DigitalWrite(BNO_PAGE_ID_ADDR, 0, 1);
-    DigitalRead(BNO_CHIP_ID_ADDR, &id, 1);
-    if (id != BNO_ID)
-        return false;
+    /*!< Remember the requested mode, so recovery knows the goal even if the imu never answers */
+    setupMode  = mode;
+    setupPower = power;
 
-    /*!< Begin setup of power mode and other configurations */
-    SetOprMode(OPMODE_CONFIG);
+    if (!(healthy = Configure(mode)))
+        failedAt = esp_timer_get_time();
 
-    DigitalWrite(BNO_SYS_TRIGGER_ADDR, 0x20, 1);
-    Pause(650);
+    return true;
+}
 
-    SetPwrMode(POWER_MODE_NORMAL);
-    Pause(10);
+//! \fn       Resume
+//! \memberof BnoModule
+//! \brief    Resume is the warm start counterpart of Setup, after deep sleep. The device
+//!           config, shadow registers, and calibration come from the saved state instead
+//!           of NVS. The imu stays powered while the esp32 sleeps, so if it still is in
+//!           the saved mode nothing is written at all, otherwise the saved config is
+//!           replayed by Recover. Resume must be called before Start.
+//! \param    <bnoWarmState> the state saved before sleep.
+//! \return   <bool> for success or failure.
+//!
+bool BnoModule::Resume(const bnoWarmState &state)
+{
+    byte mode = {};
+
+    location   = state.location;
+    deviceId   = state.deviceId;
+    test       = state.test;
+    streams    = state.streams;
+    setupMode  = static_cast<bnoOpmode>(state.setupMode);
+    hasCalib   = state.hasCalib;
+    configured = true;
+    copy(begin(state.calib), end(state.calib), calib.begin());
+
+    shadow.clear();
+    for (int i = 0; i < state.regCount && i < WARM_REGS; i++)
+        shadow[static_cast<bnoRegister>(state.regs[i][0])] = state.regs[i][1];
+    if (shadow.count(BNO_PWR_MODE_ADDR) != 0)
+        setupPower = static_cast<bnoPowermode>(shadow[BNO_PWR_MODE_ADDR]);
+
+    if (shadow.count(BNO_OPR_MODE_ADDR) != 0 && DigitalRead(BNO_OPR_MODE_ADDR, &mode, 1) == BNO_READ_SUCCESS &&
+        mode == shadow[BNO_OPR_MODE_ADDR])
+    {
+        healthy = true;
+    }else if (!(healthy = Recover())) {
+        failedAt = esp_timer_get_time();
+    }
 
-    DigitalWrite(BNO_PAGE_ID_ADDR, 0, 1);
+    return true;
+}
 
-    /*!< Configure axis mapping here */
-    if (location == locChest)
+//! \fn       SaveState
+//! \memberof BnoModule
+//! \brief    SaveState fills in the imu part of a warm state: device config, shadow
+//!           registers, and calibration profile. The caller adds the rest and stores it.
+//!           Once started, the shadow belongs to the owner task, so the state is filled
+//!           in there and SaveState waits for it.
+//! \param    <bnoWarmState> the state to fill in.
+//!
+void BnoModule::SaveState(bnoWarmState &state)
+{
+    bnoSaveRequest request = { &state, NULL };
+
+    if (owner == NULL)
     {
-        SetAxisRemap(REMAP_SWITCH_YZ);
-        SetAxisSign(REMAP_AXIS_NEGATIVE, bnoAxis::X);
-    }else if (location % 2 == 1) {                      /*!< Right side */
-        SetAxisRemap(REMAP_SHIFT_LEFT);
-    }else if (location % 2 == 0) {                      /*!< Left side */
-        SetAxisRemap(REMAP_SHIFT_LEFT);
-        SetAxisSign(REMAP_AXIS_NEGATIVE, bnoAxis::X);
-        SetAxisSign(REMAP_AXIS_NEGATIVE, bnoAxis::Y);
+        FillState(state);
+        return;
     }
 
-    DigitalWrite(BNO_SYS_TRIGGER_ADDR, 0x0, 1);
-    Pause(10);
+    request.done = xSemaphoreCreateBinary();
+    if (xQueueSend(saves, &request, portMAX_DELAY) == pdTRUE)
+    {
+        xTaskNotifyGive(owner);
+        xSemaphoreTake(request.done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(request.done);
+}
 
-    /*!< Set to requested mode of operation */
-    SetOprMode(mode);
-    Pause(150);
+//! \fn       FillState
+//! \memberof BnoModule
+//! \brief    FillState does the work of SaveState, on the owner task once started.
+//! \param    <bnoWarmState> the state to fill in.
+//!
+void BnoModule::FillState(bnoWarmState &state)
+{
+    state.location  = location;
+    state.deviceId  = deviceId;
+    state.setupMode = setupMode;
+    state.hasCalib  = hasCalib;
+    state.regCount  = 0;
+    CopyString(state.test, test);
+    CopyString(state.streams, streams);
+    copy(calib.begin(), calib.end(), begin(state.calib));
+
+    for (auto &reg : shadow)
+    {
+        if (state.regCount == WARM_REGS)
+            break;
+        state.regs[state.regCount][0] = reg.first;
+        state.regs[state.regCount][1] = reg.second;
+        state.regCount++;
+    }
+}
+
+//! \fn       Start
+//! \memberof BnoModule
+//! \brief    Start creates the request queues and the owner task. From here on the
+//!           owner task is the only one touching the bus, every read goes through
+//!           Submit or GetReading.
+//!
+void BnoModule::Start()
+{
+    for (int p = 0; p < PRIORITY_COUNT; p++)
+        queue[p] = xQueueCreate(BNO_QUEUE_SIZE, sizeof(bnoRequest));
+    saves = xQueueCreate(1, sizeof(bnoSaveRequest));
+
+    xTaskCreate(&OwnerThread, "Bno", 4096, this, tskIDLE_PRIORITY + 5, &owner);
+}
+
+//! \fn       Submit
+//! \memberof BnoModule
+//! \brief    Submit queues a read of 'type' and returns immediately. 'done' is called
+//!           from the owner task with the event once the read has been served, the
+//!           event is marked invalid if the read failed.
+//! \param    <bnoVectorType> the sensor to read, <bnoPriority> queue to use,
+//!           <bnoCallback> completion and its argument.
+//! \return   <bool> false if the queue is full and the request was dropped.
+//!
+bool BnoModule::Submit(bnoVectorType type, bnoPriority priority, bnoCallback done, void *arg)
+{
+    bnoRequest request = { type, done, arg };
+
+    if (xQueueSend(queue[priority], &request, 0) != pdTRUE)
+        return false;
+
+    xTaskNotifyGive(owner);
 
     return true;
 }
 
+//! \fn       Submit
+//! \memberof BnoModule
+//! \brief    This overload queues a read of every type in 'types' before waking the
+//!           owner task, so they are served together in as few bursts as possible.
+//! \param    <vector<bnoVectorType>> the sensors to read, <bnoPriority> queue to use,
+//!           <bnoCallback> completion, called once per type, and its argument.
+//! \return   <bool> false if the queue filled up and some requests were dropped.
+//!
+bool BnoModule::Submit(const vector<bnoVectorType> &types, bnoPriority priority, bnoCallback done, void *arg)
+{
+    bool queued = true;
+
+    for (auto type : types)
+    {
+        bnoRequest request = { type, done, arg };
+        queued &= (xQueueSend(queue[priority], &request, 0) == pdTRUE);
+    }
+
+    xTaskNotifyGive(owner);
+
+    return queued;
+}
+
+//! \brief bnoWaiter lets GetReading block on an asynchronous request.
+//!
+typedef struct
+{
+    SemaphoreHandle_t done;
+    SensorEvent       event;
+}bnoWaiter;
+
+static void WakeWaiter(SensorEvent &e, void *arg)
+{
+    bnoWaiter *waiter = static_cast<bnoWaiter*>(arg);
+
+    waiter->event = e;
+    xSemaphoreGive(waiter->done);
+}
+
 //! \fn       GetReading
 //! \memberof BnoModule
-//! \brief    GetReading initiates retrieving an event that occurs on the IMU, 
-//!           which is a reading of either an individual sensor, or if fusion 
-//!           mode is turned on, a vector or quaternion.
-//! \param    <SensorEvent> a pointer, <bnoVectorType> the sensor to read.
-//! \return   <bool> success or failure.
+//! \brief    GetReading submits a high priority read and waits for it to complete.
+//!           It is meant for occasional reads, e.g. those requested by the server,
+//!           the periodic sampler should use Submit.
+//! \param    <bnoVectorType> the sensor to read.
+//! \return   <SensorEvent> the event.
 //!
 SensorEvent BnoModule::GetReading(bnoVectorType typeOfData)
 {
-    SensorEvent e = {};
-    Quaternion  obj;
+    bnoWaiter waiter;
 
-    e.SetLocation(location);
+    waiter.done = xSemaphoreCreateBinary();
+    waiter.event.SetLocation(location);
+
+    if (Submit(typeOfData, PRIORITY_HIGH, &WakeWaiter, &waiter))
+        xSemaphoreTake(waiter.done, portMAX_DELAY);
+    vSemaphoreDelete(waiter.done);
+
+    return waiter.event;
+}
+
+//! \fn       OwnerThread
+//! \memberof BnoModule
+//! \brief    The owner task serves queued requests as they arrive, then a pending
+//!           SaveState. Health checks are the lowest priority work, done once every
+//!           HEALTH_PERIOD ms when the queues are empty, or every 100 ms while the imu
+//!           is down.
+//! \param    <void*> the BnoModule.
+//!
+void BnoModule::OwnerThread(void *arg)
+{
+    BnoModule     *self       = static_cast<BnoModule*>(arg);
+    int64_t        nextHealth = esp_timer_get_time() + HEALTH_PERIOD * 1000;
+    int64_t        wait       = {};
+    bnoSaveRequest save       = {};
 
-    switch (typeOfData)
+    while (1)
     {
-    case ACCELEROMETER:
-    case MAGNETOMETER:
-    case GYROSCOPE:
-        SetOprMode(OPMODE_AMG);
-        obj = ReadVector(typeOfData);
-        e.SetObj(obj);
-        e.SetName(vectorToString.at(typeOfData));
-        break;
-    case QUATERNION:
-        SetOprMode(OPMODE_NDOF);
-        obj = ReadQuat();
-        e.SetObj(obj);
-        e.SetName("Quaternion");
+        wait = (nextHealth - esp_timer_get_time()) / 1000;
+        ulTaskNotifyTake(pdTRUE, (wait > 0 ? wait : 0) / portTICK_PERIOD_MS);
+
+        self->ServeRequests();
+
+        if (xQueueReceive(self->saves, &save, 0) == pdTRUE)
+        {
+            self->FillState(*save.state);
+            xSemaphoreGive(save.done);
+        }
+
+        if (esp_timer_get_time() >= nextHealth)
+            nextHealth = esp_timer_get_time() + (self->CheckHealth() ? HEALTH_PERIOD : 100) * 1000;
+    }
+}
+
+//! \fn       ServeRequests
+//! \memberof BnoModule
+//! \brief    ServeRequests drains the queues, highest priority first, and serves the
+//!           requests in as few bursts as possible.
+//!
+void BnoModule::ServeRequests()
+{
+    bnoRequest batch[BNO_QUEUE_SIZE * PRIORITY_COUNT];
+    int        count = 0;
+
+    for (int p = 0; p < PRIORITY_COUNT; p++)
+    {
+        while (count < BNO_QUEUE_SIZE * PRIORITY_COUNT && xQueueReceive(queue[p], &batch[count], 0) == pdTRUE)
+            count++;
+    }
+
+    while (count > 0)
+        count = ServeBatch(batch, count);
+}
+
+//! \fn       ServeBatch
+//! \memberof BnoModule
+//! \brief    ServeBatch serves the first request in the batch along with every other
+//!           request that needs the same mode of operation, using one burst read that
+//!           spans all of their data registers. The remaining requests are moved to
+//!           the front of the batch, in order.
+//! \param    <bnoRequest*> the batch, <int> number of requests.
+//! \return   <int> number of requests remaining.
+//!
+int BnoModule::ServeBatch(bnoRequest *batch, int count)
+{
+    byte      buffer[BNO_BURST_SIZE];
+    byte      first     = 0xFF;
+    byte      last      = 0x00;
+    int       remaining = 0;
+    uerror    result    = BNO_READ_FAIL;
+    bnoOpmode mode      = (CompareTo(batch[0].type, {ACCELEROMETER, MAGNETOMETER, GYROSCOPE}) ?
+                           OPMODE_AMG : OPMODE_NDOF);
+
+    auto compatible = [&] (bnoVectorType t) {
+        return CompareTo(t, {ACCELEROMETER, MAGNETOMETER, GYROSCOPE}) == (mode == OPMODE_AMG);
+    };
+
+    /*!< Find the register span of the compatible requests */
+    for (int i = 0; i < count; i++)
+    {
+        if (!compatible(batch[i].type))
+            continue;
+        first = min<byte>(first, batch[i].type);
+        last  = max<byte>(last, batch[i].type + vectorToLength.at(batch[i].type));
+    }
+
+    if (healthy)
+    {
+        SetOprMode(mode);
+        result = DigitalRead(static_cast<bnoRegister>(first), buffer, last - first);
+        if (failures >= HEALTH_FAILS)                       /*!< Leave it to the health check */
+        {
+            healthy  = false;
+            failedAt = esp_timer_get_time();
+        }
+    }
+
+    /*!< Complete the compatible requests, keep the rest */
+    for (int i = 0; i < count; i++)
+    {
+        if (!compatible(batch[i].type))
+        {
+            batch[remaining++] = batch[i];
+            continue;
+        }
+
+        SensorEvent e = {};
+        e.SetLocation(location);
+        e.SetType(batch[i].type);
+        e.SetValid(result == BNO_READ_SUCCESS);
+        if (e.IsValid())
+            e.SetTicks(bus->GetSampleTicks(), bus->GetUncertainty());
+        if (e.IsValid() && batch[i].type == QUATERNION)
+            e.SetObj(DecodeQuat(buffer + batch[i].type - first));
+        else if (e.IsValid() && batch[i].type == TEMPERATURE)     /*!< 1 degree C = 1 LSB */
+            e.SetObj(Quaternion(static_cast<sbyte>(buffer[batch[i].type - first]), 0, 0));
+        else if (e.IsValid())
+            e.SetObj(DecodeVector(batch[i].type, buffer + batch[i].type - first));
+
+        if (batch[i].done != NULL)
+            batch[i].done(e, batch[i].arg);
+    }
+
+    return remaining;
+}
+
+//! \fn       Configure
+//! \memberof BnoModule
+//! \brief    Configure runs the full initialization sequence of the imu as a table of
+//!           register writes: chip id check, reset, power mode, and the axis mapping
+//!           of this location from locationToAxisMap. Instead of fixed pauses, the
+//!           reset and the final mode switch are polled, and writes of values the imu
+//!           already holds are skipped. The total time taken is kept in initTime.
+//! \param    <bnoOpmode> the requested mode of operation.
+//! \return   <bool> for success or failure.
+//!
+bool BnoModule::Configure(bnoOpmode mode)
+{
+    bnoAxisMap   axis      = locationToAxisMap.at(static_cast<devLocation>(location));
+    int64_t      start     = esp_timer_get_time();
+    byte         id        = {};
+    bnoSetupStep program[] = {
+        { BNO_OPR_MODE_ADDR,        OPMODE_CONFIG,     WAIT_NONE    },
+        { BNO_SYS_TRIGGER_ADDR,     0x20,              WAIT_RESET   },
+        { BNO_PWR_MODE_ADDR,        setupPower,        WAIT_NONE    },
+        { BNO_PAGE_ID_ADDR,         0x00,              WAIT_NONE    },
+        { BNO_AXIS_MAP_CONFIG_ADDR, axis.remap,        WAIT_NONE    },
+        { BNO_AXIS_MAP_SIGN_ADDR,   axis.sign,         WAIT_NONE    },
+        { BNO_SYS_TRIGGER_ADDR,     0x00,              WAIT_NONE    },
+        { BNO_OPR_MODE_ADDR,        mode,              WAIT_RUNNING }
+    };
+
+    configured = false;
+    shadow.clear();                                         /*!< Nothing is known about the imu yet */
+
+    /*!< Check for the correct chip id of the BNO055 */
+    DigitalWrite(BNO_PAGE_ID_ADDR, 0, 1);
+    DigitalRead(BNO_CHIP_ID_ADDR, &id, 1);
+    if (id != BNO_ID)
+        return false;
+
+    for (auto &step : program)
+    {
+        if (!RunStep(step))
+        {
+            cout << "BNO055 setup failed at register " << (int)step.reg << endl;
+            return false;
+        }
+    }
+
+    initTime   = esp_timer_get_time() - start;
+    configured = true;
+    cout << "BNO055 init took " << initTime / 1000 << " ms" << endl;
+
+    return true;
+}
+
+//! \fn       RunStep
+//! \memberof BnoModule
+//! \brief    RunStep performs a single step of the setup program. After a reset the
+//!           chip id is polled until the imu answers again, and after the final mode
+//!           switch the system status is polled until the imu is running, each bound
+//!           by the datasheet maximum. Polls use a single bus attempt, so a silent imu
+//!           doesn't stall them, and a poll that runs out of time fails the step.
+//! \param    <bnoSetupStep> the step.
+//! \return   <bool> for success or failure.
+//!
+bool BnoModule::RunStep(const bnoSetupStep &step)
+{
+    uerror  result   = {};
+    byte    value    = {};
+    int64_t deadline = {};
+    bool    ready    = false;
+
+    if (step.reg == BNO_OPR_MODE_ADDR)
+        result = SetOprMode(static_cast<bnoOpmode>(step.value));
+    else
+        result = DigitalWrite(step.reg, step.value, 1);
+
+    if (result != BNO_WRITE_SUCCESS && step.wait != WAIT_RESET)     /*!< The reset can eat its own ack */
+        return false;
+
+    bus->SetAttempts(1);
+    switch (step.wait)
+    {
+    case WAIT_RESET:
+        deadline = esp_timer_get_time() + BNO_RESET_TIME * 1000;
+        do {
+            Pause(BNO_POLL);
+            result = DigitalRead(BNO_CHIP_ID_ADDR, &value, 1);
+        } while ((result != BNO_READ_SUCCESS || value != BNO_ID) && esp_timer_get_time() < deadline);
+
+        shadow   = resetDefaults;                           /*!< The reset put every register back */
+        failures = 0;
+        ready    = (result == BNO_READ_SUCCESS && value == BNO_ID);
         break;
-    case EULER:
-    case LINEARACCEL:
-    case GRAVITY:
-        SetOprMode(OPMODE_NDOF);
-        obj = ReadVector(typeOfData);
-        e.SetObj(obj);
-        e.SetName(vectorToString.at(typeOfData));
+    case WAIT_RUNNING:
+        deadline = esp_timer_get_time() + BNO_RUN_TIME * 1000;
+        while ((result = DigitalRead(BNO_SYS_STAT_ADDR, &value, 1)) == BNO_READ_SUCCESS &&
+               value != SYS_STATUS_FUSION && value != SYS_STATUS_NO_FUSION &&
+               esp_timer_get_time() < deadline)
+        {
+            Pause(BNO_POLL);
+        }
+        ready = (result == BNO_READ_SUCCESS && (value == SYS_STATUS_FUSION || value == SYS_STATUS_NO_FUSION));
         break;
-    default:
+    case WAIT_NONE:
+        ready = true;
         break;
     }
+    bus->SetAttempts(0);
 
-    return e;
+    return ready;
 }
 
-//! \fn       ReadQuat
+//! \fn       CheckHealth
 //! \memberof BnoModule
-//! \brief    ReadQuat performs a read from the Bno055 IMU using the fusion mode
-//!           quaternion memory address and reads 8 bytes into a buffer. A quaternion
-//!           object is created and returned to the user.
-//! \return   <Quaternion*> an object pointer.
+//! \brief    CheckHealth is called periodically by the owner task. It reads the
+//!           system status and error registers, and together with the count of
+//!           consecutive failed transactions decides whether the imu is still healthy.
+//!           Once configured the imu must report itself running, an idle one was reset
+//!           behind our back and lost its config, while the shadow still holds it.
+//!           An unhealthy imu is recovered in place. The first time the imu reports
+//!           full calibration, its calibration profile is saved for later recoveries.
+//! \return   <bool> true if the imu is healthy after the check.
 //!
-Quaternion BnoModule::ReadQuat()
+bool BnoModule::CheckHealth()
 {
-    byte buffer[8];
-    ZeroMemory(buffer, 8);
+    byte    status[2] = {};                                 /*!< SYS_STAT and SYS_ERR are adjacent */
+    byte    calStat   = {};
+    int64_t now       = {};
+    uerror  result    = {};
+    bool    running   = false;
 
-    int16_t w(0), x(0), y(0), z(0);
+    if (healthy)
+    {
+        result  = DigitalRead(BNO_SYS_STAT_ADDR, status, 2);
+        running = (status[0] == SYS_STATUS_FUSION || status[0] == SYS_STATUS_NO_FUSION);
+        if (failures >= HEALTH_FAILS || status[0] == SYS_STATUS_ERROR ||
+            (configured && result == BNO_READ_SUCCESS && !running))
+        {
+            cout << "BNO055 unhealthy, status: " << (int)status[0] << " error: " << (int)status[1]
+                 << " failures: " << failures << endl;
+            healthy  = false;
+            failedAt = esp_timer_get_time();
+        }else if (!hasCalib) {
+            if (DigitalRead(BNO_CALIB_STAT_ADDR, &calStat, 1) == BNO_READ_SUCCESS && calStat == 0xFF)
+                SaveCalibration();
+        }
+    }
+
+    if (!healthy && Recover())
+    {
+        now       = esp_timer_get_time();
+        downtime += now - failedAt;
+        healthy   = true;
+        cout << "BNO055 recovered after " << (now - failedAt) / 1000 << " ms, total downtime "
+             << downtime / 1000 << " ms" << endl;
+    }
+
+    return healthy;
+}
+
+//! \fn       Recover
+//! \memberof BnoModule
+//! \brief    Recover performs a minimal re-init of the imu without resetting it. The
+//!           shadowed config registers and calibration profile are written back, then
+//!           the last mode of operation is restored. If the imu was never configured
+//!           the full sequence is run instead.
+//! \return   <bool> for success or failure.
+//!
+bool BnoModule::Recover()
+{
+    map<bnoRegister, byte> config = shadow;
+    bnoOpmode              mode   = setupMode;
+    byte                   id     = {};
+
+    failures = 0;
+
+    if (!configured)                                        /*!< Setup never finished */
+        return Configure(setupMode);
+
+    if (config.count(BNO_OPR_MODE_ADDR) != 0)
+        mode = static_cast<bnoOpmode>(config[BNO_OPR_MODE_ADDR]);
+    shadow.clear();                                         /*!< The imu may have lost them, write everything */
+
+    DigitalWrite(BNO_PAGE_ID_ADDR, 0, 1);
+    if (DigitalRead(BNO_CHIP_ID_ADDR, &id, 1) != BNO_READ_SUCCESS || id != BNO_ID)
+        return false;
+
+    SetOprMode(OPMODE_CONFIG);
+
+    for (auto reg : {BNO_PWR_MODE_ADDR, BNO_UNIT_SEL_ADDR, BNO_TEMP_SOURCE_ADDR,
+                     BNO_AXIS_MAP_CONFIG_ADDR, BNO_AXIS_MAP_SIGN_ADDR})
+    {
+        if (config.count(reg) != 0)
+            DigitalWrite(reg, config[reg], 1);
+    }
+
+    if (hasCalib)
+        BurstWrite(ACCEL_OFFSET_X_LSB_ADDR, calib.data(), CALIB_SIZE);
+
+    SetOprMode(mode);
+
+    return failures == 0;
+}
+
+//! \fn       SaveCalibration
+//! \memberof BnoModule
+//! \brief    SaveCalibration reads the calibration profile of the imu into memory. The
+//!           offset registers are only readable in config mode, so the imu is switched
+//!           to config mode for the read and back afterwards.
+//! \return   <uerror> bnoStatus code.
+//!
+uerror BnoModule::SaveCalibration()
+{
+    bnoOpmode mode   = static_cast<bnoOpmode>(shadow[BNO_OPR_MODE_ADDR]);
+    uerror    result = {};
+
+    SetOprMode(OPMODE_CONFIG);
+    result   = DigitalRead(ACCEL_OFFSET_X_LSB_ADDR, calib.data(), CALIB_SIZE);
+    hasCalib = (result == BNO_READ_SUCCESS);
+    SetOprMode(mode);
+
+    if (hasCalib)
+        cout << "BNO055 calibration profile saved!" << endl;
 
-    DigitalRead(BNO_QUATERNION_DATA_W_LSB_ADDR, buffer, 8);
+    return result;
+}
+
+//! \fn       DecodeQuat
+//! \memberof BnoModule
+//! \brief    DecodeQuat takes the 8 bytes of the fusion mode quaternion registers
+//!           from a burst read, and creates a quaternion object from them.
+//! \param    <byte*> the quaternion bytes.
+//! \return   <Quaternion> the object.
+//!
+Quaternion BnoModule::DecodeQuat(byte *buffer)
+{
+    int16_t w(0), x(0), y(0), z(0);
 
     w = (((uint16_t)buffer[1]) << 8) | ((uint16_t)buffer[0]);
     x = (((uint16_t)buffer[3]) << 8) | ((uint16_t)buffer[2]);
@@ -155,24 +653,18 @@ Quaternion BnoModule::ReadQuat()
     return Quaternion(scale * w, scale * x, scale * y, scale * z);
 }
 
-//! \fn       ReadVector
+//! \fn       DecodeVector
 //! \memberof BnoModule
-//! \brief    ReadVector performs a read from the Bno055 IMU using the non-fusion mode
-//!           vector memory address specified by 'whichSensor' and reads 6 bytes into a 
-//!           buffer. A quaternion object, minus the scalar portion, is created and 
-//!           returned to the user.
-//! \param    <bnoVectorType> the sensor memory address.
-//! \return   <Quaternion*> an object pointer.
+//! \brief    DecodeVector takes the 6 bytes of the vector registers specified by
+//!           'whichSensor' from a burst read, and creates a quaternion object, minus
+//!           the scalar portion, from them.
+//! \param    <bnoVectorType> the sensor, <byte*> the vector bytes.
+//! \return   <Quaternion> the object.
 //!
-Quaternion BnoModule::ReadVector(bnoVectorType whichSensor)
+Quaternion BnoModule::DecodeVector(bnoVectorType whichSensor, byte *buffer)
 {
-    byte buffer[6];
-    ZeroMemory(buffer, 6);
-
     int16_t x(0), y(0), z(0);
 
-    DigitalRead(static_cast<bnoRegister>(whichSensor), buffer, 6);
-
     x = (((int16_t)buffer[1]) << 8) | ((int16_t)buffer[0]);
     y = (((int16_t)buffer[3]) << 8) | ((int16_t)buffer[2]);
     z = (((int16_t)buffer[5]) << 8) | ((int16_t)buffer[4]);
@@ -194,51 +686,13 @@ Quaternion BnoModule::ReadVector(bnoVectorType whichSensor)
         z = ((double)z)/100.0;
         break;
     case QUATERNION:
+    case TEMPERATURE:
         break;
     }
 
     return Quaternion(x, y, z);
 }
 
-//! \fn       SetAxisRemap
-//! \memberof BnoModule
-//! \brief    This function changes the axis mapping of the IMU, which could
-//!           be either the x, y, or z axis. Available configs are shifting 
-//!           each axis up or down one, or swapping one with another.
-//!           e.g. X=Y, Y=Z, Z=X; or X=Y, Y=X, Z=Z
-//! \param    <bnoAxisRemapConfig> the preset config
-//! \return   <uerror> UART error code
-//!
-uerror BnoModule::SetAxisRemap(bnoAxisRemapConfig config)
-{
-    uerror result = {};
-    result = DigitalWrite(BNO_AXIS_MAP_CONFIG_ADDR, static_cast<byte>(config), 1);
-    Pause(10);
-
-    return result;
-}
-
-//! \fn       SetAxisSign
-//! \memberof BnoModule
-//! \brief    This function changes the axis sign of the IMU, which could
-//!           be either the x, y, or z sign. The axis parameter indicates
-//!           which position in the register the value will be written. The
-//!           sign parameter is then shifted that many places to the left.
-//!           e.g. register mapping is bit2=X, bit1=Y, bit0=Z. To set X to
-//!           negative sign shift (1 << 2).
-//! \param    <bnoAxisRemapSign> the preset config
-//! \return   <uerror> UART error code
-//!
-uerror BnoModule::SetAxisSign(bnoAxisRemapSign sign, bnoAxis axis)
-{
-    uerror result = {};
-    byte   shift  = (sign << axis);
-    result = DigitalWrite(BNO_AXIS_MAP_SIGN_ADDR, shift, 1);
-    Pause(10);
-
-    return result;
-}
-
 //! \fn       SetPwrMode
 //! \memberof BnoModule
 //! \brief    This function sets the power mode of the BNO055 IMU. The options are 
@@ -258,14 +712,18 @@ uerror BnoModule::SetPwrMode(bnoPowermode mode)
 //! \memberof BnoModule
 //! \brief    This function sets the operating mode of the BNO055 IMU. The options are
 //!           config, accel only, mag only, gyro only, combined sensors, or fusion. See
-//!           defines.h for full list.
+//!           defines.h for full list. Only an actual change of mode waits, for the
+//!           switching time given in the datasheet.
 //! \param    <bnoOpmode> mode to set.
 //!
 uerror BnoModule::SetOprMode(bnoOpmode mode)
 {
     uerror result = {};
+    bool   change = (shadow.count(BNO_OPR_MODE_ADDR) == 0 || shadow[BNO_OPR_MODE_ADDR] != mode);
+
     result = DigitalWrite(BNO_OPR_MODE_ADDR, mode, 1);
-    Pause(30);
+    if (change && result == BNO_WRITE_SUCCESS)
+        Pause(mode == OPMODE_CONFIG ? BNO_CFG_SWITCH : BNO_OPR_SWITCH);
 
     return result;
 }
@@ -273,49 +731,18 @@ uerror BnoModule::SetOprMode(bnoOpmode mode)
 //! \fn       DigitalRead
 //! \memberof BnoModule
 //! \brief    This function takes the bno register address to be read from, as well as
-//!           a buffer to read data into, and sends the command to the IMU. If 'len' is 
-//!           only 1 a one-byte read will be performed, otherwise multi-byte.
+//!           a buffer to read data into, and passes the read to the transport. If 'len'
+//!           is only 1 a one-byte read will be performed, otherwise multi-byte. Failed
+//!           transactions are counted for the health monitor.
 //! \param    <bnoRegister> register, <byte> buffer and length.
-//! \return   <error> error code.
+//! \return   <uerror> bnoStatus code.
 //!
 uerror BnoModule::DigitalRead(bnoRegister reg, byte *buff, byte len)
 {
-    uerror result = {};
-    byte   cmd[4] = {};
-    byte   *data  = new byte[len + 2];
+    uerror result = bus->Read(reg, buff, len);
 
-    cmd[0] = 0xAA;
-    cmd[1] = 0x01;
-    cmd[2] = static_cast<byte>(reg);
-    cmd[3] = len;
-
-    for (int i = 0; i < UARTLOOPCOUNT; i++)
-    {
-        uart_flush(uaPort);
-        uart_write_bytes(uaPort, (const char *)cmd, 4);
-
-        if (uart_read_bytes(uaPort, data, len + 2, 20 / portTICK_PERIOD_MS) > 0)
-        {
-            switch (data[0])
-            {
-            case 0xBB:
-                CopyMemory(buff, data + 2, len);
-                result = data[0];
-                break;
-            case 0xEE:
-                result = data[1];
-                break;
-            }
-
-            if (CompareTo(result, {0xBB}))                        /*!< 0xBB means success */
-                break;
-            else if (CompareTo(result, {0x02, 0x06, 0x07, 0x0A})) /*!< Here there is maybe a serial issue */
-                continue;
-            else                                                  /*!< Everything else, an issue with the parameters */
-                break;
-        }
-    }
-    delete data;
+    failures = (result == BNO_READ_SUCCESS ? 0 : failures + 1);
+    errors  += (result == BNO_READ_SUCCESS ? 0 : 1);
 
     return result;
 }
@@ -323,41 +750,59 @@ uerror BnoModule::DigitalRead(bnoRegister reg, byte *buff, byte len)
 //! \fn       DigitalWrite
 //! \memberof BnoModule
 //! \brief    This function takes the bno register address to be written to, as well as
-//!           the value to write, and sends the command to the IMU.
+//!           the value to write, and passes the write to the transport. Successful writes
+//!           to config registers are shadowed so they can be restored by Recover, and
+//!           writing the value a shadowed register already holds is skipped.
 //! \param    <bnoRegister> register, <byte> value and length.
-//! \return   <error> error code.
+//! \return   <uerror> bnoStatus code.
 //!
 uerror BnoModule::DigitalWrite(bnoRegister reg, byte value, byte len)
 {
-    uerror result  = {};
-    byte   *cmd    = new byte[len + 4];
-    byte   resp[2] = {};
+    uerror result = {};
 
-    cmd[0] = 0xAA;
-    cmd[1] = 0x00;
-    cmd[2] = static_cast<byte>(reg);
-    cmd[3] = len;
-    CopyMemory(cmd + 4, &value, len);
+    if (shadow.count(reg) != 0 && shadow[reg] == value)
+        return BNO_WRITE_SUCCESS;
 
-    for (int i = 0; i < UARTLOOPCOUNT; i++)
-    {
-        uart_flush(uaPort);
-        uart_write_bytes(uaPort, (const char *)cmd, len + 4);
+    result = BurstWrite(reg, &value, len);
 
-        if (uart_read_bytes(uaPort, resp, 2, 20 / portTICK_PERIOD_MS) > 0)
-        {
-            result = resp[1];
-
-            if (CompareTo(result, {0x01}))                          /*!< 0x01 means success */
-                break;
-            else if (CompareTo(result, {0x03, 0x06, 0x07, 0x0A}))   /*!< Here there is maybe a serial issue */
-                continue;
-            else                                                    /*!< Everything else, an issue with the parameters */
-                break;
-        }
+    if (result == BNO_WRITE_SUCCESS && CompareTo(reg, {BNO_PAGE_ID_ADDR, BNO_OPR_MODE_ADDR,
+        BNO_PWR_MODE_ADDR, BNO_UNIT_SEL_ADDR, BNO_TEMP_SOURCE_ADDR, BNO_AXIS_MAP_CONFIG_ADDR,
+        BNO_AXIS_MAP_SIGN_ADDR}))
+    {
+        shadow[reg] = value;
     }
-    delete cmd;
 
     return result;
 }
 
+//! \fn       BurstWrite
+//! \memberof BnoModule
+//! \brief    This function writes 'len' bytes from a buffer to consecutive registers
+//!           starting at 'reg', e.g. the whole calibration profile in one transaction.
+//! \param    <bnoRegister> register, <byte> buffer and length.
+//! \return   <uerror> bnoStatus code.
+//!
+uerror BnoModule::BurstWrite(bnoRegister reg, byte *buff, byte len)
+{
+    uerror result = bus->Write(reg, buff, len);
+
+    failures = (result == BNO_WRITE_SUCCESS ? 0 : failures + 1);
+    errors  += (result == BNO_WRITE_SUCCESS ? 0 : 1);
+
+    return result;
+}
+
+//! \fn       GetNodeName
+//! \memberof BnoModule
+//! \brief    GetNodeName names the node after its location and device id, so several
+//!           sensors on one segment, or nodes of several suits, stay apart.
+//! \return   <string> e.g. "Chest-1000".
+//!
+string BnoModule::GetNodeName()
+{
+    ostringstream name;
+
+    name << GetLocation() << "-" << deviceId;
+
+    return name.str();
+}
@@ -9,44 +9,108 @@
 #pragma once
 #include "event.h"
 #include "sparkfun.h"
+#include "transport.h"
 
 
+//! \brief bnoCallback is called from the BnoModule owner task with the event that
+//!        completes a request, and the argument given when it was submitted.
+//!
+typedef void (*bnoCallback)(SensorEvent &e, void *arg);
+
+//! \brief bnoRequest is a single entry in one of the BnoModule request queues.
+//!
+typedef struct
+{
+    bnoVectorType type;
+    bnoCallback   done;
+    void          *arg;
+}bnoRequest;
+
+//! \brief bnoSaveRequest asks the BnoModule owner task for a warm state, 'done' is given
+//!        once the state is filled in.
+//!
+typedef struct
+{
+    bnoWarmState      *state;
+    SemaphoreHandle_t done;
+}bnoSaveRequest;
+
 //! \class BnoModule bno.h
 //! \brief The BnoModule class encapsulates the BNO055 inertia module, which contains 
 //!        three sensors: the accelerometer, gyroscope, and magnetometer. It can also 
 //!        take temperature readings. The class exposes several setup functions to the 
-//!        user, and a GetReading function, which returns a reading.
+//!        user, and a GetReading function, which returns a reading. After Start is
+//!        called the bus is owned by a single task serving queued requests, so any
+//!        number of tasks can read the imu without colliding.
 class BnoModule
 {
 public:
     BnoModule(){}
     BnoModule(uport p, line tx, line rx);
+    BnoModule(shared_ptr<BnoTransport> t);
     
-    bool         Setup     (bnoOpmode mode);
-    SensorEvent  GetReading(bnoVectorType typeOfData = QUATERNION);
+    bool         Setup      (bnoOpmode mode, bnoPowermode power = POWER_MODE_NORMAL);
+    bool         Resume     (const bnoWarmState &state);
+    void         SaveState  (bnoWarmState &state);
+    void         Start      ();
+    bool         Submit     (bnoVectorType type, bnoPriority priority, bnoCallback done, void *arg);
+    bool         Submit     (const vector<bnoVectorType> &types, bnoPriority priority, bnoCallback done, void *arg);
+    SensorEvent  GetReading (bnoVectorType typeOfData = QUATERNION);
 
     /*!< inline public methods */
-    bool         IsRoot    () { return deviceId == 1000; }
-    string       GetTest   () { return test; }
+    bool         IsRoot     () { return deviceId == 1000; }
+    bool         IsHealthy  () { return healthy; }
+    string       GetTest    () { return test; }
+    string       GetLocation() { return locationToString.at(static_cast<devLocation>(location)); }
+    string       GetNodeName();
+    string       GetStreams () { return streams; }
+    int64_t      GetDowntime() { return downtime; }
+    int          GetErrors  () { return errors; }
+    int64_t      GetInitTime() { return initTime; }
     /*!< inline public methods */
 
 private:
-    Quaternion   ReadQuat  ();
-    Quaternion   ReadVector(bnoVectorType whichSensor);
+    static void  OwnerThread(void *arg);
+    void         ServeRequests();
+    void         FillState  (bnoWarmState &state);
+    int          ServeBatch (bnoRequest *batch, int count);
+    bool         CheckHealth();
+    bool         Configure  (bnoOpmode mode);
+    bool         RunStep    (const bnoSetupStep &step);
+    bool         Recover    ();
+    uerror       SaveCalibration();
+    Quaternion   DecodeQuat  (byte *buffer);
+    Quaternion   DecodeVector(bnoVectorType whichSensor, byte *buffer);
 
-    uerror SetAxisRemap(bnoAxisRemapConfig config);
-    uerror SetAxisSign(bnoAxisRemapSign sign, bnoAxis axis);
     uerror SetPwrMode(bnoPowermode mode);
     uerror SetOprMode(bnoOpmode mode);
     uerror DigitalRead (bnoRegister reg, byte *buff, byte len);
     uerror DigitalWrite(bnoRegister reg, byte value, byte len);
+    uerror BurstWrite  (bnoRegister reg, byte *buff, byte len);
 
     /*<! Private Data Section */
     string      test;
+    string      streams;                        /*!< Optional StreamTable config from NVS */
     byte        location;
     word        deviceId;
-    line        txPin, rxPin;
-    uport       uaPort;
-    SensorEvent *event;
-};
+    shared_ptr<BnoTransport> bus;
 
+    /*<! Request queues, one per bnoPriority, served by the owner task */
+    QueueHandle_t             queue[PRIORITY_COUNT];
+    QueueHandle_t             saves;            /*!< bnoSaveRequests, served between batches */
+    TaskHandle_t              owner;
+
+    /*<! Health and recovery state */
+    map<bnoRegister, byte>    shadow;           /*!< Last value written to each config register */
+    array<byte, CALIB_SIZE>   calib;            /*!< Calibration profile, once fully calibrated */
+    bool                      hasCalib;
+    bool                      healthy;
+    int                       failures;         /*!< Consecutive failed bus transactions */
+    int                       errors;           /*!< Failed bus transactions since boot */
+    int64_t                   failedAt;         /*!< Tick the current outage started */
+    int64_t                   downtime;         /*!< Total time spent unhealthy in us */
+    int64_t                   initTime;         /*!< Duration of the last full setup in us */
+    bnoOpmode                 setupMode;        /*!< Mode requested in Setup */
+    bnoPowermode              setupPower;       /*!< Power mode requested in Setup */
+    bool                      configured;       /*!< Last full setup completed */
+};
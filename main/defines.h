@@ -18,26 +18,94 @@ typedef esp_err_t          error;
 typedef int8_t             sbyte;
 typedef gpio_num_t         line;
 typedef uart_port_t        uport;
+typedef i2c_port_t         i2cport;
 typedef array<byte, 6>     addr;
 typedef vector<string>     strings;
 typedef EventGroupHandle_t egHandle;
 typedef esp_timer_handle_t timerHandle;
 
-typedef vector<class SensorEvent> eventList;
-
 const string POST = "POST /createReading HTTP/1.1\r\n";     /*!< POST field, no further additions needed */
 const string HOST = "Host: \r\n";                           /*!< HOST field, insert ip:port at pos 6 */
 const string USER = "User-Agent: ESP32\r\n";                /*!< User-Agent, no further additions needed */
 const string TYPE = "Content-Type: application/json\r\n";   /*!< Content-Type, nothing further needed */
 const string LENG = "Content-Length: \r\n";                 /*!< Content-Length, insert length at pos 16 */
-const string CONN = "Connection: Closed\r\n";               /*!< Connection, nothing further needed */
+const string CONN = "Connection: keep-alive\r\n";           /*!< Connection, nothing further needed */
 const string NEWL = "\r\n";                                 /*!< newline for end of headers */
 
 const byte BNO_ADDRESS_A  = 0x28;
 const byte BNO_ADDRESS_B  = 0x29;
 const byte BNO_ID         = 0xA0;
 const int  UARTLOOPCOUNT  = 16;
+const int  UART_BAUD      = 115200;
+const int  UART_RX_TOUT   = 10;                             /*!< Idle symbols before the driver delivers rx data */
+const int  I2CLOOPCOUNT   = 4;
+const int  I2C_FREQ_HZ    = 400000;
+
+const int64_t UART_BYTE_NS = 10 * 1000000000LL / UART_BAUD; /*!< Start, 8 data, and stop bit */
+const int64_t I2C_BYTE_NS  = 9 * 1000000000LL / I2C_FREQ_HZ;/*!< 8 data bits and ack */
+
+const int  CALIB_SIZE     = 22;                             /*!< Offset and radius registers 0x55 - 0x6A */
+const int  HEALTH_PERIOD  = 1000;                           /*!< Health monitor period in ms */
+const int  HEALTH_FAILS   = 3;                              /*!< Consecutive failures before recovery */
+const int  BNO_RESET_TIME = 650;                            /*!< Max power on reset time in ms */
+const int  BNO_RUN_TIME   = 150;                            /*!< Max time for fusion to start in ms */
+const int  BNO_CFG_SWITCH = 19;                             /*!< Any mode to config mode in ms */
+const int  BNO_OPR_SWITCH = 7;                              /*!< Config mode to any mode in ms */
+const int  BNO_POLL       = 10;                             /*!< Status polling interval in ms */
+const int  BNO_QUEUE_SIZE = 8;                              /*!< Requests per priority queue */
+const int  BNO_BURST_SIZE = 0x2D;                           /*!< Data registers 0x08 - 0x34 */
+const int  MAX_RATE       = 100;                            /*!< Fusion output rate of the BNO055 in Hz */
+const int  DEFAULT_RATE   = 10;                             /*!< Rate of the NVS 'test' stream in Hz */
+const int  SCHED_SLACK    = 5000;                           /*!< Streams due this close (us) share a burst */
+const int  STILL_RATE     = 2;                              /*!< Rate of deadband streams while still in Hz */
+const int  STILL_TIME     = 2000;                           /*!< Time within deadband before still in ms */
+const int  DEADBAND_HOLD  = 1000;                           /*!< Max time between samples sent in ms */
 const int  HTTP_RESP_SIZE = 32;
+const int  BATCH_BYTES    = 6144;                           /*!< Max estimated json size of a batch */
+const int  EVENT_BYTES    = 128;                            /*!< Estimated json size of one event */
+const int  BATCH_MIN      = 10;                             /*!< Least events a batch holds */
+const int  BATCH_MAX      = BATCH_BYTES / EVENT_BYTES;      /*!< Most events a batch holds, within BATCH_BYTES */
+const int  BATCH_AGE      = 1000;                           /*!< Max age of a batch's first event in ms */
+const int  BATCH_AGE_MAX  = 10000;                          /*!< Longest batch interval the server may set */
+const int  BATCH_TICK     = 100;                            /*!< Batch age check interval in ms */
+const int  BATCH_REPORT   = 60;                             /*!< Batches posted between batch reports */
+const int  SLOW_DIVIDER   = 4;                              /*!< Optional streams slowed by, under pressure */
+const int  JSON_ITEM_SIZE = 256;                            /*!< Longest json array item of one event */
+const int  PAYLOAD_SIZE   = 8192;                           /*!< Initial capacity of the post payload */
+const int  BATCH_POOL     = 4;                              /*!< Batches shared by sampler and uplink */
+const int  MAX_INFLIGHT   = 3;                              /*!< Requests in flight on the connection */
+const int  UPLINK_POLL    = 20;                             /*!< Response polling interval in ms */
+const int  UPLINK_RETRY   = 1000;                           /*!< Wait before posting again after a failure in ms */
+const int  MESH_PAYLOAD   = 1280;                           /*!< Json bytes per leaf message, with its header under TX_SIZE */
+const int  MERGE_SIZE     = 1440;                           /*!< Bytes of a frame of merged child messages, under TX_SIZE */
+const int  LEAF_WINDOW    = 8;                              /*!< Leaf messages kept until acked */
+const int  FORWARD_DEPTH  = 32;                             /*!< Child messages held until the slot */
+const int  RETX_TIME      = 500;                            /*!< Ack slack before a leaf resends, in ms, see RetxTime */
+const int  FLEET_REPORT   = 10;                             /*!< Seconds between fleet stats reports */
+const int  SUPERFRAME     = 1000;                           /*!< Leaf transmit slots repeat every, in ms */
+const int  SLOT_GUARD     = 15;                             /*!< No transmit starts this close to the slot end, in ms */
+const int  SLOT_EXPIRE    = 5000;                           /*!< A leaf unheard, or a schedule not renewed, for, in ms */
+const int  RECV_TIMEOUT   = 5;                              /*!< Wait on a response for at most, in s */
+const int  MQTT_KEEPALIVE = 10;                             /*!< Broker keepalive in s */
+const int  MQTT_QUEUE     = 32;                             /*!< Broker events waiting on the uplink */
+const int  RTT_HIGH       = 800;                            /*!< Post round trip that signals congestion in ms */
+const int  RTT_LOW        = 300;                            /*!< Post round trip that allows recovery in ms */
+const int  ADAPT_TIME     = 2000;                           /*!< Least time between degradation steps in ms */
+const int  RECOVER_TIME   = 5000;                           /*!< Time without congestion per recovery step in ms */
+const int  DECIMATE_DIVIDER = 2;                            /*!< Stream rates divided by, once degraded */
+const int  FEATURE_RATE   = 2;                              /*!< Rate of the feature stream in Hz */
+const int  FULL_DIGITS    = 6;                              /*!< Significant digits of a full fidelity value */
+const int  COARSE_DIGITS  = 3;                              /*!< Significant digits of a coarse value */
+const int  PRIORITY_TIERS = 3;                              /*!< Location tiers, see locationToTier */
+const int  POWER_REPORT   = 60;                             /*!< Transmit windows between power reports */
+const int  CURRENT_WINDOW = 110000;                         /*!< Nominal esp32 current with the radio awake in uA */
+const int  CURRENT_IDLE   = 30000;                          /*!< Nominal esp32 current without power save in uA */
+const int  CURRENT_SAVE   = 4000;                           /*!< Light sleep with the radio in modem sleep in uA */
+const int  CURRENT_BNO    = 12300;                          /*!< BNO055 normal mode in uA */
+const int  CURRENT_BNO_LP = 400;                            /*!< BNO055 low power mode, mostly asleep, in uA */
+const int  WARM_STR_SIZE  = 64;                             /*!< Longest string kept for a warm start */
+const int  WARM_REGS      = 8;                              /*!< Shadow registers kept for a warm start */
+const uint32_t WARM_MAGIC = 0xB0055EED;
 
 const string NVS_PARTITION_NAME = "device_cfg";
 const string NVS_NSNAME_CONFIG  = "deviceConfig";
@@ -67,6 +135,14 @@ typedef enum {
     REST_SERVER_ERROR    = 0x0C
 }rerror;
 
+//! \enum Payload encodings the server can choose between. The compact encoding uses
+//!       short keys and bare numbers.
+//!
+typedef enum {
+    ENCODING_JSON,
+    ENCODING_COMPACT
+}restEncoding;
+
 //! \enum Wifi status indicating either connected, or disconnected.
 //!
 typedef enum {
@@ -74,6 +150,78 @@ typedef enum {
     WIFI_STATUS_DISCONNECTED
 }wifiStatus;
 
+//! \enum Wifi link profiles, trading current for latency. Realtime keeps the radio awake
+//!       with deep buffers, battery lets it sleep between batches on shallow ones.
+//!
+typedef enum {
+    WIFI_PROFILE_REALTIME,
+    WIFI_PROFILE_BATTERY
+}wifiProfile;
+
+//! \enum Mesh transmit lanes, each goes out before the ones after it. Control carries the
+//!       root's acks, responses and commands, real-time the live samples, and bulk the
+//!       backlog and retransmissions.
+//!
+typedef enum {
+    LANE_CONTROL,
+    LANE_REALTIME,
+    LANE_BULK,
+    LANE_COUNT
+}meshLane;
+
+//! \enum Bus status codes of the BNO055. These are the response bytes of the UART protocol,
+//!       the I2C transport maps its results onto the same values so the BnoModule doesn't
+//!       have to know which bus it is talking on.
+//!
+typedef enum {
+    BNO_WRITE_SUCCESS    = 0x01,
+    BNO_READ_FAIL        = 0x02,
+    BNO_WRITE_FAIL       = 0x03,
+    BNO_REGMAP_INVALID   = 0x04,
+    BNO_REGMAP_DISABLED  = 0x05,
+    BNO_WRONG_START_BYTE = 0x06,
+    BNO_BUS_OVERRUN      = 0x07,
+    BNO_MAX_LENGTH       = 0x08,
+    BNO_MIN_LENGTH       = 0x09,
+    BNO_RECEIVE_TIMEOUT  = 0x0A,
+    BNO_READ_SUCCESS     = 0xBB
+}bnoStatus;
+
+//! \enum Priority of a request to the BnoModule owner task. Requests are served from
+//!       the highest priority queue first.
+//!
+typedef enum {
+    PRIORITY_HIGH,                                          /*!< Server requested reads */
+    PRIORITY_NORMAL,                                        /*!< Periodic sampler */
+    PRIORITY_COUNT
+}bnoPriority;
+
+//! \enum Watermark that closed a batch and handed it to the uplink.
+//!
+typedef enum {
+    TRIGGER_AGE,                                            /*!< First event older than BATCH_AGE */
+    TRIGGER_FULL,                                           /*!< Capacity reached */
+    TRIGGER_COUNT
+}batchTrigger;
+
+//! \enum Fidelity of a node's streams, lowered step by step while the uplink is congested.
+//!
+typedef enum {
+    FIDELITY_FULL,
+    FIDELITY_DECIMATED,                                     /*!< Rates divided by DECIMATE_DIVIDER */
+    FIDELITY_COARSE,                                        /*!< Decimated, values to COARSE_DIGITS */
+    FIDELITY_FEATURES                                       /*!< Coarse orientation only, at FEATURE_RATE */
+}streamFidelity;
+
+//! \enum Backpressure from the uplink, applied to the optional streams. Mandatory streams
+//!       are never slowed, their events are only dropped once no batch is free.
+//!
+typedef enum {
+    PRESSURE_NONE,
+    PRESSURE_SLOW,                                          /*!< Optional streams at 1/SLOW_DIVIDER rate */
+    PRESSURE_SHED                                           /*!< Optional streams not sampled */
+}streamPressure;
+
 //! \brief Register addresses of the BNO055
 //!
 typedef enum
@@ -169,6 +317,19 @@ typedef enum
     MAG_RADIUS_MSB_ADDR              = 0X6A
 }bnoRegister;
 
+//! \brief bnoSysStatus enumerates the values of the BNO_SYS_STAT_ADDR register.
+//!
+typedef enum
+{
+    SYS_STATUS_IDLE         = 0x00,
+    SYS_STATUS_ERROR        = 0x01,
+    SYS_STATUS_PERIPHERALS  = 0x02,
+    SYS_STATUS_INIT         = 0x03,
+    SYS_STATUS_SELFTEST     = 0x04,
+    SYS_STATUS_FUSION       = 0x05,
+    SYS_STATUS_NO_FUSION    = 0x06
+}bnoSysStatus;
+
 typedef enum
 {
     POWER_MODE_NORMAL   = 0X00,
@@ -193,16 +354,6 @@ typedef enum
     OPMODE_NDOF         = 0X0C
 }bnoOpmode;
 
-//! \brief bnoAxis allows the SetAxisSign function to specify which axis'
-//!        sign is being set, either positive or negative.
-//!
-typedef enum
-{
-    Z = 0x00,
-    Y = 0x01,
-    X = 0x02
-}bnoAxis;
-
 //! \brief bnoAxisRemapConfig allows the SetAxisRemap function to specify
 //!        which configuration to apply to all three axes. Either linear shift
 //!        left or right (e.g. x=z, y=x, z=y) or swapping two individual axes.
@@ -216,15 +367,6 @@ typedef enum
     REMAP_SWITCH_ZX     = 0X06
 }bnoAxisRemapConfig;
 
-//! \brief bnoAxisRemapSign enumerates the two possible signs for an axis to be
-//!        set to, positive or negative.
-//!
-typedef enum
-{
-    REMAP_AXIS_POSITIVE = 0x00,
-    REMAP_AXIS_NEGATIVE = 0x01
-}bnoAxisRemapSign;
-
 //! \brief Location refers to the position on the body where the sensor is
 //!        placed. 0x00 is the chest and acts as superpeer to the remaining
 //!        sensors. All sensors on the right side of the body are odd numbers
@@ -251,7 +393,8 @@ typedef enum
     EULER               = BNO_EULER_H_LSB_ADDR,
     QUATERNION          = BNO_QUATERNION_DATA_W_LSB_ADDR,
     LINEARACCEL         = BNO_LINEAR_ACCEL_DATA_X_LSB_ADDR,
-    GRAVITY             = BNO_GRAVITY_DATA_X_LSB_ADDR
+    GRAVITY             = BNO_GRAVITY_DATA_X_LSB_ADDR,
+    TEMPERATURE         = BNO_TEMP_ADDR
 }bnoVectorType;
 
 
@@ -266,8 +409,10 @@ const map<bnoVectorType, string> vectorToString = {
     {MAGNETOMETER,  "Mag"},
     {GYROSCOPE,     "Gyro"},
     {EULER,         "Euler"},
+    {QUATERNION,    "Quaternion"},
     {LINEARACCEL,   "LinearAccel"},
-    {GRAVITY,       "Gravity"}
+    {GRAVITY,       "Gravity"},
+    {TEMPERATURE,   "Temp"}
 };
 
 const map<string, bnoVectorType> stringToVector = {
@@ -277,7 +422,22 @@ const map<string, bnoVectorType> stringToVector = {
     {"Euler",       EULER},
     {"Quaternion",  QUATERNION},
     {"LinearAccel", LINEARACCEL},
-    {"Gravity",     GRAVITY}
+    {"Gravity",     GRAVITY},
+    {"Temp",        TEMPERATURE}
+};
+
+//! \brief Const map of vector types to the number of data register
+//!        bytes each one occupies.
+//!
+const map<bnoVectorType, byte> vectorToLength = {
+    {ACCELEROMETER, 6},
+    {MAGNETOMETER,  6},
+    {GYROSCOPE,     6},
+    {EULER,         6},
+    {QUATERNION,    8},
+    {LINEARACCEL,   6},
+    {GRAVITY,       6},
+    {TEMPERATURE,   1}
 };
 
 const map<devLocation, string> locationToString = {
@@ -292,6 +452,156 @@ const map<devLocation, string> locationToString = {
     {locLeftShin,      "LeftShin"}
 };
 
+//! \brief Const map of locations to their priority tier, 0 is degraded last. The chest and
+//!        thighs anchor the whole body pose, the limbs further out are degraded first.
+//!
+const map<devLocation, int> locationToTier = {
+    {locChest,         0},
+    {locRightThigh,    0},
+    {locLeftThigh,     0},
+    {locRightArmUpper, 1},
+    {locLeftArmUpper,  1},
+    {locRightArmLower, 2},
+    {locLeftArmLower,  2},
+    {locRightShin,     2},
+    {locLeftShin,      2}
+};
+
+//! \brief Const map of the "Encoding" values of a server response to payload encodings.
+//!
+const map<string, restEncoding> stringToEncoding = {
+    {"json",    ENCODING_JSON},
+    {"compact", ENCODING_COMPACT}
+};
+
+//! \brief wifiProfileConfig holds the radio settings of a link profile. The buffer counts
+//!        and AMPDU go into the wifi init config, the rest is applied once the radio started.
+//!
+typedef struct
+{
+    const char    *name;
+    wifi_ps_type_t sleep;                       /*!< Modem sleep outside of batch windows */
+    int            staticRxBuf;
+    int            dynamicRxBuf;
+    int            dynamicTxBuf;
+    bool           ampdu;                       /*!< Aggregation, rx and tx */
+    int8_t         txPower;                     /*!< In 0.25 dBm */
+    int            backoffMin;                  /*!< First reconnect delay, in ms */
+    int            backoffMax;                  /*!< Longest reconnect delay, in ms */
+}wifiProfileConfig;
+
+//! \brief Const map of link profiles to their radio settings.
+//!
+const map<wifiProfile, wifiProfileConfig> profileToConfig = {
+    {WIFI_PROFILE_REALTIME, {"realtime", WIFI_PS_NONE,      16, 64, 64, true,  78,  100,  2000}},
+    {WIFI_PROFILE_BATTERY,  {"battery",  WIFI_PS_MIN_MODEM,  6, 16, 16, false, 52, 1000, 30000}}
+};
+
+//! \brief Const map of the "profile" values of the net config to link profiles.
+//!
+const map<string, wifiProfile> stringToProfile = {
+    {"realtime", WIFI_PROFILE_REALTIME},
+    {"battery",  WIFI_PROFILE_BATTERY}
+};
+
+//! \brief nodeStats is the link and health block a leaf piggybacks on its batches, and the
+//!        root keeps per location.
+//!
+typedef struct
+{
+    int           rssi;                         /*!< Of the mesh parent, in dBm */
+    int           layer;
+    int           queue;                        /*!< Messages or requests in flight */
+    int           drops;                        /*!< Events and messages dropped since boot */
+    int           resent;                       /*!< Messages resent since boot */
+    int           meshErrors;
+    int           busErrors;                    /*!< Failed UART or I2C transactions */
+    uint32_t      heap;                         /*!< Free heap in bytes */
+    int           latency;                      /*!< Real-time lane queueing in ms */
+    int           profile;                      /*!< wifiProfile of the link */
+    int           rtt;                          /*!< Send to ack or response, in ms */
+    int           goodput;                      /*!< Bytes acked or posted per second */
+    int           reconnects;                   /*!< Link outages since boot */
+    int           outage;                       /*!< Length of the last outage, in ms */
+    int64_t       seenAt;                       /*!< Tick the root last heard of it */
+}nodeStats;
+
+//! \brief bnoAxisMap holds the axis remap config and sign register values for one
+//!        location. Sign bits are bit2=X, bit1=Y, bit0=Z, set for a negative axis.
+//!
+typedef struct
+{
+    bnoAxisRemapConfig remap;
+    byte               sign;
+}bnoAxisMap;
+
+//! \brief Const map of locations to their axis mapping. Right side sensors only
+//!        shift the axes, left side sensors also flip X and Y.
+//!
+const map<devLocation, bnoAxisMap> locationToAxisMap = {
+    {locChest,         {REMAP_SWITCH_YZ,  0x04}},
+    {locRightArmUpper, {REMAP_SHIFT_LEFT, 0x00}},
+    {locLeftArmUpper,  {REMAP_SHIFT_LEFT, 0x06}},
+    {locRightArmLower, {REMAP_SHIFT_LEFT, 0x00}},
+    {locLeftArmLower,  {REMAP_SHIFT_LEFT, 0x06}},
+    {locRightThigh,    {REMAP_SHIFT_LEFT, 0x00}},
+    {locLeftThigh,     {REMAP_SHIFT_LEFT, 0x06}},
+    {locRightShin,     {REMAP_SHIFT_LEFT, 0x00}},
+    {locLeftShin,      {REMAP_SHIFT_LEFT, 0x06}}
+};
+
+//! \brief Const map of the shadowed registers to their values after a reset.
+//!
+const map<bnoRegister, byte> resetDefaults = {
+    {BNO_PAGE_ID_ADDR,         0x00},
+    {BNO_OPR_MODE_ADDR,        OPMODE_CONFIG},
+    {BNO_PWR_MODE_ADDR,        POWER_MODE_NORMAL},
+    {BNO_AXIS_MAP_CONFIG_ADDR, 0x24},
+    {BNO_AXIS_MAP_SIGN_ADDR,   0x00}
+};
+
+//! \enum What a setup step waits for once its register is written.
+//!
+typedef enum {
+    WAIT_NONE,
+    WAIT_RESET,                                             /*!< Poll the chip id until the imu is back */
+    WAIT_RUNNING                                            /*!< Poll the system status until it's running */
+}bnoStepWait;
+
+//! \brief bnoSetupStep is a single register write in the BNO055 setup program.
+//!
+typedef struct
+{
+    bnoRegister reg;
+    byte        value;
+    bnoStepWait wait;
+}bnoSetupStep;
+
+//! \brief bnoWarmState is everything a node needs to resume streaming after deep sleep
+//!        without reading NVS or setting up the imu again. It is kept in RTC slow memory,
+//!        so it only holds fixed size fields, and 'crc' covers every field before it.
+//!
+typedef struct
+{
+    uint32_t magic;
+    byte     location;
+    word     deviceId;
+    char     test[WARM_STR_SIZE];
+    char     streams[WARM_STR_SIZE * 2];
+    char     ssid[WARM_STR_SIZE];
+    char     pwd[WARM_STR_SIZE];
+    char     srv[WARM_STR_SIZE];
+    char     port[8];
+    char     meshId[16];
+    char     profile[16];
+    byte     setupMode;
+    byte     regCount;
+    byte     regs[WARM_REGS][2];                            /*!< Shadowed register and its value */
+    byte     hasCalib;
+    byte     calib[CALIB_SIZE];
+    uint32_t crc;
+}bnoWarmState;
+
 typedef struct
 {
     uint8_t  accelRev;
@@ -310,9 +620,11 @@ typedef struct
 class Quaternion
 {
 public:
-    Quaternion(){}
+    Quaternion() { 
+        w = 0; x = 0; y = 0; z = 0; isQuaternion = false;
+    }
     Quaternion(double _x, double _y, double _z) { 
-        x = _x; y = _y; z = _z; isQuaternion = false;
+        w = 0; x = _x; y = _y; z = _z; isQuaternion = false;
     }
     Quaternion(double _w, double _x, double _y, double _z) { 
         w = _w; x = _x; y = _y; z = _z; isQuaternion = true;
@@ -321,11 +633,11 @@ public:
         w = q.w; x = q.x; y = q.y; z = q.z; isQuaternion = q.isQuaternion;
     }
     
-    bool   IsQuaternion() { return isQuaternion; }
-    double GetEventW()    { return w; }
-    double GetEventX()    { return x; }
-    double GetEventY()    { return y; }
-    double GetEventZ()    { return z; }
+    bool   IsQuaternion() const { return isQuaternion; }
+    double GetEventW()    const { return w; }
+    double GetEventX()    const { return x; }
+    double GetEventY()    const { return y; }
+    double GetEventZ()    const { return z; }
     
 private:
     double w, x, y, z;
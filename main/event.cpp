@@ -15,7 +15,13 @@
 //!
 SensorEvent::SensorEvent()
 {
-    ticks = esp_timer_get_time();
+    type        = QUATERNION;
+    loc         = locChest;
+    ticks       = esp_timer_get_time();
+    uncertainty = 0;
+    valid       = false;
+    skipped     = 0;
+    rate        = 0;
 }
 // SensorEvent::SensorEvent(Quaternion* q, string n, devLocation l)
 // {
@@ -32,10 +38,14 @@ SensorEvent::SensorEvent()
 //!
 SensorEvent::SensorEvent(const SensorEvent& s)
 {
-    name  = s.name;
+    type  = s.type;
     loc   = s.loc;
-    ticks = s.ticks;
-    obj   = s.obj;
+    ticks       = s.ticks;
+    uncertainty = s.uncertainty;
+    obj         = s.obj;
+    valid       = s.valid;
+    skipped     = s.skipped;
+    rate        = s.rate;
 }
 
 //! \memberof SensorEvent
@@ -22,19 +22,31 @@ public:
     SensorEvent(const SensorEvent&);
     ~SensorEvent();
 
-    Quaternion& GetObject()   { return obj; }
-    string      GetName()     { return name; }
-    string      GetLocation() { return locationToString.at(loc); }
-    int64_t     GetTicks()    { return ticks; }
+    const Quaternion&   GetObject()      const { return obj; }
+    bnoVectorType       GetType()        const { return type; }
+    const string&       GetName()        const { return vectorToString.at(type); }
+    const string&       GetLocation()    const { return locationToString.at(loc); }
+    int64_t             GetTicks()       const { return ticks; }
+    int64_t             GetUncertainty() const { return uncertainty; }
+    int                 GetSkipped()     const { return skipped; }
+    int                 GetRate()        const { return rate; }
+    bool                IsValid()        const { return valid; }
 
-    void        SetObj(Quaternion o) { obj = o; }
-    void        SetName(string n)    { name = n; }
-    void        SetLocation(byte l)  { loc = static_cast<devLocation>(l); }
+    void        SetObj(Quaternion o)           { obj = o; }
+    void        SetType(bnoVectorType t)       { type = t; }
+    void        SetLocation(byte l)            { loc = static_cast<devLocation>(l); }
+    void        SetValid(bool v)               { valid = v; }
+    void        SetTicks(int64_t t, int64_t u) { ticks = t; uncertainty = u; }
+    void        SetSkipped(int s, int r)       { skipped = s; rate = r; }
 
 private:
     Quaternion  obj;                    /*!< Sensor object, either vector or quaternion */
-    string      name;                   /*!< Json name for post'ing to server */
+    bnoVectorType type;                 /*!< Sensor, its json name is vectorToString */
     devLocation loc;
-    int64_t     ticks;
+    int64_t     ticks;                  /*!< Estimated sample time in us */
+    int64_t     uncertainty;            /*!< +/- bound on ticks in us */
+    bool        valid;                  /*!< False if the imu read failed */
+    int         skipped;                /*!< Samples suppressed by the deadband since the last one sent */
+    int         rate;                   /*!< Stream rate in Hz when sampled, 0 for on demand reads */
 };
 
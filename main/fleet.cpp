@@ -0,0 +1,131 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  fleet.cpp
+//! \brief This source contains the implementation of the FleetMonitor class, which keeps the
+//!        link and health stats of every node of the suit at the root.
+//!
+//!
+#include "fleet.h"
+
+
+//! \fn       Format
+//! \memberof FleetMonitor
+//! \brief    Format writes the stats as colon separated numbers, in the order of the
+//!           nodeStats fields, without seenAt.
+//! \param    <nodeStats> the stats.
+//! \return   <string> the compact stats.
+//!
+string FleetMonitor::Format(const nodeStats &s)
+{
+    char text[128];
+
+    snprintf(text, sizeof(text), "%d:%d:%d:%d:%d:%d:%d:%u:%d:%d:%d:%d:%d:%d", s.rssi, s.layer, s.queue,
+             s.drops, s.resent, s.meshErrors, s.busErrors, (unsigned)s.heap, s.latency, s.profile, s.rtt,
+             s.goodput, s.reconnects, s.outage);
+
+    return text;
+}
+
+//! \fn       Parse
+//! \memberof FleetMonitor
+//! \brief    Parse reads stats written by Format. Leaves from before the link fields were
+//!           added send the first 9 numbers only, the link fields of those are left 0.
+//! \param    <string> the compact stats, <nodeStats> the stats read.
+//! \return   <bool> false if the stats were malformed.
+//!
+bool FleetMonitor::Parse(const string &text, nodeStats &s)
+{
+    unsigned heap   = {};
+    int      fields = {};
+
+    s = {};
+    fields = sscanf(text.c_str(), "%d:%d:%d:%d:%d:%d:%d:%u:%d:%d:%d:%d:%d:%d", &s.rssi, &s.layer, &s.queue,
+                    &s.drops, &s.resent, &s.meshErrors, &s.busErrors, &heap, &s.latency, &s.profile, &s.rtt,
+                    &s.goodput, &s.reconnects, &s.outage);
+    if (fields != 9 && fields != 14)
+        return false;
+    if (!profileToConfig.count(static_cast<wifiProfile>(s.profile)))
+        s.profile = WIFI_PROFILE_REALTIME;
+
+    s.heap   = heap;
+    s.seenAt = esp_timer_get_time();
+
+    return true;
+}
+
+//! \fn       Update
+//! \memberof FleetMonitor
+//! \brief    Update keeps the latest stats of a node.
+//! \param    <string> the node name, <nodeStats> its stats.
+//!
+void FleetMonitor::Update(const string &node, const nodeStats &s)
+{
+    nodes[node]        = s;
+    nodes[node].seenAt = esp_timer_get_time();
+}
+
+//! \fn       Due
+//! \memberof FleetMonitor
+//! \brief    Due tells whether a report is due, and starts the next period if so.
+//! \return   <bool> true every FLEET_REPORT seconds.
+//!
+bool FleetMonitor::Due()
+{
+    int64_t now = esp_timer_get_time();
+
+    if (now - reportedAt < FLEET_REPORT * 1000000LL)
+        return false;
+
+    reportedAt = now;
+    return true;
+}
+
+//! \fn       AppendJson
+//! \memberof FleetMonitor
+//! \brief    AppendJson formats the stats of every node as a json array item.
+//! \param    <strings> the json array items to append to.
+//!
+void FleetMonitor::AppendJson(strings &items)
+{
+    char    item[2 * JSON_ITEM_SIZE];                       /*!< Longer than the item of an event */
+    int64_t now = esp_timer_get_time();
+
+    for (auto &node : nodes)
+    {
+        const nodeStats &s = node.second;
+
+        snprintf(item, sizeof(item),
+            "\t\t{\"type\":\"Stats\", \"node\":\"%s\", \"age\":\"%lld\", \"rssi\":\"%d\", \"layer\":\"%d\", "
+            "\"queue\":\"%d\", \"drops\":\"%d\", \"resent\":\"%d\", \"meshErr\":\"%d\", \"busErr\":\"%d\", "
+            "\"heap\":\"%u\", \"latency\":\"%d\", \"profile\":\"%s\", \"rtt\":\"%d\", \"goodput\":\"%d\", "
+            "\"reconnects\":\"%d\", \"outage\":\"%d\"}",
+            node.first.c_str(), (long long)((now - s.seenAt) / 1000), s.rssi, s.layer, s.queue, s.drops,
+            s.resent, s.meshErrors, s.busErrors, (unsigned)s.heap, s.latency,
+            profileToConfig.at(static_cast<wifiProfile>(s.profile)).name, s.rtt, s.goodput, s.reconnects,
+            s.outage);
+        items.push_back(item);
+    }
+}
+
+//! \fn       ToString
+//! \memberof FleetMonitor
+//! \brief    ToString formats the stats of every node for the log, one per line.
+//! \return   <string> the stats.
+//!
+string FleetMonitor::ToString()
+{
+    ostringstream out;
+
+    for (auto &node : nodes)
+    {
+        const nodeStats &s = node.second;
+
+        out << "  " << node.first << ": rssi " << s.rssi << " dBm, layer " << s.layer << ", queue "
+            << s.queue << ", drops " << s.drops << ", resent " << s.resent << ", mesh errors "
+            << s.meshErrors << ", bus errors " << s.busErrors << ", heap " << s.heap << ", latency "
+            << s.latency << " ms, profile " << profileToConfig.at(static_cast<wifiProfile>(s.profile)).name
+            << ", rtt " << s.rtt << " ms, goodput " << s.goodput << " B/s, reconnects " << s.reconnects
+            << ", last outage " << s.outage << " ms" << endl;
+    }
+
+    return out.str();
+}
@@ -0,0 +1,35 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  fleet.h
+//! \brief This header contains the definition of the FleetMonitor class, which keeps the link
+//!        and health stats of every node of the suit at the root.
+//!
+//!
+#pragma once
+#include "defines.h"
+#include "templates.h"
+
+
+//! \class FleetMonitor fleet.h
+//! \brief The FleetMonitor class keeps the latest nodeStats of each node. Leaves send
+//!        theirs in the "Stats" header of the first message of every batch, in the compact
+//!        form of Format, and the root adds its own. Every FLEET_REPORT seconds the root
+//!        logs them, and posts them along with its batch as json array items of type
+//!        "Stats", so the backend can spot the node dragging the suit down.
+//!
+class FleetMonitor
+{
+public:
+    FleetMonitor(){}
+
+    static string Format(const nodeStats &s);
+    static bool   Parse (const string &text, nodeStats &s);
+
+    void          Update    (const string &node, const nodeStats &s);
+    bool          Due       ();
+    void          AppendJson(strings &items);
+    string        ToString  ();
+
+private:
+    map<string, nodeStats> nodes;               /*!< By node name */
+    int64_t       reportedAt = 0;
+};
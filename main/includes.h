@@ -7,9 +7,14 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstddef>
 #include <deque>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <mutex>
 #include <numeric>
 #include <sstream>
@@ -18,13 +23,22 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "driver/i2c.h"
 #include "driver/uart.h"
+#include "esp_attr.h"
 #include "esp_event_loop.h"
 #include "esp_log.h"
 #include "esp_mesh.h"
+#include "esp_pm.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
 #include "esp_wifi.h"
+#include "mqtt_client.h"
 #include "nvs_flash.h"
 #include "lwip/sockets.h"
+#include "rom/crc.h"
 
 using std::accumulate;
 using std::array;
@@ -37,11 +51,19 @@ using std::endl;
 using std::equal;
 using std::fill;
 using std::flush;
+using std::find_if;
 using std::for_each;
+using std::getline;
 using std::initializer_list;
+using std::istringstream;
+using std::make_shared;
 using std::map;
+using std::max;
+using std::min;
 using std::mutex;
 using std::ostringstream;
+using std::shared_ptr;
 using std::string;
+using std::swap;
 using std::vector;
 
@@ -0,0 +1,138 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  link.cpp
+//! \brief This source contains the implementation of the LinkMonitor class, which measures
+//!        the root's uplink and decides how far the suit's streams are degraded.
+//!
+//!
+#include "link.h"
+
+
+//! \fn       OnSent
+//! \memberof LinkMonitor
+//! \brief    OnSent starts timing a post. Responses arrive in the order posts were sent.
+//! \param    <int> bytes posted.
+//!
+void LinkMonitor::OnSent(int bytes)
+{
+    inflight.push_back({ esp_timer_get_time(), bytes });
+}
+
+//! \fn       OnResponse
+//! \memberof LinkMonitor
+//! \brief    OnResponse stops timing the oldest post, and adds it to the averages. The
+//!           averages weigh each new sample by 1/4.
+//!
+void LinkMonitor::OnResponse()
+{
+    int64_t now     = esp_timer_get_time();
+    int64_t elapsed = {};
+
+    if (inflight.empty())
+        return;
+
+    elapsed = now - inflight.front().first;
+    rtt     = (rtt == 0 ? elapsed : (3 * rtt + elapsed) / 4);
+
+    if (ackedAt > 0 && now > ackedAt)
+        goodput = (3 * goodput + inflight.front().second * 1000000LL / (now - ackedAt)) / 4;
+
+    ackedAt = now;
+    inflight.pop_front();
+}
+
+//! \fn       OnFailure
+//! \memberof LinkMonitor
+//! \brief    OnFailure counts a failed post. The posts in flight are sent again on the
+//!           next connection, so their timing is dropped, and starts over then.
+//!
+void LinkMonitor::OnFailure()
+{
+    failures++;
+    inflight.clear();
+}
+
+//! \fn       Adapt
+//! \memberof LinkMonitor
+//! \brief    Adapt steps the degradation level up or down from the current averages.
+//! \param    <bool> true if every request slot is in use.
+//! \return   <bool> true if the level changed.
+//!
+bool LinkMonitor::Adapt(bool saturated)
+{
+    int64_t now       = esp_timer_get_time();
+    int     highest   = PRIORITY_TIERS * FIDELITY_FEATURES;
+    bool    congested = (rtt > RTT_HIGH * 1000 || failures > 0 || saturated);
+    int     previous  = level;
+
+    failures = 0;
+
+    if (congested)
+    {
+        calmSince = now;
+        if (level < highest && now - steppedAt >= ADAPT_TIME * 1000)
+            level++;
+    }else if (rtt < RTT_LOW * 1000 && level > 0 && now - calmSince >= RECOVER_TIME * 1000 &&
+              now - steppedAt >= RECOVER_TIME * 1000) {
+        level--;
+    }
+
+    if (level == previous)
+        return false;
+
+    steppedAt = now;
+    cout << "Uplink " << (level > previous ? "congested" : "recovering") << ", " << ToString() << endl;
+
+    return true;
+}
+
+//! \fn       Fidelity
+//! \memberof LinkMonitor
+//! \brief    Fidelity returns the fidelity of a location at a degradation level. The
+//!           level is spent on the lowest priority tier first, each tier takes up to
+//!           FIDELITY_FEATURES steps before the next one is touched.
+//! \param    <int> the level, <devLocation> the location.
+//! \return   <streamFidelity> the fidelity.
+//!
+streamFidelity LinkMonitor::Fidelity(int level, devLocation location)
+{
+    int remaining = level;
+
+    for (int tier = PRIORITY_TIERS - 1; tier > locationToTier.at(location); tier--)
+        remaining -= min<int>(remaining, FIDELITY_FEATURES);
+
+    return static_cast<streamFidelity>(min<int>(remaining, FIDELITY_FEATURES));
+}
+
+//! \fn       Commands
+//! \memberof LinkMonitor
+//! \brief    Commands formats the fidelity of every location as "Fidelity" response
+//!           fields, so the root can add them to the response it relays to the leaves.
+//! \return   <string> the fields.
+//!
+string LinkMonitor::Commands()
+{
+    string out = {};
+
+    for (auto &location : locationToString)
+    {
+        out += "Fidelity: " + location.second + ":";
+        out += static_cast<char>('0' + Fidelity(level, location.first));
+        out += "\r\n";
+    }
+
+    return out;
+}
+
+//! \fn       ToString
+//! \memberof LinkMonitor
+//! \brief    ToString formats the averages and level for the log.
+//! \return   <string> the link state.
+//!
+string LinkMonitor::ToString()
+{
+    ostringstream out;
+
+    out << "rtt " << rtt / 1000 << " ms, goodput " << goodput << " B/s, level " << level;
+
+    return out.str();
+}
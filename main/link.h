@@ -0,0 +1,50 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  link.h
+//! \brief This header contains the definition of the LinkMonitor class, which measures the
+//!        root's uplink to the server and decides how far the suit's streams are degraded.
+//!
+//!
+#pragma once
+#include "defines.h"
+#include "templates.h"
+
+
+//! \class LinkMonitor link.h
+//! \brief The LinkMonitor class times every post from send to response, and keeps moving
+//!        averages of the round trip time and the goodput, the bytes per second the server
+//!        actually acknowledged. While the uplink is congested, the round trip is over
+//!        RTT_HIGH, a post failed, or every request slot is taken, the degradation level
+//!        goes up a step every ADAPT_TIME. Once the round trip is back under RTT_LOW it
+//!        goes down a step every RECOVER_TIME. Each step lowers the fidelity of one tier
+//!        of locations by one, the lowest priority tier first, see locationToTier.
+//!
+class LinkMonitor
+{
+public:
+    LinkMonitor(){}
+
+    void         OnSent    (int bytes);
+    void         OnResponse();
+    void         OnFailure ();
+    bool         Adapt     (bool saturated);
+    string       Commands  ();
+    string       ToString  ();
+
+    /*!< inline public methods */
+    int          GetLevel  () { return level; }
+    int64_t      GetRtt    () { return rtt; }
+    int64_t      GetGoodput() { return goodput; }
+    /*!< inline public methods */
+
+    static streamFidelity Fidelity(int level, devLocation location);
+
+private:
+    deque<std::pair<int64_t, int>> inflight;    /*!< Send tick and size of each post in flight */
+    int64_t      rtt       = 0;                 /*!< Moving average in us */
+    int64_t      goodput   = 0;                 /*!< Moving average in bytes per second */
+    int64_t      ackedAt   = 0;                 /*!< Tick of the last response */
+    int64_t      steppedAt = 0;                 /*!< Tick of the last level change */
+    int64_t      calmSince = 0;                 /*!< Tick congestion was last seen */
+    int          failures  = 0;                 /*!< Failed posts since the last Adapt */
+    int          level     = 0;
+};
@@ -4,7 +4,10 @@
 //!
 //!
 #include "bno.h"
+#include "power.h"
 #include "rest.h"
+#include "stream.h"
+#include "uplink.h"
 
 
 //! -------------------------------------------------------------------------------------------- //
@@ -14,26 +17,51 @@
 //! \brief Function Prototypes
 //!
 void PostDataAsyncThread (void *arg);
+void BufferEvent         (SensorEvent &e, void *arg);
+void QueueEvent          (const SensorEvent &e);
+EventBatch *TakeBatch    ();
+int  BatchCapacity       ();
+int  BatchInterval       ();
 void ParseRestError      (rerror r);
 bool Setup               ();
-void CheckBuffer         (int i);
+void DeepSleep           (uint32_t seconds);
 
 //! \brief Constants
 //!
-const line BNO_TX = static_cast<line>(21);
-const line BNO_RX = static_cast<line>(22);
+const line BNO_TX  = static_cast<line>(21);
+const line BNO_RX  = static_cast<line>(22);
+const line BNO_SDA = static_cast<line>(21);
+const line BNO_SCL = static_cast<line>(22);
+
+#ifdef CONFIG_BNO_LOW_POWER_IMU
+const bnoPowermode BNO_POWER = POWER_MODE_LOWPOWER;
+#else
+const bnoPowermode BNO_POWER = POWER_MODE_NORMAL;
+#endif
+
+#ifdef CONFIG_LINK_PROFILE_BATTERY
+const wifiProfile LINK_PROFILE = WIFI_PROFILE_BATTERY;
+#else
+const wifiProfile LINK_PROFILE = WIFI_PROFILE_REALTIME;
+#endif
 
 //! \brief Globals
 //!
-BnoModule bno;
+BnoModule    bno;
+StreamTable  streams;
+PowerManager power;
+Uplink       uplink;
 
-eventList buffer[2];
-mutex     bufferLock[2];
+EventBatch *filling = NULL;                                 /*!< Owned by the sampler */
+mutex       batchLock;                                      /*!< Guards the 'filling' pointer and batchAge */
+int         batchAge = BATCH_AGE;                           /*!< Batch interval in ms, set by the server */
 
 string SSID = {};
 string PWD  = {};
 string SRV  = {};
 string PORT = {};
+string MESH = {};                                           /*!< Mesh id of the suit, blank for the default */
+string PROFILE = {};                                        /*!< Link profile of the venue, blank for the default */
 
 timerHandle tHandle;
 esp_timer_create_args_t timerArgs = {
@@ -63,37 +91,25 @@ extern "C" void app_main()
     }
 
     /*!< Success, we've made it to regular output */
-    SensorEvent event;
+    uplink.Start(&ParseRestError, BatchCapacity());
+    filling = uplink.Acquire();
 
     ESP_ERROR_CHECK(esp_timer_create(&timerArgs, &tHandle));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(tHandle, 1000000));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(tHandle, BATCH_TICK * 1000));
+
+    streams.SetWaiter(xTaskGetCurrentTaskHandle());
     
-    int i = 0;
     while (1)
     {
-        int32_t start(0), end(0), elapsed(0), sleep(0);
-
-        start = esp_timer_get_time() / 1000;
-        event = bno.GetReading(stringToVector.at(bno.GetTest()));
-
-        if (bufferLock[i].try_lock())
-        {
-            buffer[i].push_back(event);
-            CheckBuffer(i);
-            bufferLock[i].unlock();
-        }else {
-            ++i %= 2;
-            bufferLock[i].lock();
-            buffer[i].push_back(event);
-            CheckBuffer(i);
-            bufferLock[i].unlock();
-        }
-
-        end     = esp_timer_get_time() / 1000;
-        elapsed = end - start;
-        sleep   = ((100 - elapsed) > 0 ? (100 - elapsed) : 0);
-
-        Pause(sleep);
+        int32_t sleep(0);
+
+        vector<bnoVectorType> due = streams.Due(esp_timer_get_time());
+        if (!due.empty())
+            bno.Submit(due, PRIORITY_NORMAL, &BufferEvent, NULL);
+
+        sleep = (streams.NextDue() - esp_timer_get_time()) / 1000;
+
+        ulTaskNotifyTake(pdTRUE, max<int32_t>(sleep / portTICK_PERIOD_MS, 1));   /*!< Woken early on motion */
     }
 
     ESP_ERROR_CHECK(esp_timer_stop(tHandle));
@@ -106,34 +122,115 @@ extern "C" void app_main()
 //!
 
 //! \fn    PostDataAsyncThread
-//! \brief This function runs concurrently with the main thread and posts the readings data
-//!        to the server, once every second. It operates using a delta time, to ensure
-//!        communication with the server exactly once every second.
+//! \brief This function runs every BATCH_TICK ms and hands the batch being filled to the
+//!        uplink worker once its first event is 'batchAge' old, the other watermarks are
+//!        checked as events are queued. It also passes the uplink's backpressure on to
+//!        the streams, and sizes the batches from the current stream rates.
 //!
 void PostDataAsyncThread(void *arg)
 {
-    static int i = 0;
-    rerror     result;
+    EventBatch *full = NULL;
 
-    ESP_ERROR_CHECK(esp_timer_stop(tHandle));
+    batchLock.lock();
+    if (filling != NULL && filling->Age(esp_timer_get_time()) >= batchAge * 1000)
+        full = TakeBatch();
+    batchLock.unlock();
 
-    bufferLock[i].lock();
-    if (!buffer[i].empty())
-    {
-        result = CreateReading(buffer[i]);
-        if (result != REST_OK)
-            ParseRestError(result);
-        buffer[i].clear();
-    }
-    bufferLock[i].unlock();
-    ++i %= 2;
+    if (full != NULL)
+        uplink.Submit(full, TRIGGER_AGE);
+
+    streams.SetPressure(uplink.GetPressure());
+    uplink.SetShed(streams.GetShed());
+    uplink.SetCapacity(BatchCapacity());
+}
+
+//! \fn    BufferEvent
+//! \brief This function completes the sampler's requests to the BnoModule. It runs on
+//!        the bno owner task, and stores each valid event in the batch being filled. The
+//!        lock is only ever held for a pointer swap or a push, never during I/O.
+//! \param <SensorEvent> the event, <void*> unused.
+//!
+void BufferEvent(SensorEvent &e, void *arg)
+{
+    if (!e.IsValid())                                       /*!< Nothing to buffer, imu is being recovered */
+        return;
+
+    if (!streams.Accept(e))                                 /*!< Within its deadband, counted as skipped */
+        return;
+
+    QueueEvent(e);
+}
+
+//! \fn    QueueEvent
+//! \brief This function stores an event in the batch being filled, and hands the batch to
+//!        the uplink worker once it is full, BATCH_MAX keeps it within BATCH_BYTES. The
+//!        event is dropped if every batch is in use. The lock is never held while the
+//!        batch is submitted.
+//! \param <SensorEvent> the event.
+//!
+void QueueEvent(const SensorEvent &e)
+{
+    EventBatch  *full    = NULL;
+
+    batchLock.lock();
+    if (filling == NULL)
+        filling = uplink.Acquire();
+
+    if (filling == NULL || !filling->Push(e))
+        uplink.Drop();
+    else if (filling->Full())
+        full = TakeBatch();
+    batchLock.unlock();
+
+    if (full != NULL)
+        uplink.Submit(full, TRIGGER_FULL);
+}
+
+//! \fn     TakeBatch
+//! \brief  This function takes the batch being filled, and moves the sampler on to an
+//!         empty batch from the pool, or none if every batch is in use. Must be called
+//!         with the batch lock held.
+//! \return <EventBatch*> the batch taken.
+//!
+EventBatch *TakeBatch()
+{
+    EventBatch *full = filling;
+
+    filling = uplink.Acquire();
+
+    return full;
+}
 
-    ESP_ERROR_CHECK(esp_timer_start_periodic(tHandle, 1000000));
+//! \fn     BatchCapacity
+//! \brief  This function sizes the batches to hold a batch interval worth of events at
+//!         the full rate of every stream, within BATCH_MIN and BATCH_MAX. Must not be
+//!         called with the batch lock held.
+//! \return <int> events per batch.
+//!
+int BatchCapacity()
+{
+    return min(max(streams.RateSum() * BatchInterval() / 1000, BATCH_MIN), BATCH_MAX);
+}
+
+//! \fn     BatchInterval
+//! \brief  This function returns the batch interval set by the server. Must not be called
+//!         with the batch lock held.
+//! \return <int> the interval in ms.
+//!
+int BatchInterval()
+{
+    int age = {};
+
+    batchLock.lock();
+    age = batchAge;
+    batchLock.unlock();
+
+    return age;
 }
 
 //! \fn    ParseRestError
 //! \brief This function takes the rerror and determines the issue and takes
-//!        action.
+//!        action. Reads requested by the server are dropped if the imu failed them.
 //! \param <rerror>the rest error.
 //!
 void ParseRestError(rerror r)
@@ -150,27 +247,33 @@ void ParseRestError(rerror r)
         break;
     case REST_REQUEST_ACCEL:
         e    = bno.GetReading(ACCELEROMETER);
-        CreateReading(initializer_list<SensorEvent>{e});
+        if (e.IsValid())
+            QueueEvent(e);
         break;
     case REST_REQUEST_MAG:
         e    = bno.GetReading(MAGNETOMETER);
-        CreateReading(initializer_list<SensorEvent>{e});
+        if (e.IsValid())
+            QueueEvent(e);
         break;
     case REST_REQUEST_GYRO:
         e    = bno.GetReading(GYROSCOPE);
-        CreateReading(initializer_list<SensorEvent>{e});
+        if (e.IsValid())
+            QueueEvent(e);
         break;
     case REST_REQUEST_EULER:
         e    = bno.GetReading(EULER);
-        CreateReading(initializer_list<SensorEvent>{e});
+        if (e.IsValid())
+            QueueEvent(e);
         break;
     case REST_REQUEST_LINEARA:
         e    = bno.GetReading(LINEARACCEL);
-        CreateReading(initializer_list<SensorEvent>{e});
+        if (e.IsValid())
+            QueueEvent(e);
         break;
     case REST_REQUEST_GRAVITY:
         e    = bno.GetReading(GRAVITY);
-        CreateReading(initializer_list<SensorEvent>{e});
+        if (e.IsValid())
+            QueueEvent(e);
         break;
     case REST_CONNECT_FAIL:
         cout << "REST error: couldn't connect to server." << endl;
@@ -194,45 +297,97 @@ void ParseRestError(rerror r)
 
 //! \fn     Setup
 //! \brief  This function performs setup for the app_main function, including
-//!         initializing UART, creating a BnoModule object, and reading config
-//!         options from NVS storage.
+//!         initializing UART or I2C, creating a BnoModule object, and reading config
+//!         options from NVS storage. When waking from deep sleep with a valid warm
+//!         state in RTC memory, NVS and the imu setup are skipped.
 //! \return <bool> success or failure.
 //!
 bool Setup()
 {
-    /*!< Initialize UART and create BNO object */
-    UART::InitUART(UART_NUM_1, BNO_TX, BNO_RX);
+    bnoWarmState warm   = {};
+    bool         resume = RTC::LoadWarmState(warm);
+
+    /*!< Initialize the bus and create BNO object */
+#ifdef CONFIG_BNO_TRANSPORT_I2C
+    I2C::InitI2C(I2C_NUM_0, BNO_SDA, BNO_SCL);
+    bno = BnoModule(make_shared<I2cTransport>(I2C_NUM_0, CONFIG_BNO_I2C_ADDRESS));
+#else
     bno = BnoModule(UART_NUM_1, BNO_TX, BNO_RX);
+#endif
 
-    /*!< BNO setup section, this is critical for normal operation */
-    if (!bno.Setup(OPMODE_NDOF))
+    /*!< BNO setup section, only the device config is critical, the health monitor retries the imu */
+    if (resume)
     {
+        bno.Resume(warm);
+        cout << "Warm start, resumed BNO055 from RTC memory!" << endl;
+    }else if (!bno.Setup(OPMODE_NDOF, BNO_POWER)) {
         cout << "Oops... unable to initialize the BNO055!" << endl;
         return false;
+    }else if (!bno.IsHealthy()) {
+        cout << "BNO055 not responding, continuing while the health monitor retries!" << endl;
     }else {
         cout << "Success, Found BNO055!" << endl;
     }
+    bno.Start();
+
+    /*!< Stream subscriptions, fall back to the single 'test' stream */
+    if (!streams.Parse(bno.GetStreams()))
+        streams.Set(stringToVector.at(bno.GetTest()), DEFAULT_RATE);
     
     /*!< Network setup section, this is necessary for WiFi functionality */
-    if (NVS::OpenNVSPartition(NVS_PARTITION_NAME, NVS_NSNAME_NET) == ESP_OK)
+    if (resume)
     {
+        SSID = warm.ssid;
+        PWD  = warm.pwd;
+        SRV  = warm.srv;
+        PORT = warm.port;
+        MESH = warm.meshId;
+        PROFILE = warm.profile;
+    }else if (NVS::OpenNVSPartition(NVS_PARTITION_NAME, NVS_NSNAME_NET) == ESP_OK) {
         NVS::ReadNetConfig(SSID, PWD, SRV, PORT);
-        WIFI::WifiInit();
-        WIFI::WifiConnect(SSID, PWD);
+        NVS::ReadMeshConfig(MESH);
+        NVS::ReadLinkConfig(PROFILE);
     }else {
         cout << "Oops... unable to read net config from NVS!" << endl;
         return false;
     }
+    if (!PROFILE.empty() && !stringToProfile.count(PROFILE))
+        cout << "Invalid link profile " << PROFILE << ", using the default!" << endl;
+    WIFI::WifiInit(stringToProfile.count(PROFILE) ? stringToProfile.at(PROFILE) : LINK_PROFILE);
+    if (!MESH.empty() && !WIFI::MESH::WifiMeshSetId(MESH))
+        cout << "Invalid mesh id " << MESH << ", using the default!" << endl;
+    WIFI::WifiConnect(SSID, PWD);
+    power.Init(BNO_POWER == POWER_MODE_LOWPOWER);
+
+    if (resume)
+        cout << "Warm start took " << esp_timer_get_time() / 1000 << " ms" << endl;
 
     return true;
 }
 
-void CheckBuffer(int i)
+//! \fn     DeepSleep
+//! \brief  This function saves everything needed for a warm start into RTC memory, then
+//!         puts the esp32 in deep sleep for 'seconds'. The imu is left running, so on
+//!         wake up Setup can resume streaming without configuring it again.
+//! \param  <uint32_t> seconds to sleep.
+//!
+void DeepSleep(uint32_t seconds)
 {
-    if (buffer[i].size() > 10)
-    {
-        auto it = buffer[i].begin();
-        buffer[i].erase(it);
-    }
+    bnoWarmState warm = {};
+
+    bno.SaveState(warm);
+    CopyString(warm.streams, streams.ToString());
+    CopyString(warm.ssid, SSID);
+    CopyString(warm.pwd,  PWD);
+    CopyString(warm.srv,  SRV);
+    CopyString(warm.port, PORT);
+    CopyString(warm.meshId, MESH);
+    CopyString(warm.profile, PROFILE);
+    RTC::SaveWarmState(warm);
+
+    cout << "Entering deep sleep for " << seconds << " s" << endl;
+    WIFI::WifiDisconnect();
+    esp_sleep_enable_timer_wakeup(seconds * 1000000ULL);
+    esp_deep_sleep_start();
 }
 
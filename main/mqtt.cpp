@@ -0,0 +1,177 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  mqtt.cpp
+//! \brief This source contains the implementation of the MqttSession class, the root's
+//!        persistent session with the MQTT broker.
+//!
+//!
+#include "mqtt.h"
+
+
+const int connectedBit = BIT0;
+
+
+//! \fn       Start
+//! \memberof MqttSession
+//! \brief    Start opens the session the first time it is called, and waits up to
+//!           RECV_TIMEOUT for the broker. Later calls only tell whether the session is up,
+//!           the client reconnects on its own.
+//! \param    <string> broker address, <string> broker port, <string> the suit.
+//! \return   <bool> true if connected.
+//!
+bool MqttSession::Start(const string &srv, const string &port, const string &suit)
+{
+    esp_mqtt_client_config_t config = {};
+
+    if (client != NULL)
+        return IsConnected();
+
+    prefix   = string(CONFIG_SERVER_TOPIC_PREFIX) + "/" + suit + "/";
+    uri      = "mqtt://" + srv + ":" + port;
+    clientId = suit;
+    will     = prefix + "status";
+    if (events == NULL)
+    {
+        events = xQueueCreate(MQTT_QUEUE, sizeof(mqttEvent));
+        state  = xEventGroupCreate();
+    }
+
+    config.uri          = uri.c_str();
+    config.client_id    = clientId.c_str();
+    config.event_handle = &EventHandler;
+    config.user_context = this;
+    config.keepalive    = MQTT_KEEPALIVE;
+    config.disable_clean_session = true;                    /*!< The broker keeps the control messages */
+    config.lwt_topic    = will.c_str();
+    config.lwt_msg      = "offline";
+    config.lwt_qos      = 1;
+    config.lwt_retain   = 1;
+
+    if ((client = esp_mqtt_client_init(&config)) == NULL)
+        return false;
+
+    if (esp_mqtt_client_start(client) != ESP_OK)
+    {
+        esp_mqtt_client_destroy(client);
+        client = NULL;
+        return false;
+    }
+
+    xEventGroupWaitBits(state, connectedBit, pdFALSE, pdTRUE, RECV_TIMEOUT * 1000 / portTICK_PERIOD_MS);
+
+    return IsConnected();
+}
+
+//! \fn       Publish
+//! \memberof MqttSession
+//! \brief    Publish sends a message on the session, at QoS 1 if it must not be lost, and
+//!           otherwise at QoS 0, without waiting for the broker.
+//! \param    <string> the topic, <string> the message, <bool> QoS 1 or not.
+//! \return   <int> the message id the ack of a QoS 1 message carries, 0 for QoS 0, and -1
+//!           if the session is down or the message couldn't be sent.
+//!
+int MqttSession::Publish(const string &topic, const string &payload, bool reliable)
+{
+    if (!IsConnected())
+        return -1;
+
+    return esp_mqtt_client_publish(client, topic.c_str(), payload.data(), payload.length(), (reliable ? 1 : 0), 0);
+}
+
+//! \fn       Take
+//! \memberof MqttSession
+//! \brief    Take takes the next broker event handed over by the client task.
+//! \param    <mqttEvent> the event, <bool> wait up to RECV_TIMEOUT for one, or not.
+//! \return   <bool> false if there was no event.
+//!
+bool MqttSession::Take(mqttEvent &event, bool wait)
+{
+    if (events == NULL)
+        return false;
+
+    return (xQueueReceive(events, &event, (wait ? RECV_TIMEOUT * 1000 / portTICK_PERIOD_MS : 0)) == pdTRUE);
+}
+
+//! \fn       IsConnected
+//! \memberof MqttSession
+//! \brief    IsConnected tells whether the session with the broker is up.
+//! \return   <bool> true if connected.
+//!
+bool MqttSession::IsConnected()
+{
+    return (state != NULL && (xEventGroupGetBits(state) & connectedBit));
+}
+
+//! \fn       Topic
+//! \memberof MqttSession
+//! \brief    Topic names a topic of the suit.
+//! \param    <string> the last level, e.g. a location.
+//! \return   <string> "prefix/suit/name".
+//!
+string MqttSession::Topic(const string &name)
+{
+    return prefix + name;
+}
+
+//! \fn       EventHandler
+//! \memberof MqttSession
+//! \brief    EventHandler is the callback of the client, it runs on the client task.
+//! \param    <esp_mqtt_event_handle_t> the event.
+//! \return   <esp_err_t> ESP_OK.
+//!
+esp_err_t MqttSession::EventHandler(esp_mqtt_event_handle_t event)
+{
+    static_cast<MqttSession*>(event->user_context)->OnEvent(event);
+
+    return ESP_OK;
+}
+
+//! \fn       OnEvent
+//! \memberof MqttSession
+//! \brief    OnEvent subscribes to the control topic and marks the root online whenever
+//!           the session is up, and hands acks, control messages, and the loss of the
+//!           session to the uplink task. A control message longer than the client's buffer
+//!           arrives in pieces, and is handed over once whole.
+//! \param    <esp_mqtt_event_handle_t> the event.
+//!
+void MqttSession::OnEvent(esp_mqtt_event_handle_t event)
+{
+    mqttEvent taken = {};
+
+    switch (event->event_id)
+    {
+    case MQTT_EVENT_CONNECTED:
+        cout << "MQTT: connected to " << uri << endl;
+        esp_mqtt_client_subscribe(client, Topic("control").c_str(), 1);
+        esp_mqtt_client_publish(client, will.c_str(), "online", 0, 0, 1);
+        xEventGroupSetBits(state, connectedBit);
+        return;
+    case MQTT_EVENT_DISCONNECTED:
+        cout << "MQTT: disconnected from " << uri << endl;
+        xEventGroupClearBits(state, connectedBit);
+        fragments.clear();
+        taken.type = MQTT_TAKEN_LOST;
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        taken.type  = MQTT_TAKEN_ACK;
+        taken.msgId = event->msg_id;
+        break;
+    case MQTT_EVENT_DATA:
+        if (event->current_data_offset == 0)
+            fragments.clear();
+        fragments.append(event->data, event->data_len);
+        if (event->current_data_offset + event->data_len < event->total_data_len)
+            return;
+        taken.type    = MQTT_TAKEN_CONTROL;
+        taken.control = new string(fragments);
+        fragments.clear();
+        break;
+    default:
+        return;
+    }
+
+    if (xQueueSend(events, &taken, 0) != pdTRUE)
+    {
+        cout << "MQTT: event queue full, dropped one" << endl;
+        delete taken.control;
+    }
+}
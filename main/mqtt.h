@@ -0,0 +1,66 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  mqtt.h
+//! \brief This header contains the definition of the MqttSession class, the root's persistent
+//!        session with the MQTT broker, which stands in for the REST server when the MQTT
+//!        transport is selected.
+//!
+//!
+#pragma once
+#include "defines.h"
+#include "templates.h"
+
+
+//! \enum What a broker event taken off the session is.
+//!
+typedef enum {
+    MQTT_TAKEN_ACK,                                         /*!< A QoS 1 publish was acked */
+    MQTT_TAKEN_CONTROL,                                     /*!< A message on the control topic */
+    MQTT_TAKEN_LOST                                         /*!< The session was lost */
+}mqttTaken;
+
+//! \brief mqttEvent is a broker event on its way from the client task to the uplink, the
+//!        control message is owned by the event.
+//!
+typedef struct
+{
+    mqttTaken     type;
+    int           msgId;
+    string       *control;
+}mqttEvent;
+
+//! \class MqttSession mqtt.h
+//! \brief The MqttSession class keeps one connection to the broker at the server address of
+//!        the net config, which the client reconnects on its own. The session isn't clean,
+//!        so the broker keeps the subscription and the control messages queued while the
+//!        root was away. Readings go to "prefix/suit/location", the fleet stats to
+//!        "prefix/suit/stats", and commands come in on "prefix/suit/control" in the same
+//!        "Field: value" lines as the fields of an http response. "prefix/suit/status"
+//!        holds "online", or "offline" as the last will once the root is gone. The suit is
+//!        the root's node name. Broker events are handed from the client task through a
+//!        queue, so only the uplink task touches the session state.
+//!
+class MqttSession
+{
+public:
+    MqttSession(){}
+
+    bool         Start   (const string &srv, const string &port, const string &suit);
+    int          Publish (const string &topic, const string &payload, bool reliable);
+    bool         Take    (mqttEvent &event, bool wait);
+    bool         IsConnected();
+    string       Topic   (const string &name);
+
+private:
+    static esp_err_t EventHandler(esp_mqtt_event_handle_t event);
+    void         OnEvent (esp_mqtt_event_handle_t event);
+
+    /*<! Private Data Section */
+    esp_mqtt_client_handle_t client = NULL;
+    QueueHandle_t events    = NULL;                 /*!< mqttEvent, for the uplink task */
+    egHandle     state      = NULL;                 /*!< Connected bit */
+    string       prefix;                            /*!< "prefix/suit/" */
+    string       uri;
+    string       clientId;
+    string       will;                              /*!< Status topic */
+    string       fragments;                         /*!< Control message being reassembled */
+};
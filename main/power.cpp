@@ -0,0 +1,113 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  power.cpp
+//! \brief This source contains the implementation of the PowerManager class, which duty cycles
+//!        the esp32 and its radio, and keeps the counters of the node's current budget.
+//!
+//!
+#include "power.h"
+#include "rest.h"
+
+
+//! \fn       Init
+//! \memberof PowerManager
+//! \brief    Init enables automatic light sleep and frequency scaling, and puts the radio
+//!           in modem sleep until the first window. The minimum frequency is kept at
+//!           80 MHz, so the APB clock and with it the UART baud rate never change. Without
+//!           CONFIG_BNO_POWER_SAVE only the counters are kept.
+//! \param    <bool> true if the imu runs in its low power mode.
+//!
+void PowerManager::Init(bool imuLowPower)
+{
+    started    = esp_timer_get_time();
+    imuCurrent = (imuLowPower ? CURRENT_BNO_LP : CURRENT_BNO);
+
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_config_esp32_t config = {};
+
+    config.max_freq_mhz       = CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ;
+    config.min_freq_mhz       = 80;
+    config.light_sleep_enable = true;
+
+    if (esp_pm_configure(&config) != ESP_OK)
+        cout << "Oops... unable to enable light sleep!" << endl;
+
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "window", &lock);
+    radioSleeps = WIFI::WifiSetPowerSave(true);
+#endif
+}
+
+//! \fn       BeginWindow
+//! \memberof PowerManager
+//! \brief    BeginWindow wakes the radio up fully and holds off light sleep until
+//!           EndWindow, so a batch goes out without waiting on DTIM beacons.
+//!
+void PowerManager::BeginWindow()
+{
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_acquire(lock);
+    WIFI::WifiSetPowerSave(false);
+#endif
+    windowStart = esp_timer_get_time();
+}
+
+//! \fn       EndWindow
+//! \memberof PowerManager
+//! \brief    EndWindow puts the radio back in modem sleep and allows light sleep again.
+//!           Every POWER_REPORT windows the budget counters are printed, with a warning
+//!           if the estimated average current is over CONFIG_BNO_CURRENT_BUDGET.
+//!
+void PowerManager::EndWindow()
+{
+    windowTime += esp_timer_get_time() - windowStart;
+    windows++;
+
+#ifdef CONFIG_BNO_POWER_SAVE
+    radioSleeps = WIFI::WifiSetPowerSave(true);
+    esp_pm_lock_release(lock);
+#endif
+
+    if (windows % POWER_REPORT == 0)
+    {
+        cout << "Power: " << ToString() << endl;
+        if (GetAverageCurrent() > CONFIG_BNO_CURRENT_BUDGET * 1000)
+            cout << "Power: over the budget of " << CONFIG_BNO_CURRENT_BUDGET << " mA!" << endl;
+    }
+}
+
+//! \fn       GetAverageCurrent
+//! \memberof PowerManager
+//! \brief    GetAverageCurrent estimates the average current drawn since Init, from the
+//!           time spent in and out of windows and the nominal current of each state. Out
+//!           of windows the esp32 only saves power if the radio could go to modem sleep.
+//! \return   <int> the estimate in uA.
+//!
+int PowerManager::GetAverageCurrent()
+{
+    int64_t uptime  = GetUptime();
+    int64_t charge  = {};
+    int64_t idle    = (radioSleeps ? CURRENT_SAVE : CURRENT_IDLE);
+
+    if (uptime <= 0)
+        return imuCurrent;
+
+    charge = windowTime * CURRENT_WINDOW + (uptime - windowTime) * idle;
+
+    return charge / uptime + imuCurrent;
+}
+
+//! \fn       ToString
+//! \memberof PowerManager
+//! \brief    ToString formats the budget counters for the log.
+//! \return   <string> the counters.
+//!
+string PowerManager::ToString()
+{
+    ostringstream out;
+    int64_t       uptime = GetUptime();
+
+    out << "windows " << windows << ", awake " << windowTime / 1000 << " of " << uptime / 1000
+        << " ms, average " << GetAverageCurrent() / 1000 << "." << (GetAverageCurrent() % 1000) / 100
+        << " mA";
+
+    return out.str();
+}
@@ -0,0 +1,48 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  power.h
+//! \brief This header contains the definition of the PowerManager class, which duty cycles the
+//!        esp32 and its radio. Between samples the esp32 is allowed to enter automatic light
+//!        sleep, and the radio is only kept fully awake during batch transmit windows.
+//!
+//!
+#pragma once
+#include "defines.h"
+#include "templates.h"
+
+
+//! \class PowerManager power.h
+//! \brief The PowerManager class configures esp-idf power management, and wraps every batch
+//!        transmission in a window, BeginWindow to EndWindow, during which light sleep and
+//!        modem sleep are held off. It also keeps the counters of the node's current budget:
+//!        time spent in and out of windows, and an estimate of the average current drawn,
+//!        based on the nominal current of each state.
+//!
+class PowerManager
+{
+public:
+    PowerManager(){}
+
+    void         Init       (bool imuLowPower);
+    void         BeginWindow();
+    void         EndWindow  ();
+
+    /*!< inline public methods */
+    int64_t      GetWindowTime() { return windowTime; }
+    int64_t      GetUptime    () { return esp_timer_get_time() - started; }
+    int          GetWindows   () { return windows; }
+    /*!< inline public methods */
+
+    int          GetAverageCurrent();           /*!< Estimate in uA */
+    string       ToString   ();
+
+private:
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_handle_t lock;                  /*!< Held during a window */
+#endif
+    int64_t      started     = 0;
+    int64_t      windowStart = 0;
+    int64_t      windowTime  = 0;               /*!< Total time spent in windows in us */
+    int          windows     = 0;
+    int          imuCurrent  = CURRENT_BNO;
+    bool         radioSleeps = false;           /*!< The radio was let into modem sleep */
+};
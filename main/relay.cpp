@@ -0,0 +1,537 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  relay.cpp
+//! \brief This source contains the implementation of the MeshRelay class, the delivery of leaf
+//!        node data to the root.
+//!
+//!
+#include "relay.h"
+#include "rest.h"
+
+
+extern BnoModule bno;
+extern int       BatchInterval();
+
+const string RESENT = "Resent: 1\r\n";                        /*!< Marks a leaf message sent before */
+
+
+//! \fn       Send
+//! \memberof MeshRelay
+//! \brief    Send encodes the events into as many messages as it takes to keep each one
+//!           under MESH_PAYLOAD, and sends them without waiting. Leaf node only.
+//! \param    <EventView> the events, <string> the leaf's stats, see FleetMonitor::Format.
+//!
+void MeshRelay::Send(EventView events, const string &stats)
+{
+    bool   first = true;
+    string items = {};
+    string item  = {};
+
+    for (auto &e : events)
+    {
+        item.clear();
+        FormatDataToJson(EventView(e), item);
+
+        if (!items.empty() && items.length() + item.length() + 2 > MESH_PAYLOAD)
+        {
+            Transmit(items, (first ? stats : ""));
+            items.clear();
+            first = false;
+        }
+        if (!items.empty())
+            items += ",\n";
+        items += item;
+    }
+
+    if (!items.empty())
+        Transmit(items, (first ? stats : ""));
+}
+
+//! \fn       Pending
+//! \memberof MeshRelay
+//! \brief    Pending counts the messages not acked, and the child messages not forwarded
+//!           yet. A node that heard from a child within SLOT_EXPIRE counts one more, so
+//!           it keeps polling for the next. Leaf node only.
+//! \return   <int> the messages.
+//!
+int MeshRelay::Pending()
+{
+    bool parent = (forwardedAt != 0 && esp_timer_get_time() / 1000 - forwardedAt <= SLOT_EXPIRE);
+
+    return window.size() + forward.size() + (parent ? 1 : 0);
+}
+
+//! \fn       Poll
+//! \memberof MeshRelay
+//! \brief    Poll takes the next message from the root, removes what it acks from the
+//!           window, and takes in the schedule it carries. Then, if the slot of the leaf
+//!           is open, sends what is held. Leaf node only.
+//! \param    <string> the message, <bool> wait up to RETX_TIME, or the next slot, for
+//!           one, or not.
+//! \return   <bool> false if there was no message.
+//!
+bool MeshRelay::Poll(string &message, bool wait)
+{
+    int64_t now      = esp_timer_get_time();
+    int     timeout  = (SlotWait(now) > 0 ? min(RETX_TIME, SlotWait(now)) : RETX_TIME);
+    strings received = WIFI::MESH::WifiMeshRxMain(wait ? timeout : 0);
+    bool    got      = false;
+
+    for (auto &m : received)
+    {
+        if (m.find(": ") == string::npos)                       /*!< Not a message, e.g. "No data!" */
+            continue;
+        if (m.compare(0, 5, "Seq: ") == 0 || m.compare(0, 8, "Merged: ") == 0)
+        {
+            Forward(m);                                         /*!< From a child */
+            continue;
+        }
+        Acked(m);
+        Schedule(m);
+        message = m;
+        got     = true;
+    }
+
+    now = esp_timer_get_time();
+    if (SlotWait(now) == 0)
+        Flush(now);
+
+    return got;
+}
+
+//! \fn       SlotWait
+//! \memberof MeshRelay
+//! \brief    SlotWait tells how long until the leaf may transmit. A schedule the root has
+//!           not renewed for SLOT_EXPIRE is given up on, e.g. after the root changed.
+//! \param    <int64_t> the tick, in us.
+//! \return   <int> the wait in ms, 0 if the slot is open or the leaf is unscheduled.
+//!
+int MeshRelay::SlotWait(int64_t now)
+{
+    int64_t ms    = now / 1000;
+    int     width = {};
+    int     at    = {};
+
+    if (slot < 0 || ms - scheduledAt > SLOT_EXPIRE)
+        return 0;
+
+    width = SUPERFRAME / slots;
+    at    = (ms - frameOrigin) % SUPERFRAME - slot * width;   /*!< Ms into our slot */
+
+    if (at >= 0 && at < width - min(SLOT_GUARD, width / 2))   /*!< Narrow slots of a large mesh keep half */
+        return 0;
+
+    return (at < 0 ? -at : SUPERFRAME - at);
+}
+
+//! \fn       Flush
+//! \memberof MeshRelay
+//! \brief    Flush sends the messages held until the slot, and the child messages merged
+//!           into as few frames as it takes, those the lane is too full for are kept
+//!           for the next flush. Then it resends the window in the bulk lane if
+//!           the oldest message is RetxTime old. A resend round stops at the first
+//!           message the full lane drops, the rest go in the next round.
+//! \param    <int64_t> the tick, in us.
+//!
+void MeshRelay::Flush(int64_t now)
+{
+    for (auto &m : window)
+    {
+        if (m.sentAt != 0)
+            continue;
+        Stamp(m);
+        WIFI::MESH::WifiMeshTxMain(m.data);
+        m.sentAt = now;
+    }
+
+    while (!forward.empty())
+    {
+        ostringstream lengths;
+        string        body  = {};
+        int           parts = 0;
+
+        while (parts < static_cast<int>(forward.size()) &&
+               (parts == 0 || body.length() + forward[parts].length() + lengths.str().length() + 16 <= MERGE_SIZE))
+        {
+            lengths << (parts == 0 ? "" : ",") << forward[parts].length();
+            body += forward[parts++];
+        }
+
+        if (WIFI::MESH::WifiMeshTxMain(parts == 1 ? body : "Merged: " + lengths.str() + "\r\n" + body) != ESP_OK)
+            break;                                              /*!< Lane full, kept for the next flush */
+        forward.erase(forward.begin(), forward.begin() + parts);
+    }
+
+    if (!window.empty() && now - window.front().sentAt >= RetxTime() * 1000)
+    {
+        cout << "Relay: resending " << window.size() << " messages from " << window.front().seq << endl;
+        for (auto &m : window)
+        {
+            Stamp(m);
+            if (m.data.compare(m.data.find("\r\n") + 2, RESENT.length(), RESENT) != 0)
+                m.data.insert(m.data.find("\r\n") + 2, RESENT);     /*!< Right after the seq */
+            if (WIFI::MESH::WifiMeshTxMain(m.data, LANE_BULK) != ESP_OK)   /*!< Fresh samples go first */
+            {
+                cout << "Relay: bulk lane full, resend of " << m.seq << " deferred" << endl;
+                break;
+            }
+            m.sentAt = now;
+            resent++;
+        }
+    }
+}
+
+//! \fn       RetxTime
+//! \memberof MeshRelay
+//! \brief    RetxTime tells how long a message goes unacked before it is resent. The root
+//!           takes it in with its next post, up to a batch interval later, and every
+//!           parent on the way holds it until its own slot, up to a SUPERFRAME, so a
+//!           node below layer 2 waits that much longer per layer.
+//! \return   <int> the time in ms.
+//!
+int MeshRelay::RetxTime()
+{
+    return RETX_TIME + BatchInterval() + max(WIFI::MESH::WifiMeshGetLayer() - 2, 0) * SUPERFRAME;
+}
+
+//! \fn       Receive
+//! \memberof MeshRelay
+//! \brief    Receive takes in the leaf messages waiting at the root, see Take. Root node
+//!           only.
+//! \param    <FleetMonitor> the fleet monitor.
+//! \return   <strings> the json array items of the messages taken.
+//!
+strings MeshRelay::Receive(FleetMonitor &fleet)
+{
+    strings items = {};
+
+    for (auto &taken : Take(fleet))
+        items.push_back(taken.items);
+
+    return items;
+}
+
+//! \fn       Take
+//! \memberof MeshRelay
+//! \brief    Take takes in the leaf messages waiting at the root. A message is only taken
+//!           if it is the next one from its leaf, or the leaf's base past a gap the leaf
+//!           gave up on. Duplicates and messages after a gap are dropped, and resent by the
+//!           leaf. Frames too short to hold a header are dropped. The stats the messages
+//!           carry go to the fleet monitor. Root node only.
+//! \param    <FleetMonitor> the fleet monitor.
+//! \return   <vector<relayItems>> the json array items of each message taken, and its leaf.
+//!
+vector<relayItems> MeshRelay::Take(FleetMonitor &fleet)
+{
+    vector<relayItems> items    = {};
+    strings            messages = {};
+
+    for (auto &frame : WIFI::MESH::WifiMeshRxMain(0))
+        Unmerge(frame, messages);
+
+    for (auto &m : messages)
+    {
+        size_t        end    = m.find("\r\n");
+        size_t        body   = m.find("\r\n\r\n");
+        string        node, epochField, seqField, baseField, text;
+        uint32_t      e, s, base;
+        nodeStats     stats;
+
+        if (m.compare(0, 5, "Seq: ") != 0 || end == string::npos || body == string::npos)
+            continue;
+
+        istringstream header(m.substr(5, end - 5));
+        getline(header, node, ':');
+        getline(header, epochField, ':');
+        getline(header, seqField, ':');
+        getline(header, baseField);
+        e    = strtoul(epochField.c_str(), NULL, 10);
+        s    = strtoul(seqField.c_str(), NULL, 10);
+        base = (baseField.empty() ? s : strtoul(baseField.c_str(), NULL, 10));
+        members[node] = esp_timer_get_time() / 1000;
+
+        relayPeer &peer = peers[node];
+        if (peer.epoch != e)                                    /*!< First message since the leaf booted */
+            peer = { e, 0 };
+
+        if (s == peer.seq + 1 || (s == base && base > peer.seq + 1))   /*!< Past a gap the leaf gave up on */
+        {
+            peer.seq = s;
+            items.push_back({ node, m.compare(end + 2, RESENT.length(), RESENT) == 0, m.substr(body + 4) });
+        }
+        heard = true;
+
+        text = ExtractHttpFieldValue("Stats", m.substr(0, body + 2));
+        if (!text.empty() && FleetMonitor::Parse(text, stats))
+            fleet.Update(node, stats);
+    }
+
+    return items;
+}
+
+//! \fn       Hold
+//! \memberof MeshRelay
+//! \brief    Hold keeps what was taken in since the last post once it was sent, to be
+//!           acked by Ack when the server answers it. Root node only.
+//!
+void MeshRelay::Hold()
+{
+    held.push_back({ peers, heard });
+    heard = false;
+}
+
+//! \fn       Ack
+//! \memberof MeshRelay
+//! \brief    Ack commits the messages in the oldest post held, or taken in since the last
+//!           Ack if none is held, once the server answered, and sends the acks of every
+//!           leaf in one message. If the post failed the messages taken in since the last
+//!           one held are forgotten instead, so the leaves' resends are taken in again.
+//!           The acks carry the schedule, split between the leaves heard from within
+//!           SLOT_EXPIRE. A large mesh gets them in as many messages as it takes to keep
+//!           each one under MESH_PAYLOAD. Root node only.
+//! \param    <bool> true if the server took the messages.
+//!
+void MeshRelay::Ack(bool delivered)
+{
+    ostringstream head;
+    ostringstream line;
+    string        acks;
+    int64_t       now   = esp_timer_get_time() / 1000;
+    int           index = 0;
+
+    if (!delivered)
+    {
+        peers = (held.empty() ? committed : held.back().peers);
+        return;
+    }
+
+    if (held.empty())
+    {
+        committed = peers;
+        if (!heard)
+            return;
+        heard = false;
+    }else {
+        committed = held.front().peers;
+        if (!held.front().heard)
+        {
+            held.pop_front();
+            return;
+        }
+        held.pop_front();
+    }
+
+    for (auto member = members.begin(); member != members.end();)
+    {
+        if (now - member->second > SLOT_EXPIRE)
+        {
+            cout << "Relay: " << member->first << " left, " << members.size() - 1 << " slots" << endl;
+            member = members.erase(member);
+        }
+        else
+            ++member;
+    }
+
+    head << "Relay: ack\r\n" << "Frame: " << now % SUPERFRAME << "\r\n";
+    for (auto &peer : committed)
+        line << "Ack: " << peer.first << ":" << peer.second.epoch << ":" << peer.second.seq << "\r\n";
+    for (auto &member : members)
+        line << "Slot: " << member.first << ":" << index++ << ":" << members.size() << "\r\n";
+
+    istringstream lines(line.str());
+    string        field;
+
+    acks = head.str();
+    while (getline(lines, field))
+    {
+        if (acks.length() + field.length() + 1 > MESH_PAYLOAD)
+        {
+            WIFI::MESH::WifiMeshTxMain(acks, LANE_CONTROL);
+            acks = head.str();
+        }
+        acks += field + "\n";                                   /*!< getline kept the \r */
+    }
+
+    WIFI::MESH::WifiMeshTxMain(acks, LANE_CONTROL);
+}
+
+//! \fn       Transmit
+//! \memberof MeshRelay
+//! \brief    Transmit numbers a message, keeps it in the window, and sends it once the
+//!           slot of the leaf is open. When the window is full the oldest message is
+//!           given up on.
+//! \param    <string> the json array items, <string> the stats, or empty for none.
+//!
+void MeshRelay::Transmit(const string &items, const string &stats)
+{
+    relayMessage  message = {};
+    ostringstream header;
+
+    if (epoch == 0)
+        epoch = esp_random() | 1;
+
+    if (window.size() == LEAF_WINDOW)
+    {
+        window.pop_front();
+        cout << "Relay: window full, " << ++lost << " messages lost" << endl;
+    }
+
+    message.seq    = next++;
+    message.sentAt = 0;                                         /*!< Held until the slot */
+    header << "Seq: " << bno.GetNodeName() << ":" << epoch << ":" << message.seq << "\r\n";
+    if (!stats.empty())
+        header << "Stats: " << stats << "\r\n";
+    header << "\r\n";
+    message.data   = header.str() + items;
+    window.push_back(message);
+
+    if (SlotWait(esp_timer_get_time()) == 0)
+        Flush(esp_timer_get_time());
+}
+
+//! \fn       Stamp
+//! \memberof MeshRelay
+//! \brief    Stamp writes the base of the window, the oldest seq the leaf still holds,
+//!           into the seq line of a message about to be sent.
+//! \param    <relayMessage> the message.
+//!
+void MeshRelay::Stamp(relayMessage &message)
+{
+    ostringstream line;
+
+    line << "Seq: " << bno.GetNodeName() << ":" << epoch << ":" << message.seq << ":" << window.front().seq;
+    message.data.replace(0, message.data.find("\r\n"), line.str());
+}
+
+//! \fn       Acked
+//! \memberof MeshRelay
+//! \brief    Acked removes the messages a root message acks from the window, and adds the
+//!           time the newest of them took from its last send to the ack, and the bytes
+//!           acked, to the averages of the link. The averages weigh each new sample by 1/4.
+//! \param    <string> the root message.
+//!
+void MeshRelay::Acked(const string &message)
+{
+    int64_t now    = esp_timer_get_time();
+    int64_t sentAt = 0;
+    int     bytes  = 0;
+
+    for (auto &ack : ExtractHttpFieldValues("Ack", message))
+    {
+        istringstream fields(ack);
+        string        node, epochField, seqField;
+
+        getline(fields, node, ':');
+        getline(fields, epochField, ':');
+        getline(fields, seqField);
+
+        if (node != bno.GetNodeName() || strtoul(epochField.c_str(), NULL, 10) != epoch)
+            continue;
+
+        while (!window.empty() && window.front().seq <= strtoul(seqField.c_str(), NULL, 10))
+        {
+            sentAt = window.front().sentAt;
+            bytes += window.front().data.length();
+            window.pop_front();
+        }
+    }
+
+    if (bytes == 0)
+        return;
+
+    if (sentAt != 0 && now > sentAt)
+        rtt = (rtt == 0 ? now - sentAt : (3 * rtt + now - sentAt) / 4);
+    if (ackedAt > 0 && now > ackedAt)
+        goodput = (3 * goodput + bytes * 1000000LL / (now - ackedAt)) / 4;
+    ackedAt = now;
+}
+
+//! \fn       Schedule
+//! \memberof MeshRelay
+//! \brief    Schedule takes in the slot of the leaf from a root message, and syncs the
+//!           superframe to the root's. The time the message spent on the way shifts the
+//!           leaf's superframe a little late, which SLOT_GUARD allows for.
+//! \param    <string> the root message.
+//!
+void MeshRelay::Schedule(const string &message)
+{
+    string  frame = ExtractHttpFieldValue("Frame", message);
+    int64_t now   = esp_timer_get_time() / 1000;
+
+    if (frame.empty())
+        return;
+
+    for (auto &entry : ExtractHttpFieldValues("Slot", message))
+    {
+        istringstream fields(entry);
+        string        node, indexField, countField;
+
+        getline(fields, node, ':');
+        getline(fields, indexField, ':');
+        getline(fields, countField);
+
+        if (node != bno.GetNodeName())
+            continue;
+
+        if (slot != atoi(indexField.c_str()) || slots != atoi(countField.c_str()))
+            cout << "Relay: slot " << indexField << " of " << countField << endl;
+
+        slot        = atoi(indexField.c_str());
+        slots       = max(1, atoi(countField.c_str()));
+        frameOrigin = now - atoi(frame.c_str());
+        scheduledAt = now;
+    }
+}
+
+//! \fn       Forward
+//! \memberof MeshRelay
+//! \brief    Forward holds the messages of a child frame until the slot. When too many
+//!           are held the oldest is given up on, the child resends it.
+//! \param    <string> the child frame.
+//!
+void MeshRelay::Forward(const string &frame)
+{
+    strings messages = {};
+
+    Unmerge(frame, messages);
+    forwardedAt = esp_timer_get_time() / 1000;
+
+    for (auto &m : messages)
+    {
+        if (forward.size() == FORWARD_DEPTH)
+        {
+            forward.pop_front();
+            lost++;
+        }
+        forward.push_back(m);
+    }
+}
+
+//! \fn       Unmerge
+//! \memberof MeshRelay
+//! \brief    Unmerge splits a merged frame into its messages, any other frame is a
+//!           message of its own. A length running past the frame ends it.
+//! \param    <string> the frame, <strings> the messages to append to.
+//!
+void MeshRelay::Unmerge(const string &frame, strings &messages)
+{
+    size_t        end = frame.find("\r\n");
+    size_t        at  = end + 2;
+    string        length;
+
+    if (frame.compare(0, 8, "Merged: ") != 0 || end == string::npos)
+    {
+        messages.push_back(frame);
+        return;
+    }
+
+    istringstream lengths(frame.substr(8, end - 8));
+    while (getline(lengths, length, ','))
+    {
+        size_t n = strtoul(length.c_str(), NULL, 10);
+
+        if (at + n > frame.length())
+            break;
+        messages.push_back(frame.substr(at, n));
+        at += n;
+    }
+}
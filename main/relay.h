@@ -0,0 +1,132 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  relay.h
+//! \brief This header contains the definition of the MeshRelay class, the delivery of leaf node
+//!        data to the root. Leaves send without waiting on the server, and the root acks what
+//!        it has taken in.
+//!
+//!
+#pragma once
+#include "batch.h"
+#include "fleet.h"
+
+#if defined(CONFIG_MESH_TRANSPORT_ESPNOW)
+#include "../components/EspNowWiFi/wifi.h"
+#elif defined(CONFIG_ENABLE_MESH_WIFI)
+#include "../components/MeshWiFi/wifi.h"
+#else
+#include "../components/SimpleWiFi/wifi.h"
+#endif
+
+
+//! \brief relayMessage is a leaf message kept until the root acks it.
+//!
+typedef struct
+{
+    uint32_t      seq;
+    int64_t       sentAt;                       /*!< Tick it was last sent */
+    string        data;                         /*!< The whole message, header included */
+}relayMessage;
+
+//! \brief relayItems are the json array items of a leaf message taken in by the root.
+//!
+typedef struct
+{
+    string        node;                         /*!< Name of the leaf */
+    bool          resent;                       /*!< Resent by the leaf, late data */
+    string        items;
+}relayItems;
+
+//! \brief relayPeer is what the root knows of a leaf: the boot it is in, and the last of
+//!        its messages taken in.
+//!
+typedef struct
+{
+    uint32_t      epoch;
+    uint32_t      seq;
+}relayPeer;
+
+//! \brief relayHeld is what the root had taken in when it posted a request, kept until the
+//!        server answers it.
+//!
+typedef struct
+{
+    map<string, relayPeer> peers;
+    bool          heard;                        /*!< Leaf messages received before the post */
+}relayHeld;
+
+//! \class MeshRelay relay.h
+//! \brief The MeshRelay class numbers every leaf message, "Seq: node:epoch:seq:base" on
+//!        its first line, the first message of a batch also carries the leaf's "Stats", then
+//!        a blank line and the json array items. It keeps the message until the root acks it.
+//!        The epoch is random per boot, so the root can tell a rebooted leaf from a
+//!        duplicate. The base is the oldest seq the leaf still holds, stamped at every send.
+//!        The root takes in messages in order only, or from the base on when the leaf gave
+//!        up on the ones before, after a full window or a root change. It acks cumulatively
+//!        once the server answered the post they went into, the "Ack: node:epoch:seq"
+//!        fields of every leaf go out in one message. If the post failed, nothing is acked
+//!        and the leaves resend. A leaf resends everything unacked once the oldest message is
+//!        RetxTime old, so a lost message or ack costs a resend, never a stall, and marks
+//!        the messages it resends "Resent: 1", so the root can tell late data. Responses
+//!        relayed from the server reach the leaves the same way, and are handed on.
+//!        The root also schedules the leaves: every SUPERFRAME is split evenly between the
+//!        leaves it heard from within SLOT_EXPIRE, and each ack carries "Frame: ms" since
+//!        the superframe started along with a "Slot: node:index:count" field per leaf,
+//!        so the split is redone as leaves join or leave. A leaf holds its messages, and
+//!        resends, until its own slot; without a schedule it sends right away.
+//!        In a mesh deeper than two layers a node with children gets their messages, and
+//!        forwards them in its own slot merged into as few frames as MERGE_SIZE allows,
+//!        "Merged: length,length,..." on the first line followed by the messages. The
+//!        messages keep their own headers, so seqs and acks stay end to end.
+//!
+class MeshRelay
+{
+public:
+    MeshRelay() : epoch(0), next(1), lost(0), resent(0) {}
+
+    /*!< Leaf node methods */
+    void         Send    (EventView events, const string &stats);
+    bool         Poll    (string &message, bool wait);
+    int          Pending ();
+    int          SlotWait(int64_t now);
+    int          GetLost () { return lost; }
+    int          GetResent() { return resent; }
+    int64_t      GetRtt  () { return rtt; }
+    int64_t      GetGoodput() { return goodput; }
+
+    /*!< Root node methods */
+    strings      Receive (FleetMonitor &fleet);
+    vector<relayItems> Take(FleetMonitor &fleet);
+    void         Hold    ();
+    void         Ack     (bool delivered);
+
+private:
+    void         Transmit(const string &items, const string &stats);
+    void         Stamp   (relayMessage &message);
+    int          RetxTime();
+    void         Acked   (const string &message);
+    void         Schedule(const string &message);
+    void         Flush   (int64_t now);
+    void         Forward (const string &frame);
+    static void  Unmerge (const string &frame, strings &messages);
+
+    /*<! Private Data Section */
+    deque<relayMessage> window;                 /*!< Leaf messages not acked yet, oldest first */
+    map<string, relayPeer> peers;               /*!< Leaves by node name, as taken in */
+    map<string, relayPeer> committed;           /*!< Leaves by node name, as delivered */
+    deque<relayHeld> held;                      /*!< Posts not answered yet, oldest first */
+    bool         heard = false;                 /*!< Leaf messages received since the last Ack */
+    uint32_t     epoch;
+    uint32_t     next;                          /*!< Seq of the next leaf message */
+    int          lost;                          /*!< Leaf messages pushed out of a full window */
+    int          resent;                        /*!< Leaf messages resent */
+    int64_t      rtt          = 0;              /*!< Send to ack, moving average in us */
+    int64_t      goodput      = 0;              /*!< Bytes acked per second, moving average */
+    int64_t      ackedAt      = 0;              /*!< Tick of the last ack that removed messages */
+    map<string, int64_t> members;               /*!< Leaves by node name, tick last heard, in ms */
+    int          slot         = -1;             /*!< Slot of this leaf, -1 if unscheduled */
+    int          slots        = 0;              /*!< Slots in the superframe */
+    int64_t      frameOrigin  = 0;              /*!< Tick the root's superframes count from, in ms */
+    int64_t      scheduledAt  = 0;              /*!< Tick the schedule was last renewed, in ms */
+    deque<string> forward;                      /*!< Child messages not forwarded yet, oldest first */
+    int64_t      forwardedAt  = 0;              /*!< Tick a child message was last received, in ms, 0 if none */
+};
@@ -7,44 +7,100 @@
 //!
 //!
 #include "rest.h"
-
-
-extern string SRV;
-extern string PORT;
+#include "bno.h"
+#include "fleet.h"
+#include "link.h"
+#include "mqtt.h"
+#include "relay.h"
+#include "stream.h"
+#include "uplink.h"
+
+
+extern string      SRV;
+extern string      PORT;
+extern StreamTable streams;
+extern BnoModule   bno;
+extern Uplink      uplink;
+extern int         batchAge;
+extern mutex       batchLock;
+
+extern void DeepSleep (uint32_t seconds);
+extern void QueueEvent(const SensorEvent &e);
+
+static string payload;                                      /*!< Reused by every post, keeps its capacity */
+static string headers;
+static string inbox;                                        /*!< Received but not yet parsed */
+static int    sock    = -1;                                 /*!< Persistent connection to the server */
+static int    pending = 0;                                  /*!< Requests sent, response not read yet */
+static int    oldest  = 0;                                  /*!< Index of the oldest of them in unanswered */
+static int64_t retryAt = 0;                                 /*!< No reconnect before, in us */
+static array<string, MAX_INFLIGHT> unanswered;              /*!< Requests sent, kept until answered */
+static restEncoding encoding = ENCODING_JSON;               /*!< Chosen by the server */
+static LinkMonitor  monitor;                                /*!< Root uplink measurements */
+static MeshRelay    relay;                                  /*!< Leaf to root delivery */
+static FleetMonitor fleet;                                  /*!< Root view of every node */
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+static MqttSession  mqtt;                                   /*!< Root session with the broker */
+#endif
 
 //! -------------------------------------------------------------------------------------------- //
 //! \brief Helper functions section
 //!
 
-//! \fn     FormatDataToJson
-//! \brief  This function takes the event objects from leaf nodes, reads their x, y,  
-//!         and z values, and formats them using proper json. This override only returns
-//!         the json array item, not the entire array.
-//! \param  <initializer_list> Any number of event objects.
-//! \return <vector<string>> A vector of strings.
+//! \fn     AppendEventJson
+//! \brief  This function formats a single event as a json array item, and appends it to
+//!         'out'. It formats into a stack buffer, so nothing is allocated as long as 'out'
+//!         has the capacity. The item is in the encoding chosen by the server, and the
+//!         values are rounded to COARSE_DIGITS once the fidelity is lowered that far.
+//! \param  <SensorEvent> the event, <string> the output.
 //!
-string FormatDataToJson(eventList events)
+static void AppendEventJson(const SensorEvent &e, string &out)
 {
-    ostringstream data;
-    int i = 1;
+    char  item[JSON_ITEM_SIZE];
+    int   n = {};
+    int   d = (streams.GetFidelity() >= FIDELITY_COARSE ? COARSE_DIGITS : FULL_DIGITS);
 
-    for (auto e : events)
+    if (encoding == ENCODING_COMPACT)
     {
-        data << "\t\t{";
-        data << "\"type\":\""  << e.GetName()     << "\", ";
-        data << "\"body\":\""  << e.GetLocation() << "\", ";
-        data << "\"ticks\":\"" << e.GetTicks()    << "\", ";
+        n = snprintf(item, sizeof(item), "{\"t\":\"%s\",\"b\":\"%s\",\"k\":%lld,\"u\":%lld,\"r\":%d,\"s\":%d,\"v\":[",
+            e.GetName().c_str(), e.GetLocation().c_str(), (long long)e.GetTicks(),
+            (long long)e.GetUncertainty(), e.GetRate(), e.GetSkipped());
         if (e.GetObject().IsQuaternion())
-            data << "\"W\":\"" << e.GetObject().GetEventW() << "\", ";
-        data << "\"X\":\""     << e.GetObject().GetEventX() << "\", ";
-        data << "\"Y\":\""     << e.GetObject().GetEventY() << "\", ";
-        data << "\"Z\":\""     << e.GetObject().GetEventZ() << "\"";
-        data << "}";
-        if (i < events.size())
-            data << ",\n";
-        i++;
+            n += snprintf(item + n, sizeof(item) - n, "%.*g,", d, e.GetObject().GetEventW());
+        n += snprintf(item + n, sizeof(item) - n, "%.*g,%.*g,%.*g]}",
+            d, e.GetObject().GetEventX(), d, e.GetObject().GetEventY(), d, e.GetObject().GetEventZ());
+
+        out.append(item, min<int>(n, sizeof(item) - 1));
+        return;
+    }
+
+    n = snprintf(item, sizeof(item),
+        "\t\t{\"type\":\"%s\", \"body\":\"%s\", \"ticks\":\"%lld\", \"uncert\":\"%lld\", "
+        "\"rate\":\"%d\", \"skip\":\"%d\", ",
+        e.GetName().c_str(), e.GetLocation().c_str(), (long long)e.GetTicks(),
+        (long long)e.GetUncertainty(), e.GetRate(), e.GetSkipped());
+    if (e.GetObject().IsQuaternion())
+        n += snprintf(item + n, sizeof(item) - n, "\"W\":\"%.*g\", ", d, e.GetObject().GetEventW());
+    n += snprintf(item + n, sizeof(item) - n, "\"X\":\"%.*g\", \"Y\":\"%.*g\", \"Z\":\"%.*g\"}",
+        d, e.GetObject().GetEventX(), d, e.GetObject().GetEventY(), d, e.GetObject().GetEventZ());
+
+    out.append(item, min<int>(n, sizeof(item) - 1));
+}
+
+//! \fn     FormatDataToJson
+//! \brief  This function takes the event objects from leaf nodes, reads their x, y,  
+//!         and z values, and formats them using proper json. This override only appends
+//!         the json array items, not the entire array.
+//! \param  <EventView> the events, <string> the output.
+//!
+void FormatDataToJson(EventView events, string &out)
+{
+    for (auto &e : events)
+    {
+        if (&e != events.begin())
+            out += ",\n";
+        AppendEventJson(e, out);
     }
-    return data.str();
 }
 
 //! \fn     FormatDataToJson
@@ -52,66 +108,44 @@ string FormatDataToJson(eventList events)
 //!         values, and formats the payload using proper json. In addition,
 //!         extra json array items can be passed from mesh leaf-nodes in the
 //!         form of a vector<string>.
-//! \param  <initializer_list> Any number of event objects.
+//! \param  <EventView>        the events.
 //!         <vector<string>>   extra json array items.
-//! \return <string> A properly formated json string.
+//!         <string>           the output.
 //!
-string FormatDataToJson(eventList events, strings extra)
+void FormatDataToJson(EventView events, const strings &extra, string &out)
 {
-    ostringstream data;
-    int i = 1;
-
-    data << "{\n\t\"things\":[\n";
+    out += "{\n\t\"things\":[\n";
 
-    for (auto e : events)
-    {
-        data << "\t\t{";
-        data << "\"type\":\""  << e.GetName()     << "\", ";
-        data << "\"body\":\""  << e.GetLocation() << "\", ";
-        data << "\"ticks\":\"" << e.GetTicks()    << "\", ";
-        if (e.GetObject().IsQuaternion())
-            data << "\"W\":\"" << e.GetObject().GetEventW() << "\", ";
-        data << "\"X\":\""     << e.GetObject().GetEventX() << "\", ";
-        data << "\"Y\":\""     << e.GetObject().GetEventY() << "\", ";
-        data << "\"Z\":\""     << e.GetObject().GetEventZ() << "\"";
-        data << "}";
-        if (i < events.size())
-            data << ",\n";
-        i++;
-    }
+    FormatDataToJson(events, out);
 
-    if (!extra.empty())
+    for (auto &e : extra)
     {
-        for (auto e : extra)
-        {
-            data << ",\n";
-            data << e;
-        }
+        if (!events.empty() || &e != &extra.front())
+            out += ",\n";
+        out += e;
     }
 
-    data << "\n\t]\n}";
-
-    return data.str();
+    out += "\n\t]\n}";
 }
 
 //! \fn     BuildPostHeaders
 //! \brief  This function puts together the appropriate headers necessary 
-//!         for a POST request and returns them in a string.
-//! \param  <size_t> Length for the Content-Length field.
-//! \return <string> Completed POST headers.
+//!         for a POST request into 'out'.
+//! \param  <size_t> Length for the Content-Length field, <string> the output.
 //!
-string BuildPostHeaders(int len)
+void BuildPostHeaders(int len, string &out)
 {
-    string tempHost = HOST;
-    string tempLeng = LENG;
+    char length[12];
 
-    tempHost.insert(6, SRV + ":" + PORT);
-    
-    ostringstream tmp;
-    tmp << len;
-    tempLeng.insert(16, tmp.str());
+    snprintf(length, sizeof(length), "%d", len);
 
-    return POST + tempHost + USER + TYPE + tempLeng + CONN + NEWL;
+    out += POST;
+    out.append(HOST, 0, 6).append(SRV).append(":").append(PORT).append(HOST, 6, string::npos);
+    out += USER;
+    out += TYPE;
+    out.append(LENG, 0, 16).append(length).append(LENG, 16, string::npos);
+    out += CONN;
+    out += NEWL;
 }
 
 //! \fn     ExtractHttpFieldValue
@@ -124,8 +158,8 @@ string BuildPostHeaders(int len)
 //!
 string ExtractHttpFieldValue(string field, string response)
 {
-    int index1 = response.find(field);
-    int index2 = {};
+    size_t index1 = response.find(field);
+    size_t index2 = {};
 
     if (index1 == string::npos)
         return "";
@@ -136,106 +170,610 @@ string ExtractHttpFieldValue(string field, string response)
     return response.substr(index1, index2 - index1);
 }
 
-//! \fn     SendToServer
-//! \brief  This function handles communication with the server. It can perform any
-//!         HTTP method and abstracts those details from the CRUD functions so they can
-//!         simply provide the HTTP headers, and the data to be submitted.
-//! \params <string> headers
-//!         <string> data
-//! \return <string> server response.
+//! \fn     ExtractHttpFieldValues
+//! \brief  This function extracts every value of an http field that may be repeated in
+//!         the response, in the order they appear.
+//! \params <string, string>field and http response.
+//! \return <strings>field values, empty if the field wasn't in the response.
+//!
+strings ExtractHttpFieldValues(string field, const string &response)
+{
+    strings values = {};
+    string  key    = "\n" + field + ": ";
+    size_t  index1 = response.find(key);
+    size_t  index2 = {};
+
+    while (index1 != string::npos)
+    {
+        index1 += key.length();
+        index2  = response.find("\r\n", index1);
+        values.push_back(response.substr(index1, index2 - index1));
+        index1  = response.find(key, index1);
+    }
+
+    return values;
+}
+
+//! \fn     ForThisNode
+//! \brief  This function checks the location a command is addressed to, "*" for every
+//!         node, and strips it off the command.
+//! \param  <string> "location:command", left holding the command.
+//! \return <bool> true if the command is for this node.
+//!
+static bool ForThisNode(string &command)
+{
+    size_t colon    = command.find(':');
+    string location = command.substr(0, colon);
+
+    if (colon == string::npos)
+        return false;
+
+    command.erase(0, colon + 1);
+
+    return (location == "*" || location == bno.GetLocation());
+}
+
+//! \fn     QueueRead
+//! \brief  This function completes an on-demand read, the event goes out with the next
+//!         batch.
+//! \param  <SensorEvent> the event, <void*> unused.
+//!
+static void QueueRead(SensorEvent &e, void *arg)
+{
+    if (e.IsValid())
+        QueueEvent(e);
+}
+
+//! \fn     ApplyCommands
+//! \brief  This function applies the commands a server response may carry, any number
+//!         of each and in any order. Rate and Read commands are addressed to a location,
+//!         or "*" for every node, so the root can relay the whole response unchanged and
+//!         each leaf picks out its own:
+//!         "Rate: location:type:rate[:deadband]", a stream's rate, zero removes it,
+//!         "Read: location:type", an on-demand read sent with the next batch,
+//!         "Interval: ms", the longest a batch is held before it's posted,
+//!         "Encoding: json|compact", the payload encoding,
+//!         "Fidelity: location:level", added by the root, see streamFidelity.
+//! \param  <string> the response headers.
+//!
+static void ApplyCommands(const string &response)
+{
+    string interval = ExtractHttpFieldValue("Interval", response);
+    string encode   = ExtractHttpFieldValue("Encoding", response);
+
+    for (auto &command : ExtractHttpFieldValues("Rate", response))
+    {
+        string pair = command;
+        if (ForThisNode(pair))
+            streams.Apply(pair);
+    }
+
+    for (auto &command : ExtractHttpFieldValues("Fidelity", response))
+    {
+        string level = command;
+        if (ForThisNode(level))
+            streams.SetFidelity(static_cast<streamFidelity>(min<int>(max(atoi(level.c_str()), 0), FIDELITY_FEATURES)));
+    }
+
+    for (auto &command : ExtractHttpFieldValues("Read", response))
+    {
+        string type = command;
+        if (ForThisNode(type) && stringToVector.count(type) > 0)
+            bno.Submit(stringToVector.at(type), PRIORITY_HIGH, &QueueRead, NULL);
+    }
+
+    if (atoi(interval.c_str()) > 0)
+    {
+        batchLock.lock();
+        batchAge = min(max(atoi(interval.c_str()), BATCH_TICK), BATCH_AGE_MAX);
+        batchLock.unlock();
+        cout << "Batch interval " << batchAge << " ms" << endl;
+    }
+
+    if (stringToEncoding.count(encode) > 0 && stringToEncoding.at(encode) != encoding)
+    {
+        encoding = stringToEncoding.at(encode);
+        cout << "Encoding " << encode << endl;
+    }
+}
+
+//! \fn     ApplyResponseFields
+//! \brief  This function applies the fields of a server response meant for every node,
+//!         which root and leaf nodes both receive. These are the optional "Streams"
+//!         field, in the format accepted by StreamTable::Parse, the commands handled by
+//!         ApplyCommands, the optional "Sleep" field, seconds to spend in deep sleep,
+//!         and the "Response" field, which is returned as the rerror code.
+//! \param  <string> the response headers.
+//! \return <rerror> the response code, REST_OK if there was none.
+//!
+rerror ApplyResponseFields(string response)
+{
+    string code   = ExtractHttpFieldValue("Response", response);
+    string config = ExtractHttpFieldValue("Streams", response);
+    string sleep  = ExtractHttpFieldValue("Sleep", response);
+
+    if (!config.empty())
+        streams.Parse(config);
+
+    ApplyCommands(response);
+
+    if (atoi(sleep.c_str()) > 0)
+        DeepSleep(atoi(sleep.c_str()));                                         /*!< Doesn't return */
+
+    return (code.empty() ? REST_OK : static_cast<rerror>(atoi(code.c_str())));
+}
+
+//! \fn     CollectStats
+//! \brief  This function gathers the link and health stats of this node. The rtt and
+//!         goodput are those of the root's uplink to the server, and of a leaf's link to
+//!         the root.
+//! \return <nodeStats> the stats.
 //!
-string SendToServer(string headers, string data)
+static nodeStats CollectStats()
 {
-    char   recvBuf[500] = {};
-    int    sock         = socket(AF_INET, SOCK_STREAM, 0);
-    string output       = "";
+    nodeStats s = {};
+
+    s.rssi       = WIFI::WifiGetRssi();
+    s.layer      = WIFI::MESH::WifiMeshGetLayer();
+    s.queue      = PendingReadings();
+    s.drops      = uplink.GetStats().dropped + relay.GetLost();
+    s.resent     = relay.GetResent();
+    s.meshErrors = WIFI::MESH::WifiMeshGetErrors();
+    s.busErrors  = bno.GetErrors();
+    s.heap       = esp_get_free_heap_size();
+    s.latency    = WIFI::MESH::WifiMeshGetLatency(LANE_REALTIME) / 1000;
+    s.profile    = WIFI::WifiGetProfile();
+    s.rtt        = (WIFI::MESH::WifiIsRootNode() ? monitor.GetRtt() : relay.GetRtt()) / 1000;
+    s.goodput    = (WIFI::MESH::WifiIsRootNode() ? monitor.GetGoodput() : relay.GetGoodput());
+    s.reconnects = WIFI::WifiGetReconnects();
+    s.outage     = WIFI::WifiGetOutage();
+
+    return s;
+}
+
+//! \fn     Connect
+//! \brief  This function opens the persistent connection to the server, if it isn't
+//!         open already. Every request is sent on it, until an error closes it.
+//! \return <bool> true if connected.
+//!
+static bool Connect()
+{
+    sockaddr_in addr    = {};
+    timeval     timeout = { RECV_TIMEOUT, 0 };
+
+    if (sock >= 0)
+        return true;
 
-    sockaddr_in addr;
     addr.sin_family      = AF_INET;
     addr.sin_port        = htons(atoi(PORT.c_str()));
     addr.sin_addr.s_addr = inet_addr(SRV.c_str());
 
+    sock = socket(AF_INET, SOCK_STREAM, 0);
     if (connect(sock, (struct sockaddr *)&addr, sizeof(struct sockaddr)) != 0)
     {
-        output = "7";
-        goto cleanup;
+        close(sock);
+        sock = -1;
+        return false;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));  /*!< A lost response can't stall the uplink */
+
+    return true;
+}
+
+//! \fn     Disconnect
+//! \brief  This function closes the persistent connection. The requests still in flight
+//!         stay unanswered, Resume sends them again on the next connection.
+//!
+static void Disconnect()
+{
+    if (sock >= 0)
+    {
+        shutdown(sock, 0);
+        close(sock);
+    }
+    sock = -1;
+    inbox.clear();
+}
+
+//! \fn     Resume
+//! \brief  This function opens the persistent connection if it isn't open, and sends the
+//!         requests left unanswered by the last one again, oldest first, so a lost
+//!         connection doesn't lose them. The server may get a request twice. After a
+//!         failure it waits UPLINK_RETRY ms before trying again.
+//! \return <bool> true if connected.
+//!
+static bool Resume()
+{
+    if (sock >= 0)
+        return true;
+    if (esp_timer_get_time() < retryAt)
+        return false;
+
+    if (Connect())
+    {
+        for (int i = 0; i < pending && sock >= 0; i++)
+        {
+            const string &request = unanswered[(oldest + i) % MAX_INFLIGHT];
+
+            if (send(sock, request.data(), request.length(), 0) < 0)
+                Disconnect();
+            else
+                monitor.OnSent(request.length());
+        }
+        if (sock >= 0)
+        {
+            if (pending > 0)
+                cout << "REST: resent " << pending << " unanswered requests" << endl;
+            return true;
+        }
+    }
+
+    retryAt = esp_timer_get_time() + UPLINK_RETRY * 1000;
+    monitor.OnFailure();
+
+    return false;
+}
+
+//! \fn     SendToServer
+//! \brief  This function sends a request on the persistent connection, without waiting
+//!         for its response, and keeps it until the response arrives. If the connection
+//!         was closed the request is retried once on a new one, after the requests it
+//!         left unanswered.
+//! \params <string> headers
+//!         <string> data
+//! \return <rerror> REST_OK once the request is on its way, REST_CONNECT_FAIL or
+//!         REST_WRITE_FAIL if it wasn't sent.
+//!
+rerror SendToServer(const string &headers, const string &data)
+{
+    string &request = unanswered[(oldest + pending) % MAX_INFLIGHT];
+
+    if (pending == MAX_INFLIGHT)
+        return REST_WRITE_FAIL;
+    request.assign(headers).append(data);                   /*!< Keeps the capacity of earlier requests */
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (!Resume())
+            return REST_CONNECT_FAIL;
+
+        if (send(sock, request.data(), request.length(), 0) >= 0)
+        {
+            monitor.OnSent(request.length());
+            pending++;
+            return REST_OK;
+        }
+        Disconnect();
+    }
+    monitor.OnFailure();
+
+    return REST_WRITE_FAIL;
+}
+
+//! \fn     ReceiveFromServer
+//! \brief  This function takes the next complete response off the persistent connection.
+//!         Responses arrive in the order the requests were sent, and a response body,
+//!         as given by its Content-Length, is skipped. The request answered is let go.
+//!         Socket errors close the connection, and are returned as a "Response" field
+//!         holding the rerror code, the requests stay unanswered.
+//! \params <string> the response headers, <bool> wait for the response or not.
+//! \return <bool> false if 'wait' was false and no response is complete yet.
+//!
+bool ReceiveFromServer(string &response, bool wait)
+{
+    char   recvBuf[500];
+    int    length = {};
+    size_t end    = {};
+
+    while ((end = inbox.find("\r\n\r\n")) == string::npos ||
+           inbox.length() < end + 4 + atoi(ExtractHttpFieldValue("Content-Length", inbox.substr(0, end + 2)).c_str()))
+    {
+        length = recv(sock, recvBuf, sizeof(recvBuf), (wait ? 0 : MSG_DONTWAIT));
+        if (length > 0)
+        {
+            inbox.append(recvBuf, length);
+        }else if (length < 0 && !wait && (errno == EWOULDBLOCK || errno == EAGAIN)) {
+            return false;
+        }else {
+            response = "Response: 9\r\n";
+            Disconnect();
+            monitor.OnFailure();
+            return true;
+        }
     }
-    if (send(sock, headers.c_str(), headers.length(), 0) < 0)
+
+    response = inbox.substr(0, end + 2);                    /*!< Headers only, body is unused */
+    inbox.erase(0, end + 4 + atoi(ExtractHttpFieldValue("Content-Length", response).c_str()));
+    monitor.OnResponse();
+    oldest = (oldest + 1) % MAX_INFLIGHT;
+    pending--;
+
+    return true;
+}
+
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+//! \fn     PublishItems
+//! \brief  This function publishes events and json array items to a topic of the suit, in
+//!         the same document as the body of a post. A QoS 1 message is timed until its ack,
+//!         and counted as in flight.
+//! \param  <string> the last level of the topic, <EventView> the events, <strings> the
+//!         json array items, <bool> QoS 1 or not.
+//! \return <bool> false if the message couldn't be published.
+//!
+static bool PublishItems(const string &name, EventView events, const strings &items, bool reliable)
+{
+    if (events.empty() && items.empty())
+        return true;
+
+    payload.clear();
+    FormatDataToJson(events, items, payload);
+    if (mqtt.Publish(mqtt.Topic(name), payload, reliable) < 0)
+        return false;
+
+    if (reliable)
+    {
+        monitor.OnSent(payload.length());
+        pending++;
+    }
+    return true;
+}
+
+//! \fn     PublishToBroker
+//! \brief  This function publishes the events of the root and the leaf messages taken in,
+//!         one message per location to the location's topic. Live data goes at QoS 0, and
+//!         the messages the leaves resent, data that is late already, at QoS 1 in messages
+//!         of their own, as does the fleet stats report. QoS 1 messages are timed until
+//!         their ack like the posts of the http transport, and counted as in flight. The
+//!         leaf messages are acked once published, and the fidelity of every location goes
+//!         to the leaves when it changes, and with every stats report.
+//! \param  <EventView> The events to publish.
+//! \return <rerror> REST_OK once the messages are on their way, REST_CONNECT_FAIL if the
+//!         broker couldn't be reached and nothing was published.
+//!
+static rerror PublishToBroker(EventView events)
+{
+    map<string, strings> live     = {};                     /*!< Json array items by location */
+    map<string, strings> late     = {};
+    strings              stats    = {};
+    string               fidelity = {};
+    bool                 due      = fleet.Due();
+    bool                 failed   = false;
+
+    for (auto &taken : relay.Take(fleet))
+        (taken.resent ? late : live)[taken.node.substr(0, taken.node.find('-'))].push_back(taken.items);
+    live[bno.GetLocation()];                                /*!< The root's own events, if no leaf shares it */
+    if (due)
+    {
+        fleet.Update(bno.GetNodeName(), CollectStats());
+        fleet.AppendJson(stats);
+        cout << "Fleet:" << endl << fleet.ToString();
+    }
+
+    if (!mqtt.Start(SRV, PORT, bno.GetNodeName()))
+    {
+        relay.Ack(false);
+        monitor.OnFailure();
+        return REST_CONNECT_FAIL;                           /*!< Nothing published, the batch is kept */
+    }
+
+    for (auto &location : live)
+    {
+        EventView own = (location.first == bno.GetLocation() ? events : EventView(NULL, 0));
+        if (!PublishItems(location.first, own, location.second, false))
+            failed = true;
+    }
+    for (auto &location : late)
+    {
+        if (!PublishItems(location.first, EventView(NULL, 0), location.second, true))
+            failed = true;
+    }
+    if (!PublishItems("stats", EventView(NULL, 0), stats, true))
+        failed = true;
+
+    relay.Ack(!failed);
+    if (failed)
+        monitor.OnFailure();
+
+    if (monitor.Adapt(pending >= MAX_INFLIGHT) || due)
     {
-        output = "8";
-        goto cleanup;
-    }else {
-        send(sock, data.c_str(), data.length(), 0);
+        fidelity = "\r\n" + monitor.Commands();
+        WIFI::MESH::WifiMeshTxMain(fidelity, LANE_CONTROL);
+        ApplyResponseFields(fidelity);
     }
 
-    if (recv(sock, recvBuf, sizeof(recvBuf) - 1, 0) < 0)
+    return (failed ? REST_MQTT_ERROR : REST_OK);
+}
+
+//! \fn     TakeFromBroker
+//! \brief  This function takes the next event of the broker session. An ack ends the
+//!         timing of the oldest QoS 1 message, a control message is relayed to the leaf
+//!         nodes and applied like a server response, with the fidelity of every location
+//!         added to it. If the session was lost, or the acks don't come within
+//!         RECV_TIMEOUT, the messages in flight are given up on.
+//! \params <rerror> the response code, <bool> wait for an ack or not.
+//! \return <bool> false if there was no event to take.
+//!
+static bool TakeFromBroker(rerror &result, bool wait)
+{
+    mqttEvent event    = {};
+    string    response = {};
+
+    if (!mqtt.Take(event, wait && pending > 0))
     {
-        output = "9";
-        goto cleanup;
+        if (!wait || pending == 0)
+            return false;
+        event.type = MQTT_TAKEN_LOST;
     }
-    output = ExtractHttpFieldValue("Response", string(recvBuf));
 
-cleanup:
-    shutdown(sock, 0);
-    close(sock);
+    switch (event.type)
+    {
+    case MQTT_TAKEN_ACK:
+        monitor.OnResponse();
+        pending = max(pending - 1, 0);
+        result  = REST_OK;
+        break;
+    case MQTT_TAKEN_CONTROL:
+        response = "\r\n" + *event.control;                 /*!< Fields start on a new line, as after a status line */
+        delete event.control;
+        if (response.compare(response.length() - 2, 2, "\r\n") != 0)
+            response += "\r\n";
+        response += monitor.Commands();
+        WIFI::MESH::WifiMeshTxMain(response, LANE_CONTROL);
+        result = ApplyResponseFields(response);
+        break;
+    case MQTT_TAKEN_LOST:
+        monitor.OnFailure();
+        pending = 0;
+        result  = REST_MQTT_ERROR;
+        break;
+    }
 
-    return output;
+    return true;
 }
+#endif
 
 //! -------------------------------------------------------------------------------------------- //
 //! \brief CRUD section
 //!
 
-//! \fn     CreateReading
-//! \brief  This function handles POST'ing json data to the REST server.
-//! \param  <string> The json data to POST.
-//! \return <bool> Success or failure.
+//! \fn     PostReading
+//! \brief  This function sends the events on without waiting for the response, so the
+//!         next batch can be encoded while this one is in flight. The root encodes them,
+//!         together with the messages taken in from the leaf nodes, and sends them to
+//!         the server, the leaf messages are acked once the server answers. A leaf
+//!         hands them to the relay, which numbers them and keeps them until acked. The
+//!         events are only read, and the root encodes them into buffers kept between
+//!         calls, so posting a batch doesn't copy or allocate events. With the MQTT
+//!         transport the root publishes them instead, see PublishToBroker.
+//! \param  <EventView> The events to POST.
+//! \return <rerror> REST_OK once the request is on its way.
 //!
-rerror CreateReading(eventList events)
+rerror PostReading(EventView events)
 {
-    string  response = {};
-    strings meshData = {};
-    rerror  result   = REST_OK;
-
     if (WIFI::WifiGetStatus() == WIFI_STATUS_DISCONNECTED)
         return REST_NO_WIFI;
-    
+
+    /*!< Leaf node section */
+    if (WIFI::MESH::WifiIsMeshEnabled() && !WIFI::MESH::WifiIsRootNode())
+    {
+        relay.Send(events, FleetMonitor::Format(CollectStats()));
+        return REST_OK;
+    }
+
     /*!< Root Section */
-    if (!WIFI::MESH::WifiIsMeshEnabled() || WIFI::MESH::WifiIsRootNode())
+    if (payload.capacity() < PAYLOAD_SIZE)
+        payload.reserve(PAYLOAD_SIZE);
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+    return PublishToBroker(events);
+#else
+    strings meshData = relay.Receive(fleet);                                    /*!< First, take in the leaf node data */
+    rerror  result   = REST_OK;
+
+    payload.clear();
+    headers.clear();
+
+    if (fleet.Due())
     {
-        cout << "Root node entered CreateReading!" << endl;
-        meshData    = WIFI::MESH::WifiMeshRxMain(0);                            /*!< First, Rx the leaf node data */
-        string data = FormatDataToJson(events, meshData);
-        string post = BuildPostHeaders(data.length());
+        fleet.Update(bno.GetNodeName(), CollectStats());
+        fleet.AppendJson(meshData);
+        cout << "Fleet:" << endl << fleet.ToString();
+    }
+    FormatDataToJson(events, meshData, payload);
+    BuildPostHeaders(payload.length(), headers);
 
-        //if (runTimes.size() > 0)
-        //{
-        //    for_each(runTimes.begin(), runTimes.end(), [&] (int n) {
-        //        avg += n;
-        //    });
-        //    avg /= runTimes.size();
-        //}
+    result = SendToServer(headers, payload);                                    /*!< Second, Tx to server */
+    if (result == REST_OK)
+        relay.Hold();                                                           /*!< Acked once the server answers */
+    else
+        relay.Ack(false);
 
-        if ((response = SendToServer(post, data)) != string(""))                /*!< Second, Tx to server */
-            result = static_cast<rerror>(atoi(response.c_str()));
+    return result;
+#endif
+}
 
-        WIFI::MESH::WifiMeshTxMain(response);                                   /*!< Last, Tx the response to leaf nodes */
+//! \fn     PollReading
+//! \brief  This function takes the response to the oldest request in flight, and applies
+//!         it. On the root node the response is relayed to the leaf nodes first, with
+//!         the fidelity of every location, from the uplink measurements, added to it so
+//!         the whole suit degrades and recovers together. On a leaf node it takes the
+//!         next message from the root, which also carries the acks. With the MQTT
+//!         transport the root takes the next broker event instead, see TakeFromBroker.
+//! \param  <rerror> the response code, <bool> wait for the response or not.
+//! \return <bool> false if there was no response to take.
+//!
+bool PollReading(rerror &result, bool wait)
+{
+    string response = {};
 
     /*!< Leaf node section */
-    }else {
-        cout << "Leaf node entered CreateReading!" << endl;
-        string data = {};
-        data = FormatDataToJson(events);
+    if (WIFI::MESH::WifiIsMeshEnabled() && !WIFI::MESH::WifiIsRootNode())
+    {
+        if (!relay.Poll(response, wait))
+            return false;
+
+        result = ApplyResponseFields(response);
+        return true;
+    }
 
-        WIFI::MESH::WifiMeshTxMain(data);                                       /*!< First, Tx the data */
+    /*!< Root Section */
+#ifdef CONFIG_SERVER_TRANSPORT_MQTT
+    return TakeFromBroker(result, wait);
+#else
+    bool saturated = (pending >= MAX_INFLIGHT);
 
-        meshData = WIFI::MESH::WifiMeshRxMain(portMAX_DELAY);                   /*!< Second, Rx the response */
+    if (pending == 0 || !Resume() || !ReceiveFromServer(response, wait))
+        return false;
 
-        response = meshData.front();                                            /*!< The response is the first vector item */
-        if (!response.empty() && response.find("No data:") == string::npos)
-            result = static_cast<rerror>(atoi(response.c_str()));
+    if (sock < 0)                                                               /*!< Lost the connection, nothing was answered */
+    {
+        retryAt = esp_timer_get_time() + UPLINK_RETRY * 1000;
+        result  = REST_READ_FAIL;
+        return true;
     }
 
+    relay.Ack(true);                                                            /*!< Answered, the leaves may let go */
+    monitor.Adapt(saturated);
+    response += monitor.Commands();
+
+    WIFI::MESH::WifiMeshTxMain(response, LANE_CONTROL);                         /*!< Third, Tx the response to leaf nodes */
+
+    result = ApplyResponseFields(response);                                     /*!< Last, apply it here too */
+
+    return true;
+#endif
+}
+
+//! \fn     PendingReadings
+//! \brief  This function returns the number of requests in flight, on a leaf node the
+//!         number of messages the root hasn't acked yet, or the children's messages
+//!         not forwarded yet.
+//! \return <int> the number of requests.
+//!
+int PendingReadings()
+{
+    if (WIFI::MESH::WifiIsMeshEnabled() && !WIFI::MESH::WifiIsRootNode())
+        return relay.Pending();
+
+    return pending;
+}
+
+//! \fn     CreateReading
+//! \brief  This function handles POST'ing json data to the REST server, and waits for
+//!         the responses to every request in flight, the result is that of the last one.
+//!         On a leaf node it waits until the root stops sending.
+//! \param  <EventView> The events to POST.
+//! \return <bool> Success or failure.
+//!
+rerror CreateReading(EventView events)
+{
+    rerror  result   = REST_OK;
+
+    if ((result = PostReading(events)) != REST_OK)
+        return result;
+
+    while (PollReading(result, true))
+        ;
+
     return result;
 }
 
@@ -7,21 +7,65 @@
 //!
 //!
 #pragma once
-#include "event.h"
+#include "batch.h"
 
-#ifdef CONFIG_ENABLE_MESH_WIFI
+#if defined(CONFIG_MESH_TRANSPORT_ESPNOW)
+#include "../components/EspNowWiFi/wifi.h"
+#elif defined(CONFIG_ENABLE_MESH_WIFI)
 #include "../components/MeshWiFi/wifi.h"
 #else
 #include "../components/SimpleWiFi/wifi.h"
 #endif
 
 
+//! \fn     FormatDataToJson
+//! \brief  This function formats the events as json array items, without the array.
+//! \param  <EventView> the events, <string> the output.
+//!
+void   FormatDataToJson(EventView events, string &out);
+
+//! \fn     ExtractHttpFieldValues
+//! \brief  This function extracts every value of an http field that may be repeated.
+//! \params <string, string>field and http response.
+//! \return <strings>field values.
+//!
+strings ExtractHttpFieldValues(string field, const string &response);
+
+//! \fn     ExtractHttpFieldValue
+//! \brief  This function extracts the value of an http field.
+//! \params <string, string>field and http response.
+//! \return <string>field value, or blank string.
+//!
+string ExtractHttpFieldValue(string field, string response);
+
 //! \fn     CreateReading
 //! \brief  This function handles POST'ing json data to the REST server.
-//! \param  <string> The json data to POST.
+//! \param  <EventView> The events to POST.
 //! \return <bool> Success or failure.
 //!
-rerror CreateReading(eventList events);
+rerror CreateReading(EventView events);
+
+//! \fn     PostReading
+//! \brief  This function POST's json data to the REST server without waiting for the
+//!         response. Root node only.
+//! \param  <EventView> The events to POST.
+//! \return <rerror> REST_OK once the request is on its way.
+//!
+rerror PostReading(EventView events);
+
+//! \fn     PollReading
+//! \brief  This function takes, relays, and applies the response to the oldest request
+//!         in flight. Root node only.
+//! \param  <rerror> the response code, <bool> wait for the response or not.
+//! \return <bool> false if there was no response to take.
+//!
+bool   PollReading(rerror &result, bool wait);
+
+//! \fn     PendingReadings
+//! \brief  This function returns the number of requests in flight.
+//! \return <int> the number of requests.
+//!
+int    PendingReadings();
 
 //! \fn     ReadReading
 //! \brief  This function handles GET'ing json data from the REST server.
@@ -9,6 +9,8 @@
 
 nvs_handle handle;
 
+RTC_DATA_ATTR bnoWarmState warmState;                       /*!< Survives deep sleep, not power loss */
+
 //! \fn     InitUART
 //! \brief  InitUART sets up the configuration of the UART driver run by the esp32 by 
 //!         providing gpio pins and other settings, includes tx, rx, and port.
@@ -18,7 +20,7 @@ void UART::InitUART(uport uaPort, line txPin, line rxPin)
 {
     uart_config_t config = {};
 
-    config.baud_rate = 115200;
+    config.baud_rate = UART_BAUD;
     config.data_bits = UART_DATA_8_BITS;
     config.parity    = UART_PARITY_DISABLE;
     config.stop_bits = UART_STOP_BITS_1;
@@ -29,6 +31,32 @@ void UART::InitUART(uport uaPort, line txPin, line rxPin)
     uart_driver_install(uaPort, 128 * 2, 0, 0, NULL, 0);
 }
 
+//! \fn     InitI2C
+//! \brief  InitI2C sets up the esp32 as I2C master at 400 kHz on the given port and pins.
+//!         The driver is only installed once per port, so every sensor sharing a bus can
+//!         call this safely.
+//!
+void I2C::InitI2C(i2cport i2Port, line sdaPin, line sclPin)
+{
+    static bool  installed[I2C_NUM_MAX] = {};
+    i2c_config_t config                 = {};
+
+    if (installed[i2Port])
+        return;
+
+    config.mode             = I2C_MODE_MASTER;
+    config.sda_io_num       = sdaPin;
+    config.sda_pullup_en    = GPIO_PULLUP_ENABLE;
+    config.scl_io_num       = sclPin;
+    config.scl_pullup_en    = GPIO_PULLUP_ENABLE;
+    config.master.clk_speed = I2C_FREQ_HZ;
+
+    i2c_param_config(i2Port, &config);
+    i2c_driver_install(i2Port, I2C_MODE_MASTER, 0, 0, 0);
+    i2c_set_timeout(i2Port, 0xFFFFF);                       /*!< BNO055 stretches the clock */
+    installed[i2Port] = true;
+}
+
 //! \fn     OpenPartition
 //! \brief  This function handles initializing and opening an NVS partition using its
 //!         partition name, and a namespace name.
@@ -85,6 +113,24 @@ error NVS::ReadDeviceConfig(byte &loc, word &id, string &test)
     return ESP_OK;
 }
 
+//! \fn     ReadStreamConfig
+//! \brief  ReadStreamConfig reads the optional stream subscriptions of the device, in the
+//!         format accepted by StreamTable::Parse. Nodes without the key stream the 'test'
+//!         vector only.
+//! \return <error> esp error code.
+//!
+error NVS::ReadStreamConfig(string &streams)
+{
+    error status;
+
+    /*!< Read stream subscriptions using nvs_get_str */
+    if ((status = ReadNVS(&nvs_get_str, handle, "streams", streams)) != ESP_OK)
+        return status;
+    else
+        cout << "Streams retrieved!" << endl;
+    return ESP_OK;
+}
+
 error NVS::ReadNetConfig(string &ssid, string &pwd, string &srv, string &port)
 {
     error status;
@@ -116,3 +162,79 @@ error NVS::ReadNetConfig(string &ssid, string &pwd, string &srv, string &port)
     return status;
 }
 
+//! \fn     ReadMeshConfig
+//! \brief  ReadMeshConfig reads the optional mesh id of the suit, 12 hex digits. Every node
+//!         of a suit is provisioned with the same id, and every suit in a room with its
+//!         own, so suits sharing a channel never join each other's mesh.
+//! \return <error> esp error code.
+//!
+error NVS::ReadMeshConfig(string &meshId)
+{
+    error status;
+
+    /*!< Read mesh id using nvs_get_str */
+    if ((status = ReadNVS(&nvs_get_str, handle, "meshId", meshId)) != ESP_OK)
+        return status;
+    else
+        cout << "Mesh id retrieved!" << endl;
+    return ESP_OK;
+}
+
+//! \fn     ReadLinkConfig
+//! \brief  ReadLinkConfig reads the optional link profile of the venue, "realtime" or
+//!         "battery", which overrides the one the firmware was configured with.
+//! \return <error> esp error code.
+//!
+error NVS::ReadLinkConfig(string &profile)
+{
+    error status;
+
+    /*!< Read link profile using nvs_get_str */
+    if ((status = ReadNVS(&nvs_get_str, handle, "profile", profile)) != ESP_OK)
+        return status;
+    else
+        cout << "Link profile retrieved!" << endl;
+    return ESP_OK;
+}
+
+//! \fn     WarmStateChecksum
+//! \brief  WarmStateChecksum computes the crc of every field before 'crc'.
+//! \return <uint32_t> the checksum.
+//!
+static uint32_t WarmStateChecksum(const bnoWarmState &state)
+{
+    return crc32_le(0, reinterpret_cast<const uint8_t *>(&state), offsetof(bnoWarmState, crc));
+}
+
+//! \fn     LoadWarmState
+//! \brief  LoadWarmState copies the state saved before deep sleep out of RTC memory. It
+//!         fails on a cold boot, or if the magic or checksum don't match, in which case
+//!         the node must go through the regular setup.
+//! \return <bool> true if a valid warm state was loaded.
+//!
+bool RTC::LoadWarmState(bnoWarmState &state)
+{
+    if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_UNDEFINED)
+        return false;
+
+    if (warmState.magic != WARM_MAGIC || warmState.crc != WarmStateChecksum(warmState))
+    {
+        cout << "Warm state in RTC memory is invalid, cold starting!" << endl;
+        return false;
+    }
+
+    state = warmState;
+
+    return true;
+}
+
+//! \fn     SaveWarmState
+//! \brief  SaveWarmState stores the state in RTC memory with its magic and checksum. It
+//!         should be the last thing done before entering deep sleep.
+//!
+void RTC::SaveWarmState(const bnoWarmState &state)
+{
+    warmState       = state;
+    warmState.magic = WARM_MAGIC;
+    warmState.crc   = WarmStateChecksum(warmState);
+}
@@ -13,9 +13,21 @@ namespace UART {
     void InitUART(uport uaPort, line txPin, line rxPin);
 }
 
+namespace I2C {
+    void InitI2C(i2cport i2Port, line sdaPin, line sclPin);
+}
+
 namespace NVS {
     error OpenNVSPartition(string partName, string nsName);
     error ReadDeviceConfig(byte &loc, word &id, string &test);
+    error ReadStreamConfig(string &streams);
     error ReadNetConfig(string &ssid, string &pwd, string &srv, string &port);
+    error ReadMeshConfig(string &meshId);
+    error ReadLinkConfig(string &profile);
+}
+
+namespace RTC {
+    bool  LoadWarmState(bnoWarmState &state);
+    void  SaveWarmState(const bnoWarmState &state);
 }
 
@@ -0,0 +1,384 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  stream.cpp
+//! \brief This source contains the implementation of the StreamTable class, which holds the
+//!        vector types a node streams and the rate of each one.
+//!
+//!
+#include "stream.h"
+
+
+//! \fn     Distance
+//! \brief  Distance returns the largest difference between any two components of the
+//!         samples, which is what a deadband is compared against.
+//! \param  <Quaternion> the two samples.
+//! \return <double> the distance.
+//!
+static double Distance(Quaternion a, Quaternion b)
+{
+    double d = max(max(fabs(a.GetEventX() - b.GetEventX()), fabs(a.GetEventY() - b.GetEventY())),
+                   fabs(a.GetEventZ() - b.GetEventZ()));
+
+    if (a.IsQuaternion() && b.IsQuaternion())
+        d = max(d, fabs(a.GetEventW() - b.GetEventW()));
+
+    return d;
+}
+
+//! \fn     ParsePair
+//! \brief  ParsePair reads a single "type:rate[:deadband]" pair, optional types end in
+//!         '?'. A rate of zero is valid, and means the stream is removed.
+//! \param  <string> the pair, <bnoStream> the stream read, scheduled from 'now'.
+//! \return <bool> false if the pair is malformed or the type unknown.
+//!
+static bool ParsePair(const string &pair, bnoStream &s, int64_t now)
+{
+    size_t colon    = pair.find(':');
+    size_t second   = pair.find(':', colon + 1);
+    string type     = pair.substr(0, colon);
+    int    rate     = atoi(pair.substr(colon + 1).c_str());
+    double deadband = (second == string::npos ? 0 : atof(pair.substr(second + 1).c_str()));
+    bool   optional = (!type.empty() && type.back() == '?');
+
+    if (optional)
+        type.pop_back();
+
+    if (colon == string::npos || stringToVector.count(type) == 0 || rate < 0 || deadband < 0)
+        return false;
+
+    s = { stringToVector.at(type), min(rate, MAX_RATE), now, deadband, Quaternion(), 0, 0, optional };
+
+    return true;
+}
+
+//! \fn       Parse
+//! \memberof StreamTable
+//! \brief    Parse replaces the subscriptions with the ones in the config string.
+//!           Unknown types and malformed pairs are skipped, and if nothing valid is
+//!           found the current subscriptions are kept.
+//! \param    <string> "type:rate" or "type:rate:deadband" separated by ';', optional
+//!           types end in '?'.
+//! \return   <bool> true if the table was replaced.
+//!
+bool StreamTable::Parse(string config)
+{
+    vector<bnoStream>  parsed;
+    istringstream      pairs(config);
+    string             pair;
+    int64_t            now = esp_timer_get_time();
+
+    while (getline(pairs, pair, ';'))
+    {
+        bnoStream s = {};
+
+        if (!ParsePair(pair, s, now) || s.rate == 0)
+        {
+            cout << "Ignoring stream \"" << pair << "\"" << endl;
+            continue;
+        }
+        parsed.push_back(s);
+    }
+
+    if (parsed.empty())
+        return false;
+
+    lock.lock();
+    streams = parsed;
+    movedAt = now;
+    still   = false;
+    lock.unlock();
+
+    cout << "Streams: " << ToString() << endl;
+
+    return true;
+}
+
+//! \fn       Set
+//! \memberof StreamTable
+//! \brief    Set changes the rate and deadband of a single stream, adding it if it isn't
+//!           in the table yet. A rate of zero removes the stream.
+//! \param    <bnoVectorType> the stream, <int> rate in Hz, <double> deadband,
+//!           <bool> optional.
+//!
+void StreamTable::Set(bnoVectorType type, int rate, double deadband, bool optional)
+{
+    lock.lock();
+
+    auto it = find_if(streams.begin(), streams.end(), [&] (bnoStream &s) {
+        return s.type == type;
+    });
+
+    if (it != streams.end() && rate <= 0)
+        streams.erase(it);
+    else if (it != streams.end())
+    {
+        it->rate     = min(rate, MAX_RATE);
+        it->deadband = deadband;
+        it->optional = optional;
+    }else if (rate > 0)
+        streams.push_back({ type, min(rate, MAX_RATE), esp_timer_get_time(), deadband, Quaternion(), 0, 0, optional });
+
+    lock.unlock();
+}
+
+//! \fn       Apply
+//! \memberof StreamTable
+//! \brief    Apply changes a single stream from a "type:rate[:deadband]" pair, leaving
+//!           the others as they are. A rate of zero removes the stream.
+//! \param    <string> the pair.
+//! \return   <bool> false if the pair was malformed.
+//!
+bool StreamTable::Apply(const string &pair)
+{
+    bnoStream s = {};
+
+    if (!ParsePair(pair, s, esp_timer_get_time()))
+    {
+        cout << "Ignoring stream \"" << pair << "\"" << endl;
+        return false;
+    }
+    Set(s.type, s.rate, s.deadband, s.optional);
+
+    cout << "Streams: " << ToString() << endl;
+
+    return true;
+}
+
+//! \fn       Accept
+//! \memberof StreamTable
+//! \brief    Accept decides whether a sample of a subscribed stream is sent. A sample is
+//!           suppressed if it is within the deadband of the last one sent, unless that
+//!           was DEADBAND_HOLD ago. A sent sample carries the number suppressed before
+//!           it and the rate it was taken at, so the server can rebuild the stream. The
+//!           first sample outside a deadband while still brings every stream back to
+//!           its full rate right away.
+//! \param    <SensorEvent> the sample, its skip count and rate are filled in.
+//! \return   <bool> true if the sample should be sent.
+//!
+bool StreamTable::Accept(SensorEvent &e)
+{
+    int64_t now    = e.GetTicks();
+    bool    accept = true;
+    bool    moved  = false;
+    bool    woke   = false;
+    double  change = {};
+
+    lock.lock();
+
+    auto it = find_if(streams.begin(), streams.end(), [&] (bnoStream &s) {
+        return s.type == e.GetType();
+    });
+
+    if (it != streams.end())
+    {
+        change = (it->sentAt == 0 ? it->deadband : Distance(it->last, e.GetObject()));
+        moved  = (it->deadband > 0 && change >= it->deadband);
+
+        if (it->deadband > 0 && !moved && now - it->sentAt < DEADBAND_HOLD * 1000)
+        {
+            it->skipped++;
+            accept = false;
+        }else {
+            e.SetSkipped(it->skipped, Rate(*it));
+            it->skipped = 0;
+            it->last    = e.GetObject();
+            it->sentAt  = now;
+        }
+    }
+
+    if (moved)
+    {
+        movedAt = now;
+        if (still)
+        {
+            still = false;
+            woke  = true;
+            for (auto &s : streams)
+                s.next = min(s.next, now);
+        }
+    }
+
+    lock.unlock();
+
+    if (woke && waiter != NULL)                             /*!< Don't wait out the still period */
+        xTaskNotifyGive(waiter);
+
+    return accept;
+}
+
+//! \fn       Due
+//! \memberof StreamTable
+//! \brief    Due returns every stream that is due at 'now', or within SCHED_SLACK of
+//!           it, and advances each of them by one period. A stream that fell more than
+//!           a period behind skips ahead instead of bursting to catch up. Optional
+//!           streams stay on their schedule while shed, and so do all but the feature
+//!           stream at FIDELITY_FEATURES, but they aren't read.
+//! \param    <int64_t> current tick in us.
+//! \return   <vector<bnoVectorType>> the streams to read now.
+//!
+vector<bnoVectorType> StreamTable::Due(int64_t now)
+{
+    vector<bnoVectorType> due;
+
+    lock.lock();
+    if (!still && now - movedAt > STILL_TIME * 1000 &&
+        find_if(streams.begin(), streams.end(), [] (bnoStream &s) { return s.deadband > 0; }) != streams.end())
+    {
+        still = true;
+        cout << "Segment still, deadband streams slowed to " << STILL_RATE << " Hz" << endl;
+    }
+
+    for (auto &s : streams)
+    {
+        if (s.next > now + SCHED_SLACK)
+            continue;
+
+        if (s.optional && pressure == PRESSURE_SHED)
+            shed++;
+        else if (fidelity < FIDELITY_FEATURES || IsFeature(s))
+            due.push_back(s.type);
+        s.next += 1000000 / Rate(s);
+        if (s.next <= now)
+            s.next = now + 1000000 / Rate(s);
+    }
+    lock.unlock();
+
+    return due;
+}
+
+//! \fn       NextDue
+//! \memberof StreamTable
+//! \brief    NextDue returns the tick the next stream comes due, or one second from
+//!           now if the table is empty.
+//! \return   <int64_t> tick in us.
+//!
+int64_t StreamTable::NextDue()
+{
+    int64_t next = esp_timer_get_time() + 1000000;
+
+    lock.lock();
+    for (auto &s : streams)
+        next = min(next, s.next);
+    lock.unlock();
+
+    return next;
+}
+
+//! \fn       ToString
+//! \memberof StreamTable
+//! \brief    ToString formats the table the same way Parse accepts it.
+//! \return   <string> "type:rate" pairs separated by ';'.
+//!
+string StreamTable::ToString()
+{
+    ostringstream out;
+
+    lock.lock();
+    for (auto &s : streams)
+    {
+        if (&s != &streams.front())
+            out << ";";
+        out << vectorToString.at(s.type) << (s.optional ? "?" : "") << ":" << s.rate;
+        if (s.deadband > 0)
+            out << ":" << s.deadband;
+    }
+    lock.unlock();
+
+    return out.str();
+}
+
+//! \fn       SetPressure
+//! \memberof StreamTable
+//! \brief    SetPressure applies the uplink's backpressure to the optional streams.
+//! \param    <streamPressure> the pressure.
+//!
+void StreamTable::SetPressure(streamPressure p)
+{
+    if (p == pressure)
+        return;
+
+    lock.lock();
+    pressure = p;
+    lock.unlock();
+
+    cout << "Backpressure " << p << ", optional streams "
+         << (p == PRESSURE_NONE ? "at full rate" : (p == PRESSURE_SLOW ? "slowed" : "shed")) << endl;
+}
+
+//! \fn       SetFidelity
+//! \memberof StreamTable
+//! \brief    SetFidelity lowers or restores the fidelity of every stream.
+//! \param    <streamFidelity> the fidelity.
+//!
+void StreamTable::SetFidelity(streamFidelity f)
+{
+    if (f == fidelity)
+        return;
+
+    lock.lock();
+    fidelity = f;
+    lock.unlock();
+
+    cout << "Fidelity " << f << ", streams "
+         << (f == FIDELITY_FULL ? "at full rate" : (f == FIDELITY_FEATURES ? "reduced to orientation" : "decimated"))
+         << endl;
+}
+
+//! \fn       RateSum
+//! \memberof StreamTable
+//! \brief    RateSum returns the sum of the full rates of all streams, the most events
+//!           per second the table produces.
+//! \return   <int> events per second.
+//!
+int StreamTable::RateSum()
+{
+    int sum = 0;
+
+    lock.lock();
+    for (auto &s : streams)
+        sum += s.rate;
+    lock.unlock();
+
+    return sum;
+}
+
+//! \fn       Rate
+//! \memberof StreamTable
+//! \brief    Rate returns the rate a stream is currently sampled at. Streams with a
+//!           deadband drop to STILL_RATE while the segment is still, optional streams
+//!           to 1/SLOW_DIVIDER under backpressure, and every stream is decimated once
+//!           the fidelity is lowered. Must be called with the lock held.
+//! \param    <bnoStream> the stream.
+//! \return   <int> rate in Hz.
+//!
+int StreamTable::Rate(const bnoStream &s)
+{
+    int rate = (still && s.deadband > 0 ? min(s.rate, STILL_RATE) : s.rate);
+
+    if (s.optional && pressure != PRESSURE_NONE)
+        rate = max(rate / SLOW_DIVIDER, 1);
+
+    if (fidelity == FIDELITY_FEATURES)
+        rate = min(rate, FEATURE_RATE);
+    else if (fidelity != FIDELITY_FULL)
+        rate = max(rate / DECIMATE_DIVIDER, 1);
+
+    return rate;
+}
+
+//! \fn       IsFeature
+//! \memberof StreamTable
+//! \brief    IsFeature tells the stream kept at FIDELITY_FEATURES, the quaternion, or
+//!           the first stream if there is no quaternion stream. Must be called with
+//!           the lock held.
+//! \param    <bnoStream> the stream.
+//! \return   <bool> true if the stream is the feature stream.
+//!
+bool StreamTable::IsFeature(const bnoStream &s)
+{
+    if (s.type == QUATERNION)
+        return true;
+
+    return (&s == &streams.front() && find_if(streams.begin(), streams.end(), [] (bnoStream &q) {
+        return q.type == QUATERNION;
+    }) == streams.end());
+}
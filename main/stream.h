@@ -0,0 +1,77 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  stream.h
+//! \brief This header contains the definition of the StreamTable class, which holds the vector
+//!        types a node streams and the rate of each one. The sampler asks the table which
+//!        streams are due, and reads all of them in one request to the BnoModule.
+//!
+//!
+#pragma once
+#include "event.h"
+#include "templates.h"
+
+
+//! \brief bnoStream is a single subscription: a vector type, its rate in Hz, and the
+//!        tick it is next due. A stream with a deadband only sends samples that differ
+//!        from the last one sent by more than the deadband, and is slowed to STILL_RATE
+//!        while the segment is still. An optional stream is slowed, then shed, under
+//!        backpressure from the uplink.
+//!
+typedef struct
+{
+    bnoVectorType type;
+    int           rate;
+    int64_t       next;
+    double        deadband;                     /*!< 0 sends every sample */
+    Quaternion    last;                         /*!< Last sample sent */
+    int64_t       sentAt;                       /*!< Tick of the last sample sent, 0 if none */
+    int           skipped;                      /*!< Samples suppressed since the last one sent */
+    bool          optional;
+}bnoStream;
+
+//! \class StreamTable stream.h
+//! \brief The StreamTable class holds the subscriptions of a node. Its config string is
+//!        a list of "type:rate" pairs separated by ';', e.g. "Quaternion:100;Gravity:1"
+//!        where type is any key of stringToVector, and each pair may end in a deadband,
+//!        e.g. "Quaternion:100:0.002", and a type ending in '?' is optional, e.g.
+//!        "Gravity?:1". All streams are scheduled on a common grid, so streams with
+//!        related rates come due on the same tick and share a burst read.
+//!        The segment is still once no deadband stream has moved for STILL_TIME, and
+//!        is back in motion on the first sample outside a deadband. While the uplink is
+//!        congested the root lowers the fidelity of the table, see streamFidelity.
+//!
+class StreamTable
+{
+public:
+    StreamTable(){}
+
+    bool                  Parse  (string config);
+    void                  Set    (bnoVectorType type, int rate, double deadband = 0, bool optional = false);
+    bool                  Apply  (const string &pair);
+    void                  SetPressure(streamPressure p);
+    void                  SetFidelity(streamFidelity f);
+    int                   RateSum();
+    bool                  Accept (SensorEvent &e);
+    vector<bnoVectorType> Due    (int64_t now);
+    int64_t               NextDue();
+    string                ToString();
+
+    /*!< inline public methods */
+    void                  SetWaiter(TaskHandle_t t) { waiter = t; }
+    bool                  IsStill  ()               { return still; }
+    int                   GetShed  ()               { return shed; }
+    streamFidelity        GetFidelity()             { return fidelity; }
+    /*!< inline public methods */
+
+private:
+    int                   Rate   (const bnoStream &s);
+    bool                  IsFeature(const bnoStream &s);
+
+    vector<bnoStream> streams;
+    mutex             lock;
+    bool              still    = false;
+    streamPressure    pressure = PRESSURE_NONE;
+    streamFidelity    fidelity = FIDELITY_FULL;     /*!< Set by the root while its uplink is congested */
+    int               shed     = 0;                 /*!< Optional samples not taken under pressure */
+    int64_t           movedAt  = 0;                 /*!< Tick a deadband was last exceeded */
+    TaskHandle_t      waiter   = NULL;              /*!< Task notified when streams come due early */
+};
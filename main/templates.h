@@ -33,16 +33,31 @@ void CopyMemory(D *destination, S* source, int length)
     copy(src, src + length, dst);
 }
 
+//! \fn     CopyString
+//! \brief  CopyString copies a string into a fixed size char array, truncating it if
+//!         needed. The array is always null terminated.
+//! \params <char (&)[N] destination, string source>
+//!
+template <size_t N>
+void CopyString(char (&destination)[N], const string &source)
+{
+    size_t length = min(source.length(), N - 1);
+
+    source.copy(destination, length);
+    destination[length] = '\0';
+}
+
 //! \fn     TaskDelay
 //! \brief  TaskDelay performs a system delay using the parameter ms, and
 //!         simply passes it to the FreeRtos function vTaskDelay. 'ms' is
-//!         automatically converted to the correct type.
+//!         automatically converted to the correct type, and rounded up to
+//!         whole ticks so short delays aren't skipped.
 //! \params <T ms> number of milliseconds.
 //!
 template <typename T>
 void Pause(T ms)
 {
-    vTaskDelay(static_cast<uint32_t>(ms) / portTICK_PERIOD_MS);
+    vTaskDelay((static_cast<uint32_t>(ms) + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
 }
 
 //! \fn     CompareTo
@@ -105,7 +120,7 @@ error ReadNVS(Func func, nvs_handle h, const char* key, string &out)
             str = new char[length];
             func(h, key, str, &length);
             out = string(str);
-            delete str;
+            delete[] str;
         }else {
             cout << "Blank string found using key!" << endl;
             status = ESP_ERR_NVS_INVALID_LENGTH;
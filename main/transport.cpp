@@ -0,0 +1,245 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  transport.cpp
+//! \brief This source contains the implementation of the UART and I2C transports which move
+//!        register reads and writes between the esp32 and the BNO055.
+//!
+//!
+#include "transport.h"
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief BnoTransport section
+//!
+
+//! \fn       Stamp
+//! \memberof BnoTransport
+//! \brief    Stamp estimates when the imu latched the data of the last read. The read
+//!           command was started at 'tx' and the response finished arriving at 'rx'.
+//!           The imu can't have latched before the 'sent' command bytes were on the
+//!           wire, nor after it started returning the 'received' response bytes, so
+//!           the sample is placed in the middle of that window and half the window
+//!           is the uncertainty.
+//! \param    <int64_t> tx and rx ticks, <int> bytes sent and received, <int64_t> ns per byte.
+//!
+void BnoTransport::Stamp(int64_t tx, int64_t rx, int sent, int received, int64_t byteNs)
+{
+    int64_t earliest = tx + sent * byteNs / 1000;
+    int64_t latest   = rx - received * byteNs / 1000;
+
+    if (latest < earliest)                                  /*!< Preempted while stamping, trust rx */
+        earliest = latest;
+
+    sampleTicks = (earliest + latest) / 2;
+    uncertainty = (latest - earliest) / 2;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief UartTransport section
+//!
+
+//! \fn       Constructor
+//! \memberof UartTransport
+//! \brief    This is the constructor for the UartTransport class.
+//! \param    <uport> an initialized uart port.
+//!
+UartTransport::UartTransport(uport p)
+{
+    uaPort   = p;
+    retries  = UARTLOOPCOUNT;
+    attempts = UARTLOOPCOUNT;
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_create(ESP_PM_NO_LIGHT_SLEEP, 0, "bno_uart", &pmLock);
+#endif
+}
+
+//! \fn       Read
+//! \memberof UartTransport
+//! \brief    This function takes the bno register address to be read from, as well as
+//!           a buffer to read data into, and sends the command to the IMU. If 'len' is
+//!           only 1 a one-byte read will be performed, otherwise multi-byte.
+//! \param    <bnoRegister> register, <byte> buffer and length.
+//! \return   <uerror> bnoStatus code.
+//!
+uerror UartTransport::Read(bnoRegister reg, byte *buff, byte len)
+{
+    uerror  result = {};
+    byte    cmd[4] = {};
+    byte    *data  = new byte[len + 2];
+    int64_t tx     = {};
+
+    cmd[0] = 0xAA;
+    cmd[1] = 0x01;
+    cmd[2] = static_cast<byte>(reg);
+    cmd[3] = len;
+
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_acquire(pmLock);
+#endif
+    for (int i = 0; i < attempts; i++)
+    {
+        uart_flush(uaPort);
+        tx = esp_timer_get_time();
+        uart_write_bytes(uaPort, (const char *)cmd, 4);
+
+        if (uart_read_bytes(uaPort, data, len + 2, 20 / portTICK_PERIOD_MS) > 0)
+        {
+            switch (data[0])
+            {
+            case 0xBB:                                      /*!< The driver hands data over after UART_RX_TOUT idle symbols */
+                Stamp(tx, esp_timer_get_time(), 4, len + 2 + UART_RX_TOUT, UART_BYTE_NS);
+                CopyMemory(buff, data + 2, len);
+                result = data[0];
+                break;
+            case 0xEE:
+                result = data[1];
+                break;
+            }
+
+            if (CompareTo<uerror>(result, {BNO_READ_SUCCESS}))
+                break;
+            else if (CompareTo<uerror>(result, {BNO_READ_FAIL, BNO_WRONG_START_BYTE, BNO_BUS_OVERRUN, BNO_RECEIVE_TIMEOUT}))
+                continue;                                         /*!< Here there is maybe a serial issue */
+            else                                                  /*!< Everything else, an issue with the parameters */
+                break;
+        }
+    }
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_release(pmLock);
+#endif
+    delete[] data;
+
+    return result;
+}
+
+//! \fn       Write
+//! \memberof UartTransport
+//! \brief    This function takes the bno register address to be written to, as well as
+//!           the bytes to write, and sends the command to the IMU.
+//! \param    <bnoRegister> register, <byte> buffer and length.
+//! \return   <uerror> bnoStatus code.
+//!
+uerror UartTransport::Write(bnoRegister reg, byte *buff, byte len)
+{
+    uerror result  = {};
+    byte   *cmd    = new byte[len + 4];
+    byte   resp[2] = {};
+
+    cmd[0] = 0xAA;
+    cmd[1] = 0x00;
+    cmd[2] = static_cast<byte>(reg);
+    cmd[3] = len;
+    CopyMemory(cmd + 4, buff, len);
+
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_acquire(pmLock);
+#endif
+    for (int i = 0; i < attempts; i++)
+    {
+        uart_flush(uaPort);
+        uart_write_bytes(uaPort, (const char *)cmd, len + 4);
+
+        if (uart_read_bytes(uaPort, resp, 2, 20 / portTICK_PERIOD_MS) > 0)
+        {
+            result = resp[1];
+
+            if (CompareTo<uerror>(result, {BNO_WRITE_SUCCESS}))
+                break;
+            else if (CompareTo<uerror>(result, {BNO_WRITE_FAIL, BNO_WRONG_START_BYTE, BNO_BUS_OVERRUN, BNO_RECEIVE_TIMEOUT}))
+                continue;                                           /*!< Here there is maybe a serial issue */
+            else                                                    /*!< Everything else, an issue with the parameters */
+                break;
+        }
+    }
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_release(pmLock);
+#endif
+    delete[] cmd;
+
+    return result;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief I2cTransport section
+//!
+
+//! \fn       Constructor
+//! \memberof I2cTransport
+//! \brief    This is the constructor for the I2cTransport class.
+//! \param    <i2cport> an initialized i2c port, <byte> BNO_ADDRESS_A or BNO_ADDRESS_B.
+//!
+I2cTransport::I2cTransport(i2cport p, byte address)
+{
+    i2Port     = p;
+    devAddress = address;
+    retries    = I2CLOOPCOUNT;
+    attempts   = I2CLOOPCOUNT;
+}
+
+//! \fn       Read
+//! \memberof I2cTransport
+//! \brief    This function writes the register address, then issues a repeated start and
+//!           reads 'len' bytes in one burst, acking every byte but the last.
+//! \param    <bnoRegister> register, <byte> buffer and length.
+//! \return   <uerror> bnoStatus code, BNO_MIN_LENGTH if 'len' is 0.
+//!
+uerror I2cTransport::Read(bnoRegister reg, byte *buff, byte len)
+{
+    error   result = ESP_FAIL;
+    int64_t tx     = {};
+
+    if (len == 0)                                           /*!< The last byte is read on its own */
+        return BNO_MIN_LENGTH;
+
+    for (int i = 0; i < attempts && result != ESP_OK; i++)
+    {
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (devAddress << 1) | I2C_MASTER_WRITE, true);
+        i2c_master_write_byte(cmd, static_cast<byte>(reg), true);
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (devAddress << 1) | I2C_MASTER_READ, true);
+        if (len > 1)
+            i2c_master_read(cmd, buff, len - 1, I2C_MASTER_ACK);
+        i2c_master_read_byte(cmd, buff + len - 1, I2C_MASTER_NACK);
+        i2c_master_stop(cmd);
+
+        tx     = esp_timer_get_time();
+        result = i2c_master_cmd_begin(i2Port, cmd, 20 / portTICK_PERIOD_MS);
+        if (result == ESP_OK)                               /*!< Address, register, address, then data */
+            Stamp(tx, esp_timer_get_time(), 3, len, I2C_BYTE_NS);
+        i2c_cmd_link_delete(cmd);
+    }
+
+    return (result == ESP_OK ? BNO_READ_SUCCESS : BNO_READ_FAIL);
+}
+
+//! \fn       Write
+//! \memberof I2cTransport
+//! \brief    This function writes the register address followed by 'len' bytes, the
+//!           BNO055 auto-increments the register address after each byte.
+//! \param    <bnoRegister> register, <byte> buffer and length.
+//! \return   <uerror> bnoStatus code.
+//!
+uerror I2cTransport::Write(bnoRegister reg, byte *buff, byte len)
+{
+    error result = ESP_FAIL;
+
+    for (int i = 0; i < attempts && result != ESP_OK; i++)
+    {
+        i2c_cmd_handle_t cmd = i2c_cmd_link_create();
+
+        i2c_master_start(cmd);
+        i2c_master_write_byte(cmd, (devAddress << 1) | I2C_MASTER_WRITE, true);
+        i2c_master_write_byte(cmd, static_cast<byte>(reg), true);
+        i2c_master_write(cmd, buff, len, true);
+        i2c_master_stop(cmd);
+
+        result = i2c_master_cmd_begin(i2Port, cmd, 20 / portTICK_PERIOD_MS);
+        i2c_cmd_link_delete(cmd);
+    }
+
+    return (result == ESP_OK ? BNO_WRITE_SUCCESS : BNO_WRITE_FAIL);
+}
@@ -0,0 +1,78 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  transport.h
+//! \brief This header contains the definition of the BnoTransport interface and its UART and I2C
+//!        implementations. A transport moves register reads and writes between the esp32 and
+//!        the BNO055, which allows the BnoModule to be constructed on either bus.
+//!
+//!
+#pragma once
+#include "defines.h"
+#include "templates.h"
+
+
+//! \class BnoTransport transport.h
+//! \brief The BnoTransport class is the interface every bus backend implements. Both
+//!        functions return one of the bnoStatus codes, BNO_READ_SUCCESS or
+//!        BNO_WRITE_SUCCESS on success. After a successful read, GetSampleTicks is the
+//!        estimated moment the imu latched the data, and GetUncertainty the +/- bound
+//!        on that estimate, both in us.
+//!
+class BnoTransport
+{
+public:
+    virtual ~BnoTransport() {}
+
+    virtual uerror Read (bnoRegister reg, byte *buff, byte len) = 0;
+    virtual uerror Write(bnoRegister reg, byte *buff, byte len) = 0;
+
+    int64_t GetSampleTicks() { return sampleTicks; }
+    int64_t GetUncertainty() { return uncertainty; }
+    void    SetAttempts(int n) { attempts = (n > 0 ? n : retries); }    /*!< n <= 0 restores the default */
+
+protected:
+    void    Stamp(int64_t tx, int64_t rx, int sent, int received, int64_t byteNs);
+
+    int64_t sampleTicks = 0;
+    int64_t uncertainty = 0;
+    int     retries     = 1;                                /*!< Default attempts per transaction */
+    int     attempts    = 1;
+};
+
+//! \class UartTransport transport.h
+//! \brief The UartTransport class speaks the BNO055 UART framing, 0xAA start byte followed
+//!        by the read/write flag, register, and length. The port must already be set up
+//!        using UART::InitUART.
+//!
+class UartTransport : public BnoTransport
+{
+public:
+    UartTransport(uport p);
+
+    uerror Read (bnoRegister reg, byte *buff, byte len);
+    uerror Write(bnoRegister reg, byte *buff, byte len);
+
+private:
+    uport uaPort;
+#ifdef CONFIG_BNO_POWER_SAVE
+    esp_pm_lock_handle_t pmLock;                /*!< No light sleep while a frame is on the wire */
+#endif
+};
+
+//! \class I2cTransport transport.h
+//! \brief The I2cTransport class reads and writes BNO055 registers over I2C. Reads are a
+//!        single burst using a repeated start, so any length is one bus transaction. Two
+//!        sensors can share a port as long as one is at BNO_ADDRESS_A and the other at
+//!        BNO_ADDRESS_B. The port must already be set up using I2C::InitI2C.
+//!
+class I2cTransport : public BnoTransport
+{
+public:
+    I2cTransport(i2cport p, byte address);
+
+    uerror Read (bnoRegister reg, byte *buff, byte len);
+    uerror Write(bnoRegister reg, byte *buff, byte len);
+
+private:
+    i2cport i2Port;
+    byte    devAddress;
+};
@@ -0,0 +1,189 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  uplink.cpp
+//! \brief This source contains the implementation of the Uplink class, the network worker.
+//!
+//!
+#include "uplink.h"
+
+
+//! \brief Globals
+//!
+extern PowerManager power;
+
+
+//! \fn       Start
+//! \memberof Uplink
+//! \brief    Start creates the batch queues, fills the free queue with the pool, and
+//!           creates the worker task.
+//! \param    <uplinkHandler> called with every rerror other than REST_OK,
+//!           <int> events per batch.
+//!
+void Uplink::Start(uplinkHandler h, int capacity)
+{
+    handler   = h;
+    SetCapacity(capacity);
+    freeQueue = xQueueCreate(BATCH_POOL, sizeof(EventBatch*));
+    fullQueue = xQueueCreate(BATCH_POOL, sizeof(EventBatch*));
+
+    for (auto &batch : pool)
+        Release(&batch);
+
+    xTaskCreate(&WorkerThread, "Uplink", 8192, this, tskIDLE_PRIORITY + 4, &worker);
+}
+
+//! \fn       Acquire
+//! \memberof Uplink
+//! \brief    Acquire takes an empty batch from the pool, without waiting.
+//! \return   <EventBatch*> the batch, NULL if every batch is in use.
+//!
+EventBatch *Uplink::Acquire()
+{
+    EventBatch *batch = NULL;
+
+    if (xQueueReceive(freeQueue, &batch, 0) != pdTRUE)
+        return NULL;
+
+    return batch;
+}
+
+//! \fn       Submit
+//! \memberof Uplink
+//! \brief    Submit hands a batch to the worker. The caller must not touch it again.
+//! \param    <EventBatch*> the batch, <batchTrigger> the watermark that closed it.
+//!
+void Uplink::Submit(EventBatch *batch, batchTrigger trigger)
+{
+    batch->SetTrigger(trigger);
+    xQueueSend(fullQueue, &batch, portMAX_DELAY);           /*!< Never blocks, the queue holds the whole pool */
+}
+
+//! \fn       Release
+//! \memberof Uplink
+//! \brief    Release clears a batch and returns it to the pool, from the worker once it's
+//!           encoded, or from the sampler when it had nothing to submit. The batch takes
+//!           the current capacity here, while no one is filling it.
+//! \param    <EventBatch*> the batch.
+//!
+void Uplink::Release(EventBatch *batch)
+{
+    batch->Clear();
+    batch->SetCapacity(capacity);
+    xQueueSend(freeQueue, &batch, portMAX_DELAY);
+}
+
+//! \fn       WorkerThread
+//! \memberof Uplink
+//! \brief    WorkerThread is the entry point of the worker task.
+//! \param    <void*> the Uplink.
+//!
+void Uplink::WorkerThread(void *arg)
+{
+    static_cast<Uplink*>(arg)->Serve();
+}
+
+//! \fn       Serve
+//! \memberof Uplink
+//! \brief    Serve posts the submitted batches, and takes the responses as they arrive.
+//!           It only blocks on a response when MAX_INFLIGHT requests are in flight, and
+//!           otherwise polls every UPLINK_POLL ms while waiting on the next batch. The
+//!           power window spans from the first batch until the last response. Leaf nodes
+//!           have no connection of their own, there the requests in flight are the
+//!           messages the root hasn't acked yet. A batch that couldn't be sent, for lack
+//!           of wifi or of the server, goes back to the front of the queue and is tried
+//!           again after UPLINK_RETRY ms, meanwhile the sampler runs out of batches and
+//!           sheds its optional streams.
+//!
+void Uplink::Serve()
+{
+    EventBatch *batch  = NULL;
+    rerror      result = REST_OK;
+    bool        busy   = false;
+    TickType_t  wait   = {};
+
+    while (1)
+    {
+        wait = (PendingReadings() > 0 ? UPLINK_POLL / portTICK_PERIOD_MS : portMAX_DELAY);
+
+        if (xQueueReceive(fullQueue, &batch, wait) == pdTRUE)
+        {
+            if (!busy)
+                power.BeginWindow();
+            busy = true;
+
+            result = PostReading(batch->View());
+            if (result == REST_NO_WIFI || result == REST_CONNECT_FAIL || result == REST_WRITE_FAIL)
+            {
+                xQueueSendToFront(fullQueue, &batch, portMAX_DELAY);   /*!< Not sent, kept for the next try */
+                handler(result);
+                vTaskDelay(UPLINK_RETRY / portTICK_PERIOD_MS);
+                continue;
+            }
+
+            Count(batch);
+            Release(batch);                                 /*!< Encoded, the sampler may have it back */
+            if (result != REST_OK)
+                handler(result);
+        }
+
+        while (PollReading(result, PendingReadings() >= MAX_INFLIGHT))
+        {
+            if (result != REST_OK)
+                handler(result);
+        }
+
+        if (busy && PendingReadings() == 0 && uxQueueMessagesWaiting(fullQueue) == 0)
+        {
+            power.EndWindow();
+            busy = false;
+        }
+    }
+}
+
+//! \fn       GetPressure
+//! \memberof Uplink
+//! \brief    GetPressure maps the batches left free to backpressure. With one batch
+//!           left the optional streams are slowed, with none they are shed.
+//! \return   <streamPressure> the pressure.
+//!
+streamPressure Uplink::GetPressure()
+{
+    int free = uxQueueMessagesWaiting(freeQueue);
+
+    return (free == 0 ? PRESSURE_SHED : (free == 1 ? PRESSURE_SLOW : PRESSURE_NONE));
+}
+
+//! \fn       Count
+//! \memberof Uplink
+//! \brief    Count adds a posted batch to the stats, and prints them every BATCH_REPORT
+//!           batches.
+//! \param    <EventBatch*> the batch.
+//!
+void Uplink::Count(const EventBatch *batch)
+{
+    int size = batch->Size();
+
+    stats.smallest = (stats.batches == 0 ? size : min(stats.smallest, size));
+    stats.largest  = max(stats.largest, size);
+    stats.events  += size;
+    stats.batches++;
+    stats.triggers[batch->GetTrigger()]++;
+
+    if (stats.batches % BATCH_REPORT == 0)
+        cout << "Batches: " << ToString() << endl;
+}
+
+//! \fn       ToString
+//! \memberof Uplink
+//! \brief    ToString formats the batch stats for the log.
+//! \return   <string> the stats.
+//!
+string Uplink::ToString()
+{
+    ostringstream out;
+
+    out << stats.batches << " posted, " << stats.smallest << "-" << stats.largest << " events, average "
+        << (stats.batches == 0 ? 0 : stats.events / stats.batches) << ", closed by age "
+        << stats.triggers[TRIGGER_AGE] << " full " << stats.triggers[TRIGGER_FULL] << ", dropped " << stats.dropped << " shed " << stats.shed;
+
+    return out.str();
+}
@@ -0,0 +1,59 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  uplink.h
+//! \brief This header contains the definition of the Uplink class, the network worker that
+//!        takes full batches from the sampler and posts them to the server.
+//!
+//!
+#pragma once
+#include "batch.h"
+#include "power.h"
+#include "rest.h"
+
+
+//! \brief uplinkHandler is called from the worker with every rerror other than REST_OK.
+//!
+typedef void (*uplinkHandler)(rerror r);
+
+//! \class Uplink uplink.h
+//! \brief The Uplink class owns a small pool of batches and a worker task. The sampler
+//!        fills a batch it acquired, and submits it once full or due, the worker encodes
+//!        and sends it, and returns it to the pool as soon as it's encoded. On the root
+//!        node requests are pipelined on the persistent connection: up to MAX_INFLIGHT
+//!        requests are in flight, so batch N+1 is encoded while batch N waits on the
+//!        server. Batches only change hands through the queues, so neither side holds a
+//!        lock during I/O. The batches are resized as they come back to the pool, and the
+//!        number left free is the backpressure the sampler applies to its streams.
+//!
+class Uplink
+{
+public:
+    Uplink(){}
+
+    void         Start  (uplinkHandler h, int capacity);
+    EventBatch  *Acquire();                     /*!< NULL if every batch is in use */
+    void         Submit (EventBatch *batch, batchTrigger trigger);
+    void         Release(EventBatch *batch);    /*!< Returns a batch unused */
+    streamPressure GetPressure();
+    string       ToString();
+
+    /*!< inline public methods */
+    void         SetCapacity(int n) { capacity = n; }
+    void         Drop       ()      { stats.dropped++; }
+    void         SetShed    (int n) { stats.shed = n; }
+    batchStats   GetStats   ()      { return stats; }
+    /*!< inline public methods */
+
+private:
+    static void  WorkerThread(void *arg);
+    void         Serve  ();
+    void         Count  (const EventBatch *batch);
+
+    /*<! Private Data Section */
+    array<EventBatch, BATCH_POOL> pool;
+    QueueHandle_t freeQueue = NULL;             /*!< Empty batches, taken by the sampler */
+    QueueHandle_t fullQueue = NULL;             /*!< Batches waiting on the worker */
+    TaskHandle_t  worker    = NULL;
+    uplinkHandler handler   = NULL;
+    int           capacity  = BATCH_MIN;        /*!< Events per batch, applied on Release */
+    batchStats    stats     = {};
+};
@@ -0,0 +1,295 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  bno055.cpp
+//! \brief This source contains the host stand-in for the BNO055 and the buses to it. Both the
+//!        UART and the I2C driver lead to one register file, page 0 only. The chip answers
+//!        the way the datasheet says, and in a fusion mode reports a node turning slowly
+//!        about z, its rate set by the mac, with gravity straight down.
+//!
+//!
+#include "idf.h"
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::mutex;
+using std::vector;
+
+const int     UART_BYTE_US = 87;                            /*!< 10 bits at 115200 baud */
+const uint8_t REG_DATA     = 0x08;                          /*!< First data register */
+const uint8_t REG_DATA_END = 0x35;                          /*!< First register after the data */
+const uint8_t REG_SYS_STAT = 0x39;
+const uint8_t REG_OPR_MODE = 0x3D;
+const uint8_t REG_TRIGGER  = 0x3F;
+
+//! \brief i2cStep is a queued I2C command, its data is written from or read into.
+//!
+typedef struct
+{
+    bool     start;
+    bool     read;
+    uint8_t *data;
+    size_t   length;
+    vector<uint8_t> written;
+}i2cStep;
+
+static mutex           chipLock;
+static uint8_t         regs[128]  = {};
+static bool            powered    = false;
+static vector<uint8_t> uartReply;
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief The chip
+//!
+
+//! \fn    Reset
+//! \brief Puts the registers back the way they are at power on, lock held.
+//!
+static void Reset()
+{
+    memset(regs, 0, sizeof(regs));
+    regs[0x00] = 0xA0;                                      /*!< Chip id */
+    regs[0x01] = 0xFB;
+    regs[0x02] = 0x32;
+    regs[0x03] = 0x0F;
+    regs[0x04] = 0x11;
+    regs[0x05] = 0x03;
+    regs[0x34] = 25;                                        /*!< Temperature, C */
+    regs[0x35] = 0xFF;                                      /*!< Fully calibrated */
+    regs[0x3B] = 0x80;
+    regs[0x41] = 0x24;
+    powered    = true;
+}
+
+static void Put(int reg, double value)
+{
+    int16_t raw = static_cast<int16_t>(lround(value));
+
+    regs[reg]     = raw & 0xFF;
+    regs[reg + 1] = (raw >> 8) & 0xFF;
+}
+
+//! \fn    Sample
+//! \brief Fills the data registers for now, lock held. Outside a fusion mode only the raw
+//!        sensors change.
+//!
+static void Sample()
+{
+    const uint8_t *mac   = HostGetMac();
+    double         rate  = 0.2 + 0.05 * (mac[5] % 16);      /*!< rad/s */
+    double         t     = esp_timer_get_time() / 1e6;
+    double         angle = fmod(rate * t, 2 * M_PI);
+    bool           fused = (regs[REG_OPR_MODE] & 0x0F) >= 0x08;
+
+    Put(0x08, 0);         Put(0x0A, 0);          Put(0x0C, 981);          /*!< Accel, 1 m/s2 = 100 */
+    Put(0x0E, 200 * cos(angle)); Put(0x10, -200 * sin(angle)); Put(0x12, -400);  /*!< Mag, 1 uT = 16 */
+    Put(0x14, 0);         Put(0x16, 0);          Put(0x18, 16 * rate * 180 / M_PI);  /*!< Gyro, 1 dps = 16 */
+
+    if (!fused)
+        return;
+
+    Put(0x1A, 16 * angle * 180 / M_PI); Put(0x1C, 0); Put(0x1E, 0);                  /*!< Euler, 1 deg = 16 */
+    Put(0x20, 16384 * cos(angle / 2));  Put(0x22, 0); Put(0x24, 0);                  /*!< Quaternion, 1 = 2^14 */
+    Put(0x26, 16384 * sin(angle / 2));
+    Put(0x28, 0);   Put(0x2A, 0);   Put(0x2C, 0);                                    /*!< Linear accel */
+    Put(0x2E, 0);   Put(0x30, 0);   Put(0x32, 981);                                  /*!< Gravity */
+}
+
+//! \fn    ReadRegs
+//! \brief Reads registers, lock held.
+//!
+static void ReadRegs(uint8_t reg, uint8_t *data, size_t length)
+{
+    if (reg < REG_DATA_END && reg + length > REG_DATA)
+        Sample();
+    for (size_t i = 0; i < length; i++)
+        data[i] = regs[(reg + i) & 0x7F];
+}
+
+//! \fn    WriteRegs
+//! \brief Writes registers, lock held. The mode and trigger registers act as on the chip.
+//!
+static void WriteRegs(uint8_t reg, const uint8_t *data, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t at = (reg + i) & 0x7F;
+
+        if (at == REG_TRIGGER && (data[i] & 0x20))
+        {
+            Reset();
+            continue;
+        }
+        if (at <= REG_SYS_STAT || at == 0x3A)               /*!< Read only */
+            continue;
+        regs[at] = data[i];
+
+        if (at == REG_OPR_MODE)
+            regs[REG_SYS_STAT] = ((data[i] & 0x0F) == 0 ? 0x00 : (data[i] & 0x0F) >= 0x08 ? 0x05 : 0x06);
+    }
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief UART, "AA 01 reg len" reads and "AA 00 reg len data" writes
+//!
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config) { return ESP_OK; }
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)  { return ESP_OK; }
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)              { return ESP_OK; }
+
+esp_err_t uart_driver_install(uart_port_t port, int rxSize, int txSize, int queueSize, QueueHandle_t *queue, int flags)
+{
+    std::lock_guard<mutex> guard(chipLock);
+
+    if (!powered)
+        Reset();
+    return ESP_OK;
+}
+
+esp_err_t uart_flush(uart_port_t port)
+{
+    std::lock_guard<mutex> guard(chipLock);
+
+    uartReply.clear();
+    return ESP_OK;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+    return uart_flush(port);
+}
+
+int uart_write_bytes(uart_port_t port, const char *data, size_t length)
+{
+    const uint8_t         *cmd = reinterpret_cast<const uint8_t*>(data);
+    std::lock_guard<mutex> guard(chipLock);
+
+    uartReply.clear();
+    if (length < 4 || cmd[0] != 0xAA)
+    {
+        uartReply = { 0xEE, 0x06 };                         /*!< Wrong start byte */
+    }else if (cmd[1] == 0x01) {
+        uartReply.resize(2 + cmd[3]);
+        uartReply[0] = 0xBB;
+        uartReply[1] = cmd[3];
+        ReadRegs(cmd[2], uartReply.data() + 2, cmd[3]);
+    }else if (length < 4u + cmd[3]) {
+        uartReply = { 0xEE, 0x0A };                         /*!< Receive character timeout */
+    }else {
+        WriteRegs(cmd[2], cmd + 4, cmd[3]);
+        uartReply = { 0xEE, 0x01 };
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(length * UART_BYTE_US));
+    return length;
+}
+
+int uart_read_bytes(uart_port_t port, uint8_t *data, uint32_t length, TickType_t ticks)
+{
+    size_t count;
+    {
+        std::lock_guard<mutex> guard(chipLock);
+
+        count = std::min<size_t>(length, uartReply.size());
+        memcpy(data, uartReply.data(), count);
+        uartReply.erase(uartReply.begin(), uartReply.begin() + count);
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(count * UART_BYTE_US));
+    return count;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief I2C, a command link is run against the register file when it's begun
+//!
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t *config) { return ESP_OK; }
+esp_err_t i2c_set_timeout(i2c_port_t port, int timeout)                  { return ESP_OK; }
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rxSize, size_t txSize, int flags)
+{
+    std::lock_guard<mutex> guard(chipLock);
+
+    if (!powered)
+        Reset();
+    return ESP_OK;
+}
+
+i2c_cmd_handle_t i2c_cmd_link_create()                 { return new vector<i2cStep>(); }
+void             i2c_cmd_link_delete(i2c_cmd_handle_t cmd) { delete static_cast<vector<i2cStep>*>(cmd); }
+
+static esp_err_t Queue(i2c_cmd_handle_t cmd, i2cStep step)
+{
+    static_cast<vector<i2cStep>*>(cmd)->push_back(step);
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_start(i2c_cmd_handle_t cmd) { return Queue(cmd, { true, false, NULL, 0, {} }); }
+esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd)  { return ESP_OK; }
+
+esp_err_t i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack)
+{
+    return Queue(cmd, { false, false, NULL, 0, { data } });
+}
+
+esp_err_t i2c_master_write(i2c_cmd_handle_t cmd, uint8_t *data, size_t length, bool ack)
+{
+    return Queue(cmd, { false, false, NULL, 0, vector<uint8_t>(data, data + length) });
+}
+
+esp_err_t i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, i2c_ack_type_t ack)
+{
+    return Queue(cmd, { false, true, data, 1, {} });
+}
+
+esp_err_t i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t length, i2c_ack_type_t ack)
+{
+    return Queue(cmd, { false, true, data, length, {} });
+}
+
+//! \fn    i2c_master_cmd_begin
+//! \brief Runs a command link. A write transaction's first byte after the address sets the
+//!        register pointer, the rest is written from there; reads go on from the pointer.
+//!
+esp_err_t i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks)
+{
+    std::lock_guard<mutex> guard(chipLock);
+    static uint8_t         pointer = 0;
+    vector<uint8_t>        written;
+    bool                   addressed = false;
+    size_t                 bytes     = 0;
+
+    for (auto &step : *static_cast<vector<i2cStep>*>(cmd))
+    {
+        if (step.start)
+        {
+            if (written.size() > 1)
+                WriteRegs(written[0], written.data() + 1, written.size() - 1);
+            if (!written.empty())
+                pointer = written[0];
+            written.clear();
+            addressed = false;
+        }else if (step.read) {
+            ReadRegs(pointer, step.data, step.length);
+            pointer += step.length;
+            bytes   += step.length;
+        }else {
+            for (auto b : step.written)
+            {
+                if (addressed)
+                    written.push_back(b);
+                addressed = true;                           /*!< The first byte is the address */
+            }
+            bytes += step.written.size();
+        }
+    }
+    if (written.size() > 1)
+        WriteRegs(written[0], written.data() + 1, written.size() - 1);
+    if (!written.empty())
+        pointer = written[0];
+
+    std::this_thread::sleep_for(std::chrono::microseconds(bytes * 23));    /*!< 9 bits at 400 kHz */
+    return ESP_OK;
+}
@@ -0,0 +1,313 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  freertos.cpp
+//! \brief This source contains the host stand-in for FreeRTOS. Tasks are threads, queues,
+//!        semaphores and event groups are guarded by a mutex, and waits are condition
+//!        variable waits of the tick count in wall time.
+//!
+//!
+#include "idf.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::chrono::milliseconds;
+using std::chrono::steady_clock;
+using std::condition_variable;
+using std::deque;
+using std::mutex;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+
+//! \brief hostTask is a task, the notification count is its only state.
+//!
+typedef struct
+{
+    mutex              lock;
+    condition_variable signal;
+    uint32_t           notified;
+}hostTask;
+
+//! \brief hostQueue is a queue of fixed size items, a semaphore is a queue of empty items.
+//!
+typedef struct
+{
+    mutex              lock;
+    condition_variable signal;
+    deque<vector<uint8_t>> items;
+    UBaseType_t        length;
+    UBaseType_t        size;
+}hostQueue;
+
+//! \brief hostGroup is an event group.
+//!
+typedef struct
+{
+    mutex              lock;
+    condition_variable signal;
+    EventBits_t        bits;
+}hostGroup;
+
+static thread_local hostTask *self = NULL;
+static const steady_clock::time_point boot = steady_clock::now();
+
+
+//! \fn     Wait
+//! \brief  Waits on a condition for up to the given ticks, portMAX_DELAY waits forever.
+//! \return <bool> the condition, as it was when the wait ended.
+//!
+template <typename Condition>
+static bool Wait(condition_variable &signal, unique_lock<mutex> &guard, TickType_t ticks, Condition condition)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        signal.wait(guard, condition);
+        return true;
+    }
+    return signal.wait_for(guard, milliseconds((uint64_t)ticks * portTICK_PERIOD_MS), condition);
+}
+
+//! \fn     CurrentTask
+//! \brief  Gets the task of the calling thread, app_main's thread gets one on first use.
+//!
+static hostTask *CurrentTask()
+{
+    if (self == NULL)
+        self = new hostTask();
+    return self;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Tasks
+//!
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *task)
+{
+    hostTask *created = new hostTask();
+
+    if (task != NULL)
+        *task = created;                                    /*!< Before it runs, it may be notified at once */
+
+    thread([=]() { self = created; fn(arg); }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                                   TaskHandle_t *task, BaseType_t core)
+{
+    return xTaskCreate(fn, name, stack, arg, prio, task);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == NULL || task == self)
+    {
+        while (1)                                           /*!< Threads can't be killed, park it */
+            std::this_thread::sleep_for(std::chrono::hours(1));
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(milliseconds((uint64_t)ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return std::chrono::duration_cast<milliseconds>(steady_clock::now() - boot).count() / portTICK_PERIOD_MS;
+}
+
+void vTaskDelayUntil(TickType_t *previous, TickType_t ticks)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    *previous += ticks;
+    if ((int32_t)(*previous - now) > 0)
+        vTaskDelay(*previous - now);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    return CurrentTask();
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+    hostTask          *task = CurrentTask();
+    unique_lock<mutex> guard(task->lock);
+    uint32_t           count;
+
+    Wait(task->signal, guard, ticks, [&]() { return task->notified > 0; });
+    count          = task->notified;
+    task->notified = (clear ? 0 : (count > 0 ? count - 1 : 0));
+
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t handle)
+{
+    hostTask *task = static_cast<hostTask*>(handle);
+
+    if (task == NULL)
+        return pdFAIL;
+
+    std::lock_guard<mutex> guard(task->lock);
+    task->notified++;
+    task->signal.notify_all();
+
+    return pdPASS;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Queues
+//!
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t size)
+{
+    hostQueue *queue = new hostQueue();
+
+    queue->length = length;
+    queue->size   = size;
+    return queue;
+}
+
+static BaseType_t QueuePut(QueueHandle_t handle, const void *item, TickType_t ticks, bool front)
+{
+    hostQueue         *queue = static_cast<hostQueue*>(handle);
+    unique_lock<mutex> guard(queue->lock);
+    const uint8_t     *bytes = static_cast<const uint8_t*>(item);
+
+    if (!Wait(queue->signal, guard, ticks, [&]() { return queue->items.size() < queue->length; }))
+        return pdFALSE;
+
+    vector<uint8_t> copied(bytes, bytes + (item == NULL ? 0 : queue->size));
+    if (front)
+        queue->items.push_front(copied);
+    else
+        queue->items.push_back(copied);
+    queue->signal.notify_all();
+
+    return pdTRUE;
+}
+
+static BaseType_t QueueGet(QueueHandle_t handle, void *item, TickType_t ticks, bool remove)
+{
+    hostQueue         *queue = static_cast<hostQueue*>(handle);
+    unique_lock<mutex> guard(queue->lock);
+
+    if (!Wait(queue->signal, guard, ticks, [&]() { return !queue->items.empty(); }))
+        return pdFALSE;
+
+    if (item != NULL && queue->size > 0)
+        memcpy(item, queue->items.front().data(), queue->size);
+    if (remove)
+    {
+        queue->items.pop_front();
+        queue->signal.notify_all();
+    }
+
+    return pdTRUE;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks)        { return QueuePut(q, item, ticks, false); }
+BaseType_t xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t ticks)  { return QueuePut(q, item, ticks, false); }
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t ticks) { return QueuePut(q, item, ticks, true); }
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks)           { return QueueGet(q, item, ticks, true); }
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks)              { return QueueGet(q, item, ticks, false); }
+
+BaseType_t xQueueReset(QueueHandle_t handle)
+{
+    hostQueue             *queue = static_cast<hostQueue*>(handle);
+    std::lock_guard<mutex> guard(queue->lock);
+
+    queue->items.clear();
+    queue->signal.notify_all();
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t handle)
+{
+    hostQueue             *queue = static_cast<hostQueue*>(handle);
+    std::lock_guard<mutex> guard(queue->lock);
+
+    return queue->items.size();
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Semaphores, a counting semaphore of items of size 0
+//!
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    QueueHandle_t queue = xQueueCreate(max, 0);
+
+    for (UBaseType_t i = 0; i < initial; i++)
+        xQueueSend(queue, NULL, 0);
+    return queue;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()              { return xSemaphoreCreateCounting(1, 0); }
+SemaphoreHandle_t xSemaphoreCreateMutex()               { return xSemaphoreCreateCounting(1, 1); }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) { return QueueGet(s, NULL, ticks, true); }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)          { return QueuePut(s, NULL, 0, false); }
+void       vSemaphoreDelete(SemaphoreHandle_t s)        { delete static_cast<hostQueue*>(s); }
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Event groups
+//!
+EventGroupHandle_t xEventGroupCreate()
+{
+    hostGroup *group = new hostGroup();
+
+    group->bits = 0;
+    return group;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t handle, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks)
+{
+    hostGroup         *group = static_cast<hostGroup*>(handle);
+    unique_lock<mutex> guard(group->lock);
+    EventBits_t        seen;
+
+    auto set = [&]() { return (all ? (group->bits & bits) == bits : (group->bits & bits) != 0); };
+
+    bool met = Wait(group->signal, guard, ticks, set);
+    seen     = group->bits;
+    if (met && clear)
+        group->bits &= ~bits;
+
+    return seen;
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t handle, EventBits_t bits)
+{
+    hostGroup             *group = static_cast<hostGroup*>(handle);
+    std::lock_guard<mutex> guard(group->lock);
+
+    group->bits |= bits;
+    group->signal.notify_all();
+    return group->bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t handle, EventBits_t bits)
+{
+    hostGroup             *group = static_cast<hostGroup*>(handle);
+    std::lock_guard<mutex> guard(group->lock);
+    EventBits_t            before = group->bits;
+
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t handle)
+{
+    hostGroup             *group = static_cast<hostGroup*>(handle);
+    std::lock_guard<mutex> guard(group->lock);
+
+    return group->bits;
+}
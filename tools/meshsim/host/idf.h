@@ -0,0 +1,630 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  idf.h
+//! \brief This header contains the host stand-in for the part of the esp-idf the firmware uses.
+//!        The esp-idf headers the firmware includes all forward here. FreeRTOS runs on
+//!        std::thread, NVS reads a partition CSV, the BNO055 is emulated behind the UART and
+//!        I2C drivers, lwip and esp-mqtt are on the host socket layer, and esp-mesh, ESP-NOW,
+//!        and the station talk to the meshsim medium, see mesh.cpp.
+//!
+//!
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Errors and attributes
+//!
+typedef int esp_err_t;
+
+#define ESP_OK                      0
+#define ESP_FAIL                    -1
+#define ESP_ERR_NO_MEM              0x101
+#define ESP_ERR_INVALID_ARG         0x102
+#define ESP_ERR_INVALID_STATE       0x103
+#define ESP_ERR_INVALID_SIZE        0x104
+#define ESP_ERR_NOT_FOUND           0x105
+#define ESP_ERR_TIMEOUT             0x107
+#define ESP_ERR_INVALID_CRC         0x109
+#define ESP_ERR_NVS_NOT_FOUND       0x1102
+#define ESP_ERR_NVS_TYPE_MISMATCH   0x1103
+#define ESP_ERR_NVS_NO_FREE_PAGES   0x110d
+#define ESP_ERR_NVS_INVALID_LENGTH  0x110c
+#define ESP_ERR_MESH_NOT_START      0x4003
+#define ESP_ERR_MESH_DISCONNECTED   0x4005
+#define ESP_ERR_MESH_TIMEOUT        0x4008
+#define ESP_ERR_MESH_QUEUE_FULL     0x4011
+
+#define ESP_ERROR_CHECK(x)          do { esp_err_t rc = (x); if (rc != ESP_OK) HostAbort(#x, rc); } while (0)
+
+#define BIT0                        0x01
+#define BIT1                        0x02
+#define BIT2                        0x04
+#define BIT3                        0x08
+#define BIT4                        0x10
+#define BIT5                        0x20
+#define BIT6                        0x40
+#define BIT7                        0x80
+
+#define IRAM_ATTR
+#define RTC_DATA_ATTR               __attribute__((section("meshsim_rtc")))     /*!< Kept over deep sleep, see node.cpp */
+#define RTC_NOINIT_ATTR             RTC_DATA_ATTR
+
+#define ESP_LOGI(tag, ...)          (void)0
+#define ESP_LOGW(tag, ...)          (void)0
+#define ESP_LOGE(tag, ...)          (void)0
+
+typedef enum { ESP_LOG_NONE, ESP_LOG_ERROR, ESP_LOG_WARN, ESP_LOG_INFO } esp_log_level_t;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief FreeRTOS, tasks are threads and one tick is portTICK_PERIOD_MS of wall time
+//!
+typedef uint32_t TickType_t;
+typedef int      BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t EventBits_t;
+typedef void    *TaskHandle_t;
+typedef void    *QueueHandle_t;
+typedef void    *SemaphoreHandle_t;
+typedef void    *EventGroupHandle_t;
+typedef void   (*TaskFunction_t)(void *);
+
+#define portTICK_PERIOD_MS          (1000 / CONFIG_FREERTOS_HZ)
+#define portMAX_DELAY               0xffffffffUL
+#define pdMS_TO_TICKS(ms)           ((TickType_t)(ms) / portTICK_PERIOD_MS)
+#define pdTRUE                      1
+#define pdFALSE                     0
+#define pdPASS                      1
+#define pdFAIL                      0
+#define tskIDLE_PRIORITY            0
+#define tskNO_AFFINITY              0x7fffffff
+
+BaseType_t   xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *task);
+BaseType_t   xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                                     TaskHandle_t *task, BaseType_t core);
+void         vTaskDelete(TaskHandle_t task);
+void         vTaskDelay(TickType_t ticks);
+void         vTaskDelayUntil(TickType_t *previous, TickType_t ticks);
+TickType_t   xTaskGetTickCount();
+TaskHandle_t xTaskGetCurrentTaskHandle();
+uint32_t     ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+BaseType_t   xTaskNotifyGive(TaskHandle_t task);
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t size);
+BaseType_t    xQueueSend(QueueHandle_t q, const void *item, TickType_t ticks);
+BaseType_t    xQueueSendToBack(QueueHandle_t q, const void *item, TickType_t ticks);
+BaseType_t    xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t ticks);
+BaseType_t    xQueueReceive(QueueHandle_t q, void *item, TickType_t ticks);
+BaseType_t    xQueuePeek(QueueHandle_t q, void *item, TickType_t ticks);
+BaseType_t    xQueueReset(QueueHandle_t q);
+UBaseType_t   uxQueueMessagesWaiting(QueueHandle_t q);
+
+SemaphoreHandle_t xSemaphoreCreateBinary();
+SemaphoreHandle_t xSemaphoreCreateMutex();
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t        xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks);
+BaseType_t        xSemaphoreGive(SemaphoreHandle_t s);
+void              vSemaphoreDelete(SemaphoreHandle_t s);
+
+EventGroupHandle_t xEventGroupCreate();
+EventBits_t        xEventGroupWaitBits(EventGroupHandle_t g, EventBits_t bits, BaseType_t clear, BaseType_t all, TickType_t ticks);
+EventBits_t        xEventGroupSetBits(EventGroupHandle_t g, EventBits_t bits);
+EventBits_t        xEventGroupClearBits(EventGroupHandle_t g, EventBits_t bits);
+EventBits_t        xEventGroupGetBits(EventGroupHandle_t g);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief System, timers, sleep and power management
+//!
+typedef void *esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void *arg);
+
+typedef enum { ESP_TIMER_TASK } esp_timer_dispatch_t;
+
+typedef struct
+{
+    esp_timer_cb_t       callback;
+    void                 *arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char           *name;
+}esp_timer_create_args_t;
+
+int64_t   esp_timer_get_time();
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer);
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+
+uint32_t  esp_get_free_heap_size();
+uint32_t  esp_get_minimum_free_heap_size();
+uint32_t  esp_random();
+void      esp_restart();
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED, ESP_SLEEP_WAKEUP_ALL, ESP_SLEEP_WAKEUP_EXT0, ESP_SLEEP_WAKEUP_EXT1,
+    ESP_SLEEP_WAKEUP_TIMER, ESP_SLEEP_WAKEUP_TOUCHPAD, ESP_SLEEP_WAKEUP_ULP, ESP_SLEEP_WAKEUP_GPIO,
+    ESP_SLEEP_WAKEUP_UART
+}esp_sleep_source_t;
+
+esp_sleep_source_t esp_sleep_get_wakeup_cause();
+esp_err_t          esp_sleep_enable_timer_wakeup(uint64_t us);
+esp_err_t          esp_light_sleep_start();
+void               esp_deep_sleep_start();
+
+typedef enum { ESP_PM_CPU_FREQ_MAX, ESP_PM_APB_FREQ_MAX, ESP_PM_NO_LIGHT_SLEEP } esp_pm_lock_type_t;
+typedef struct esp_pm_lock *esp_pm_lock_handle_t;
+
+typedef struct
+{
+    int  max_freq_mhz;
+    int  min_freq_mhz;
+    bool light_sleep_enable;
+}esp_pm_config_esp32_t;
+
+esp_err_t esp_pm_configure(const void *config);
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char *name, esp_pm_lock_handle_t *lock);
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t lock);
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t lock);
+
+uint32_t  crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Drivers, both buses lead to the emulated BNO055 in bno055.cpp
+//!
+typedef enum { GPIO_NUM_0 = 0, GPIO_NUM_16 = 16, GPIO_NUM_17 = 17, GPIO_NUM_21 = 21, GPIO_NUM_22 = 22, GPIO_NUM_MAX = 40 } gpio_num_t;
+typedef enum { GPIO_PULLUP_DISABLE, GPIO_PULLUP_ENABLE } gpio_pullup_t;
+
+typedef enum { UART_NUM_0, UART_NUM_1, UART_NUM_2, UART_NUM_MAX } uart_port_t;
+typedef enum { UART_DATA_5_BITS, UART_DATA_6_BITS, UART_DATA_7_BITS, UART_DATA_8_BITS } uart_word_length_t;
+typedef enum { UART_PARITY_DISABLE, UART_PARITY_EVEN = 2, UART_PARITY_ODD } uart_parity_t;
+typedef enum { UART_STOP_BITS_1 = 1, UART_STOP_BITS_1_5, UART_STOP_BITS_2 } uart_stop_bits_t;
+typedef enum { UART_HW_FLOWCTRL_DISABLE } uart_hw_flowcontrol_t;
+
+typedef struct
+{
+    int                   baud_rate;
+    uart_word_length_t    data_bits;
+    uart_parity_t         parity;
+    uart_stop_bits_t      stop_bits;
+    uart_hw_flowcontrol_t flow_ctrl;
+    uint8_t               rx_flow_ctrl_thresh;
+}uart_config_t;
+
+#define UART_PIN_NO_CHANGE          -1
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_driver_install(uart_port_t port, int rxSize, int txSize, int queueSize, QueueHandle_t *queue, int flags);
+esp_err_t uart_flush(uart_port_t port);
+esp_err_t uart_flush_input(uart_port_t port);
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks);
+int       uart_write_bytes(uart_port_t port, const char *data, size_t length);
+int       uart_read_bytes(uart_port_t port, uint8_t *data, uint32_t length, TickType_t ticks);
+
+typedef enum { I2C_NUM_0, I2C_NUM_1, I2C_NUM_MAX } i2c_port_t;
+typedef enum { I2C_MODE_SLAVE, I2C_MODE_MASTER } i2c_mode_t;
+typedef enum { I2C_MASTER_WRITE, I2C_MASTER_READ } i2c_rw_t;
+typedef enum { I2C_MASTER_ACK, I2C_MASTER_NACK, I2C_MASTER_LAST_NACK } i2c_ack_type_t;
+typedef void *i2c_cmd_handle_t;
+
+typedef struct
+{
+    i2c_mode_t    mode;
+    int           sda_io_num;
+    gpio_pullup_t sda_pullup_en;
+    int           scl_io_num;
+    gpio_pullup_t scl_pullup_en;
+    struct { uint32_t clk_speed; } master;
+}i2c_config_t;
+
+esp_err_t        i2c_param_config(i2c_port_t port, const i2c_config_t *config);
+esp_err_t        i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rxSize, size_t txSize, int flags);
+esp_err_t        i2c_set_timeout(i2c_port_t port, int timeout);
+i2c_cmd_handle_t i2c_cmd_link_create();
+void             i2c_cmd_link_delete(i2c_cmd_handle_t cmd);
+esp_err_t        i2c_master_start(i2c_cmd_handle_t cmd);
+esp_err_t        i2c_master_stop(i2c_cmd_handle_t cmd);
+esp_err_t        i2c_master_write_byte(i2c_cmd_handle_t cmd, uint8_t data, bool ack);
+esp_err_t        i2c_master_write(i2c_cmd_handle_t cmd, uint8_t *data, size_t length, bool ack);
+esp_err_t        i2c_master_read_byte(i2c_cmd_handle_t cmd, uint8_t *data, i2c_ack_type_t ack);
+esp_err_t        i2c_master_read(i2c_cmd_handle_t cmd, uint8_t *data, size_t length, i2c_ack_type_t ack);
+esp_err_t        i2c_master_cmd_begin(i2c_port_t port, i2c_cmd_handle_t cmd, TickType_t ticks);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief NVS, every partition is the CSV given on the command line, see nvs_partition_gen.py
+//!
+typedef uint32_t nvs_handle;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode;
+
+esp_err_t nvs_flash_init();
+esp_err_t nvs_flash_erase();
+esp_err_t nvs_flash_init_partition(const char *partition);
+esp_err_t nvs_flash_erase_partition(const char *partition);
+esp_err_t nvs_open(const char *ns, nvs_open_mode mode, nvs_handle *handle);
+esp_err_t nvs_open_from_partition(const char *partition, const char *ns, nvs_open_mode mode, nvs_handle *handle);
+esp_err_t nvs_get_u8(nvs_handle handle, const char *key, uint8_t *out);
+esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *out);
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out);
+esp_err_t nvs_get_str(nvs_handle handle, const char *key, char *out, size_t *length);
+void      nvs_close(nvs_handle handle);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief WiFi, scans are answered by the medium, and the station joins one of its routers,
+//!        see mesh.cpp
+//!
+typedef enum { WIFI_AUTH_OPEN, WIFI_AUTH_WEP, WIFI_AUTH_WPA_PSK, WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK } wifi_auth_mode_t;
+typedef enum { WIFI_MODE_NULL, WIFI_MODE_STA, WIFI_MODE_AP, WIFI_MODE_APSTA } wifi_mode_t;
+typedef enum { ESP_IF_WIFI_STA, ESP_IF_WIFI_AP } esp_interface_t;
+typedef esp_interface_t wifi_interface_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef enum { WIFI_STORAGE_FLASH, WIFI_STORAGE_RAM } wifi_storage_t;
+typedef enum { WIFI_SCAN_TYPE_ACTIVE, WIFI_SCAN_TYPE_PASSIVE } wifi_scan_type_t;
+typedef enum { WIFI_SECOND_CHAN_NONE, WIFI_SECOND_CHAN_ABOVE, WIFI_SECOND_CHAN_BELOW } wifi_second_chan_t;
+
+#define WIFI_IF_STA                 ESP_IF_WIFI_STA
+#define WIFI_IF_AP                  ESP_IF_WIFI_AP
+#define WIFI_PROTOCOL_11B           1
+#define WIFI_PROTOCOL_11G           2
+#define WIFI_PROTOCOL_11N           4
+#define WIFI_PROTOCOL_LR            8
+
+typedef struct
+{
+    int static_rx_buf_num;
+    int dynamic_rx_buf_num;
+    int tx_buf_type;
+    int static_tx_buf_num;
+    int dynamic_tx_buf_num;
+    int ampdu_rx_enable;
+    int ampdu_tx_enable;
+    int tx_ba_win;
+    int rx_ba_win;
+    int magic;
+}wifi_init_config_t;
+
+#define WIFI_INIT_CONFIG_DEFAULT()  wifi_init_config_t{}
+
+typedef struct
+{
+    uint8_t  ssid[32];
+    uint8_t  password[64];
+    int      scan_method;
+    bool     bssid_set;
+    uint8_t  bssid[6];
+    uint8_t  channel;
+    uint16_t listen_interval;
+}wifi_sta_config_t;
+
+typedef struct
+{
+    uint8_t          ssid[32];
+    uint8_t          password[64];
+    uint8_t          ssid_len;
+    uint8_t          channel;
+    wifi_auth_mode_t authmode;
+    uint8_t          ssid_hidden;
+    uint8_t          max_connection;
+    uint16_t         beacon_interval;
+}wifi_ap_config_t;
+
+typedef union
+{
+    wifi_ap_config_t  ap;
+    wifi_sta_config_t sta;
+}wifi_config_t;
+
+typedef struct
+{
+    uint8_t            bssid[6];
+    uint8_t            ssid[33];
+    uint8_t            primary;
+    wifi_second_chan_t second;
+    int8_t             rssi;
+    wifi_auth_mode_t   authmode;
+}wifi_ap_record_t;
+
+typedef struct
+{
+    uint8_t          *ssid;
+    uint8_t          *bssid;
+    uint8_t          channel;
+    bool             show_hidden;
+    wifi_scan_type_t scan_type;
+    struct { struct { uint32_t min, max; } active; uint32_t passive; } scan_time;
+}wifi_scan_config_t;
+
+esp_err_t esp_wifi_init(const wifi_init_config_t *config);
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage);
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode);
+esp_err_t esp_wifi_set_config(esp_interface_t iface, wifi_config_t *config);
+esp_err_t esp_wifi_start();
+esp_err_t esp_wifi_stop();
+esp_err_t esp_wifi_connect();
+esp_err_t esp_wifi_disconnect();
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type);
+esp_err_t esp_wifi_set_protocol(wifi_interface_t iface, uint8_t protocols);
+esp_err_t esp_wifi_set_max_tx_power(int8_t power);
+esp_err_t esp_wifi_get_mac(wifi_interface_t iface, uint8_t mac[6]);
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block);
+esp_err_t esp_wifi_scan_stop();
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number);
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *records);
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *record);
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second);
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second);
+
+typedef enum { SYSTEM_EVENT_STA_START, SYSTEM_EVENT_STA_CONNECTED, SYSTEM_EVENT_STA_GOT_IP, SYSTEM_EVENT_STA_DISCONNECTED } system_event_id_t;
+
+typedef struct
+{
+    system_event_id_t event_id;
+    union { struct { uint8_t reason; } disconnected; } event_info;
+}system_event_t;
+
+typedef esp_err_t (*system_event_cb_t)(void *ctx, system_event_t *event);
+
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx);
+
+typedef enum { TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_IF_AP } tcpip_adapter_if_t;
+
+void      tcpip_adapter_init();
+esp_err_t tcpip_adapter_dhcps_stop(tcpip_adapter_if_t iface);
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t iface);
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t iface);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief esp-mesh, see mesh.cpp
+//!
+#define MESH_ROOT_LAYER             1
+#define MESH_MPS                    1472
+#define MESH_DATA_ENC               0x01
+#define MESH_DATA_P2P               0x02
+#define MESH_DATA_FROMDS            0x04
+#define MESH_DATA_TODS              0x08
+#define MESH_DATA_NONBLOCK          0x10
+#define MESH_DATA_DROP              0x20
+#define MESH_DATA_GROUP             0x40
+
+typedef enum { MESH_IDLE, MESH_ROOT, MESH_NODE, MESH_LEAF } mesh_type_t;
+typedef enum { MESH_PROTO_BIN, MESH_PROTO_HTTP, MESH_PROTO_JSON, MESH_PROTO_MQTT } mesh_proto_t;
+typedef enum { MESH_TOS_P2P, MESH_TOS_E2E, MESH_TOS_DEF } mesh_tos_t;
+
+typedef union
+{
+    uint8_t addr[6];
+    struct { uint32_t ip4; uint16_t port; } __attribute__((packed)) mip;
+}mesh_addr_t;
+
+typedef struct
+{
+    uint8_t      *data;
+    uint16_t     size;
+    mesh_proto_t proto;
+    mesh_tos_t   tos;
+}mesh_data_t;
+
+typedef struct { uint8_t type; uint16_t len; uint8_t *val; } mesh_opt_t;
+typedef struct { int toDS; int toSelf; } mesh_rx_pending_t;
+typedef struct { int to_parent; int to_parent_p2p; int to_child; int to_child_p2p; int mgmt; int broadcast; } mesh_tx_pending_t;
+
+typedef struct
+{
+    uint8_t  eid, len, oui[3], type;
+    uint8_t  encrypted:1, version:7;
+    uint8_t  mesh_type;
+    uint8_t  mesh_id[6];
+    uint8_t  layer_cap, layer, assoc_cap, assoc;
+    uint8_t  leaf_cap, leaf_assoc;
+    uint16_t root_cap, self_cap, layer2_cap, scan_ap_num;
+    int8_t   rssi, router_rssi;
+    uint8_t  flag;
+}mesh_assoc_t;
+
+typedef enum
+{
+    MESH_EVENT_STARTED, MESH_EVENT_STOPPED, MESH_EVENT_CHANNEL_SWITCH, MESH_EVENT_CHILD_CONNECTED,
+    MESH_EVENT_CHILD_DISCONNECTED, MESH_EVENT_ROUTING_TABLE_ADD, MESH_EVENT_ROUTING_TABLE_REMOVE,
+    MESH_EVENT_PARENT_CONNECTED, MESH_EVENT_PARENT_DISCONNECTED, MESH_EVENT_NO_PARENT_FOUND,
+    MESH_EVENT_LAYER_CHANGE, MESH_EVENT_TODS_STATE, MESH_EVENT_VOTE_STARTED, MESH_EVENT_VOTE_STOPPED,
+    MESH_EVENT_ROOT_ADDRESS, MESH_EVENT_ROOT_SWITCH_REQ, MESH_EVENT_ROOT_SWITCH_ACK, MESH_EVENT_ROOT_GOT_IP,
+    MESH_EVENT_ROOT_LOST_IP, MESH_EVENT_ROOT_ASKED_YIELD, MESH_EVENT_ROOT_FIXED, MESH_EVENT_SCAN_DONE
+}mesh_event_id_t;
+
+typedef union
+{
+    struct { uint16_t rt_size_new; uint16_t rt_size_change; } routing_table;
+    struct { uint8_t number; } scan_done;
+    struct { int layer; } layer_change;
+    struct { uint8_t mac[6]; } child_connected;
+    struct { uint8_t mac[6]; } child_disconnected;
+    struct { wifi_sta_config_t connected; uint8_t self_layer; } connected;
+    struct { uint8_t reason; } disconnected;
+    mesh_addr_t root_addr;
+}mesh_event_info_t;
+
+typedef struct
+{
+    mesh_event_id_t   id;
+    mesh_event_info_t info;
+}mesh_event_t;
+
+typedef void (*mesh_event_cb_t)(mesh_event_t event);
+
+typedef struct { uint8_t ssid[32]; uint8_t ssid_len; uint8_t bssid[6]; uint8_t password[64]; } mesh_router_t;
+typedef struct { uint8_t password[64]; uint8_t max_connection; } mesh_ap_cfg_t;
+typedef struct { int unused; } mesh_crypto_funcs_t;
+
+extern const mesh_crypto_funcs_t g_wifi_default_mesh_crypto_funcs;
+
+typedef struct
+{
+    uint8_t                   channel;
+    bool                      allow_channel_switch;
+    mesh_event_cb_t           event_cb;
+    mesh_addr_t               mesh_id;
+    mesh_router_t             router;
+    mesh_ap_cfg_t             mesh_ap;
+    const mesh_crypto_funcs_t *crypto_funcs;
+}mesh_cfg_t;
+
+esp_err_t   esp_mesh_init();
+esp_err_t   esp_mesh_deinit();
+esp_err_t   esp_mesh_start();
+esp_err_t   esp_mesh_stop();
+esp_err_t   esp_mesh_set_config(const mesh_cfg_t *config);
+esp_err_t   esp_mesh_set_max_layer(int layers);
+int         esp_mesh_get_max_layer();
+esp_err_t   esp_mesh_set_capacity_num(int num);
+esp_err_t   esp_mesh_set_xon_qsize(int size);
+esp_err_t   esp_mesh_set_ap_authmode(wifi_auth_mode_t mode);
+esp_err_t   esp_mesh_set_ap_connections(int connections);
+esp_err_t   esp_mesh_fix_root(bool enable);
+esp_err_t   esp_mesh_set_self_organized(bool enable, bool select);
+esp_err_t   esp_mesh_set_type(mesh_type_t type);
+mesh_type_t esp_mesh_get_type();
+bool        esp_mesh_is_root();
+int         esp_mesh_get_layer();
+int         esp_mesh_get_total_node_num();
+esp_err_t   esp_mesh_get_id(mesh_addr_t *id);
+esp_err_t   esp_mesh_get_parent_bssid(mesh_addr_t *bssid);
+esp_err_t   esp_mesh_set_group_id(const mesh_addr_t *addrs, int num);
+esp_err_t   esp_mesh_set_parent(const wifi_config_t *parent, const mesh_addr_t *id, mesh_type_t type, int layer);
+esp_err_t   esp_mesh_disconnect();
+esp_err_t   esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[], int count);
+esp_err_t   esp_mesh_recv(mesh_addr_t *from, mesh_data_t *data, int timeout, int *flag, mesh_opt_t opt[], int count);
+esp_err_t   esp_mesh_get_rx_pending(mesh_rx_pending_t *pending);
+esp_err_t   esp_mesh_get_tx_pending(mesh_tx_pending_t *pending);
+int         esp_mesh_get_routing_table_size();
+esp_err_t   esp_mesh_get_routing_table(mesh_addr_t *table, int length, int *size);
+esp_err_t   esp_mesh_scan_get_ap_ie_len(int *length);
+esp_err_t   esp_mesh_scan_get_ap_record(wifi_ap_record_t *record, void *buffer);
+esp_err_t   esp_mesh_flush_scan_result();
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief ESP-NOW, see mesh.cpp
+//!
+#define ESP_NOW_ETH_ALEN            6
+#define ESP_NOW_KEY_LEN             16
+#define ESP_NOW_MAX_DATA_LEN        250
+#define ESP_NOW_MAX_TOTAL_PEER_NUM  20
+
+#define ESP_ERR_ESPNOW_BASE         0x3000
+#define ESP_ERR_ESPNOW_NOT_INIT     (ESP_ERR_ESPNOW_BASE + 1)
+#define ESP_ERR_ESPNOW_ARG          (ESP_ERR_ESPNOW_BASE + 2)
+#define ESP_ERR_ESPNOW_NO_MEM       (ESP_ERR_ESPNOW_BASE + 3)
+#define ESP_ERR_ESPNOW_FULL         (ESP_ERR_ESPNOW_BASE + 4)
+#define ESP_ERR_ESPNOW_NOT_FOUND    (ESP_ERR_ESPNOW_BASE + 5)
+#define ESP_ERR_ESPNOW_INTERNAL     (ESP_ERR_ESPNOW_BASE + 6)
+#define ESP_ERR_ESPNOW_EXIST        (ESP_ERR_ESPNOW_BASE + 7)
+#define ESP_ERR_ESPNOW_IF           (ESP_ERR_ESPNOW_BASE + 8)
+
+typedef enum { ESP_NOW_SEND_SUCCESS = 0, ESP_NOW_SEND_FAIL } esp_now_send_status_t;
+
+typedef struct
+{
+    uint8_t          peer_addr[ESP_NOW_ETH_ALEN];
+    uint8_t          lmk[ESP_NOW_KEY_LEN];
+    uint8_t          channel;
+    wifi_interface_t ifidx;
+    bool             encrypt;
+    void            *priv;
+}esp_now_peer_info_t;
+
+typedef void (*esp_now_recv_cb_t)(const uint8_t *mac, const uint8_t *data, int length);
+typedef void (*esp_now_send_cb_t)(const uint8_t *mac, esp_now_send_status_t status);
+
+esp_err_t esp_now_init();
+esp_err_t esp_now_deinit();
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb);
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb);
+esp_err_t esp_now_send(const uint8_t *peer, const uint8_t *data, size_t length);
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer);
+esp_err_t esp_now_del_peer(const uint8_t *peer);
+bool      esp_now_is_peer_exist(const uint8_t *peer);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief esp-mqtt, an MQTT 3.1.1 client over host sockets, see mqtt.cpp
+//!
+typedef struct esp_mqtt_client *esp_mqtt_client_handle_t;
+
+typedef enum
+{
+    MQTT_EVENT_ERROR,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA
+}esp_mqtt_event_id_t;
+
+typedef struct
+{
+    esp_mqtt_event_id_t      event_id;
+    esp_mqtt_client_handle_t client;
+    void                    *user_context;
+    char                    *data;
+    int                      data_len;
+    int                      total_data_len;
+    int                      current_data_offset;
+    char                    *topic;
+    int                      topic_len;
+    int                      msg_id;
+}esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t *esp_mqtt_event_handle_t;
+typedef esp_err_t (*mqtt_event_callback_t)(esp_mqtt_event_handle_t event);
+
+typedef struct
+{
+    mqtt_event_callback_t event_handle;
+    const char *uri;                                        /*!< "mqtt://host:port" */
+    const char *client_id;
+    const char *lwt_topic;
+    const char *lwt_msg;
+    int         lwt_qos;
+    int         lwt_retain;
+    int         disable_clean_session;
+    int         keepalive;                                  /*!< In s */
+    bool        disable_auto_reconnect;
+    void       *user_context;
+}esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+int       esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
+int       esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                                  int qos, int retain);
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Host side, called by node.cpp
+//!
+void               HostAbort    (const char *what, esp_err_t rc);
+bool               HostLoadNvs  (const char *csv);
+void               HostSetMedium(const uint8_t mac[6], int port);
+const uint8_t     *HostGetMac   ();
+void               HostRestart  (uint64_t after, bool warm);
+esp_sleep_source_t HostWakeup   ();
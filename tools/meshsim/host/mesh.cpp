@@ -0,0 +1,999 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  mesh.cpp
+//! \brief This source contains the host stand-in for esp-mesh, ESP-NOW, the station, and the
+//!        wifi scan. The node joins the meshsim medium over the loopback, the medium builds
+//!        the tree, routes the frames, and tells the node its layer, parent, root, and
+//!        routing table. Changes to those are turned into the mesh events esp-mesh would
+//!        raise, on an event task of their own like the esp-idf event loop. Parent selection
+//!        is the medium's, so esp_mesh_set_parent only records the call. The station joins
+//!        the strongest router with its ssid, and ESP-NOW frames go to the stations on the
+//!        same channel in one hop.
+//!
+//!
+#include "idf.h"
+#include "../medium.h"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::condition_variable;
+using std::deque;
+using std::lock_guard;
+using std::mutex;
+using std::set;
+using std::string;
+using std::thread;
+using std::unique_lock;
+using std::vector;
+
+
+//! \brief meshRxFrame is a frame waiting in the receive queue.
+//!
+typedef struct
+{
+    mesh_addr_t     from;
+    int             flag;
+    vector<uint8_t> data;
+}meshRxFrame;
+
+const mesh_crypto_funcs_t g_wifi_default_mesh_crypto_funcs = { 0 };
+
+static mutex              lock;
+static condition_variable rxSignal;
+static condition_variable scanSignal;
+static condition_variable eventSignal;
+
+static int                sock        = -1;
+static sockaddr_in        medium      = {};
+static uint8_t            mac[6]      = {};
+static mesh_cfg_t         cfg         = {};
+static bool               started     = false;
+static bool               designated  = false;          /*!< esp_mesh_set_type(MESH_ROOT) */
+static bool               fixed       = false;
+static int                maxLayer    = 25;
+static int                xonQsize    = 32;
+static uint16_t           overflow    = 0;              /*!< Frames dropped on a full receive queue */
+static vector<mesh_addr_t> groups;
+
+static int                layer       = 0;              /*!< 0 while not in the tree */
+static bool               elected     = false;          /*!< The medium made this node the root */
+static uint8_t            parent[6]   = {};
+static uint8_t            root[6]     = {};
+static uint8_t            channel     = 0;
+static int8_t             rssi        = 0;
+static vector<mesh_addr_t> table;
+
+static system_event_cb_t   loopCb      = NULL;           /*!< esp_event_loop_init */
+static void               *loopCtx     = NULL;
+static wifi_sta_config_t   staCfg      = {};
+static bool                associated  = false;          /*!< The station joined a router */
+static uint8_t             staChannel  = 1;              /*!< Channel of the station */
+static wifi_ap_record_t    router      = {};
+
+static bool                nowStarted  = false;          /*!< esp_now_init */
+static esp_now_recv_cb_t   nowRecv     = NULL;
+static esp_now_send_cb_t   nowSent     = NULL;
+static set<uint64_t>       nowPeers;
+
+static deque<meshRxFrame>  rxQueue;
+static deque<mesh_event_t> events;
+static deque<system_event_t> systemEvents;
+static vector<simAp>       scanned;
+static size_t              scanCursor = 0;
+static bool                scanDone   = false;
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Medium link
+//!
+
+//! \fn    Post
+//! \brief Sends a datagram to the medium, from this node unless 'src' is set.
+//!
+static void Post(simHeader header, const void *payload, int length)
+{
+    vector<uint8_t> datagram(sizeof(header) + length);
+    static const uint8_t none[6] = {};
+
+    if (memcmp(header.src, none, 6) == 0)
+        memcpy(header.src, mac, 6);
+    header.length = length;
+
+    memcpy(datagram.data(), &header, sizeof(header));
+    if (length > 0)
+        memcpy(datagram.data() + sizeof(header), payload, length);
+    sendto(sock, datagram.data(), datagram.size(), 0, (sockaddr *)&medium, sizeof(medium));
+}
+
+//! \fn    Key
+//! \brief Packs a mac address into a set key.
+//!
+static uint64_t Key(const uint8_t address[6])
+{
+    uint64_t k = 0;
+
+    for (int i = 0; i < 6; i++)
+        k = (k << 8) | address[i];
+    return k;
+}
+
+//! \fn    Join
+//! \brief Sends the node's whole state to the medium, lock held. With ESP-NOW up, the node
+//!        is a station on the channel it is on, and not in a tree.
+//!
+static void Join()
+{
+    simHeader header = {};
+
+    header.type    = SIM_JOIN;
+    header.flags   = (designated ? SIM_ROOT : 0) | (fixed ? SIM_FIXED : 0) | (nowStarted ? SIM_STATION : 0);
+    header.layer   = maxLayer;
+    header.channel = (nowStarted ? staChannel : cfg.channel);
+    header.count   = overflow;
+    memcpy(header.meshId, cfg.mesh_id.addr, 6);
+    Post(header, groups.data(), groups.size() * sizeof(mesh_addr_t));
+}
+
+//! \fn    Raise
+//! \brief Queues a mesh event for the event task, lock held.
+//!
+static void Raise(mesh_event_id_t id, mesh_event_info_t info = mesh_event_info_t())
+{
+    mesh_event_t event;
+
+    event.id   = id;
+    event.info = info;
+    events.push_back(event);
+    eventSignal.notify_all();
+}
+
+//! \fn    RaiseSystem
+//! \brief Queues a station event for the event task, lock held.
+//!
+static void RaiseSystem(system_event_id_t id)
+{
+    system_event_t event = {};
+
+    event.event_id = id;
+    systemEvents.push_back(event);
+    eventSignal.notify_all();
+}
+
+//! \fn    Detach
+//! \brief Forgets the node's place in the tree, lock held.
+//!
+static void Detach()
+{
+    if (layer > 0)
+        Raise(MESH_EVENT_PARENT_DISCONNECTED);
+
+    layer   = 0;
+    elected = false;
+    table.assign(1, mesh_addr_t());
+    memcpy(table[0].addr, mac, 6);
+}
+
+//! \fn    Place
+//! \brief Takes in a SIM_STATE and raises the events of what changed, lock held.
+//!
+static void Place(const simHeader &header, const uint8_t *payload)
+{
+    vector<mesh_addr_t> updated(header.count);
+    mesh_event_info_t   info    = {};
+    int                 added   = 0;
+    int                 removed = 0;
+    bool                moved   = (layer > 0 && header.layer > 0 && memcmp(parent, header.src, 6) != 0);
+
+    if (header.layer == 0)
+    {
+        if (layer == 0)
+            Raise(MESH_EVENT_NO_PARENT_FOUND);
+        Detach();
+        return;
+    }
+
+    memcpy(updated.data(), payload, header.count * sizeof(mesh_addr_t));
+    for (auto &entry : updated)
+    {
+        if (std::find_if(table.begin(), table.end(), [&](const mesh_addr_t &a) { return memcmp(a.addr, entry.addr, 6) == 0; }) == table.end())
+            added++;
+    }
+    removed = table.size() + added - updated.size();
+
+    if (moved)
+        Raise(MESH_EVENT_PARENT_DISCONNECTED);
+    if (memcmp(root, header.dst, 6) != 0)
+    {
+        memcpy(info.root_addr.addr, header.dst, 6);
+        Raise(MESH_EVENT_ROOT_ADDRESS, info);
+    }
+    if (layer != 0 && layer != header.layer)
+    {
+        info.layer_change.layer = header.layer;
+        Raise(MESH_EVENT_LAYER_CHANGE, info);
+    }
+
+    bool joined = (layer == 0 || moved);
+
+    layer   = header.layer;
+    elected = (header.flags & SIM_ROOT) != 0;
+    channel = header.channel;
+    rssi    = header.rssi;
+    memcpy(parent, header.src, 6);
+    memcpy(root, header.dst, 6);
+    table.swap(updated);
+
+    if (joined)
+    {
+        info.connected.self_layer = layer;
+        Raise(MESH_EVENT_PARENT_CONNECTED, info);
+        if (elected)
+            Raise(MESH_EVENT_ROOT_GOT_IP);
+    }
+    if (added > 0)
+    {
+        info.routing_table.rt_size_new    = table.size();
+        info.routing_table.rt_size_change = added;
+        Raise(MESH_EVENT_ROUTING_TABLE_ADD, info);
+    }
+    if (removed > 0)
+    {
+        info.routing_table.rt_size_new    = table.size();
+        info.routing_table.rt_size_change = removed;
+        Raise(MESH_EVENT_ROUTING_TABLE_REMOVE, info);
+    }
+}
+
+//! \fn    ReceiveThread
+//! \brief Takes in everything the medium sends.
+//!
+static void ReceiveThread()
+{
+    vector<uint8_t> datagram(SIM_MAX_DATAGRAM);
+    simHeader       header;
+
+    while (1)
+    {
+        int got = recv(sock, datagram.data(), datagram.size(), 0);
+
+        if (got < (int)sizeof(header))
+            continue;
+        memcpy(&header, datagram.data(), sizeof(header));
+        if (got < (int)(sizeof(header) + header.length))
+            continue;
+
+        const uint8_t     *payload = datagram.data() + sizeof(header);
+        unique_lock<mutex> guard(lock);
+        esp_now_recv_cb_t  received = nowRecv;
+        esp_now_send_cb_t  sent     = nowSent;
+
+        switch (header.type) {
+        case SIM_DATA:
+            if (!started)
+                break;
+            if ((int)rxQueue.size() >= xonQsize)
+            {
+                overflow++;
+                break;
+            }
+            rxQueue.push_back(meshRxFrame());
+            memcpy(rxQueue.back().from.addr, header.src, 6);
+            rxQueue.back().flag = header.flags & ~SIM_TO_ROOT;
+            rxQueue.back().data.assign(payload, payload + header.length);
+            rxSignal.notify_all();
+            break;
+        case SIM_STATE:
+            if (started)
+                Place(header, payload);
+            break;
+        case SIM_SCAN:
+            scanned.resize(header.length / sizeof(simAp));
+            memcpy(scanned.data(), payload, scanned.size() * sizeof(simAp));
+            scanCursor = 0;
+            scanDone   = true;
+            scanSignal.notify_all();
+            if (started)
+            {
+                mesh_event_info_t info = {};
+                info.scan_done.number  = scanned.size();
+                Raise(MESH_EVENT_SCAN_DONE, info);
+            }
+            break;
+        case SIM_RADIO:
+            guard.unlock();                                 /*!< The callbacks may call back in */
+            if (nowStarted && received != NULL)
+                received(header.src, payload, header.length);
+            break;
+        case SIM_SENT:
+            guard.unlock();
+            if (nowStarted && sent != NULL)
+                sent(header.dst, (header.flags & SIM_ACKED) ? ESP_NOW_SEND_SUCCESS : ESP_NOW_SEND_FAIL);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+//! \fn    BeatThread
+//! \brief Joins every SIM_BEAT ms while the mesh is started, the medium takes a node as
+//!        gone after SIM_TIMEOUT without one.
+//!
+static void BeatThread()
+{
+    while (1)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SIM_BEAT));
+
+        lock_guard<mutex> guard(lock);
+        if (started || nowStarted)
+            Join();
+    }
+}
+
+//! \fn    EventThread
+//! \brief Hands the station and mesh events to their callbacks, one at a time and without
+//!        the lock held, so the callbacks can call back in.
+//!
+static void EventThread()
+{
+    while (1)
+    {
+        unique_lock<mutex> guard(lock);
+        eventSignal.wait(guard, []() { return !events.empty() || !systemEvents.empty(); });
+
+        if (!systemEvents.empty())
+        {
+            system_event_t    event    = systemEvents.front();
+            system_event_cb_t callback = loopCb;
+            void             *context  = loopCtx;
+            systemEvents.pop_front();
+            guard.unlock();
+
+            if (callback != NULL)
+                callback(context, &event);
+            continue;
+        }
+
+        mesh_event_t    event    = events.front();
+        mesh_event_cb_t callback = cfg.event_cb;
+        events.pop_front();
+        guard.unlock();
+
+        if (callback != NULL)
+            callback(event);
+    }
+}
+
+//! \fn    Open
+//! \brief Opens the link to the medium, once.
+//!
+static void Open()
+{
+    lock_guard<mutex> guard(lock);
+
+    if (sock >= 0)
+        return;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    Detach();
+    thread(ReceiveThread).detach();
+    thread(BeatThread).detach();
+    thread(EventThread).detach();
+}
+
+//! \fn    HostSetMedium
+//! \brief Sets this node's station mac, and the port of the medium on the loopback.
+//!
+void HostSetMedium(const uint8_t address[6], int port)
+{
+    memcpy(mac, address, 6);
+    medium.sin_family      = AF_INET;
+    medium.sin_port        = htons(port);
+    medium.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+//! \fn    HostGetMac
+//! \brief Gets this node's station mac.
+//!
+const uint8_t *HostGetMac()
+{
+    return mac;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief esp-mesh
+//!
+esp_err_t esp_mesh_init()
+{
+    Open();
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_deinit()
+{
+    return esp_mesh_stop();
+}
+
+esp_err_t esp_mesh_start()
+{
+    lock_guard<mutex> guard(lock);
+
+    started = true;
+    Join();
+    Raise(MESH_EVENT_STARTED);
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_stop()
+{
+    esp_mesh_disconnect();
+
+    lock_guard<mutex> guard(lock);
+    Raise(MESH_EVENT_STOPPED);
+    return ESP_OK;
+}
+
+//! \fn    esp_mesh_disconnect
+//! \brief Leaves the tree, the node stays out until esp_mesh_start is called again.
+//!
+esp_err_t esp_mesh_disconnect()
+{
+    simHeader         header = {};
+    lock_guard<mutex> guard(lock);
+
+    if (!started)
+        return ESP_OK;
+
+    header.type = SIM_LEAVE;
+    memcpy(header.meshId, cfg.mesh_id.addr, 6);
+    Post(header, NULL, 0);
+
+    started = false;
+    Detach();
+    rxQueue.clear();
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_config(const mesh_cfg_t *config)
+{
+    lock_guard<mutex> guard(lock);
+
+    cfg = *config;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_max_layer(int layers)
+{
+    lock_guard<mutex> guard(lock);
+
+    maxLayer = layers;
+    return ESP_OK;
+}
+
+int esp_mesh_get_max_layer()
+{
+    lock_guard<mutex> guard(lock);
+    return maxLayer;
+}
+
+esp_err_t esp_mesh_set_xon_qsize(int size)
+{
+    lock_guard<mutex> guard(lock);
+
+    xonQsize = size;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_fix_root(bool enable)
+{
+    lock_guard<mutex> guard(lock);
+
+    fixed = enable;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_type(mesh_type_t type)
+{
+    lock_guard<mutex> guard(lock);
+
+    designated = (type == MESH_ROOT);
+    return ESP_OK;
+}
+
+bool esp_mesh_is_root()
+{
+    lock_guard<mutex> guard(lock);
+    return designated || elected;
+}
+
+mesh_type_t esp_mesh_get_type()
+{
+    lock_guard<mutex> guard(lock);
+
+    if (designated || elected)
+        return MESH_ROOT;
+    if (layer == 0)
+        return MESH_IDLE;
+    return (table.size() > 1 ? MESH_NODE : MESH_LEAF);
+}
+
+int esp_mesh_get_layer()
+{
+    lock_guard<mutex> guard(lock);
+    return layer;
+}
+
+int esp_mesh_get_total_node_num()
+{
+    lock_guard<mutex> guard(lock);
+    return (layer > 0 ? table.size() : 0);
+}
+
+esp_err_t esp_mesh_get_id(mesh_addr_t *id)
+{
+    lock_guard<mutex> guard(lock);
+
+    *id = cfg.mesh_id;
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_get_parent_bssid(mesh_addr_t *bssid)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (layer == 0)
+        return ESP_ERR_MESH_DISCONNECTED;
+
+    memcpy(bssid->addr, parent, 6);
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_group_id(const mesh_addr_t *addrs, int num)
+{
+    lock_guard<mutex> guard(lock);
+
+    groups.assign(addrs, addrs + num);
+    if (started)
+        Join();
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_set_parent(const wifi_config_t *config, const mesh_addr_t *id, mesh_type_t type, int layer)
+{
+    return ESP_OK;
+}
+
+//! \fn    esp_mesh_send
+//! \brief Hands a frame to the medium, which takes care of the hops. Like esp-mesh, sending
+//!        to NULL from a node goes to the root.
+//!
+esp_err_t esp_mesh_send(const mesh_addr_t *to, const mesh_data_t *data, int flag, const mesh_opt_t opt[], int count)
+{
+    simHeader         header = {};
+    lock_guard<mutex> guard(lock);
+
+    if (!started)
+        return ESP_ERR_MESH_NOT_START;
+    if (data == NULL || data->size > MESH_MPS)
+        return ESP_ERR_INVALID_ARG;
+    if (layer == 0)
+        return ESP_ERR_MESH_DISCONNECTED;
+
+    header.type  = SIM_DATA;
+    header.flags = flag & ~SIM_TO_ROOT;
+    header.tos   = data->tos;
+    memcpy(header.meshId, cfg.mesh_id.addr, 6);
+
+    if (to == NULL)
+    {
+        if (designated || elected)
+            return ESP_ERR_INVALID_ARG;                     /*!< The root would send to the router */
+        header.flags |= SIM_TO_ROOT;
+    }else {
+        memcpy(header.dst, to->addr, 6);
+    }
+
+    Post(header, data->data, data->size);
+    return ESP_OK;
+}
+
+//! \fn    esp_mesh_recv
+//! \brief Takes the oldest frame for this node, waiting up to 'timeout' ms for one,
+//!        portMAX_DELAY or less than 0 waits forever.
+//!
+esp_err_t esp_mesh_recv(mesh_addr_t *from, mesh_data_t *data, int timeout, int *flag, mesh_opt_t opt[], int count)
+{
+    unique_lock<mutex> guard(lock);
+    auto               ready = []() { return !rxQueue.empty(); };
+
+    if (!started)
+        return ESP_ERR_MESH_NOT_START;
+
+    if (timeout < 0 || (uint32_t)timeout == portMAX_DELAY)
+        rxSignal.wait(guard, ready);
+    else if (!rxSignal.wait_for(guard, std::chrono::milliseconds(timeout), ready))
+    {
+        data->size = 0;
+        return ESP_ERR_MESH_TIMEOUT;
+    }
+
+    meshRxFrame frame = rxQueue.front();
+    rxQueue.pop_front();
+
+    if (frame.data.size() > data->size)
+        return ESP_ERR_INVALID_ARG;
+
+    memcpy(data->data, frame.data.data(), frame.data.size());
+    data->size  = frame.data.size();
+    data->proto = MESH_PROTO_BIN;
+    data->tos   = MESH_TOS_P2P;
+    if (from != NULL)
+        *from = frame.from;
+    if (flag != NULL)
+        *flag = frame.flag;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_get_rx_pending(mesh_rx_pending_t *pending)
+{
+    lock_guard<mutex> guard(lock);
+
+    pending->toDS   = 0;
+    pending->toSelf = rxQueue.size();
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_get_tx_pending(mesh_tx_pending_t *pending)
+{
+    memset(pending, 0, sizeof(*pending));                   /*!< The medium queues, not the node */
+    return ESP_OK;
+}
+
+int esp_mesh_get_routing_table_size()
+{
+    lock_guard<mutex> guard(lock);
+    return table.size();
+}
+
+esp_err_t esp_mesh_get_routing_table(mesh_addr_t *addrs, int length, int *size)
+{
+    lock_guard<mutex> guard(lock);
+    int               copied = std::min<int>(length / sizeof(mesh_addr_t), table.size());
+
+    memcpy(addrs, table.data(), copied * sizeof(mesh_addr_t));
+    *size = copied;
+    return ESP_OK;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Wifi scan, answered by the medium
+//!
+esp_err_t esp_wifi_scan_start(const wifi_scan_config_t *config, bool block)
+{
+    simHeader  header = {};
+    nvs_handle nvs    = {};
+    char       ssid[33] = {};
+    size_t     length = sizeof(ssid);
+
+    Open();
+    if (nvs_open("netConfig", NVS_READONLY, &nvs) == ESP_OK)
+        nvs_get_str(nvs, "ssid", ssid, &length);            /*!< Routers carry the ssid the node looks for */
+
+    unique_lock<mutex> guard(lock);
+    header.type = SIM_SCAN;
+    scanDone    = false;
+    Post(header, ssid, strlen(ssid) + 1);
+
+    if (block && !scanSignal.wait_for(guard, std::chrono::milliseconds(2 * SIM_BEAT), []() { return scanDone; }))
+    {
+        scanned.clear();
+        scanCursor = 0;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_stop()
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_num(uint16_t *number)
+{
+    lock_guard<mutex> guard(lock);
+
+    *number = scanned.size();
+    return ESP_OK;
+}
+
+//! \fn    ToRecord
+//! \brief Converts an access point from the medium to the esp-idf record.
+//!
+static void ToRecord(const simAp &ap, wifi_ap_record_t *record)
+{
+    memset(record, 0, sizeof(*record));
+    memcpy(record->bssid, ap.bssid, 6);
+    memcpy(record->ssid, ap.ssid, sizeof(ap.ssid));
+    record->primary  = ap.channel;
+    record->rssi     = ap.rssi;
+    record->authmode = WIFI_AUTH_WPA2_PSK;
+}
+
+esp_err_t esp_wifi_scan_get_ap_records(uint16_t *number, wifi_ap_record_t *records)
+{
+    lock_guard<mutex> guard(lock);
+
+    *number = std::min<size_t>(*number, scanned.size());
+    for (int i = 0; i < *number; i++)
+        ToRecord(scanned[i], &records[i]);
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_scan_get_ap_ie_len(int *length)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (scanCursor >= scanned.size())
+        return ESP_ERR_NOT_FOUND;
+
+    *length = (scanned[scanCursor].mesh ? sizeof(mesh_assoc_t) : 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_scan_get_ap_record(wifi_ap_record_t *record, void *buffer)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (scanCursor >= scanned.size())
+        return ESP_ERR_NOT_FOUND;
+
+    const simAp &ap = scanned[scanCursor++];
+    ToRecord(ap, record);
+    if (ap.mesh && buffer != NULL)
+    {
+        mesh_assoc_t *assoc = static_cast<mesh_assoc_t*>(buffer);
+
+        memset(assoc, 0, sizeof(*assoc));
+        assoc->mesh_type = ap.mesh;
+        assoc->layer     = ap.layer;
+        assoc->rssi      = ap.rssi;
+        memcpy(assoc->mesh_id, ap.meshId, 6);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_mesh_flush_scan_result()
+{
+    lock_guard<mutex> guard(lock);
+
+    scanned.clear();
+    scanCursor = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *record)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (associated)
+    {
+        *record = router;
+        return ESP_OK;
+    }
+    if (layer == 0)
+        return ESP_FAIL;
+
+    memset(record, 0, sizeof(*record));
+    memcpy(record->bssid, parent, 6);
+    record->primary = channel;
+    record->rssi    = rssi;
+    return ESP_OK;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Station, joins a router of the medium
+//!
+esp_err_t esp_event_loop_init(system_event_cb_t cb, void *ctx)
+{
+    Open();
+
+    lock_guard<mutex> guard(lock);
+    loopCb  = cb;
+    loopCtx = ctx;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(esp_interface_t iface, wifi_config_t *config)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (iface == ESP_IF_WIFI_STA)
+        staCfg = config->sta;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start()
+{
+    Open();
+
+    lock_guard<mutex> guard(lock);
+    RaiseSystem(SYSTEM_EVENT_STA_START);
+    return ESP_OK;
+}
+
+//! \fn    Associate
+//! \brief Scans, and joins the strongest router with the ssid of the station. Without one
+//!        the connect fails after SIM_BEAT ms, as the esp32 gives up on a missing ssid.
+//!
+static void Associate()
+{
+    wifi_scan_config_t config = {};
+
+    esp_wifi_scan_start(&config, true);
+
+    unique_lock<mutex> guard(lock);
+    const simAp       *best = NULL;
+
+    for (auto &ap : scanned)
+    {
+        if (ap.mesh == 0 && strncmp(ap.ssid, (const char *)staCfg.ssid, sizeof(staCfg.ssid)) == 0 &&
+            (best == NULL || ap.rssi > best->rssi))
+            best = &ap;
+    }
+    if (best == NULL)
+    {
+        guard.unlock();
+        std::this_thread::sleep_for(std::chrono::milliseconds(SIM_BEAT));
+        guard.lock();
+        RaiseSystem(SYSTEM_EVENT_STA_DISCONNECTED);
+        return;
+    }
+
+    ToRecord(*best, &router);
+    associated = true;
+    staChannel = best->channel;
+    if (nowStarted)
+        Join();
+    RaiseSystem(SYSTEM_EVENT_STA_CONNECTED);
+    RaiseSystem(SYSTEM_EVENT_STA_GOT_IP);
+}
+
+esp_err_t esp_wifi_connect()
+{
+    thread(Associate).detach();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect()
+{
+    lock_guard<mutex> guard(lock);
+
+    if (associated)
+    {
+        associated = false;
+        RaiseSystem(SYSTEM_EVENT_STA_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_channel(uint8_t primary, wifi_second_chan_t second)
+{
+    lock_guard<mutex> guard(lock);
+
+    staChannel = primary;
+    if (nowStarted)
+        Join();
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_channel(uint8_t *primary, wifi_second_chan_t *second)
+{
+    lock_guard<mutex> guard(lock);
+
+    *primary = (layer > 0 && !nowStarted ? channel : staChannel);
+    *second  = WIFI_SECOND_CHAN_NONE;
+    return ESP_OK;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief ESP-NOW, one hop to the stations on the channel of this one
+//!
+esp_err_t esp_now_init()
+{
+    Open();
+
+    lock_guard<mutex> guard(lock);
+    nowStarted = true;
+    nowPeers.clear();
+    Join();
+    return ESP_OK;
+}
+
+esp_err_t esp_now_deinit()
+{
+    simHeader         header = {};
+    lock_guard<mutex> guard(lock);
+
+    if (nowStarted && !started)
+    {
+        header.type = SIM_LEAVE;
+        Post(header, NULL, 0);
+    }
+    nowStarted = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_recv_cb(esp_now_recv_cb_t cb)
+{
+    lock_guard<mutex> guard(lock);
+
+    nowRecv = cb;
+    return ESP_OK;
+}
+
+esp_err_t esp_now_register_send_cb(esp_now_send_cb_t cb)
+{
+    lock_guard<mutex> guard(lock);
+
+    nowSent = cb;
+    return ESP_OK;
+}
+
+//! \fn    esp_now_send
+//! \brief Hands a frame to the medium, for a peer added before, the broadcast address
+//!        included. The send callback follows once the frame is through.
+//!
+esp_err_t esp_now_send(const uint8_t *peer, const uint8_t *data, size_t length)
+{
+    simHeader         header = {};
+    lock_guard<mutex> guard(lock);
+
+    if (!nowStarted)
+        return ESP_ERR_ESPNOW_NOT_INIT;
+    if (peer == NULL || data == NULL || length == 0 || length > ESP_NOW_MAX_DATA_LEN)
+        return ESP_ERR_ESPNOW_ARG;
+    if (nowPeers.count(Key(peer)) == 0)
+        return ESP_ERR_ESPNOW_NOT_FOUND;
+
+    header.type    = SIM_RADIO;
+    header.channel = staChannel;
+    memcpy(header.dst, peer, 6);
+    Post(header, data, length);
+    return ESP_OK;
+}
+
+esp_err_t esp_now_add_peer(const esp_now_peer_info_t *peer)
+{
+    lock_guard<mutex> guard(lock);
+
+    if (nowPeers.count(Key(peer->peer_addr)))
+        return ESP_ERR_ESPNOW_EXIST;
+    if (nowPeers.size() >= ESP_NOW_MAX_TOTAL_PEER_NUM)
+        return ESP_ERR_ESPNOW_FULL;
+
+    nowPeers.insert(Key(peer->peer_addr));
+    return ESP_OK;
+}
+
+esp_err_t esp_now_del_peer(const uint8_t *peer)
+{
+    lock_guard<mutex> guard(lock);
+
+    return (nowPeers.erase(Key(peer)) ? ESP_OK : ESP_ERR_ESPNOW_NOT_FOUND);
+}
+
+bool esp_now_is_peer_exist(const uint8_t *peer)
+{
+    lock_guard<mutex> guard(lock);
+    return nowPeers.count(Key(peer)) != 0;
+}
@@ -0,0 +1,411 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  mqtt.cpp
+//! \brief This source contains the host stand-in for esp-mqtt, an MQTT 3.1.1 client over host
+//!        sockets, so a root on meshsim can publish to a local broker, or to ingest.py --mqtt.
+//!        Like esp-mqtt the client runs on a thread of its own, which connects, reads, pings,
+//!        reconnects after RECONNECT_TIME, and raises the events on that thread. Publishing
+//!        and subscribing write straight to the socket. QoS 2 isn't supported.
+//!
+//!
+#include "idf.h"
+#include <poll.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::lock_guard;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::vector;
+
+const int RECONNECT_TIME = 10000;                           /*!< ms, the esp-mqtt default */
+const int READ_TIMEOUT   = 5;                               /*!< s, for the rest of a packet */
+
+//! \brief esp_mqtt_client is a client, its strings are copied from the config.
+//!
+struct esp_mqtt_client
+{
+    esp_mqtt_client_config_t config;
+    string                   host;
+    int                      port;
+    string                   clientId;
+    string                   willTopic;
+    string                   willMessage;
+    int                      sock;
+    mutex                    sendLock;                      /*!< Guards sock writes and nextId */
+    uint16_t                 nextId;
+    std::atomic<bool>        running;
+    std::atomic<bool>        connected;
+    thread                   worker;
+};
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Packets
+//!
+
+//! \fn    AppendLength
+//! \brief Appends the remaining length of a packet, 7 bits per byte.
+//!
+static void AppendLength(vector<uint8_t> &out, size_t length)
+{
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        out.push_back(digit | (length > 0 ? 0x80 : 0));
+    } while (length > 0);
+}
+
+//! \fn    AppendString
+//! \brief Appends a string with its 16 bit length.
+//!
+static void AppendString(vector<uint8_t> &out, const string &text)
+{
+    out.push_back(text.length() >> 8);
+    out.push_back(text.length() & 0xFF);
+    out.insert(out.end(), text.begin(), text.end());
+}
+
+//! \fn    Packet
+//! \brief Puts the fixed header in front of the variable header and payload.
+//!
+static vector<uint8_t> Packet(uint8_t type, const vector<uint8_t> &body)
+{
+    vector<uint8_t> packet = { type };
+
+    AppendLength(packet, body.size());
+    packet.insert(packet.end(), body.begin(), body.end());
+    return packet;
+}
+
+//! \fn    Send
+//! \brief Writes a packet whole, false if the connection is gone.
+//!
+static bool Send(esp_mqtt_client *client, const vector<uint8_t> &packet)
+{
+    lock_guard<mutex> guard(client->sendLock);
+    size_t            sent = 0;
+
+    while (client->sock >= 0 && sent < packet.size())
+    {
+        ssize_t n = send(client->sock, packet.data() + sent, packet.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return (sent == packet.size());
+}
+
+//! \fn    ReadFully
+//! \brief Reads exactly 'length' bytes, false if the connection is gone or stalls.
+//!
+static bool ReadFully(int sock, uint8_t *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t n = recv(sock, data, length, 0);
+        if (n <= 0)
+            return false;
+        data   += n;
+        length -= n;
+    }
+    return true;
+}
+
+//! \fn    ReadPacket
+//! \brief Reads the next packet, its type byte and its body.
+//!
+static bool ReadPacket(int sock, uint8_t &type, vector<uint8_t> &body)
+{
+    size_t  length = 0;
+    int     shift  = 0;
+    uint8_t digit  = 0;
+
+    if (!ReadFully(sock, &type, 1))
+        return false;
+
+    do {
+        if (!ReadFully(sock, &digit, 1) || shift > 21)
+            return false;
+        length |= (size_t)(digit & 0x7F) << shift;
+        shift  += 7;
+    } while (digit & 0x80);
+
+    body.resize(length);
+    return ReadFully(sock, body.data(), length);
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Session
+//!
+
+//! \fn    Raise
+//! \brief Calls the event handler of the client.
+//!
+static void Raise(esp_mqtt_client *client, esp_mqtt_event_t event)
+{
+    event.client       = client;
+    event.user_context = client->config.user_context;
+    if (client->config.event_handle != NULL)
+        client->config.event_handle(&event);
+}
+
+//! \fn    Open
+//! \brief Connects to the broker and sends CONNECT, with the will if there is one, then
+//!        waits for CONNACK.
+//!
+static bool Open(esp_mqtt_client *client)
+{
+    sockaddr_in     addr    = {};
+    timeval         timeout = { READ_TIMEOUT, 0 };
+    vector<uint8_t> body    = { 0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x00 };
+    uint8_t         type    = 0;
+    int             sock    = socket(AF_INET, SOCK_STREAM, 0);
+
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(client->port);
+    addr.sin_addr.s_addr = inet_addr(client->host.c_str());
+
+    if (sock < 0 || connect(sock, (sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        if (sock >= 0)
+            close(sock);
+        return false;
+    }
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (!client->config.disable_clean_session)
+        body[7] |= 0x02;
+    if (!client->willTopic.empty())
+        body[7] |= 0x04 | (client->config.lwt_qos & 3) << 3 | (client->config.lwt_retain ? 0x20 : 0);
+    body.push_back(client->config.keepalive >> 8);
+    body.push_back(client->config.keepalive & 0xFF);
+    AppendString(body, client->clientId);
+    if (!client->willTopic.empty())
+    {
+        AppendString(body, client->willTopic);
+        AppendString(body, client->willMessage);
+    }
+
+    {
+        lock_guard<mutex> guard(client->sendLock);
+        client->sock = sock;
+    }
+    if (!Send(client, Packet(0x10, body)) || !ReadPacket(sock, type, body) || type != 0x20 ||
+        body.size() < 2 || body[1] != 0)
+    {
+        lock_guard<mutex> guard(client->sendLock);
+        close(sock);
+        client->sock = -1;
+        return false;
+    }
+    return true;
+}
+
+//! \fn    Serve
+//! \brief Reads the packets of an open session until it's lost or the client stops, and
+//!        pings the broker so it stays open. Acks every QoS 1 message it receives.
+//!
+static void Serve(esp_mqtt_client *client)
+{
+    auto            pingAt = std::chrono::steady_clock::now();
+    auto            every  = std::chrono::seconds(client->config.keepalive > 0 ? client->config.keepalive : 120) / 2;
+    pollfd          ready  = { client->sock, POLLIN, 0 };
+    vector<uint8_t> body;
+    uint8_t         type   = 0;
+
+    while (client->running)
+    {
+        if (std::chrono::steady_clock::now() - pingAt >= every)
+        {
+            if (!Send(client, { 0xC0, 0x00 }))
+                return;
+            pingAt = std::chrono::steady_clock::now();
+        }
+
+        if (poll(&ready, 1, 100) <= 0)
+            continue;
+        if (!ReadPacket(client->sock, type, body))
+            return;
+
+        esp_mqtt_event_t event = {};
+        switch (type & 0xF0)
+        {
+        case 0x30:                                          /*!< PUBLISH */
+        {
+            int    qos    = (type >> 1) & 3;
+            size_t topic  = body.size() >= 2 ? (body[0] << 8 | body[1]) : 0;
+            size_t offset = 2 + topic + (qos > 0 ? 2 : 0);
+
+            if (body.size() < offset)
+                return;
+            if (qos > 0)
+                Send(client, { 0x40, 0x02, body[2 + topic], body[3 + topic] });
+
+            event.event_id       = MQTT_EVENT_DATA;
+            event.topic          = reinterpret_cast<char*>(body.data() + 2);
+            event.topic_len      = topic;
+            event.data           = reinterpret_cast<char*>(body.data() + offset);
+            event.data_len       = body.size() - offset;
+            event.total_data_len = event.data_len;
+            Raise(client, event);
+            break;
+        }
+        case 0x40:                                          /*!< PUBACK */
+            event.event_id = MQTT_EVENT_PUBLISHED;
+            event.msg_id   = (body.size() >= 2 ? body[0] << 8 | body[1] : 0);
+            Raise(client, event);
+            break;
+        case 0x90:                                          /*!< SUBACK */
+            event.event_id = MQTT_EVENT_SUBSCRIBED;
+            event.msg_id   = (body.size() >= 2 ? body[0] << 8 | body[1] : 0);
+            Raise(client, event);
+            break;
+        default:                                            /*!< PINGRESP */
+            break;
+        }
+    }
+}
+
+//! \fn    Run
+//! \brief The client thread, opens the session, serves it, and opens it again once lost
+//!        unless auto reconnect is off.
+//!
+static void Run(esp_mqtt_client *client)
+{
+    while (client->running)
+    {
+        esp_mqtt_event_t event = {};
+
+        if (Open(client))
+        {
+            client->connected = true;
+            event.event_id    = MQTT_EVENT_CONNECTED;
+            Raise(client, event);
+            Serve(client);
+            client->connected = false;
+
+            lock_guard<mutex> guard(client->sendLock);
+            close(client->sock);
+            client->sock = -1;
+        }
+
+        event.event_id = MQTT_EVENT_DISCONNECTED;
+        Raise(client, event);
+        if (client->config.disable_auto_reconnect)
+            break;
+
+        for (int waited = 0; client->running && waited < RECONNECT_TIME; waited += 100)
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief esp-mqtt
+//!
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client *client = new esp_mqtt_client();
+    string           uri    = (config->uri != NULL ? config->uri : "");
+    size_t           colon  = {};
+
+    if (uri.compare(0, 7, "mqtt://") == 0)
+        uri.erase(0, 7);
+    colon = uri.rfind(':');
+
+    client->config      = *config;
+    client->host        = uri.substr(0, colon);
+    client->port        = (colon == string::npos ? 1883 : atoi(uri.c_str() + colon + 1));
+    client->clientId    = (config->client_id != NULL ? config->client_id : "");
+    client->willTopic   = (config->lwt_topic != NULL ? config->lwt_topic : "");
+    client->willMessage = (config->lwt_msg != NULL ? config->lwt_msg : "");
+    client->sock        = -1;
+    client->nextId      = 1;
+    client->running     = false;
+    client->connected   = false;
+
+    return client;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client->running)
+        return ESP_FAIL;
+
+    client->running = true;
+    client->worker  = thread(&Run, client);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client)
+{
+    if (!client->running)
+        return ESP_FAIL;
+
+    Send(client, { 0xE0, 0x00 });                           /*!< DISCONNECT, the will isn't sent */
+    client->running = false;
+    if (client->worker.joinable())
+        client->worker.join();
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    esp_mqtt_client_stop(client);
+    delete client;
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    vector<uint8_t> body;
+    int             id = {};
+
+    if (!client->connected)
+        return -1;
+
+    {
+        lock_guard<mutex> guard(client->sendLock);
+        id = client->nextId++;
+        if (client->nextId == 0)
+            client->nextId = 1;
+    }
+    body.push_back(id >> 8);
+    body.push_back(id & 0xFF);
+    AppendString(body, topic);
+    body.push_back(qos & 1);
+
+    return (Send(client, Packet(0x82, body)) ? id : -1);
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len,
+                            int qos, int retain)
+{
+    vector<uint8_t> body;
+    int             id = 0;
+
+    if (!client->connected || qos > 1)
+        return -1;
+    if (len == 0)
+        len = strlen(data);
+
+    AppendString(body, topic);
+    if (qos > 0)
+    {
+        lock_guard<mutex> guard(client->sendLock);
+        id = client->nextId++;
+        if (client->nextId == 0)
+            client->nextId = 1;
+        body.push_back(id >> 8);
+        body.push_back(id & 0xFF);
+    }
+    body.insert(body.end(), data, data + len);
+
+    return (Send(client, Packet(0x30 | qos << 1 | (retain ? 1 : 0), body)) ? id : -1);
+}
@@ -0,0 +1,320 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  system.cpp
+//! \brief This source contains the host stand-in for the esp-idf system calls: timers, random
+//!        numbers, sleep and power management, NVS, and the wifi and tcpip calls that only
+//!        matter on the esp32. NVS reads the same partition CSV nvs_partition_gen.py flashes.
+//!
+//!
+#include "idf.h"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using std::map;
+using std::mutex;
+using std::string;
+
+
+//! \brief hostTimer is an esp_timer, it runs on a thread of its own while started.
+//!
+typedef struct
+{
+    esp_timer_create_args_t args;
+    std::atomic<uint32_t>   generation;                 /*!< Bumped on every start and stop */
+}hostTimer;
+
+//! \brief nvsEntry is a key of a namespace, as written in the CSV.
+//!
+typedef struct
+{
+    string encoding;
+    string value;
+}nvsEntry;
+
+static const std::chrono::steady_clock::time_point boot = std::chrono::steady_clock::now();
+static map<string, map<string, nvsEntry>> nvs;          /*!< Namespaces by name */
+static map<nvs_handle, string>            handles;      /*!< Open namespaces by handle */
+static mutex                              nvsLock;
+static uint64_t                           wakeAfter = 0;
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Timers and system
+//!
+int64_t esp_timer_get_time()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - boot).count();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer)
+{
+    hostTimer *created = new hostTimer();
+
+    created->args       = *args;
+    created->generation = 0;
+    *timer              = created;
+    return ESP_OK;
+}
+
+//! \fn    StartTimer
+//! \brief Runs the timer's callback after 'period' us, and every 'period' us after that if
+//!        periodic, until the timer is started again or stopped.
+//!
+static esp_err_t StartTimer(esp_timer_handle_t handle, uint64_t period, bool periodic)
+{
+    hostTimer *timer      = static_cast<hostTimer*>(handle);
+    uint32_t   generation = ++timer->generation;
+
+    std::thread([=]() {
+        auto due = std::chrono::steady_clock::now();
+        do {
+            due += std::chrono::microseconds(period);
+            std::this_thread::sleep_until(due);
+            if (timer->generation != generation)
+                return;
+            timer->args.callback(timer->args.arg);
+        } while (periodic);
+    }).detach();
+
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) { return StartTimer(timer, period, true); }
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout)    { return StartTimer(timer, timeout, false); }
+
+esp_err_t esp_timer_stop(esp_timer_handle_t handle)
+{
+    static_cast<hostTimer*>(handle)->generation++;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t handle)
+{
+    esp_timer_stop(handle);                                 /*!< Leaked, a stopping thread may still look */
+    return ESP_OK;
+}
+
+uint32_t esp_get_free_heap_size()         { return 200 * 1024; }
+uint32_t esp_get_minimum_free_heap_size() { return 180 * 1024; }
+
+//! \fn    esp_random
+//! \brief Random numbers seeded by the mac and the time, so every node and every boot differ.
+//!
+uint32_t esp_random()
+{
+    static mutex        randomLock;
+    static std::mt19937 generator;
+    static bool         seeded = false;
+    std::lock_guard<mutex> guard(randomLock);
+
+    if (!seeded)
+    {
+        const uint8_t *mac = HostGetMac();
+        generator.seed(crc32_le(0, mac, 6) ^ std::chrono::system_clock::now().time_since_epoch().count());
+        seeded = true;
+    }
+    return generator();
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+    return ~crc;
+}
+
+void esp_restart()
+{
+    HostRestart(0, false);
+}
+
+esp_sleep_source_t esp_sleep_get_wakeup_cause()        { return HostWakeup(); }
+esp_err_t          esp_sleep_enable_timer_wakeup(uint64_t us) { wakeAfter = us; return ESP_OK; }
+esp_err_t          esp_light_sleep_start()             { std::this_thread::sleep_for(std::chrono::microseconds(wakeAfter)); return ESP_OK; }
+void               esp_deep_sleep_start()              { HostRestart(wakeAfter, true); }
+
+esp_err_t esp_pm_configure(const void *config)         { return ESP_OK; }
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t lock) { return ESP_OK; }
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t lock) { return ESP_OK; }
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t type, int arg, const char *name, esp_pm_lock_handle_t *lock)
+{
+    *lock = NULL;
+    return ESP_OK;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+}
+
+void HostAbort(const char *what, esp_err_t rc)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: 0x%x, %s\n", rc, what);
+    abort();
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief NVS, every partition is the one CSV
+//!
+
+//! \fn     HostLoadNvs
+//! \brief  Loads the partition CSV, "key,type,encoding,value" lines where a namespace line
+//!         starts the keys that follow it.
+//! \return <bool> false if the file can't be read.
+//!
+bool HostLoadNvs(const char *csv)
+{
+    std::ifstream file(csv);
+    string        line;
+    string        space;
+
+    if (!file)
+        return false;
+
+    std::getline(file, line);                               /*!< Header */
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        string key, type, encoding, value;
+
+        std::getline(fields, key, ',');
+        std::getline(fields, type, ',');
+        std::getline(fields, encoding, ',');
+        std::getline(fields, value);
+        if (!value.empty() && value.back() == '\r')
+            value.pop_back();
+
+        if (type == "namespace")
+            space = key;
+        else if (type == "data" && !space.empty())
+            nvs[space][key] = { encoding, value };
+    }
+    return true;
+}
+
+esp_err_t nvs_flash_init()                                 { return ESP_OK; }
+esp_err_t nvs_flash_erase()                                { return ESP_OK; }
+esp_err_t nvs_flash_init_partition(const char *partition)  { return ESP_OK; }
+esp_err_t nvs_flash_erase_partition(const char *partition) { return ESP_OK; }
+
+esp_err_t nvs_open(const char *ns, nvs_open_mode mode, nvs_handle *handle)
+{
+    std::lock_guard<mutex> guard(nvsLock);
+
+    if (nvs.count(ns) == 0)
+        return ESP_ERR_NVS_NOT_FOUND;
+
+    *handle          = handles.size() + 1;
+    handles[*handle] = ns;
+    return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char *partition, const char *ns, nvs_open_mode mode, nvs_handle *handle)
+{
+    return nvs_open(ns, mode, handle);
+}
+
+void nvs_close(nvs_handle handle)
+{
+}
+
+//! \fn     Find
+//! \brief  Finds a key of an open namespace, with the encoding asked for.
+//!
+static esp_err_t Find(nvs_handle handle, const char *key, const char *encoding, string &value)
+{
+    std::lock_guard<mutex> guard(nvsLock);
+
+    if (handles.count(handle) == 0)
+        return ESP_ERR_INVALID_ARG;
+
+    auto &space = nvs[handles[handle]];
+    auto  entry = space.find(key);
+    if (entry == space.end())
+        return ESP_ERR_NVS_NOT_FOUND;
+    if (entry->second.encoding != encoding)
+        return ESP_ERR_NVS_TYPE_MISMATCH;
+
+    value = entry->second.value;
+    return ESP_OK;
+}
+
+template <typename Int>
+static esp_err_t GetInt(nvs_handle handle, const char *key, const char *encoding, Int *out)
+{
+    string    value;
+    esp_err_t status = Find(handle, key, encoding, value);
+
+    if (status == ESP_OK)
+        *out = static_cast<Int>(strtoul(value.c_str(), NULL, 0));
+    return status;
+}
+
+esp_err_t nvs_get_u8(nvs_handle handle, const char *key, uint8_t *out)   { return GetInt(handle, key, "u8", out); }
+esp_err_t nvs_get_u16(nvs_handle handle, const char *key, uint16_t *out) { return GetInt(handle, key, "u16", out); }
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out) { return GetInt(handle, key, "u32", out); }
+
+//! \fn     nvs_get_str
+//! \brief  Like the esp-idf, a NULL 'out' only gets the length, the terminator included.
+//!
+esp_err_t nvs_get_str(nvs_handle handle, const char *key, char *out, size_t *length)
+{
+    string    value;
+    esp_err_t status = Find(handle, key, "string", value);
+
+    if (status != ESP_OK)
+        return status;
+    if (out != NULL && *length < value.length() + 1)
+        return ESP_ERR_NVS_INVALID_LENGTH;
+
+    if (out != NULL)
+        memcpy(out, value.c_str(), value.length() + 1);
+    *length = value.length() + 1;
+    return ESP_OK;
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Wifi and tcpip, nothing to do on the host, the station is in mesh.cpp
+//!
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)                     { return ESP_OK; }
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)                        { return ESP_OK; }
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)                                 { return ESP_OK; }
+esp_err_t esp_wifi_stop()                                                     { return ESP_OK; }
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type)                                { return ESP_OK; }
+esp_err_t esp_wifi_set_protocol(wifi_interface_t iface, uint8_t protocols)    { return ESP_OK; }
+esp_err_t esp_wifi_set_max_tx_power(int8_t power)                             { return ESP_OK; }
+esp_err_t esp_mesh_set_capacity_num(int num)                                  { return ESP_OK; }
+esp_err_t esp_mesh_set_ap_authmode(wifi_auth_mode_t mode)                     { return ESP_OK; }
+esp_err_t esp_mesh_set_ap_connections(int connections)                        { return ESP_OK; }
+esp_err_t esp_mesh_set_self_organized(bool enable, bool select)               { return ESP_OK; }
+
+esp_err_t esp_wifi_get_ps(wifi_ps_type_t *type)
+{
+    *type = WIFI_PS_NONE;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t iface, uint8_t mac[6])
+{
+    memcpy(mac, HostGetMac(), 6);
+    mac[5] += (iface == WIFI_IF_AP ? 1 : 0);
+    return ESP_OK;
+}
+
+void      tcpip_adapter_init()                                                {}
+esp_err_t tcpip_adapter_dhcps_stop(tcpip_adapter_if_t iface)                  { return ESP_OK; }
+esp_err_t tcpip_adapter_dhcpc_stop(tcpip_adapter_if_t iface)                  { return ESP_OK; }
+esp_err_t tcpip_adapter_dhcpc_start(tcpip_adapter_if_t iface)                 { return ESP_OK; }
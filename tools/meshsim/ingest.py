@@ -0,0 +1,178 @@
+#!/usr/bin/env python3
+#
+# ingest.py, the local stand-in for the REST server. Takes the roots' POST /createReading
+# requests on keep-alive connections, counts the json array items by root, type, and body,
+# and answers "Response: 0" with any extra fields given by --field. Prints the rate every
+# --every seconds, and the totals when stopped.
+#
+# With --mqtt it stands in for the MQTT broker instead, for roots built with
+# CONFIG_SERVER_TRANSPORT_MQTT. It takes MQTT 3.1.1 QoS 0 and 1 publishes, counts the items
+# the same way with the client id as the root, and sends the --field lines once on the
+# control topic a root subscribes to. It isn't a broker, nothing is forwarded or kept.
+#
+#   ingest.py [--port 18080] [--every 1] [--mqtt] [--field "Rate: *:Quaternion:50"]...
+#
+import argparse
+import json
+import signal
+import socketserver
+import struct
+import sys
+import threading
+import time
+from collections import Counter
+
+lock    = threading.Lock()
+items   = Counter()                 # (root, type, body) -> items
+posts   = Counter()                 # root -> posts
+errors  = Counter()                 # root -> bodies that weren't json
+volume  = Counter()                 # root -> body bytes
+started = time.time()
+fields  = []
+
+
+def count(root, body):
+    try:
+        things = json.loads(body)["things"]
+    except (ValueError, KeyError):
+        with lock:
+            errors[root] += 1
+        return
+
+    with lock:
+        posts[root]  += 1
+        volume[root] += len(body)
+        for thing in things:
+            kind = thing.get("type", thing.get("t", "?"))
+            name = thing.get("node", thing.get("body", thing.get("b", "?")))
+            items[(root, kind, name)] += 1
+
+
+class Handler(socketserver.StreamRequestHandler):
+    def handle(self):
+        root  = "%s:%d" % self.client_address
+        reply = "HTTP/1.1 200 OK\r\nResponse: 0\r\n" + "".join(f + "\r\n" for f in fields)
+        reply = (reply + "Content-Length: 0\r\n\r\n").encode()
+
+        while True:
+            length = 0
+            line   = self.rfile.readline()
+            if not line:
+                return
+            while line not in (b"\r\n", b"\n", b""):
+                name, _, value = line.decode(errors="replace").partition(":")
+                if name.strip().lower() == "content-length":
+                    length = int(value.strip() or 0)
+                line = self.rfile.readline()
+
+            count(root, self.rfile.read(length).decode(errors="replace"))
+            self.wfile.write(reply)
+
+
+class MqttHandler(socketserver.StreamRequestHandler):
+    def packet(self):
+        head = self.rfile.read(1)
+        if not head:
+            return None, b""
+        length, shift = 0, 0
+        while True:
+            digit   = self.rfile.read(1)
+            if not digit:
+                return None, b""
+            length |= (digit[0] & 0x7F) << shift
+            shift  += 7
+            if not digit[0] & 0x80:
+                break
+        return head[0], self.rfile.read(length)
+
+    def send(self, kind, body):
+        length, size = len(body), b""
+        while True:
+            digit, length = length % 128, length // 128
+            size += bytes([digit | (0x80 if length else 0)])
+            if not length:
+                break
+        self.wfile.write(bytes([kind]) + size + body)
+        self.wfile.flush()
+
+    def handle(self):
+        root = "%s:%d" % self.client_address
+        while True:
+            head, body = self.packet()
+            kind       = (head or 0xE0) & 0xF0
+            if kind == 0xE0:                        # DISCONNECT, or the connection is gone
+                return
+            elif kind == 0x10:                      # CONNECT, the client id follows the keepalive
+                size = struct.unpack(">H", body[10:12])[0]
+                root = body[12:12 + size].decode(errors="replace") or root
+                self.send(0x20, b"\x00\x00")
+            elif kind == 0x30:                      # PUBLISH, acked at QoS 1
+                size  = struct.unpack(">H", body[:2])[0]
+                topic = body[2:2 + size].decode(errors="replace")
+                start = 2 + size + (2 if head & 0x06 else 0)
+                if head & 0x06:
+                    self.send(0x40, body[2 + size:start])
+                if not topic.endswith("/status"):
+                    count(root, body[start:].decode(errors="replace"))
+            elif kind == 0x80:                      # SUBSCRIBE, one topic, granted QoS 0
+                size  = struct.unpack(">H", body[2:4])[0]
+                topic = body[4:4 + size]
+                self.send(0x90, body[:2] + b"\x00")
+                if fields:
+                    control = ("".join(f + "\r\n" for f in fields)).encode()
+                    self.send(0x30, struct.pack(">H", len(topic)) + topic + control)
+            elif kind == 0xC0:                      # PINGREQ
+                self.send(0xD0, b"")
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads      = True
+    allow_reuse_address = True
+
+
+def report(every):
+    last = 0
+    while True:
+        time.sleep(every)
+        with lock:
+            total = sum(items.values())
+            roots = len(posts)
+        print("ingest: %.0f items/s, %d items from %d roots" % ((total - last) / every, total, roots), flush=True)
+        last = total
+
+
+def summary(*_):
+    elapsed = time.time() - started
+    with lock:
+        print("ingest summary after %.0f s:" % elapsed)
+        for root in sorted(posts):
+            mine  = {k: v for k, v in items.items() if k[0] == root}
+            total = sum(mine.values())
+            print("  root %s: %d posts, %d items, %.1f items/s, %.1f kB/s, %d bad bodies"
+                  % (root, posts[root], total, total / elapsed, volume[root] / elapsed / 1000, errors[root]))
+            for (_, kind, name), n in sorted(mine.items(), key=lambda e: (e[0][1], e[0][2])):
+                print("    %-10s %-24s %d" % (kind, name, n))
+    sys.stdout.flush()
+    sys.exit(0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="REST server stand-in for meshsim")
+    parser.add_argument("--port", type=int, default=18080)
+    parser.add_argument("--every", type=float, default=1)
+    parser.add_argument("--field", action="append", default=[], help="extra response field")
+    parser.add_argument("--mqtt", action="store_true", help="stand in for the MQTT broker")
+    options = parser.parse_args()
+    fields.extend(options.field)
+
+    signal.signal(signal.SIGTERM, summary)
+    signal.signal(signal.SIGINT, summary)
+    threading.Thread(target=report, args=(options.every,), daemon=True).start()
+
+    with Server(("127.0.0.1", options.port), MqttHandler if options.mqtt else Handler) as server:
+        print("ingest on port %d%s" % (options.port, " as the MQTT broker" if options.mqtt else ""), flush=True)
+        server.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,814 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  medium.cpp
+//! \brief This source contains meshsim, the radio medium the simulated nodes share. It builds
+//!        a tree per mesh id the way esp-mesh does, and carries the frames along it hop by hop.
+//!
+//!        meshsim [--port 47000] [--latency 2] [--jitter 1] [--loss 0] [--bandwidth 250000]
+//!                [--queue 500] [--fanout 6] [--layers 0] [--channels 1,6,11] [--seed 1]
+//!                [--stats 5]
+//!
+//!        The root is the node set as root, or if there is none and the root isn't fixed, the
+//!        lowest mac. The other nodes keep their parent while they can, and otherwise take
+//!        the shallowest node with room, so a mesh fills layer by layer, 'fanout' children
+//!        per node and no deeper than 'layers', or the node's own max layer. Every hop loses
+//!        a frame with probability 'loss', and takes 'latency' ms plus up to 'jitter' ms, on
+//!        top of its airtime. Airtime is 'bandwidth' bytes per second shared by every mesh on
+//!        the channel, a frame that would wait more than 'queue' ms for it is dropped.
+//!
+//!
+#include "medium.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <netinet/in.h>
+#include <queue>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+const uint8_t MESH_TYPE_ROOT  = 1;                          /*!< mesh_type_t */
+const uint8_t MESH_TYPE_NODE  = 2;
+const uint8_t MESH_TYPE_LEAF  = 3;
+const uint8_t DATA_GROUP      = 0x40;                       /*!< MESH_DATA_GROUP */
+const int     FRAME_OVERHEAD  = 60;                         /*!< 802.11 and mesh headers, bytes */
+
+typedef uint64_t key;                                       /*!< A mac or a mesh id */
+
+//! \brief simNode is a node the medium knows of, and its place in the tree.
+//!
+typedef struct
+{
+    sockaddr_in   addr;
+    key           mesh;
+    uint8_t       flags;
+    uint8_t       channel;
+    int           maxLayer;
+    set<key>      groups;
+    int64_t       seen;                                     /*!< us */
+    uint16_t      overflow;
+    key           parent;                                   /*!< 0 if not in the tree */
+    int           layer;
+    vector<key>   table;
+    vector<uint8_t> state;                                  /*!< Last SIM_STATE sent */
+}simNode;
+
+//! \brief simMesh is a mesh id's tree.
+//!
+typedef struct
+{
+    key           root;
+    uint8_t       channel;
+}simMesh;
+
+//! \brief simDelivery is a frame on its way to a node.
+//!
+typedef struct
+{
+    int64_t       at;                                       /*!< us */
+    uint64_t      order;
+    key           to;
+    vector<uint8_t> datagram;
+}simDelivery;
+
+struct Later
+{
+    bool operator()(const simDelivery &a, const simDelivery &b) const
+    {
+        return a.at != b.at ? a.at > b.at : a.order > b.order;
+    }
+};
+
+//! \brief simStats are the counts of a stats interval.
+//!
+typedef struct
+{
+    uint64_t      sent;
+    uint64_t      delivered;
+    uint64_t      lost;                                     /*!< To loss */
+    uint64_t      dropped;                                  /*!< To a full channel */
+    uint64_t      unroutable;
+    uint64_t      bytes;
+    map<int, int64_t> airtime;                              /*!< us by channel */
+}simStats;
+
+static double         latency   = 2;
+static double         jitter    = 1;
+static double         loss      = 0;
+static double         bandwidth = 250000;
+static double         queueMs   = 500;
+static int            fanout    = 6;
+static int            layers    = 0;
+static vector<int>    channels  = { 1, 6, 11 };
+static int            statsEvery = 5;
+
+static int            sock;
+static std::mt19937   generator;
+static map<key, simNode> nodes;
+static map<key, simMesh> meshes;
+static map<int, int64_t> busy;                              /*!< us each channel is taken until */
+static std::priority_queue<simDelivery, vector<simDelivery>, Later> deliveries;
+static uint64_t       order     = 0;
+static simStats       stats     = {};
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Helpers
+//!
+static int64_t Now()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static key ToKey(const uint8_t mac[6])
+{
+    key k = 0;
+
+    for (int i = 0; i < 6; i++)
+        k = (k << 8) | mac[i];
+    return k;
+}
+
+static void FromKey(key k, uint8_t mac[6])
+{
+    for (int i = 5; i >= 0; i--, k >>= 8)
+        mac[i] = k & 0xFF;
+}
+
+static string Name(key k)
+{
+    char text[18];
+
+    snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x", (int)(k >> 40) & 0xFF, (int)(k >> 32) & 0xFF,
+             (int)(k >> 24) & 0xFF, (int)(k >> 16) & 0xFF, (int)(k >> 8) & 0xFF, (int)k & 0xFF);
+    return text;
+}
+
+//! \fn    RouterRssi
+//! \brief The routers are one per channel in 'channels', the first the strongest.
+//!
+static int8_t RouterRssi(int channel)
+{
+    for (size_t i = 0; i < channels.size(); i++)
+    {
+        if (channels[i] == channel)
+            return -45 - 3 * i;
+    }
+    return -90;
+}
+
+static key RouterBssid(int channel)
+{
+    return 0x02005E000000ULL | channel;
+}
+
+static void Send(key to, const simHeader &header, const void *payload, int length)
+{
+    vector<uint8_t> datagram(sizeof(header) + length);
+    simHeader       head = header;
+
+    head.length = length;
+    memcpy(datagram.data(), &head, sizeof(head));
+    if (length > 0)
+        memcpy(datagram.data() + sizeof(head), payload, length);
+    sendto(sock, datagram.data(), datagram.size(), 0, (sockaddr *)&nodes[to].addr, sizeof(sockaddr_in));
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Topology
+//!
+
+//! \fn    Collect
+//! \brief Fills a node's routing table, itself and everything below it, depth first.
+//!
+static void Collect(key self, const map<key, vector<key>> &children, vector<key> &table)
+{
+    table.push_back(self);
+    if (children.count(self) == 0)
+        return;
+    for (key child : children.at(self))
+        Collect(child, children, table);
+}
+
+//! \fn    Publish
+//! \brief Sends a node its SIM_STATE, if it changed since the last one.
+//!
+static void Publish(key k)
+{
+    simNode        &node   = nodes[k];
+    simMesh        &mesh   = meshes[node.mesh];
+    simHeader       header = {};
+    vector<uint8_t> payload(node.table.size() * 6);
+    vector<uint8_t> state;
+
+    header.type  = SIM_STATE;
+    header.layer = node.layer;
+    header.count = node.table.size();
+    FromKey(node.mesh, header.meshId);
+
+    if (node.layer > 0)
+    {
+        header.channel = mesh.channel;
+        header.flags   = (k == mesh.root ? SIM_ROOT : 0);
+        header.rssi    = (k == mesh.root ? RouterRssi(mesh.channel) : -45 - 3 * (node.layer - 1) - (int)(k % 8));
+        FromKey(k == mesh.root ? RouterBssid(mesh.channel) : node.parent + 1, header.src);     /*!< Parent softAP */
+        FromKey(mesh.root, header.dst);
+        for (size_t i = 0; i < node.table.size(); i++)
+            FromKey(node.table[i], &payload[6 * i]);
+    }else {
+        header.count = 0;
+        payload.clear();
+    }
+
+    state.assign(reinterpret_cast<uint8_t*>(&header), reinterpret_cast<uint8_t*>(&header) + sizeof(header));
+    state.insert(state.end(), payload.begin(), payload.end());
+    if (state == node.state)
+        return;
+
+    node.state = state;
+    Send(k, header, payload.data(), payload.size());
+}
+
+//! \fn    Rebuild
+//! \brief Builds a mesh's tree again, after a node joined, left, or changed.
+//!
+static void Rebuild(key id)
+{
+    simMesh           &mesh    = meshes[id];
+    vector<key>        members;
+    map<key, vector<key>> children;
+    key                root    = 0;
+    bool               fixed   = false;
+
+    for (auto &entry : nodes)
+    {
+        if (entry.second.mesh != id || (entry.second.flags & SIM_STATION))
+            continue;
+        members.push_back(entry.first);
+        fixed |= (entry.second.flags & SIM_FIXED) != 0;
+        if ((entry.second.flags & SIM_ROOT) && root == 0)
+            root = entry.first;                             /*!< Lowest mac set as root */
+    }
+    if (root == 0 && !fixed && !members.empty())
+        root = members.front();                             /*!< Elected */
+
+    if (root != mesh.root)
+    {
+        printf("mesh %s: root %s\n", Name(id).c_str(), root ? Name(root).c_str() : "none");
+        for (key m : members)
+            nodes[m].parent = 0;                            /*!< A new root, everyone joins again */
+    }
+    mesh.root    = root;
+    mesh.channel = (root != 0 && nodes[root].channel != 0 ? nodes[root].channel : channels.front());
+
+    map<key, int> layer;
+    auto limit = [&](key m) { return (layers > 0 ? std::min(layers, nodes[m].maxLayer) : nodes[m].maxLayer); };
+    auto room  = [&](key p, key m) { return children[p].size() < (size_t)fanout && layer[p] + 1 <= limit(m); };
+
+    if (root != 0)
+        layer[root] = 1;
+
+    /*!< Keep parents while they are in the tree and have room, then place the rest shallowest first */
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (key m : members)
+        {
+            key p = nodes[m].parent;
+            if (layer.count(m) || p == 0 || layer.count(p) == 0 || !room(p, m))
+                continue;
+            layer[m] = layer[p] + 1;
+            children[p].push_back(m);
+            changed = true;
+        }
+    }
+    for (bool changed = true; changed; )
+    {
+        changed = false;
+        for (key m : members)
+        {
+            key best = 0;
+
+            if (layer.count(m))
+                continue;
+            for (auto &placed : layer)
+            {
+                if (room(placed.first, m) && (best == 0 || placed.second < layer[best] ||
+                    (placed.second == layer[best] && children[placed.first].size() < children[best].size())))
+                    best = placed.first;
+            }
+            if (best == 0)
+                continue;
+            layer[m] = layer[best] + 1;
+            children[best].push_back(m);
+            changed = true;
+        }
+    }
+
+    for (key m : members)
+    {
+        simNode &node = nodes[m];
+
+        node.layer  = (layer.count(m) ? layer[m] : 0);
+        node.parent = 0;
+        node.table.clear();
+        if (node.layer > 0)
+            Collect(m, children, node.table);
+    }
+    for (auto &entry : children)
+    {
+        for (key child : entry.second)
+            nodes[child].parent = entry.first;
+    }
+    for (key m : members)
+        Publish(m);
+}
+
+//! \fn    Remove
+//! \brief Forgets a node, and rebuilds its mesh.
+//!
+static void Remove(key k, const char *why)
+{
+    key mesh = nodes[k].mesh;
+
+    printf("node %s %s\n", Name(k).c_str(), why);
+    nodes.erase(k);
+    Rebuild(mesh);
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Traffic
+//!
+
+//! \fn    Path
+//! \brief Gets the hops from one node to another through their lowest common ancestor.
+//!
+static vector<key> Path(key from, key to)
+{
+    vector<key> up;
+    vector<key> down;
+
+    for (key k = from; k != 0; k = nodes[k].parent)
+        up.push_back(k);
+    for (key k = to; k != 0; k = nodes[k].parent)
+    {
+        auto common = std::find(up.begin(), up.end(), k);
+        if (common != up.end())
+        {
+            up.erase(common + 1, up.end());
+            up.insert(up.end(), down.rbegin(), down.rend());
+            return up;
+        }
+        down.push_back(k);
+    }
+    return vector<key>();                                   /*!< Not in the same tree */
+}
+
+//! \brief hopResult is when a frame got across a hop, or that it didn't.
+//!
+typedef struct
+{
+    int64_t       at;
+    bool          lost;
+}hopResult;
+
+//! \fn    Hop
+//! \brief Sends a frame across one hop ready at 'ready', on the mesh channel.
+//!
+static hopResult Hop(int channel, int bytes, int64_t ready)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    hopResult result = {};
+    int64_t   start  = std::max(ready, busy[channel]);
+    int64_t   air    = (bandwidth > 0 ? (int64_t)((bytes + FRAME_OVERHEAD) * 1e6 / bandwidth) : 0);
+
+    if (start - ready > queueMs * 1000)
+    {
+        stats.dropped++;
+        result.lost = true;
+        return result;
+    }
+
+    busy[channel]              = start + air;
+    stats.airtime[channel]    += air;
+    result.at                  = start + air + (int64_t)((latency + jitter * uniform(generator)) * 1000);
+    result.lost                = uniform(generator) < loss;
+    stats.lost                += result.lost;
+
+    return result;
+}
+
+//! \fn    Route
+//! \brief Carries a frame from its sender to every node it is for. A frame to a group
+//!        crosses each hop of the group's tree once.
+//!
+static void Route(key from, simHeader header, const uint8_t *payload)
+{
+    simNode                       &sender  = nodes[from];
+    simMesh                       &mesh    = meshes[sender.mesh];
+    vector<key>                    targets;
+    map<std::pair<key, key>, hopResult> hops;
+    int64_t                        now     = Now();
+
+    stats.sent++;
+    if (sender.layer == 0)
+    {
+        stats.unroutable++;
+        return;
+    }
+
+    if (header.flags & SIM_TO_ROOT)
+    {
+        targets.push_back(mesh.root);
+    }else if (header.flags & DATA_GROUP) {
+        for (auto &entry : nodes)
+        {
+            if (entry.first != from && entry.second.mesh == sender.mesh && entry.second.layer > 0 &&
+                entry.second.groups.count(ToKey(header.dst)))
+                targets.push_back(entry.first);
+        }
+    }else {
+        key to = ToKey(header.dst);
+        if (nodes.count(to) && nodes[to].mesh == sender.mesh && nodes[to].layer > 0)
+            targets.push_back(to);
+    }
+    if (targets.empty())
+    {
+        stats.unroutable++;
+        return;
+    }
+
+    header.flags &= ~SIM_TO_ROOT;
+    FromKey(from, header.src);
+
+    for (key to : targets)
+    {
+        vector<key> path   = Path(from, to);
+        hopResult   result = { now, false };
+
+        for (size_t i = 0; i + 1 < path.size() && !result.lost; i++)
+        {
+            auto hop = std::make_pair(path[i], path[i + 1]);
+            if (hops.count(hop) == 0)
+                hops[hop] = Hop(mesh.channel, header.length, result.at);
+            result = hops[hop];
+        }
+        if (path.empty() || result.lost)
+            continue;
+
+        simDelivery delivery = { result.at, order++, to, vector<uint8_t>(sizeof(header) + header.length) };
+        memcpy(delivery.datagram.data(), &header, sizeof(header));
+        memcpy(delivery.datagram.data() + sizeof(header), payload, header.length);
+        deliveries.push(delivery);
+    }
+}
+
+//! \fn    Deliver
+//! \brief Hands over every frame due by now.
+//!
+static void Deliver(int64_t now)
+{
+    while (!deliveries.empty() && deliveries.top().at <= now)
+    {
+        const simDelivery &delivery = deliveries.top();
+
+        if (nodes.count(delivery.to))
+        {
+            sendto(sock, delivery.datagram.data(), delivery.datagram.size(), 0,
+                   (sockaddr *)&nodes[delivery.to].addr, sizeof(sockaddr_in));
+            if (delivery.datagram[0] != SIM_SENT)
+            {
+                stats.delivered++;
+                stats.bytes += delivery.datagram.size() - sizeof(simHeader);
+            }
+        }
+        deliveries.pop();
+    }
+}
+
+//! \fn    Radio
+//! \brief Carries an ESP-NOW frame to the stations on its channel in one hop, every one
+//!        of them for a broadcast. The sender gets the send status when the frame is
+//!        through, acked if it was for one station and that station received it, or if
+//!        it was a broadcast and it went out.
+//!
+static void Radio(key from, simHeader header, const uint8_t *payload)
+{
+    std::uniform_real_distribution<double> uniform(0, 1);
+    vector<key>  targets;
+    key          to      = ToKey(header.dst);
+    bool         all     = (to == 0xFFFFFFFFFFFFULL);
+    bool         acked   = false;
+    int64_t      now     = Now();
+    simHeader    status  = {};
+
+    stats.sent++;
+    for (auto &entry : nodes)
+    {
+        const simNode &node = entry.second;
+
+        if (entry.first != from && (node.flags & SIM_STATION) && node.channel == header.channel &&
+            (all || entry.first == to))
+            targets.push_back(entry.first);
+    }
+
+    hopResult hop = Hop(header.channel, header.length, now);
+    FromKey(from, header.src);
+
+    for (size_t i = 0; i < targets.size(); i++)
+    {
+        bool lost = (i == 0 ? hop.lost : hop.at == 0 || uniform(generator) < loss);   /*!< Each station its own loss */
+
+        stats.lost += (i > 0 && lost && hop.at != 0);
+        if (lost)
+            continue;
+
+        simDelivery delivery = { hop.at, order++, targets[i], vector<uint8_t>(sizeof(header) + header.length) };
+        memcpy(delivery.datagram.data(), &header, sizeof(header));
+        memcpy(delivery.datagram.data() + sizeof(header), payload, header.length);
+        deliveries.push(delivery);
+        acked = !all;
+    }
+    if (targets.empty())
+        stats.unroutable++;
+
+    status.type    = SIM_SENT;
+    status.flags   = (acked || (all && hop.at != 0) ? SIM_ACKED : 0);      /*!< A broadcast went out */
+    status.channel = header.channel;
+    memcpy(status.dst, header.dst, 6);
+
+    simDelivery delivery = { std::max(hop.at, now), order++, from, vector<uint8_t>(sizeof(status)) };
+    memcpy(delivery.datagram.data(), &status, sizeof(status));
+    deliveries.push(delivery);
+}
+
+//! \fn    Scan
+//! \brief Answers a scan with the routers and the softAP of every node in a tree.
+//!
+static void Scan(const sockaddr_in &addr, const simHeader &header, const uint8_t *payload)
+{
+    vector<simAp> aps;
+    simHeader     answer = {};
+    vector<uint8_t> datagram;
+
+    for (int channel : channels)
+    {
+        simAp ap = {};
+
+        FromKey(RouterBssid(channel), ap.bssid);
+        memcpy(ap.ssid, payload, std::min<size_t>(header.length, sizeof(ap.ssid) - 1));
+        ap.channel = channel;
+        ap.rssi    = RouterRssi(channel);
+        aps.push_back(ap);
+    }
+    for (auto &entry : nodes)
+    {
+        const simNode &node = entry.second;
+        simAp          ap   = {};
+
+        if (node.layer == 0 || memcmp(&addr, &node.addr, sizeof(addr)) == 0)
+            continue;
+        FromKey(entry.first + 1, ap.bssid);
+        snprintf(ap.ssid, sizeof(ap.ssid), "ESPM_%06X", (unsigned)(entry.first & 0xFFFFFF));
+        ap.channel = meshes[node.mesh].channel;
+        ap.rssi    = -50 - (int)(entry.first % 30);
+        ap.mesh    = (node.layer == 1 ? MESH_TYPE_ROOT : node.table.size() > 1 ? MESH_TYPE_NODE : MESH_TYPE_LEAF);
+        ap.layer   = node.layer;
+        FromKey(node.mesh, ap.meshId);
+        aps.push_back(ap);
+    }
+
+    answer.type   = SIM_SCAN;
+    answer.length = aps.size() * sizeof(simAp);
+    datagram.resize(sizeof(answer) + answer.length);
+    memcpy(datagram.data(), &answer, sizeof(answer));
+    memcpy(datagram.data() + sizeof(answer), aps.data(), answer.length);
+    sendto(sock, datagram.data(), datagram.size(), 0, (const sockaddr *)&addr, sizeof(addr));
+}
+
+//! \fn    Join
+//! \brief Takes in a node's state, and rebuilds the meshes it changed.
+//!
+static void Join(const sockaddr_in &addr, const simHeader &header, const uint8_t *payload)
+{
+    key      k     = ToKey(header.src);
+    key      mesh  = ToKey(header.meshId);
+    bool     fresh = (nodes.count(k) == 0);
+    simNode &node  = nodes[k];
+    key      was   = node.mesh;
+    set<key> groups;
+
+    for (int i = 0; i + 6 <= header.length; i += 6)
+        groups.insert(ToKey(payload + i));
+
+    bool moved = fresh || memcmp(&node.addr, &addr, sizeof(addr)) != 0;        /*!< New, or rebooted */
+    bool changed = moved || was != mesh || node.flags != header.flags || node.channel != header.channel ||
+                   node.maxLayer != header.layer;
+
+    if (fresh)
+        printf("node %s joined mesh %s\n", Name(k).c_str(), Name(mesh).c_str());
+    if (moved)
+        node.state.clear();
+
+    node.addr     = addr;
+    node.mesh     = mesh;
+    node.flags    = header.flags;
+    node.channel  = header.channel;
+    node.maxLayer = std::max<int>(1, header.layer);
+    node.groups   = groups;
+    node.seen     = Now();
+    node.overflow = header.count;
+
+    if (!changed || (header.flags & SIM_STATION))
+        return;                                             /*!< Stations aren't in a tree */
+    if (!fresh && was != mesh)
+        Rebuild(was);
+    Rebuild(mesh);
+}
+
+
+//! -------------------------------------------------------------------------------------------- //
+//! \brief Main loop
+//!
+
+//! \fn    Report
+//! \brief Prints the stats of the interval, and starts the next.
+//!
+static void Report(double seconds)
+{
+    int attached = 0;
+    int stations = 0;
+    int deepest  = 0;
+    int overflow = 0;
+
+    for (auto &entry : nodes)
+    {
+        attached += (entry.second.layer > 0);
+        stations += (entry.second.flags & SIM_STATION) != 0;
+        deepest   = std::max(deepest, entry.second.layer);
+        overflow += entry.second.overflow;
+    }
+
+    std::ostringstream air;
+    for (auto &entry : stats.airtime)
+        air << " ch" << entry.first << " " << (int)(100 * entry.second / (seconds * 1e6)) << "%";
+
+    printf("stats: %d/%d nodes in %d layers, %d on ESP-NOW, %llu frames sent, %llu delivered, %llu lost, "
+           "%llu dropped, %llu unroutable, %.1f kB/s, rx overflow %d, airtime booked%s\n",
+           attached, (int)nodes.size(), deepest, stations, (unsigned long long)stats.sent, (unsigned long long)stats.delivered,
+           (unsigned long long)stats.lost, (unsigned long long)stats.dropped, (unsigned long long)stats.unroutable,
+           stats.bytes / seconds / 1000, overflow, air.str().c_str());
+    fflush(stdout);
+    stats = simStats();
+}
+
+static vector<int> ParseChannels(const string &list)
+{
+    vector<int>        parsed;
+    std::istringstream fields(list);
+    string             field;
+
+    while (std::getline(fields, field, ','))
+        parsed.push_back(atoi(field.c_str()));
+    return parsed;
+}
+
+int main(int argc, char **argv)
+{
+    int         port   = SIM_PORT;
+    unsigned    seed   = 1;
+    sockaddr_in local  = {};
+    vector<uint8_t> datagram(SIM_MAX_DATAGRAM);
+
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        string option(argv[i]);
+        char  *value = argv[i + 1];
+
+        if      (option == "--port")      port      = atoi(value);
+        else if (option == "--latency")   latency   = atof(value);
+        else if (option == "--jitter")    jitter    = atof(value);
+        else if (option == "--loss")      loss      = atof(value);
+        else if (option == "--bandwidth") bandwidth = atof(value);
+        else if (option == "--queue")     queueMs   = atof(value);
+        else if (option == "--fanout")    fanout    = atoi(value);
+        else if (option == "--layers")    layers    = atoi(value);
+        else if (option == "--channels")  channels  = ParseChannels(value);
+        else if (option == "--seed")      seed      = atoi(value);
+        else if (option == "--stats")     statsEvery = atoi(value);
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+    }
+    if (argc % 2 == 0 || channels.empty())
+    {
+        fprintf(stderr, "usage: %s [--option value]..., see medium.cpp\n", argv[0]);
+        return 2;
+    }
+    generator.seed(seed);
+
+    sock                  = socket(AF_INET, SOCK_DGRAM, 0);
+    local.sin_family      = AF_INET;
+    local.sin_port        = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (sockaddr *)&local, sizeof(local)) != 0)
+    {
+        perror("bind");
+        return 1;
+    }
+    printf("meshsim on port %d: latency %.1f+%.1f ms, loss %.3f, %.0f B/s, fanout %d, layers %d\n",
+           port, latency, jitter, loss, bandwidth, fanout, layers);
+    fflush(stdout);
+
+    int64_t reportAt = Now() + statsEvery * 1000000LL;
+    int64_t checkAt  = Now();
+
+    while (1)
+    {
+        int64_t now  = Now();
+        int64_t wait = std::min(reportAt, checkAt + 100000) - now;
+        fd_set  readable;
+        timeval timeout;
+
+        if (!deliveries.empty())
+            wait = std::min(wait, deliveries.top().at - now);
+        wait            = std::max<int64_t>(wait, 0);
+        timeout.tv_sec  = wait / 1000000;
+        timeout.tv_usec = wait % 1000000;
+
+        FD_ZERO(&readable);
+        FD_SET(sock, &readable);
+        if (select(sock + 1, &readable, NULL, NULL, &timeout) > 0)
+        {
+            sockaddr_in from   = {};
+            socklen_t   length = sizeof(from);
+            int         got    = recvfrom(sock, datagram.data(), datagram.size(), 0, (sockaddr *)&from, &length);
+            simHeader   header;
+
+            memcpy(&header, datagram.data(), std::min<size_t>(std::max(got, 0), sizeof(header)));
+            if (got >= (int)sizeof(header) && got >= (int)(sizeof(header) + header.length))
+            {
+                const uint8_t *payload = datagram.data() + sizeof(header);
+                key            k       = ToKey(header.src);
+
+                switch (header.type) {
+                case SIM_JOIN:
+                    Join(from, header, payload);
+                    break;
+                case SIM_LEAVE:
+                    if (nodes.count(k))
+                        Remove(k, "left");
+                    break;
+                case SIM_DATA:
+                    if (nodes.count(k))
+                        Route(k, header, payload);
+                    break;
+                case SIM_SCAN:
+                    Scan(from, header, payload);
+                    break;
+                case SIM_RADIO:
+                    if (nodes.count(k))
+                        Radio(k, header, payload);
+                    break;
+                default:
+                    break;
+                }
+            }
+        }
+
+        now = Now();
+        Deliver(now);
+
+        if (now >= checkAt + 100000)
+        {
+            checkAt = now;
+            for (auto entry = nodes.begin(); entry != nodes.end(); )
+            {
+                key k = (entry++)->first;
+                if (now - nodes[k].seen > SIM_TIMEOUT * 1000LL)
+                    Remove(k, "timed out");
+            }
+        }
+        if (now >= reportAt)
+        {
+            Report(statsEvery + (now - reportAt) / 1e6);
+            reportAt = now + statsEvery * 1000000LL;
+        }
+    }
+}
@@ -0,0 +1,84 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  medium.h
+//! \brief This header contains the wire format between the nodes and the meshsim medium. Every
+//!        datagram on the loopback is a simHeader followed by 'length' bytes of payload.
+//!
+//!        node -> medium  SIM_JOIN    every SIM_BEAT ms while started, the node's whole state
+//!                        SIM_LEAVE   the node stopped, or went to sleep
+//!                        SIM_DATA    a frame to route, 'dst' a node, a group, or none
+//!                        SIM_SCAN    a wifi scan, the payload is the router ssid
+//!                        SIM_RADIO   an ESP-NOW frame on 'channel', 'dst' a station or broadcast
+//!        medium -> node  SIM_DATA    a frame delivered, 'src' the node that sent it
+//!                        SIM_STATE   the node's place in the tree, sent when it changes
+//!                        SIM_SCAN    the access points in range, simAp records
+//!                        SIM_RADIO   an ESP-NOW frame delivered, 'src' the station that sent it
+//!                        SIM_SENT    the send status of an ESP-NOW frame, SIM_ACKED if it arrived, or
+//!                                    went out for a broadcast
+//!
+//!
+#pragma once
+#include <stdint.h>
+
+#define SIM_PORT         47000                      /*!< Default port of the medium */
+#define SIM_BEAT         500                        /*!< ms between joins */
+#define SIM_TIMEOUT      3000                       /*!< ms without a join before a node is gone */
+#define SIM_MAX_DATAGRAM 65507                      /*!< Scan answers can be long */
+
+typedef enum : uint8_t
+{
+    SIM_JOIN = 1,
+    SIM_LEAVE,
+    SIM_DATA,
+    SIM_STATE,
+    SIM_SCAN,
+    SIM_RADIO,
+    SIM_SENT
+}simType;
+
+/*!< SIM_JOIN flags */
+#define SIM_ROOT         0x01                       /*!< esp_mesh_set_type(MESH_ROOT) was called */
+#define SIM_FIXED        0x02                       /*!< esp_mesh_fix_root(true) was called */
+#define SIM_STATION      0x04                       /*!< ESP-NOW is up, the node is a station on 'channel' */
+
+/*!< SIM_DATA flags, besides the MESH_DATA_* ones */
+#define SIM_TO_ROOT      0x80                       /*!< esp_mesh_send(NULL, ...) */
+
+/*!< SIM_SENT flags */
+#define SIM_ACKED        0x01                       /*!< The station received it, a broadcast went out */
+
+//! \brief simHeader is the head of every datagram. SIM_JOIN carries the mesh id, the flags,
+//!        the channel the node was configured with, the max layer, and the frames dropped
+//!        on a full receive queue in 'count'; its payload is the group ids the node joined.
+//!        A station only carries SIM_STATION, and the channel it is on.
+//!        SIM_STATE carries the layer, 0 if not in the tree, the parent bssid in 'src', the
+//!        root in 'dst', the mesh channel, the rssi of the parent link, SIM_ROOT if it is
+//!        the root, and the routing table in the payload, 'count' addresses, itself first.
+//!
+typedef struct
+{
+    uint8_t  type;
+    uint8_t  flags;
+    uint8_t  tos;
+    uint8_t  layer;
+    uint8_t  src[6];
+    uint8_t  dst[6];
+    uint8_t  meshId[6];
+    uint8_t  channel;
+    int8_t   rssi;
+    uint16_t count;
+    uint16_t length;
+} __attribute__((packed)) simHeader;
+
+//! \brief simAp is an access point in a SIM_SCAN answer, either a router or the softAP of a
+//!        mesh node.
+//!
+typedef struct
+{
+    uint8_t  bssid[6];
+    char     ssid[33];
+    uint8_t  channel;
+    int8_t   rssi;
+    uint8_t  mesh;                                  /*!< 0 for a router, else the node's mesh_type_t */
+    uint8_t  meshId[6];
+    uint8_t  layer;
+} __attribute__((packed)) simAp;
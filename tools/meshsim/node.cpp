@@ -0,0 +1,146 @@
+//! -------------------------------------------------------------------------------------------- //
+//! \file  node.cpp
+//! \brief This source contains the entry point of a simulated node, the firmware's app_main
+//!        on top of the host stand-in for the esp-idf in host/.
+//!
+//!        node <partition.csv> [--suit N] [--medium PORT] [--wake]
+//!
+//!        The partition CSV is what nvs_partition_gen.py would flash, see suit.sh. The station
+//!        mac is made of the suit and the deviceId, so nodes keep their address over restarts.
+//!        Deep sleep saves the RTC_DATA_ATTR variables next to the CSV, sleeps, and runs the
+//!        process again with --wake, which loads them back; esp_restart does the same without
+//!        them, like a power cycle.
+//!
+//!
+#include "idf.h"
+#include "medium.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+extern "C" void app_main();
+
+extern uint8_t __start_meshsim_rtc[] __attribute__((weak));     /*!< RTC memory, by the linker */
+extern uint8_t __stop_meshsim_rtc[]  __attribute__((weak));
+
+static vector<string> args;
+static string         rtcFile;
+static bool           woke = false;
+
+
+//! \fn     RtcSize
+//! \brief  Gets the size of the RTC memory.
+//!
+static size_t RtcSize()
+{
+    return (__start_meshsim_rtc == NULL ? 0 : __stop_meshsim_rtc - __start_meshsim_rtc);
+}
+
+//! \fn     HostWakeup
+//! \brief  Gets why the node booted, a timer if it woke from deep sleep.
+//!
+esp_sleep_source_t HostWakeup()
+{
+    return (woke ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED);
+}
+
+//! \fn     HostRestart
+//! \brief  Leaves the mesh, keeps the RTC memory if 'warm', and boots again 'after' us.
+//!
+void HostRestart(uint64_t after, bool warm)
+{
+    vector<char*> argv;
+
+    std::cout << std::flush;
+    esp_mesh_disconnect();
+
+    if (warm)
+    {
+        std::ofstream(rtcFile, std::ios::binary).write(reinterpret_cast<char*>(__start_meshsim_rtc), RtcSize());
+        args.push_back("--wake");
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(after));
+
+    for (auto &arg : args)
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(NULL);
+    execv("/proc/self/exe", argv.data());
+
+    perror("execv");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t    mac[6]   = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x00 };
+    int        port     = SIM_PORT;
+    int        suit     = 0;
+    uint16_t   deviceId = 0;
+    nvs_handle nvs      = {};
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <partition.csv> [--suit N] [--medium PORT] [--wake]\n", argv[0]);
+        return 2;
+    }
+
+    args.push_back(argv[0]);
+    args.push_back(argv[1]);
+    for (int i = 2; i < argc; i++)
+    {
+        string arg(argv[i]);
+
+        if (arg == "--suit" && i + 1 < argc)
+            suit = atoi(argv[++i]);
+        else if (arg == "--medium" && i + 1 < argc)
+            port = atoi(argv[++i]);
+        else if (arg == "--wake")
+        {
+            woke = true;
+            continue;                                       /*!< Not kept for the next boot */
+        }else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 2;
+        }
+        args.push_back(arg);
+        args.push_back(argv[i]);
+    }
+
+    if (!HostLoadNvs(argv[1]))
+    {
+        fprintf(stderr, "can't read %s\n", argv[1]);
+        return 1;
+    }
+    if (nvs_open("deviceConfig", NVS_READONLY, &nvs) == ESP_OK)
+        nvs_get_u16(nvs, "deviceId", &deviceId);
+
+    mac[3] = suit;
+    mac[4] = deviceId >> 7;
+    mac[5] = deviceId << 1;                                 /*!< Even, the softAP is the station plus one */
+    HostSetMedium(mac, port);
+
+    rtcFile = string(argv[1]) + ".rtc";
+    if (woke)
+    {
+        std::ifstream file(rtcFile, std::ios::binary);
+        vector<char>  saved((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+        woke = (saved.size() == RtcSize());
+        if (woke)
+            memcpy(__start_meshsim_rtc, saved.data(), saved.size());
+        remove(rtcFile.c_str());
+    }
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    app_main();
+
+    while (1)                                               /*!< app_main returns, its tasks go on */
+        std::this_thread::sleep_for(std::chrono::hours(1));
+}
@@ -0,0 +1,83 @@
+#!/bin/sh
+#
+# suit.sh, runs whole suits on meshsim against the ingest stand-in, and prints what got
+# through. Node 0 of a suit is the root, deviceId 1000, the others are 1001 and up with the
+# body locations of partitions/ in turn. Every suit has a mesh id of its own.
+#
+#   suit.sh [-s suits] [-n nodes per suit] [-t seconds] [-o dir] [-- meshsim options]
+#
+# DEFINES in the environment is handed to make, see the Makefile. With
+# CONFIG_SERVER_TRANSPORT_MQTT=1 in it the roots publish over MQTT, and ingest.py stands in for
+# the broker.
+#
+#   ./suit.sh -n 9 -t 60
+#   ./suit.sh -s 2 -n 25 -t 120 -- --fanout 4 --loss 0.01 --bandwidth 125000
+#   DEFINES="CONFIG_MESH_TRANSPORT_ESPNOW=1" ./suit.sh -n 9
+#   DEFINES="CONFIG_SERVER_TRANSPORT_MQTT=1" ./suit.sh -n 9
+#
+set -e
+cd "$(dirname "$0")"
+
+SUITS=1
+NODES=9
+SECONDS_=60
+OUT=build/run
+MEDIUM_PORT=47000
+INGEST_PORT=18080
+INGEST_MODE=""
+
+while getopts "s:n:t:o:" opt; do
+    case $opt in
+    s) SUITS=$OPTARG ;;
+    n) NODES=$OPTARG ;;
+    t) SECONDS_=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,17p' "$0"; exit 2 ;;
+    esac
+done
+shift $((OPTIND - 1))
+
+make -s DEFINES="$DEFINES"
+case " $DEFINES " in *" CONFIG_SERVER_TRANSPORT_MQTT=1 "*) INGEST_MODE=--mqtt ;; esac
+rm -rf "$OUT"
+mkdir -p "$OUT"
+
+PIDS=""
+cleanup() {
+    for pid in $PIDS; do kill "$pid" 2>/dev/null || true; done
+}
+trap cleanup EXIT INT TERM
+
+./build/meshsim --port $MEDIUM_PORT "$@" > "$OUT/medium.log" 2>&1 &
+PIDS="$PIDS $!"
+python3 ingest.py --port $INGEST_PORT $INGEST_MODE > "$OUT/ingest.log" 2>&1 &
+INGEST=$!
+PIDS="$PIDS $INGEST"
+sleep 1
+
+for s in $(seq 1 "$SUITS"); do
+    MESH=$(printf "7a69dead%04x" "$s")
+    for i in $(seq 0 $((NODES - 1))); do
+        LOC=$((i % 9))
+        CSV="$OUT/suit$s-node$i.csv"
+        sed -e "s/^deviceId,data,u16,.*/deviceId,data,u16,$((1000 + i))/" \
+            -e "s/^srv,data,string,.*/srv,data,string,127.0.0.1/" \
+            -e "s/^port,data,string,.*/port,data,string,$INGEST_PORT/" \
+            -e "s/^meshId,data,string,.*/meshId,data,string,$MESH/" \
+            ../../partitions/$LOC*.csv > "$CSV"
+        ./build/node "$CSV" --suit "$s" --medium $MEDIUM_PORT > "$OUT/suit$s-node$i.log" 2>&1 &
+        PIDS="$PIDS $!"
+    done
+done
+
+echo "running $SUITS suit(s) of $NODES nodes for $SECONDS_ s, logs in $OUT"
+sleep "$SECONDS_"
+
+kill "$INGEST"
+wait "$INGEST" 2>/dev/null || true
+cleanup
+PIDS=""
+
+grep '^stats' "$OUT/medium.log" | tail -n 3
+sed -n '/^ingest summary/,$p' "$OUT/ingest.log"
+echo "nodes in the mesh: $(grep -l 'connected to mesh network\|Connected to access point' "$OUT"/suit*-node*.log | wc -l) of $((SUITS * NODES))"